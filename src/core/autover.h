@@ -0,0 +1,6 @@
+/* this file is autogenerated by CMake */
+/* DO NOT EDIT IT */
+
+#define REPO_VER "3299c6-dirty"
+#define REPO_HASH "3299c6"
+#define REPO_STATE "dirty"
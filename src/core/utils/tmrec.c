@@ -1290,3 +1290,66 @@ error:
 		*s = sep;
 	return -1;
 }
+
+
+/* the interval of a cached result must fit in the packed value */
+#define TR_CACHE_MAXSPAN 3600
+
+time_t tr_next_change(time_t dtstart, time_t duration, time_t until,
+		const struct tm *ts, time_t t, const struct tm *tt)
+{
+	time_t next;
+	int v0, v1;
+
+	/* the date parts of the recurrence are checked per day, re-check at
+	 * the next hour, so that also daylight saving time changes are seen */
+	v1 = tt->tm_hour * 3600 + tt->tm_min * 60 + tt->tm_sec;
+	next = t + TR_CACHE_MAXSPAN - v1 % 3600;
+
+	if(t < dtstart)
+		return (dtstart < next) ? dtstart : next;
+	if(duration <= 0)
+		return next;
+
+	/* end of the first interval */
+	if(t <= dtstart + duration && dtstart + duration + 1 < next)
+		next = dtstart + duration + 1;
+	/* after the bound of recurrence */
+	if(_IS_SET(until) && t < until + duration && until + duration < next)
+		next = until + duration;
+
+	/* start and end of the interval in the day */
+	v0 = ts->tm_hour * 3600 + ts->tm_min * 60 + ts->tm_sec;
+	if(v1 < v0 && t + v0 - v1 < next)
+		next = t + v0 - v1;
+	if(v1 < v0 + duration && t + v0 + duration - v1 < next)
+		next = t + v0 + duration - v1;
+
+	return next;
+}
+
+
+int tr_cache_get(tr_cache_t *_trc, time_t _t, int *_res)
+{
+	uint64_t v;
+	time_t until;
+
+	v = _trc->v;
+	if(v == 0)
+		return -1;
+	until = (time_t)(v >> 13);
+	if(_t >= until || _t < until - (time_t)((v >> 1) & 0xfff))
+		return -1;
+	*_res = (int)(v & 1);
+	return 0;
+}
+
+
+void tr_cache_set(tr_cache_t *_trc, time_t _t, time_t _next, int _res)
+{
+	if(_next <= _t || _next - _t > TR_CACHE_MAXSPAN || _t < 0
+			|| (_res != REC_MATCH && _res != REC_NOMATCH))
+		return;
+	_trc->v = ((uint64_t)_next << 13) | ((uint64_t)(_next - _t) << 1)
+			  | (uint64_t)_res;
+}
@@ -29,6 +29,8 @@
 
 #include <time.h>
 
+#include "tmrec_cache.h"
+
 
 /* USE_YWEEK_U	-- Sunday system - see strftime %U
  * USE_YWEEK_V	-- ISO 8601 - see strftime %V
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2026 Kamailio.org
+ *
+ * This file is part of Kamailio, a free SIP server.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Kamailio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * Kamailio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/**
+ * Cache of time recurrence check results.
+ *
+ * The result of a recurrence check can change only at the start or the
+ * end of an interval, or when the date changes. The next of these times
+ * is computed with the result, and the result is reused for the times
+ * before it.
+ *
+ * This header does not depend on the recurrence structures, so it can be
+ * used also by the modules with their own copy of them.
+ */
+
+#ifndef _SR_TMREC_CACHE_H_
+#define _SR_TMREC_CACHE_H_
+
+#include <time.h>
+#include <stdint.h>
+
+/* result of a check with the time interval where it is valid, packed in
+ * one word so it can be updated in shared memory without locking */
+typedef struct _tr_cache
+{
+	uint64_t v;
+} tr_cache_t;
+
+/**
+ * return the first time after t when the result of the check of the
+ * recurrence can change
+ * - dtstart, duration, until and ts are the fields of the recurrence,
+ *   duration 0 for an interval without end
+ * - tt is the local time of t
+ */
+time_t tr_next_change(time_t dtstart, time_t duration, time_t until,
+		const struct tm *ts, time_t t, const struct tm *tt);
+
+/**
+ * get the cached result for time t
+ * return 0 and set res (0 - match, 1 - no match) if found, -1 otherwise
+ */
+int tr_cache_get(tr_cache_t *trc, time_t t, int *res);
+
+/**
+ * store the result res (0 - match, 1 - no match) computed for time t and
+ * valid until time next (as returned by tr_next_change())
+ */
+void tr_cache_set(tr_cache_t *trc, time_t t, time_t next, int res);
+
+#endif
@@ -32,42 +32,165 @@
  * digit only matching you need to use a branches parameter of
  * 10, when you use 128, the complete standard ascii charset is
  * available for matching. The trie is set up in shared memory.
+ *
+ * With the DTRIE_COMPACT flag in the branches parameter, a node keeps
+ * only the existing children in a packed array indexed by a bitmap, the
+ * position of a child is the number of bits set before its own.
  * - Module: \ref carrierroute
  * - Module: \ref userblocklist
  * @{
  */
 
 
+#include <time.h>
+
 #include "dtrie.h"
 
 #include "../../core/dprint.h"
 #include "../../core/mem/shm_mem.h"
 #include "../../core/mem/mem.h"
+#include "../../core/ut.h"
 
+#define DTRIE_BENCH_KEYS 512
+#define DTRIE_BENCH_KEYLEN 32
+#define DTRIE_BENCH_ROUNDS 16
 
-struct dtrie_node_t *dtrie_init(const unsigned int branches)
+
+/*! number of children in compact layout */
+static inline unsigned int dtrie_cchild_count(const struct dtrie_cchild_t *cc)
 {
-	struct dtrie_node_t *root;
+	if(cc == NULL)
+		return 0;
+	return __builtin_popcountll(cc->bitmap[0])
+		   + __builtin_popcountll(cc->bitmap[1]);
+}
+
+
+/*! size of the node including children pointers */
+static inline unsigned long dtrie_node_memsize(
+		const struct dtrie_node_t *node, const unsigned int branches)
+{
+	if(!(branches & DTRIE_COMPACT))
+		return sizeof(struct dtrie_node_t)
+			   + sizeof(struct dtrie_node_t *) * branches;
+	if(node->child == NULL)
+		return sizeof(struct dtrie_node_t);
+	return sizeof(struct dtrie_node_t) + sizeof(struct dtrie_cchild_t)
+		   + sizeof(struct dtrie_node_t *)
+					 * dtrie_cchild_count(
+							 (struct dtrie_cchild_t *)node->child);
+}
+
+
+/*!
+ * \brief Get the i-th existing child, i.e., the child in the packed array
+ * in compact layout or the i-th not NULL pointer otherwise
+ */
+static struct dtrie_node_t *dtrie_iter_child(const struct dtrie_node_t *node,
+		unsigned int *i, const unsigned int branches)
+{
+	struct dtrie_cchild_t *cc;
 
-	root = shm_malloc(sizeof(struct dtrie_node_t));
-	if(root == NULL) {
+	if(branches & DTRIE_COMPACT) {
+		cc = (struct dtrie_cchild_t *)node->child;
+		if(*i >= dtrie_cchild_count(cc))
+			return NULL;
+		return cc->child[(*i)++];
+	}
+	while(*i < DTRIE_BRANCHES(branches)) {
+		if(node->child[*i] != NULL)
+			return node->child[(*i)++];
+		(*i)++;
+	}
+	return NULL;
+}
+
+
+static struct dtrie_node_t *dtrie_new_node(const unsigned int branches)
+{
+	struct dtrie_node_t *node;
+
+	node = shm_malloc(sizeof(struct dtrie_node_t));
+	if(node == NULL) {
 		SHM_MEM_ERROR;
 		return NULL;
 	}
-	LM_DBG("allocate %lu bytes for root at %p\n",
-			(long unsigned)sizeof(struct dtrie_node_t), root);
-	memset(root, 0, sizeof(struct dtrie_node_t));
+	LM_DBG("allocate %lu bytes for node at %p\n",
+			(long unsigned)sizeof(struct dtrie_node_t), node);
+	memset(node, 0, sizeof(struct dtrie_node_t));
+
+	if(branches & DTRIE_COMPACT)
+		return node;
 
-	root->child = shm_malloc(sizeof(struct dtrie_node_t *) * branches);
-	if(root->child == NULL) {
-		shm_free(root);
+	node->child = shm_malloc(sizeof(struct dtrie_node_t *) * branches);
+	if(node->child == NULL) {
+		shm_free(node);
 		SHM_MEM_ERROR;
 		return NULL;
 	}
-	LM_DBG("allocate %lu bytes for %d root children pointer at %p\n",
+	LM_DBG("allocate %lu bytes for %d children pointer at %p\n",
 			(long unsigned)sizeof(struct dtrie_node_t *) * branches, branches,
-			root->child);
-	memset(root->child, 0, sizeof(struct dtrie_node_t *) * branches);
+			node->child);
+	memset(node->child, 0, sizeof(struct dtrie_node_t *) * branches);
+	return node;
+}
+
+
+static void dtrie_free_node(struct dtrie_node_t *node)
+{
+	if(node->child)
+		shm_free(node->child);
+	node->child = NULL;
+	shm_free(node);
+}
+
+
+/*!
+ * \brief Add a child in compact layout, the packed array is reallocated
+ * \return 0 on success, -1 on failure
+ */
+static int dtrie_add_cchild(struct dtrie_node_t *node, unsigned char digit,
+		struct dtrie_node_t *child)
+{
+	struct dtrie_cchild_t *cc;
+	struct dtrie_cchild_t *ncc;
+	unsigned int n, idx;
+
+	cc = (struct dtrie_cchild_t *)node->child;
+	n = dtrie_cchild_count(cc);
+	idx = dtrie_cchild_index(cc, digit);
+
+	ncc = shm_malloc(sizeof(struct dtrie_cchild_t)
+					 + sizeof(struct dtrie_node_t *) * (n + 1));
+	if(ncc == NULL) {
+		SHM_MEM_ERROR;
+		return -1;
+	}
+	if(cc != NULL) {
+		ncc->bitmap[0] = cc->bitmap[0];
+		ncc->bitmap[1] = cc->bitmap[1];
+		memcpy(ncc->child, cc->child, sizeof(struct dtrie_node_t *) * idx);
+		memcpy(ncc->child + idx + 1, cc->child + idx,
+				sizeof(struct dtrie_node_t *) * (n - idx));
+		shm_free(cc);
+	} else {
+		ncc->bitmap[0] = ncc->bitmap[1] = 0;
+	}
+	ncc->bitmap[digit >> 6] |= 1ULL << (digit & 63);
+	ncc->child[idx] = child;
+	node->child = (struct dtrie_node_t **)ncc;
+	return 0;
+}
+
+
+struct dtrie_node_t *dtrie_init(const unsigned int branches)
+{
+	struct dtrie_node_t *root;
+
+	root = dtrie_new_node(branches);
+	if(root == NULL)
+		return NULL;
+	LM_DBG("allocated root at %p\n", root);
 
 	return root;
 }
@@ -76,6 +199,7 @@ struct dtrie_node_t *dtrie_init(const unsigned int branches)
 void dtrie_delete(struct dtrie_node_t *root, struct dtrie_node_t *node,
 		dt_delete_func_t delete_payload, const unsigned int branches)
 {
+	struct dtrie_node_t *child;
 	unsigned int i;
 
 	if(node == NULL)
@@ -83,9 +207,17 @@ void dtrie_delete(struct dtrie_node_t *root, struct dtrie_node_t *node,
 	if(root == NULL)
 		return;
 
-	for(i = 0; i < branches; i++) {
-		dtrie_delete(root, node->child[i], delete_payload, branches);
-		node->child[i] = NULL;
+	i = 0;
+	while((child = dtrie_iter_child(node, &i, branches)) != NULL) {
+		dtrie_delete(root, child, delete_payload, branches);
+	}
+	if(branches & DTRIE_COMPACT) {
+		if(node->child)
+			shm_free(node->child);
+		node->child = NULL;
+	} else {
+		memset(node->child, 0,
+				sizeof(struct dtrie_node_t *) * DTRIE_BRANCHES(branches));
 	}
 
 	if(delete_payload) {
@@ -96,9 +228,7 @@ void dtrie_delete(struct dtrie_node_t *root, struct dtrie_node_t *node,
 
 	if(node != root) {
 		LM_DBG("free node at %p\n", node);
-		shm_free(node->child);
-		node->child = NULL;
-		shm_free(node);
+		dtrie_free_node(node);
 	}
 }
 
@@ -109,8 +239,7 @@ void dtrie_destroy(struct dtrie_node_t **root, dt_delete_func_t delete_payload,
 	if((root != NULL) && (*root != NULL)) {
 		dtrie_delete(*root, *root, delete_payload, branches);
 		LM_DBG("free root at %p\n", root);
-		shm_free((*root)->child);
-		shm_free(*root);
+		dtrie_free_node(*root);
 		*root = NULL;
 	}
 }
@@ -127,6 +256,7 @@ int dtrie_insert(struct dtrie_node_t *root, const char *number,
 		const unsigned int numberlen, void *data, const unsigned int branches)
 {
 	struct dtrie_node_t *node = root;
+	struct dtrie_node_t *child;
 	unsigned char digit;
 	unsigned i = 0;
 
@@ -136,7 +266,7 @@ int dtrie_insert(struct dtrie_node_t *root, const char *number,
 		return -1;
 
 	while(i < numberlen) {
-		if(branches == 10) {
+		if(DTRIE_BRANCHES(branches) == 10) {
 			digit = number[i] - '0';
 			if(digit > 9) {
 				LM_ERR("cannot insert non-numerical character\n");
@@ -150,33 +280,19 @@ int dtrie_insert(struct dtrie_node_t *root, const char *number,
 			}
 		}
 
-		if(node->child[digit] == NULL) {
-			node->child[digit] = shm_malloc(sizeof(struct dtrie_node_t));
-			if(node->child[digit] == NULL) {
-				SHM_MEM_ERROR;
+		child = dtrie_get_child(node, digit, branches);
+		if(child == NULL) {
+			child = dtrie_new_node(branches);
+			if(child == NULL)
 				return -1;
-			}
-
-			LM_DBG("allocate %lu bytes for node at %p\n",
-					(long unsigned)sizeof(struct dtrie_node_t),
-					node->child[digit]);
-			memset(node->child[digit], 0, sizeof(struct dtrie_node_t));
-
-			node->child[digit]->child =
-					shm_malloc(sizeof(struct dtrie_node_t *) * branches);
-			if(node->child[digit]->child == NULL) {
-				SHM_MEM_ERROR;
-				shm_free(node->child[digit]);
-				node->child[digit] = NULL;
+			if(!(branches & DTRIE_COMPACT)) {
+				node->child[digit] = child;
+			} else if(dtrie_add_cchild(node, digit, child) < 0) {
+				dtrie_free_node(child);
 				return -1;
 			}
-			LM_DBG("allocate %lu bytes for %d root children pointer at %p\n",
-					(long unsigned)sizeof(struct dtrie_node_t *) * branches,
-					branches, node->child[digit]->child);
-			memset(node->child[digit]->child, 0,
-					sizeof(struct dtrie_node_t *) * branches);
 		}
-		node = node->child[digit];
+		node = child;
 		i++;
 	}
 	node->data = data;
@@ -187,13 +303,14 @@ int dtrie_insert(struct dtrie_node_t *root, const char *number,
 unsigned int dtrie_size(
 		const struct dtrie_node_t *root, const unsigned int branches)
 {
-	unsigned int i, sum = 0;
+	struct dtrie_node_t *child;
+	unsigned int i = 0, sum = 0;
 
 	if(root == NULL)
 		return 0;
 
-	for(i = 0; i < branches; i++) {
-		sum += dtrie_size(root->child[i], branches);
+	while((child = dtrie_iter_child(root, &i, branches)) != NULL) {
+		sum += dtrie_size(child, branches);
 	}
 
 	return sum + 1;
@@ -203,13 +320,14 @@ unsigned int dtrie_size(
 unsigned int dtrie_loaded_nodes(
 		const struct dtrie_node_t *root, const unsigned int branches)
 {
-	unsigned int i, sum = 0;
+	struct dtrie_node_t *child;
+	unsigned int i = 0, sum = 0;
 
 	if(root == NULL)
 		return 0;
 
-	for(i = 0; i < branches; i++) {
-		sum += dtrie_loaded_nodes(root->child[i], branches);
+	while((child = dtrie_iter_child(root, &i, branches)) != NULL) {
+		sum += dtrie_loaded_nodes(child, branches);
 	}
 
 	if(root->data != NULL)
@@ -222,22 +340,39 @@ unsigned int dtrie_loaded_nodes(
 unsigned int dtrie_leaves(
 		const struct dtrie_node_t *root, const unsigned int branches)
 {
-	unsigned int i, sum = 0, leaf = 1;
+	struct dtrie_node_t *child;
+	unsigned int i = 0, sum = 0, leaf = 1;
 
 	if(root == NULL)
 		return 0;
 
-	for(i = 0; i < branches; i++) {
-		if(root->child[i]) {
-			sum += dtrie_leaves(root->child[i], branches);
-			leaf = 0;
-		}
+	while((child = dtrie_iter_child(root, &i, branches)) != NULL) {
+		sum += dtrie_leaves(child, branches);
+		leaf = 0;
 	}
 
 	return sum + leaf;
 }
 
 
+unsigned long dtrie_memsize(
+		const struct dtrie_node_t *root, const unsigned int branches)
+{
+	struct dtrie_node_t *child;
+	unsigned int i = 0;
+	unsigned long sum = 0;
+
+	if(root == NULL)
+		return 0;
+
+	while((child = dtrie_iter_child(root, &i, branches)) != NULL) {
+		sum += dtrie_memsize(child, branches);
+	}
+
+	return sum + dtrie_node_memsize(root, branches);
+}
+
+
 void **dtrie_longest_match(struct dtrie_node_t *root, const char *number,
 		const unsigned int numberlen, int *nmatchptr,
 		const unsigned int branches)
@@ -260,7 +395,7 @@ void **dtrie_longest_match(struct dtrie_node_t *root, const char *number,
 		ret = &node->data;
 	}
 	while(i < numberlen) {
-		if(branches == 10) {
+		if(DTRIE_BRANCHES(branches) == 10) {
 			digit = number[i] - '0';
 			if(digit > 9)
 				return ret;
@@ -270,9 +405,9 @@ void **dtrie_longest_match(struct dtrie_node_t *root, const char *number,
 				return ret;
 		}
 
-		if(node->child[digit] == NULL)
+		node = dtrie_get_child(node, digit, branches);
+		if(node == NULL)
 			return ret;
-		node = node->child[digit];
 		i++;
 		if(node->data != NULL) {
 			if(nmatchptr)
@@ -297,4 +432,141 @@ void **dtrie_contains(struct dtrie_node_t *root, const char *number,
 	return NULL;
 }
 
+
+/*!
+ * \brief Copy the structure of a tree, the payload pointers are shared
+ */
+static struct dtrie_node_t *dtrie_copy(const struct dtrie_node_t *node,
+		const unsigned int branches, const unsigned int nbranches)
+{
+	struct dtrie_node_t *nnode;
+	struct dtrie_node_t *child;
+	struct dtrie_node_t *nchild;
+	unsigned int i;
+
+	nnode = dtrie_new_node(nbranches);
+	if(nnode == NULL)
+		return NULL;
+	nnode->data = node->data;
+	for(i = 0; i < DTRIE_BRANCHES(branches); i++) {
+		child = dtrie_get_child(node, i, branches);
+		if(child == NULL)
+			continue;
+		nchild = dtrie_copy(child, branches, nbranches);
+		if(nchild == NULL)
+			goto error;
+		if(!(nbranches & DTRIE_COMPACT)) {
+			nnode->child[i] = nchild;
+		} else if(dtrie_add_cchild(nnode, i, nchild) < 0) {
+			dtrie_destroy(&nchild, NULL, nbranches);
+			goto error;
+		}
+	}
+	return nnode;
+
+error:
+	dtrie_destroy(&nnode, NULL, nbranches);
+	return NULL;
+}
+
+
+static void dtrie_bench_keys(const struct dtrie_node_t *node,
+		const unsigned int branches, char *key, int depth, char *keys,
+		int *nkeys, int *cnt, int step)
+{
+	struct dtrie_node_t *child;
+	unsigned int i;
+
+	if(*nkeys >= DTRIE_BENCH_KEYS)
+		return;
+	if(node->data != NULL && depth > 0) {
+		if((*cnt)++ % step == 0) {
+			memcpy(keys + *nkeys * DTRIE_BENCH_KEYLEN, key, depth);
+			keys[*nkeys * DTRIE_BENCH_KEYLEN + DTRIE_BENCH_KEYLEN - 1] =
+					(char)depth;
+			(*nkeys)++;
+		}
+	}
+	if(depth >= DTRIE_BENCH_KEYLEN - 1)
+		return;
+	for(i = 0; i < DTRIE_BRANCHES(branches); i++) {
+		child = dtrie_get_child(node, i, branches);
+		if(child == NULL)
+			continue;
+		key[depth] = (DTRIE_BRANCHES(branches) == 10) ? '0' + i : i;
+		dtrie_bench_keys(
+				child, branches, key, depth + 1, keys, nkeys, cnt, step);
+	}
+}
+
+
+static unsigned int dtrie_bench_lookup(struct dtrie_node_t *root,
+		const unsigned int branches, char *keys, int nkeys)
+{
+	struct timespec t0;
+	struct timespec t1;
+	volatile long sink = 0;
+	long long ns;
+	int i, r;
+
+	ksr_clock_gettime(&t0);
+	for(r = 0; r < DTRIE_BENCH_ROUNDS; r++) {
+		for(i = 0; i < nkeys; i++) {
+			sink += (long)dtrie_longest_match(root, keys + i * DTRIE_BENCH_KEYLEN,
+					(unsigned int)keys[i * DTRIE_BENCH_KEYLEN + DTRIE_BENCH_KEYLEN
+									   - 1],
+					NULL, branches);
+		}
+	}
+	ksr_clock_gettime(&t1);
+	ns = (long long)(t1.tv_sec - t0.tv_sec) * 1000000000LL
+		 + (t1.tv_nsec - t0.tv_nsec);
+	if(ns < 0 || nkeys == 0)
+		return 0;
+	return (unsigned int)(ns / (nkeys * DTRIE_BENCH_ROUNDS));
+}
+
+
+int dtrie_bench(struct dtrie_node_t *root, const unsigned int branches,
+		dtrie_bench_t *res)
+{
+	struct dtrie_node_t *copy;
+	char key[DTRIE_BENCH_KEYLEN];
+	unsigned int nbranches;
+	char *keys;
+	int nkeys, cnt, cur;
+
+	memset(res, 0, sizeof(dtrie_bench_t));
+	if(root == NULL)
+		return -1;
+
+	/* index 0 is the default layout, 1 the compact one */
+	cur = (branches & DTRIE_COMPACT) ? 1 : 0;
+	nbranches = branches ^ DTRIE_COMPACT;
+	copy = dtrie_copy(root, branches, nbranches);
+	if(copy == NULL)
+		return -1;
+	keys = (char *)pkg_malloc(DTRIE_BENCH_KEYS * DTRIE_BENCH_KEYLEN);
+	if(keys == NULL) {
+		PKG_MEM_ERROR;
+		dtrie_destroy(&copy, NULL, nbranches);
+		return -1;
+	}
+
+	res->nodes = dtrie_size(root, branches);
+	res->memsize[cur] = dtrie_memsize(root, branches);
+	res->memsize[1 - cur] = dtrie_memsize(copy, nbranches);
+
+	nkeys = cnt = 0;
+	dtrie_bench_keys(root, branches, key, 0, keys, &nkeys, &cnt,
+			dtrie_loaded_nodes(root, branches) / DTRIE_BENCH_KEYS + 1);
+	res->nkeys = nkeys;
+	res->lookup_ns[cur] = dtrie_bench_lookup(root, branches, keys, nkeys);
+	res->lookup_ns[1 - cur] = dtrie_bench_lookup(copy, nbranches, keys, nkeys);
+
+	pkg_free(keys);
+	dtrie_destroy(&copy, NULL, nbranches);
+	return 0;
+}
+
 /** @} */
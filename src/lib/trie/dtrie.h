@@ -34,6 +34,12 @@
  * digit only matching you need to use a branches parameter of
  * 10, when you use 128, the complete standard ascii charset is
  * available for matching. The trie is set up in shared memory.
+ *
+ * By default each node holds an array of branches children pointers.
+ * If DTRIE_COMPACT is added to the branches parameter, a node stores
+ * only its existing children in a packed array addressed by a bitmap,
+ * which saves most of the memory of sparse trees and keeps more nodes
+ * in the cache. The same flag must be given to all functions.
  * - Module: \ref carrierroute
  * - Module: \ref userblocklist
  * @{
@@ -42,6 +48,14 @@
 #ifndef _DTRIE_H_
 #define _DTRIE_H_
 
+#include <stdint.h>
+
+/*! flag for the branches parameter to use the compact node layout */
+#define DTRIE_COMPACT (1 << 16)
+
+/*! number of branches without the layout flag */
+#define DTRIE_BRANCHES(b) ((b)&0xffff)
+
 
 /*! Trie node */
 struct dtrie_node_t
@@ -51,6 +65,28 @@ struct dtrie_node_t
 };
 
 
+/*!
+ * Children of a node in compact layout, child[] holds only the existing
+ * children ordered by digit. The node child member points to this
+ * structure, or is NULL if the node has no children.
+ */
+struct dtrie_cchild_t
+{
+	uint64_t bitmap[2];			  /*!< set bits for existing children */
+	struct dtrie_node_t *child[]; /*!< existing children */
+};
+
+
+/*! Result of dtrie_bench(), index 0 for default and 1 for compact layout */
+typedef struct dtrie_bench
+{
+	unsigned int nodes;			/*!< number of nodes */
+	unsigned int nkeys;			/*!< number of sampled keys */
+	unsigned long memsize[2];	/*!< memory used by the nodes */
+	unsigned int lookup_ns[2];	/*!< average lookup time in nanoseconds */
+} dtrie_bench_t;
+
+
 /*! Function signature for destroying the payload. First parameter is the payload. */
 typedef void (*dt_delete_func_t)(void *);
 
@@ -180,5 +216,68 @@ void **dtrie_contains(struct dtrie_node_t *root, const char *number,
 		const unsigned int numberlen, const unsigned int branches);
 
 
+/*!
+ * \brief Returns the memory used by the nodes of the given tree
+ * \param root root node
+ * \param branches number of branches in the trie
+ * \return number of bytes, without the payload
+ */
+unsigned long dtrie_memsize(
+		const struct dtrie_node_t *root, const unsigned int branches);
+
+
+/*!
+ * \brief Compare the memory and the lookup speed of both node layouts
+ *
+ * A copy of the tree is built in the other layout (sharing the payload)
+ * and the longest match of up to 512 keys sampled from the tree is timed
+ * on both. The copy is freed before returning.
+ * \param root root node
+ * \param branches number of branches in the trie
+ * \param res filled with the results
+ * \return 0 on success, -1 otherwise.
+ */
+int dtrie_bench(struct dtrie_node_t *root, const unsigned int branches,
+		dtrie_bench_t *res);
+
+
+/*! position of a digit in the packed children array */
+static inline unsigned int dtrie_cchild_index(
+		const struct dtrie_cchild_t *cc, unsigned int digit)
+{
+	uint64_t mask;
+
+	if(cc == NULL)
+		return 0;
+	mask = (1ULL << (digit & 63)) - 1;
+	if(digit < 64)
+		return __builtin_popcountll(cc->bitmap[0] & mask);
+	return __builtin_popcountll(cc->bitmap[0])
+		   + __builtin_popcountll(cc->bitmap[1] & mask);
+}
+
+
+/*!
+ * \brief Get the child of a node for a digit in any layout
+ * \param node tree node
+ * \param digit branch index, smaller than the number of branches
+ * \param branches number of branches in the trie
+ * \return child node or NULL if not existing
+ */
+static inline struct dtrie_node_t *dtrie_get_child(
+		const struct dtrie_node_t *node, unsigned int digit,
+		const unsigned int branches)
+{
+	const struct dtrie_cchild_t *cc;
+
+	if(!(branches & DTRIE_COMPACT))
+		return node->child[digit];
+	cc = (const struct dtrie_cchild_t *)node->child;
+	if(cc == NULL || !(cc->bitmap[digit >> 6] & (1ULL << (digit & 63))))
+		return NULL;
+	return cc->child[dtrie_cchild_index(cc, digit)];
+}
+
+
 /** @} */
 #endif
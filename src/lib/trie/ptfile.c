@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2026 Kamailio.org
+ *
+ * This file is part of Kamailio, a free SIP server.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Kamailio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * Kamailio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * \ingroup ptfile
+ * \brief Read-only prefix trees compiled offline and mapped in memory
+ * @{
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "ptfile.h"
+
+#include "../../core/dprint.h"
+
+
+/*!
+ * \brief Check that all offsets of a tree stay inside the file and
+ * that the child indexes cannot loop
+ */
+static int ptf_check_tree(ptf_map_t *map, ptf_tree_t *tree)
+{
+	ptf_node_t *nodes;
+	ptf_value_t *val;
+	uint32_t i;
+	uint32_t off;
+
+	if((uint64_t)tree->name + tree->namelen > map->size) {
+		LM_ERR("invalid tree name offset\n");
+		return -1;
+	}
+	if(tree->nrnodes == 0 || (tree->nodes & 3) != 0
+			|| (uint64_t)tree->nodes
+							   + (uint64_t)tree->nrnodes * sizeof(ptf_node_t)
+					   > map->size) {
+		LM_ERR("invalid node array for tree [%.*s]\n", (int)tree->namelen,
+				map->base + tree->name);
+		return -1;
+	}
+	nodes = ptf_tree_nodes(map, tree);
+	for(i = 0; i < tree->nrnodes; i++) {
+		if(nodes[i].nchild > 0
+				&& (nodes[i].child <= i
+						|| (uint64_t)nodes[i].child + nodes[i].nchild
+								   > tree->nrnodes)) {
+			LM_ERR("invalid children for node %u\n", i);
+			return -1;
+		}
+		if((i > 0 && (nodes[i].llen == 0 || nodes[i].llen >= PTF_MAX_DEPTH))
+				|| (uint64_t)nodes[i].label + nodes[i].llen > map->size) {
+			LM_ERR("invalid label for node %u\n", i);
+			return -1;
+		}
+		off = nodes[i].value;
+		while(off != 0) {
+			if((off & 3) != 0 || (uint64_t)off + sizeof(ptf_value_t) > map->size) {
+				LM_ERR("invalid value offset for node %u\n", i);
+				return -1;
+			}
+			val = (ptf_value_t *)(map->base + off);
+			if((uint64_t)off + sizeof(ptf_value_t) + val->len + 1 > map->size
+					|| (val->next != 0 && val->next <= off)) {
+				LM_ERR("invalid value for node %u\n", i);
+				return -1;
+			}
+			off = val->next;
+		}
+	}
+	return 0;
+}
+
+
+int ptf_map_file(const char *path, ptf_map_t *map)
+{
+	ptf_header_t *hdr;
+	struct stat st;
+	char *base;
+	uint32_t i;
+	int fd;
+
+	memset(map, 0, sizeof(ptf_map_t));
+	fd = open(path, O_RDONLY);
+	if(fd < 0) {
+		LM_ERR("cannot open file '%s' (%s)\n", path, strerror(errno));
+		return -1;
+	}
+	if(fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(ptf_header_t)) {
+		LM_ERR("invalid file '%s'\n", path);
+		close(fd);
+		return -1;
+	}
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(base == MAP_FAILED) {
+		LM_ERR("cannot mmap file '%s' (%s)\n", path, strerror(errno));
+		return -1;
+	}
+	map->base = base;
+	map->size = st.st_size;
+
+	hdr = (ptf_header_t *)base;
+	if(hdr->magic != PTF_MAGIC || hdr->version != PTF_VERSION
+			|| hdr->size != (uint64_t)st.st_size
+			|| sizeof(ptf_header_t) + (uint64_t)hdr->ntrees * sizeof(ptf_tree_t)
+					   > map->size) {
+		LM_ERR("invalid header in file '%s'\n", path);
+		goto error;
+	}
+	map->trees = (ptf_tree_t *)(base + sizeof(ptf_header_t));
+	map->ntrees = hdr->ntrees;
+	for(i = 0; i < map->ntrees; i++) {
+		if(ptf_check_tree(map, &map->trees[i]) < 0) {
+			LM_ERR("invalid tree %u in file '%s'\n", i, path);
+			goto error;
+		}
+	}
+	LM_DBG("mapped file '%s' with %u trees (%lu bytes)\n", path, map->ntrees,
+			(unsigned long)map->size);
+	return 0;
+
+error:
+	ptf_unmap_file(map);
+	return -1;
+}
+
+
+void ptf_unmap_file(ptf_map_t *map)
+{
+	if(map->base != NULL)
+		munmap(map->base, map->size);
+	memset(map, 0, sizeof(ptf_map_t));
+}
+
+
+int ptf_map_sync(
+		ptf_map_t *map, const char *path, unsigned int *lgen, unsigned int sgen)
+{
+	ptf_map_t nmap;
+
+	if(*lgen == sgen && map->base != NULL)
+		return 0;
+	/* do not retry on each call if the new file is broken */
+	*lgen = sgen;
+	if(ptf_map_file(path, &nmap) < 0)
+		return -1;
+	ptf_unmap_file(map);
+	*map = nmap;
+	return 0;
+}
+
+
+ptf_tree_t *ptf_get_tree(ptf_map_t *map, const char *name, int len)
+{
+	uint32_t i;
+
+	for(i = 0; i < map->ntrees; i++) {
+		if(map->trees[i].namelen == (uint32_t)len
+				&& memcmp(map->base + map->trees[i].name, name, len) == 0)
+			return &map->trees[i];
+	}
+	return NULL;
+}
+
+
+int ptf_match(ptf_map_t *map, ptf_tree_t *tree, const char *s, int len,
+		ptf_node_t **path, int *plen)
+{
+	ptf_node_t *nodes;
+	ptf_node_t *cn;
+	ptf_node_t *cc;
+	unsigned char ch;
+	char *lb;
+	int i, l, n;
+
+	l = n = 0;
+	nodes = ptf_tree_nodes(map, tree);
+	cn = &nodes[0];
+	while(l < len && l < PTF_MAX_DEPTH) {
+		ch = (unsigned char)s[l];
+		cc = NULL;
+		for(i = 0; i < cn->nchild; i++) {
+			if(nodes[cn->child + i].key >= ch) {
+				if(nodes[cn->child + i].key == ch)
+					cc = &nodes[cn->child + i];
+				break;
+			}
+		}
+		if(cc == NULL)
+			return n;
+		if(l + cc->llen > len)
+			return n;
+		lb = ptf_node_label(map, cc);
+		if(cc->llen > 1 && memcmp(lb + 1, s + l + 1, cc->llen - 1) != 0)
+			return n;
+		l += cc->llen;
+		if(cc->value != 0) {
+			path[n] = cc;
+			plen[n] = l;
+			n++;
+		}
+		cn = cc;
+	}
+	return n;
+}
+
+/*! @} */
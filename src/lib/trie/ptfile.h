@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2026 Kamailio.org
+ *
+ * This file is part of Kamailio, a free SIP server.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Kamailio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * Kamailio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * \defgroup ptfile Kamailio prebuilt prefix tree files
+ * \brief Read-only prefix trees compiled offline and mapped in memory
+ *
+ * The file is produced by the utils/ptfc compiler and contains one or
+ * more named prefix trees in a path compressed layout. All references
+ * inside the file are offsets, so it can be mapped at any address and
+ * shared read-only by all processes.
+ *
+ * Layout: header, tree directory, then nodes, labels, values and names
+ * in any order (referenced by offset). In each tree, node 0 is the root
+ * and the children of a node are adjacent, sorted by their first char.
+ *
+ * This header is also used by the compiler, so it must not depend on
+ * the core headers.
+ * - Module: \ref mtree
+ * - Module: \ref prefix_route
+ * - Module: \ref pdt
+ * @{
+ */
+
+#ifndef _PTFILE_H_
+#define _PTFILE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define PTF_MAGIC 0x4654504bU /* "KPTF" */
+#define PTF_VERSION 1
+#define PTF_MAX_DEPTH 64
+
+/*! file header */
+typedef struct ptf_header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t ntrees; /*!< entries in the tree directory following header */
+	uint32_t flags;
+	uint64_t size; /*!< total file size */
+} ptf_header_t;
+
+/*! tree directory entry */
+typedef struct ptf_tree
+{
+	uint32_t name; /*!< offset of the tree name */
+	uint32_t namelen;
+	uint32_t nodes; /*!< offset of the node array */
+	uint32_t nrnodes;
+	uint32_t nritems; /*!< number of values */
+	uint32_t reserved;
+} ptf_tree_t;
+
+/*! tree node - the edge label leads from the parent to this node */
+typedef struct ptf_node
+{
+	uint32_t child;	 /*!< index of the first child */
+	uint32_t label;	 /*!< offset of the edge label */
+	uint32_t value;	 /*!< offset of the first value, 0 if none */
+	uint16_t nchild; /*!< number of children */
+	uint8_t llen;	 /*!< length of the edge label */
+	uint8_t key;	 /*!< first char of the edge label */
+} ptf_node_t;
+
+/*! value record, the string is zero terminated and padded to 4 bytes */
+typedef struct ptf_value
+{
+	uint32_t next; /*!< offset of the next value of same prefix, 0 if none */
+	uint32_t len;
+	char s[];
+} ptf_value_t;
+
+#define PTF_ALIGN(x) (((x) + 3) & ~((uint32_t)3))
+
+/*! a file mapped in the current process */
+typedef struct ptf_map
+{
+	char *base;
+	size_t size;
+	ptf_tree_t *trees;
+	uint32_t ntrees;
+} ptf_map_t;
+
+
+/*!
+ * \brief Map a tree file read-only and validate its content
+ * \param path file path
+ * \param map filled with the mapping details
+ * \return 0 on success, -1 on failure
+ */
+int ptf_map_file(const char *path, ptf_map_t *map);
+
+
+/*!
+ * \brief Unmap a tree file
+ * \param map mapping details, reset on return
+ */
+void ptf_unmap_file(ptf_map_t *map);
+
+
+/*!
+ * \brief Remap the file in the current process if the shared generation
+ * was changed since the last call (e.g., by a reload command)
+ * \param map mapping of the current process
+ * \param path file path
+ * \param lgen generation of the mapping in the current process
+ * \param sgen shared generation
+ * \return 0 if the mapping is up to date, -1 on failure (the previous
+ * mapping is kept)
+ */
+int ptf_map_sync(
+		ptf_map_t *map, const char *path, unsigned int *lgen, unsigned int sgen);
+
+
+/*!
+ * \brief Find a tree by name
+ * \return tree directory entry or NULL if not found
+ */
+ptf_tree_t *ptf_get_tree(ptf_map_t *map, const char *name, int len);
+
+
+/*!
+ * \brief Walk the tree with the chars of s
+ * \param path filled with the nodes having values along the path, it
+ * must have room for PTF_MAX_DEPTH entries
+ * \param plen filled with the prefix length of each node in path
+ * \return number of nodes stored in path, the last being the longest match
+ */
+int ptf_match(ptf_map_t *map, ptf_tree_t *tree, const char *s, int len,
+		ptf_node_t **path, int *plen);
+
+
+static inline ptf_node_t *ptf_tree_nodes(ptf_map_t *map, ptf_tree_t *tree)
+{
+	return (ptf_node_t *)(map->base + tree->nodes);
+}
+
+static inline ptf_value_t *ptf_node_value(ptf_map_t *map, ptf_node_t *node)
+{
+	return (node->value != 0) ? (ptf_value_t *)(map->base + node->value)
+							  : NULL;
+}
+
+static inline ptf_value_t *ptf_value_next(ptf_map_t *map, ptf_value_t *val)
+{
+	return (val->next != 0) ? (ptf_value_t *)(map->base + val->next) : NULL;
+}
+
+static inline char *ptf_node_label(ptf_map_t *map, ptf_node_t *node)
+{
+	return map->base + node->label;
+}
+
+/*! @} */
+
+#endif
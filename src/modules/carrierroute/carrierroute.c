@@ -77,6 +77,8 @@ const str CR_EMPTY_PREFIX = str_init("null");
 
 int mode = 0;
 int cr_match_mode = 10;
+int cr_dtrie_compact = 0;
+int cr_dtrie_mode = 10;
 int cr_avoid_failed_dests = 1;
 
 /************* Declaration of Interface Functions **************************/
@@ -123,6 +125,7 @@ static param_export_t params[] = {
 		{"fetch_rows", PARAM_INT, &default_carrierroute_cfg.fetch_rows},
 		{"db_load_description", PARAM_INT, &cr_load_comments},
 		{"match_mode", PARAM_INT, &cr_match_mode},
+		{"dtrie_compact", PARAM_INT, &cr_dtrie_compact},
 		{"avoid_failed_destinations", PARAM_INT, &cr_avoid_failed_dests},
 		{0, 0, 0}};
 
@@ -165,6 +168,7 @@ static int mod_init(void)
 				cr_match_mode);
 		return -1;
 	}
+	cr_dtrie_mode = cr_match_mode | (cr_dtrie_compact ? DTRIE_COMPACT : 0);
 
 	if(cr_avoid_failed_dests != 0 && cr_avoid_failed_dests != 1) {
 		LM_ERR("avoid_failed_dests must be 0 or 1");
@@ -521,6 +521,7 @@ errclose:
  */
 static int save_route_data_recursor(struct dtrie_node_t *node, FILE *outfile)
 {
+	struct dtrie_node_t *child;
 	int i;
 	struct route_flags *rf;
 	struct route_rule *rr;
@@ -579,8 +580,9 @@ static int save_route_data_recursor(struct dtrie_node_t *node, FILE *outfile)
 		fprintf(outfile, "\t}\n");
 	}
 	for(i = 0; i < cr_match_mode; i++) {
-		if(node->child[i]) {
-			if(save_route_data_recursor(node->child[i], outfile) < 0) {
+		child = dtrie_get_child(node, i, cr_dtrie_mode);
+		if(child) {
+			if(save_route_data_recursor(child, outfile) < 0) {
 				return -1;
 			}
 		}
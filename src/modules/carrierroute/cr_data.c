@@ -599,6 +599,7 @@ static int fixup_rule_backup(struct route_flags *rf, struct route_rule *rr)
  */
 static int rule_fixup_recursor(struct dtrie_node_t *node)
 {
+	struct dtrie_node_t *child;
 	struct route_rule *rr;
 	struct route_flags *rf;
 	int i, p_dice, ret = 0;
@@ -687,8 +688,9 @@ static int rule_fixup_recursor(struct dtrie_node_t *node)
 	}
 
 	for(i = 0; i < cr_match_mode; i++) {
-		if(node->child[i]) {
-			ret += rule_fixup_recursor(node->child[i]);
+		child = dtrie_get_child(node, i, cr_dtrie_mode);
+		if(child) {
+			ret += rule_fixup_recursor(child);
 		}
 	}
 
@@ -223,7 +223,7 @@ static int set_next_domain_recursor(sip_msg_t *_msg,
 		--re_uri.len;
 	}
 	ret = dtrie_longest_match(
-			failure_node, re_uri.s, re_uri.len, NULL, cr_match_mode);
+			failure_node, re_uri.s, re_uri.len, NULL, cr_dtrie_mode);
 
 	if(ret == NULL) {
 		LM_INFO("URI or prefix tree nodes empty, empty rule list\n");
@@ -619,7 +619,7 @@ static int rewrite_uri_recursor(sip_msg_t *msg, struct dtrie_node_t *node,
 		++re_pm.s;
 		--re_pm.len;
 	}
-	ret = dtrie_longest_match(node, re_pm.s, re_pm.len, NULL, cr_match_mode);
+	ret = dtrie_longest_match(node, re_pm.s, re_pm.len, NULL, cr_dtrie_mode);
 
 	if(ret == NULL) {
 		LM_INFO("URI or prefix tree nodes empty, empty rule list\n");
@@ -172,6 +172,68 @@ error:
 static const char *cr_rpc_dump_routes_doc[2] = {"Dump carrierroute routes", 0};
 
 
+static void cr_rpc_dtrie_bench(rpc_t *rpc, void *ctx)
+{
+	struct route_data_t *rd;
+	struct domain_data_t *dd;
+	dtrie_bench_t res;
+	void *th;
+	void *ih;
+	void *vh;
+	int i, j;
+
+	if((rd = get_data()) == NULL) {
+		LM_ERR("error during retrieve data\n");
+		rpc->fault(ctx, 500, "Internal error - cr data");
+		return;
+	}
+	if(rpc->add(ctx, "{", &th) < 0) {
+		rpc->fault(ctx, 500, "Internal error root reply");
+		goto done;
+	}
+	if(rpc->struct_add(th, "s[", "layout",
+			   (cr_dtrie_mode & DTRIE_COMPACT) ? "compact" : "default",
+			   "trees", &ih)
+			< 0) {
+		rpc->fault(ctx, 500, "Internal error - trees structure");
+		goto done;
+	}
+	for(i = 0; i < rd->carrier_num; i++) {
+		if(rd->carriers[i] == NULL)
+			continue;
+		for(j = 0; j < rd->carriers[i]->domain_num; j++) {
+			dd = rd->carriers[i]->domains[j];
+			if(dd == NULL || dd->tree == NULL)
+				continue;
+			if(dtrie_bench(dd->tree, cr_dtrie_mode, &res) < 0) {
+				rpc->fault(ctx, 500, "Benchmark failed");
+				goto done;
+			}
+			if(rpc->array_add(ih, "{", &vh) < 0
+					|| rpc->struct_add(vh, "SSuujjuu", "carrier",
+							   rd->carriers[i]->name, "domain", dd->name,
+							   "nodes", res.nodes, "keys", res.nkeys,
+							   "default_mem", res.memsize[0], "compact_mem",
+							   res.memsize[1], "default_lookup_ns",
+							   res.lookup_ns[0], "compact_lookup_ns",
+							   res.lookup_ns[1])
+							   < 0) {
+				rpc->fault(ctx, 500, "Internal error - tree structure");
+				goto done;
+			}
+		}
+	}
+
+done:
+	release_data(rd);
+}
+
+static const char *cr_rpc_dtrie_bench_doc[2] = {
+		"Compare memory and lookup time of the routing trees in default and "
+		"compact layout",
+		0};
+
+
 static void cr_rpc_activate_host(rpc_t *rpc, void *ctx)
 {
 	int ret;
@@ -374,6 +436,7 @@ static const char *cr_rpc_replace_host_doc[2] = {
 rpc_export_t cr_rpc_methods[] = {
 		{"cr.reload_routes", cr_rpc_reload_routes, cr_rpc_reload_routes_doc, 0},
 		{"cr.dump_routes", cr_rpc_dump_routes, cr_rpc_dump_routes_doc, 0},
+		{"cr.dtrie_bench", cr_rpc_dtrie_bench, cr_rpc_dtrie_bench_doc, 0},
 		{"cr.activate_host", cr_rpc_activate_host, cr_rpc_activate_host_doc, 0},
 		{"cr.deactivate_host", cr_rpc_deactivate_host,
 				cr_rpc_deactivate_host_doc, 0},
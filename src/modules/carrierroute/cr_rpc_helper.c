@@ -67,6 +67,7 @@ static int str_toklen(str *str, const char *delims)
 static int update_route_data_recursor(
 		struct dtrie_node_t *node, str *act_domain, rpc_opt_t *opts)
 {
+	struct dtrie_node_t *child;
 	int i, hash = 0;
 	struct route_rule *rr, *prev = NULL, *tmp, *backup;
 	struct route_flags *rf;
@@ -250,8 +251,9 @@ static int update_route_data_recursor(
 		}
 	}
 	for(i = 0; i < cr_match_mode; i++) {
-		if(node->child[i]) {
-			if(update_route_data_recursor(node->child[i], act_domain, opts)
+		child = dtrie_get_child(node, i, cr_dtrie_mode);
+		if(child) {
+			if(update_route_data_recursor(child, act_domain, opts)
 					< 0) {
 				return -1;
 			}
@@ -275,6 +277,7 @@ static int update_route_data_recursor(
 int dump_tree_recursor(rpc_t *rpc, void *ctx, void *gh,
 		struct dtrie_node_t *node, char *prefix)
 {
+	struct dtrie_node_t *child;
 	char s[256];
 	char *p;
 	int i, len;
@@ -293,10 +296,11 @@ int dump_tree_recursor(rpc_t *rpc, void *ctx, void *gh,
 	p = s + len;
 	p[1] = '\0';
 	for(i = 0; i < cr_match_mode; ++i) {
-		if(node->child[i] != NULL) {
+		child = dtrie_get_child(node, i, cr_dtrie_mode);
+		if(child != NULL) {
 			*p = i + '0';
 			/* if there is a problem in processing the child nodes .. return an error */
-			if(dump_tree_recursor(rpc, ctx, gh, node->child[i], s) < 0)
+			if(dump_tree_recursor(rpc, ctx, gh, child, s) < 0)
 				return -1;
 		}
 	}
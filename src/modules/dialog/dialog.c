@@ -110,6 +110,7 @@ int dlg_filter_mode = 0;
 int initial_cbs_inscript = 1;
 int dlg_wait_ack = 1;
 static int dlg_timer_procs = 0;
+static int dlg_timer_wheel_size = DLG_TIMER_WHEEL_SIZE;
 static int _dlg_track_cseq_updates = 0;
 int dlg_ka_failed_limit = 1;
 int dlg_early_timeout = 300;
@@ -350,6 +351,7 @@ static param_export_t mod_params[]={
 	{ "vars_value_column",     PARAM_STR, &vars_value_column      },
 
 	{ "db_update_period",      PARAM_INT, &db_update_period         },
+	{ "db_update_batch",       PARAM_INT, &dlg_db_update_batch      },
 	{ "db_fetch_rows",         PARAM_INT, &db_fetch_rows            },
 	{ "profiles_with_value",   PARAM_STRING, &profiles_wv_s            },
 	{ "profiles_no_value",     PARAM_STRING, &profiles_nv_s            },
@@ -364,6 +366,7 @@ static param_export_t mod_params[]={
 	{ "ka_interval",           PARAM_INT, &dlg_ka_interval          },
 	{ "timeout_noreset",       PARAM_INT, &dlg_timeout_noreset      },
 	{ "timer_procs",           PARAM_INT, &dlg_timer_procs          },
+	{ "timer_wheel_size",      PARAM_INT, &dlg_timer_wheel_size     },
 	{ "track_cseq_updates",    PARAM_INT, &_dlg_track_cseq_updates  },
 	{ "lreq_callee_headers",   PARAM_STR, &dlg_lreq_callee_headers  },
 	{ "db_skip_load",          PARAM_INT, &db_skip_load             },
@@ -725,7 +728,7 @@ static int mod_init(void)
 			default_timeout, seq_match_mode, dlg_keep_proxy_rr);
 
 	/* init timer */
-	if(init_dlg_timer(dlg_ontimeout) != 0) {
+	if(init_dlg_timer(dlg_ontimeout, dlg_timer_wheel_size) != 0) {
 		LM_ERR("cannot init timer list\n");
 		return -1;
 	}
@@ -777,6 +780,10 @@ static int mod_init(void)
 		}
 	}
 
+	/* timer process to write the grouped delayed updates */
+	if(dlg_db_mode == DB_MODE_DELAYED && dlg_db_update_batch > 0)
+		register_sync_timers(1);
+
 	/* timer process to send keep alive requests */
 	if(dlg_ka_timer > 0 && dlg_ka_interval > 0)
 		register_sync_timers(1);
@@ -837,6 +844,15 @@ static int child_init(int rank)
 			}
 		}
 
+		if(dlg_db_mode == DB_MODE_DELAYED && dlg_db_update_batch > 0) {
+			if(fork_sync_timer(PROC_TIMER, "Dialog DB Writer", 1 /*socks flag*/,
+					   dialog_update_db, NULL, db_update_period /*sec*/)
+					< 0) {
+				LM_ERR("failed to start db writer routine as process\n");
+				return -1; /* error */
+			}
+		}
+
 		if(fork_sync_timer(PROC_TIMER, "Dialog Clean Timer", 1 /*socks flag*/,
 				   dlg_clean_timer_exec, NULL, dlg_clean_timer /*sec*/)
 				< 0) {
@@ -3520,6 +3536,63 @@ static void rpc_dlg_bridge(rpc_t *rpc, void *c)
 	dlg_bridge(&from, &to, &op, &bd);
 }
 
+static const char *rpc_dlg_stats_hash_doc[2] = {
+		"Get stats about the chains of the dialogs hash table", 0};
+
+/*!
+ * \brief Print stats of the dialogs hash table chains
+ */
+static void rpc_dlg_stats_hash(rpc_t *rpc, void *c)
+{
+	dlg_cell_t *dlg;
+	unsigned int i;
+	unsigned int n;
+	unsigned int dlg_all = 0;
+	unsigned int slots_used = 0;
+	unsigned int chain_max = 0;
+	unsigned int chain_fp = 0;
+	unsigned int fp_collisions = 0;
+	dlg_cell_t *dlg2;
+	void *h;
+
+	for(i = 0; i < d_table->size; i++) {
+		dlg_lock(d_table, &(d_table->entries[i]));
+		n = 0;
+		for(dlg = d_table->entries[i].first; dlg; dlg = dlg->next) {
+			n++;
+			/* dialogs sharing the callid fingerprint need string compares */
+			for(dlg2 = dlg->next; dlg2; dlg2 = dlg2->next) {
+				if(dlg2->cid_hash == dlg->cid_hash) {
+					chain_fp++;
+					if(dlg2->callid.len != dlg->callid.len
+							|| memcmp(dlg2->callid.s, dlg->callid.s,
+									   dlg->callid.len)
+									   != 0) {
+						fp_collisions++;
+					}
+					break;
+				}
+			}
+		}
+		dlg_unlock(d_table, &(d_table->entries[i]));
+		if(n > 0)
+			slots_used++;
+		if(n > chain_max)
+			chain_max = n;
+		dlg_all += n;
+	}
+
+	if(rpc->add(c, "{", &h) < 0) {
+		rpc->fault(c, 500, "Server failure");
+		return;
+	}
+
+	rpc->struct_add(h, "uuuuuuu", "size", d_table->size, "dialogs", dlg_all,
+			"slots_used", slots_used, "chain_max", chain_max, "chain_avg",
+			(slots_used > 0) ? (dlg_all / slots_used) : 0, "same_fingerprint",
+			chain_fp, "fingerprint_collisions", fp_collisions);
+}
+
 static const char *rpc_dlg_stats_active_doc[2] = {
 		"Get stats about active dialogs", 0};
 
@@ -3890,5 +3963,6 @@ static rpc_export_t rpc_methods[] = {
 				0},
 		{"dlg.set_state", rpc_dlg_set_state, rpc_dlg_set_state_doc, 0},
 		{"dlg.stats_active", rpc_dlg_stats_active, rpc_dlg_stats_active_doc, 0},
+		{"dlg.stats_hash", rpc_dlg_stats_hash, rpc_dlg_stats_hash_doc, 0},
 		{"dlg.is_alive", rpc_dlg_is_alive, rpc_dlg_is_alive_doc, 0},
 		{0, 0, 0, 0}};
@@ -34,6 +34,7 @@
 #include <sys/time.h>
 
 #include "../../core/dprint.h"
+#include "../../core/mem/mem.h"
 #include "../../core/ut.h"
 #include "../../core/timer.h"
 #include "../../lib/srdb1/db.h"
@@ -72,6 +73,7 @@ str req_uri_column = str_init(REQ_URI_COL);
 str xdata_column = str_init(XDATA_COL);
 str dialog_table_name = str_init(DIALOG_TABLE_NAME);
 int dlg_db_mode = DB_MODE_NONE;
+int dlg_db_update_batch = 0;
 
 str vars_h_id_column = str_init(VARS_HASH_ID_COL);
 str vars_h_entry_column = str_init(VARS_HASH_ENTRY_COL);
@@ -166,7 +168,8 @@ int init_dlg_db(const str *db_url, int dlg_hash_size, int db_update_period,
 		goto dberror;
 	}
 
-	if((dlg_db_mode == DB_MODE_DELAYED)
+	/* with grouped updates, the writes are done by a dedicated process */
+	if((dlg_db_mode == DB_MODE_DELAYED) && dlg_db_update_batch <= 0
 			&& (register_timer(dialog_update_db, 0, db_update_period) < 0)) {
 		LM_ERR("Failed to register update db timer\n");
 		goto dberror;
@@ -1034,21 +1037,187 @@ int update_dialog_dbinfo(struct dlg_cell *cell)
 	return 0;
 }
 
+/*! dialog written in the current group of delayed updates */
+typedef struct dlg_db_batch_item
+{
+	unsigned int h_entry;
+	unsigned int h_id;
+} dlg_db_batch_item_t;
+
+static dlg_db_batch_item_t *_dlg_db_batch = NULL;
+static int _dlg_db_batch_size = 0;
+static int _dlg_db_batch_n = 0;
+
+/*!
+ * \brief Start a group of delayed dialog updates
+ * \return 1 if a transaction was started, 0 otherwise
+ */
+static int dlg_db_batch_start(void)
+{
+	_dlg_db_batch_n = 0;
+	if(dlg_db_update_batch <= 1 || dialog_dbf.start_transaction == NULL
+			|| dialog_dbf.end_transaction == NULL)
+		return 0;
+	if(dialog_dbf.start_transaction(dialog_db_handle, DB_LOCKING_NONE) < 0) {
+		LM_ERR("failed to start transaction\n");
+		return 0;
+	}
+	return 1;
+}
+
+/*!
+ * \brief Keep the id of a dialog written in the current group
+ * \return 0 on success, -1 on failure
+ */
+static int dlg_db_batch_add(struct dlg_cell *cell)
+{
+	dlg_db_batch_item_t *nb;
+	int nsize;
+
+	if(_dlg_db_batch_n >= _dlg_db_batch_size) {
+		nsize = (_dlg_db_batch_size > 0) ? 2 * _dlg_db_batch_size
+										 : dlg_db_update_batch;
+		nb = (dlg_db_batch_item_t *)pkg_realloc(
+				_dlg_db_batch, nsize * sizeof(dlg_db_batch_item_t));
+		if(nb == NULL) {
+			PKG_MEM_ERROR;
+			return -1;
+		}
+		_dlg_db_batch = nb;
+		_dlg_db_batch_size = nsize;
+	}
+	_dlg_db_batch[_dlg_db_batch_n].h_entry = cell->h_entry;
+	_dlg_db_batch[_dlg_db_batch_n].h_id = cell->h_id;
+	_dlg_db_batch_n++;
+	return 0;
+}
+
+/*!
+ * \brief Write again one by one the dialogs of a rolled back group
+ *
+ * The database has the records of the dialogs as before the group, while
+ * the change flags were reset by the writes, so each dialog is removed
+ * and inserted again with all its variables.
+ * \note no dialog slot has to be locked by the caller
+ */
+static void dlg_db_batch_rewrite(void)
+{
+	struct dlg_entry *d_entry;
+	struct dlg_cell *cell;
+	struct dlg_var *var;
+	int i;
+
+	for(i = 0; i < _dlg_db_batch_n; i++) {
+		d_entry = &d_table->entries[_dlg_db_batch[i].h_entry];
+		dlg_lock(d_table, d_entry);
+		for(cell = d_entry->first; cell != NULL; cell = cell->next) {
+			if(cell->h_id == _dlg_db_batch[i].h_id)
+				break;
+		}
+		if(cell == NULL || cell->state < DLG_STATE_EARLY
+				|| cell->state == DLG_STATE_DELETED) {
+			dlg_unlock(d_table, d_entry);
+			continue;
+		}
+		if(remove_dialog_from_db(cell) < 0) {
+			LM_ERR("failed to remove dlg [%u:%u] for writing it again\n",
+					cell->h_entry, cell->h_id);
+			cell->dflags |= DLG_FLAG_CHANGED;
+			dlg_unlock(d_table, d_entry);
+			continue;
+		}
+		cell->dflags |= DLG_FLAG_NEW | DLG_FLAG_CHANGED_VARS;
+		for(var = cell->vars; var; var = var->next) {
+			if((var->vflags & DLG_FLAG_DEL) == 0)
+				var->vflags |= DLG_FLAG_NEW;
+		}
+		/* on failure the flags are kept for the next run */
+		update_dialog_dbinfo_unsafe(cell);
+		dlg_unlock(d_table, d_entry);
+	}
+}
+
+/*!
+ * \brief End a group of delayed dialog updates
+ *
+ * If the transaction cannot be committed or one of its statements failed,
+ * it is rolled back and the dialogs of the group are written one by one.
+ * \param intrans set if a transaction was started for the group
+ * \param failed set if a write of the group failed
+ * \note no dialog slot has to be locked by the caller
+ */
+static void dlg_db_batch_end(int intrans, int failed)
+{
+	if(intrans == 0)
+		return;
+	if(failed == 0) {
+		if(dialog_dbf.end_transaction(dialog_db_handle) == 0) {
+			_dlg_db_batch_n = 0;
+			return;
+		}
+		LM_ERR("failed to end transaction\n");
+	}
+	if(dialog_dbf.abort_transaction != NULL
+			&& dialog_dbf.abort_transaction(dialog_db_handle) < 0) {
+		LM_ERR("failed to abort transaction\n");
+	}
+	dlg_db_batch_rewrite();
+	_dlg_db_batch_n = 0;
+}
+
 void dialog_update_db(unsigned int ticks, void *param)
 {
 	int i;
+	int n;
+	int intrans;
+	int failed;
 	struct dlg_cell *cell;
 
 	LM_DBG("saving current_info \n");
 
+	n = 0;
+	intrans = 0;
 	for(i = 0; i < d_table->size; i++) {
+		failed = 0;
 		/* lock the slot */
 		dlg_lock(d_table, &d_table->entries[i]);
 		for(cell = d_table->entries[i].first; cell != NULL; cell = cell->next) {
-			/* if update fails for one dlg, still do it for the next ones */
-			update_dialog_dbinfo_unsafe(cell);
+			/* only dialogs changed since the last run have to be written,
+			 * each of them once with its latest state */
+			if((cell->dflags
+					   & (DLG_FLAG_NEW | DLG_FLAG_CHANGED
+							   | DLG_FLAG_CHANGED_VARS))
+					== 0)
+				continue;
+			if(n == 0)
+				intrans = dlg_db_batch_start();
+			n++;
+			if(intrans == 0) {
+				/* if update fails for one dlg, still do it for the next ones */
+				update_dialog_dbinfo_unsafe(cell);
+				continue;
+			}
+			/* a failed statement can abort the whole transaction, the next
+			 * dialogs of the slot are written by the next run */
+			if(dlg_db_batch_add(cell) < 0
+					|| update_dialog_dbinfo_unsafe(cell) < 0) {
+				failed = 1;
+				break;
+			}
 		}
 		dlg_unlock(d_table, &d_table->entries[i]);
+		/* groups are ended with no slot locked, a failed one being written
+		 * again dialog by dialog */
+		if(n > 0
+				&& (failed
+						|| (dlg_db_update_batch > 0
+								&& n >= dlg_db_update_batch))) {
+			dlg_db_batch_end(intrans, failed);
+			intrans = 0;
+			n = 0;
+		}
 	}
+	if(n > 0)
+		dlg_db_batch_end(intrans, 0);
 	return;
 }
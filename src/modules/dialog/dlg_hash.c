@@ -476,7 +476,8 @@ struct dlg_cell *build_new_dlg(
 	dlg->state = DLG_STATE_UNCONFIRMED;
 	dlg->init_ts = ksr_time_uint(NULL, NULL);
 
-	dlg->h_entry = core_hash(callid, 0, d_table->size);
+	dlg->cid_hash = core_hash(callid, 0, 0);
+	dlg->h_entry = core_hash_idx(dlg->cid_hash, d_table->size);
 	LM_DBG("new dialog on hash %u\n", dlg->h_entry);
 
 	p = (char *)(dlg + 1);
@@ -850,6 +851,7 @@ dlg_cell_t *dlg_get_by_iuid(dlg_iuid_t *diuid)
  * \brief Helper function to get a dialog corresponding to a SIP message
  * \see get_dlg
  * \param h_entry hash index in the directory list
+ * \param cid_hash full hash id of callid
  * \param callid callid
  * \param ftag from tag
  * \param ttag to tag
@@ -858,7 +860,8 @@ dlg_cell_t *dlg_get_by_iuid(dlg_iuid_t *diuid)
  * \return dialog structure on success, NULL on failure
  */
 static inline struct dlg_cell *internal_get_dlg(unsigned int h_entry,
-		str *callid, str *ftag, str *ttag, unsigned int *dir, int mode)
+		unsigned int cid_hash, str *callid, str *ftag, str *ttag,
+		unsigned int *dir, int mode)
 {
 	struct dlg_cell *dlg;
 	struct dlg_cell *dlg_no_totag = NULL;
@@ -870,6 +873,9 @@ static inline struct dlg_cell *internal_get_dlg(unsigned int h_entry,
 	dlg_lock(d_table, d_entry);
 
 	for(dlg = d_entry->first; dlg; dlg = dlg->next) {
+		/* skip dialogs with other callid without comparing strings */
+		if(dlg->cid_hash != cid_hash)
+			continue;
 		/* check callid / fromtag / totag */
 		if(match_dialog(dlg, callid, ftag, ttag, dir) == 1) {
 			/* if to-tag is empty continue to search in case another dialog
@@ -930,14 +936,16 @@ static inline struct dlg_cell *internal_get_dlg(unsigned int h_entry,
 struct dlg_cell *get_dlg(str *callid, str *ftag, str *ttag, unsigned int *dir)
 {
 	struct dlg_cell *dlg;
+	unsigned int hid;
 	unsigned int he;
 
 	if(d_table == NULL) {
 		LM_ERR("dialog hash table not available\n");
 		return 0;
 	}
-	he = core_hash(callid, 0, d_table->size);
-	dlg = internal_get_dlg(he, callid, ftag, ttag, dir, 0);
+	hid = core_hash(callid, 0, 0);
+	he = core_hash_idx(hid, d_table->size);
+	dlg = internal_get_dlg(he, hid, callid, ftag, ttag, dir, 0);
 
 	if(dlg == 0) {
 		LM_DBG("no dialog callid='%.*s' found\n", callid->len, callid->s);
@@ -968,10 +976,12 @@ struct dlg_cell *get_dlg(str *callid, str *ftag, str *ttag, unsigned int *dir)
 dlg_cell_t *dlg_search(str *callid, str *ftag, str *ttag, unsigned int *dir)
 {
 	struct dlg_cell *dlg;
+	unsigned int hid;
 	unsigned int he;
 
-	he = core_hash(callid, 0, d_table->size);
-	dlg = internal_get_dlg(he, callid, ftag, ttag, dir, 1);
+	hid = core_hash(callid, 0, 0);
+	he = core_hash_idx(hid, d_table->size);
+	dlg = internal_get_dlg(he, hid, callid, ftag, ttag, dir, 1);
 
 	if(dlg == 0) {
 		LM_DBG("dialog with callid='%.*s' not found\n", callid->len, callid->s);
@@ -113,6 +113,7 @@ typedef struct dlg_cell
 	struct dlg_cell *prev;	 /*!< previous entry in the list */
 	unsigned int h_id;		 /*!< id in the hash table entry (seq nr in slot) */
 	unsigned int h_entry;	 /*!< index of hash table entry (the slot number) */
+	unsigned int cid_hash;	 /*!< full hash id of callid (fingerprint) */
 	unsigned int state;		 /*!< dialog state */
 	unsigned int lifetime;	 /*!< dialog lifetime */
 	unsigned int init_ts;	 /*!< init (creation) time (absolute UNIX ts)*/
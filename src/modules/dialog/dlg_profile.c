@@ -235,9 +235,19 @@ static struct dlg_profile_table *new_dlg_profile(
  */
 static void destroy_dlg_profile(struct dlg_profile_table *profile)
 {
+	struct dlg_profile_vcount *vc;
+	unsigned int i;
+
 	if(profile == NULL)
 		return;
 
+	for(i = 0; i < profile->size; i++) {
+		while(profile->entries[i].vcounts) {
+			vc = profile->entries[i].vcounts;
+			profile->entries[i].vcounts = vc->next;
+			shm_free(vc);
+		}
+	}
 	lock_destroy(&profile->lock);
 	shm_free(profile);
 	return;
@@ -260,6 +270,95 @@ void destroy_dlg_profiles(void)
 }
 
 
+/*!
+ * \brief Account an item linked to a profile hash entry
+ *
+ * Keeps the total number of items of the profile and, for profiles with
+ * value, the number of items per value, so that the profile size can be
+ * returned without walking the hash entry.
+ * \param profile dialog profile table
+ * \param p_entry profile hash entry
+ * \param lh linked item
+ * \note the profile lock must be held
+ */
+static void dlg_profile_count_link(struct dlg_profile_table *profile,
+		struct dlg_profile_entry *p_entry, struct dlg_profile_hash *lh)
+{
+	struct dlg_profile_vcount *vc;
+
+	p_entry->content++;
+	atomic_inc(&profile->count);
+	lh->vcount = NULL;
+	if(profile->has_value == 0) {
+		return;
+	}
+	for(vc = p_entry->vcounts; vc; vc = vc->next) {
+		if(vc->value.len == lh->value.len
+				&& memcmp(vc->value.s, lh->value.s, lh->value.len) == 0) {
+			break;
+		}
+	}
+	if(vc == NULL) {
+		vc = (struct dlg_profile_vcount *)shm_malloc(
+				sizeof(struct dlg_profile_vcount) + lh->value.len + 1);
+		if(vc == NULL) {
+			LM_ERR("no more shm mem\n");
+			/* size of this entry is computed by walking the items */
+			p_entry->vcmiss++;
+			return;
+		}
+		memset(vc, 0, sizeof(struct dlg_profile_vcount));
+		vc->value.s = (char *)(vc + 1);
+		memcpy(vc->value.s, lh->value.s, lh->value.len);
+		vc->value.len = lh->value.len;
+		vc->value.s[vc->value.len] = '\0';
+		vc->next = p_entry->vcounts;
+		p_entry->vcounts = vc;
+	}
+	vc->count++;
+	lh->vcount = vc;
+}
+
+
+/*!
+ * \brief Account an item unlinked from a profile hash entry
+ * \param profile dialog profile table
+ * \param p_entry profile hash entry
+ * \param lh unlinked item
+ * \note the profile lock must be held
+ */
+static void dlg_profile_count_unlink(struct dlg_profile_table *profile,
+		struct dlg_profile_entry *p_entry, struct dlg_profile_hash *lh)
+{
+	struct dlg_profile_vcount *vc;
+	struct dlg_profile_vcount **pvc;
+
+	p_entry->content--;
+	atomic_dec(&profile->count);
+	if(profile->has_value == 0) {
+		return;
+	}
+	vc = lh->vcount;
+	lh->vcount = NULL;
+	if(vc == NULL) {
+		if(p_entry->vcmiss > 0)
+			p_entry->vcmiss--;
+		return;
+	}
+	vc->count--;
+	if(vc->count > 0) {
+		return;
+	}
+	for(pvc = &p_entry->vcounts; *pvc; pvc = &(*pvc)->next) {
+		if(*pvc == vc) {
+			*pvc = vc->next;
+			shm_free(vc);
+			return;
+		}
+	}
+}
+
+
 /*!
  * \brief Destroy dialog linkers
  * \param linker dialog linker
@@ -288,7 +387,7 @@ void destroy_linkers(struct dlg_profile_link *linker)
 				lh->prev->next = lh->next;
 			}
 			lh->next = lh->prev = NULL;
-			p_entry->content--;
+			dlg_profile_count_unlink(l->profile, p_entry, lh);
 			lock_release(&l->profile->lock);
 		}
 		/* free memory */
@@ -352,9 +451,9 @@ void remove_expired_remote_profiles(time_t te)
 							lh->prev->next = lh->next;
 						}
 						lh->next = lh->prev = NULL;
+						dlg_profile_count_unlink(profile, p_entry, lh);
 						if(lh->linker)
 							shm_free(lh->linker);
-						p_entry->content--;
 						lock_release(&profile->lock);
 						return;
 					}
@@ -398,9 +497,9 @@ int remove_profile(dlg_profile_table_t *profile, str *value, str *puid)
 					lh->prev->next = lh->next;
 				}
 				lh->next = lh->prev = NULL;
+				dlg_profile_count_unlink(profile, p_entry, lh);
 				if(lh->linker)
 					shm_free(lh->linker);
-				p_entry->content--;
 				lock_release(&profile->lock);
 				return 1;
 			}
@@ -495,7 +594,7 @@ static void link_profile(struct dlg_profile_link *linker, str *vkey)
 		p_entry->first = linker->hash_linker.next = linker->hash_linker.prev =
 				&linker->hash_linker;
 	}
-	p_entry->content++;
+	dlg_profile_count_link(linker->profile, p_entry, &linker->hash_linker);
 	lock_release(&linker->profile->lock);
 }
 
@@ -847,20 +946,30 @@ unsigned int get_profile_size(struct dlg_profile_table *profile, str *value)
 {
 	unsigned int n, i;
 	struct dlg_profile_hash *ph;
+	struct dlg_profile_vcount *vc;
 
 	if(profile->has_value == 0 || value == NULL) {
-		/* iterate through the hash and count all records */
-		lock_get(&profile->lock);
-		for(i = 0, n = 0; i < profile->size; i++)
-			n += profile->entries[i].content;
-		lock_release(&profile->lock);
+		/* total number of records is kept up to date on link/unlink */
+		n = (unsigned int)atomic_get(&profile->count);
 		return n;
 	} else {
-		/* iterate through the hash entry and count only matching */
 		/* calculate the hash position */
 		i = calc_hash_profile(value, NULL, profile);
 		n = 0;
 		lock_get(&profile->lock);
+		if(profile->entries[i].vcmiss == 0) {
+			/* use the counter of the value */
+			for(vc = profile->entries[i].vcounts; vc; vc = vc->next) {
+				if(value->len == vc->value.len
+						&& memcmp(value->s, vc->value.s, value->len) == 0) {
+					n = vc->count;
+					break;
+				}
+			}
+			lock_release(&profile->lock);
+			return n;
+		}
+		/* iterate through the hash entry and count only matching */
 		ph = profile->entries[i].first;
 		if(ph) {
 			do {
@@ -51,6 +51,15 @@
  */
 
 
+/*! counter of the items with the same value in a dialog profile */
+typedef struct dlg_profile_vcount
+{
+	str value;			/*!< profile value */
+	unsigned int count; /*!< number of items with this value */
+	struct dlg_profile_vcount *next;
+} dlg_profile_vcount_t;
+
+
 /*! dialog profile hash list */
 typedef struct dlg_profile_hash
 {
@@ -61,6 +70,7 @@ typedef struct dlg_profile_hash
 	time_t expires;
 	int flags;
 	struct dlg_profile_link *linker;
+	struct dlg_profile_vcount *vcount; /*!< counter for the value */
 	struct dlg_profile_hash *next;
 	struct dlg_profile_hash *prev;
 	unsigned int hash; /*!< position in the hash table */
@@ -81,6 +91,8 @@ typedef struct dlg_profile_entry
 {
 	struct dlg_profile_hash *first;
 	unsigned int content; /*!< content of the entry */
+	struct dlg_profile_vcount *vcounts; /*!< counters per value */
+	unsigned int vcmiss; /*!< items linked without a value counter */
 } dlg_profile_entry_t;
 
 #define FLAG_PROFILE_REMOTE 1
@@ -94,6 +106,7 @@ typedef struct dlg_profile_table
 			has_value; /*!< 0 for profiles without value, otherwise it has a value */
 	int flags;		   /*!< flags related to the profile */
 	gen_lock_t lock; /*! lock for concurrent access */
+	atomic_t count;	 /*!< number of items in the profile */
 	struct dlg_profile_entry *entries;
 	struct dlg_profile_table *next;
 } dlg_profile_table_t;
@@ -37,16 +37,38 @@ struct dlg_timer *d_timer = 0;
 /*! global dialog timer handler */
 dlg_timer_handler timer_hdl = 0;
 
+/*! index of the wheel slot for a timeout value */
+#define dlg_timer_slot(_t) ((_t) & (d_timer->size - 1))
+/*! index of the lock protecting the wheel slot for a timeout value */
+#define dlg_timer_lock_idx(_t) ((_t) & (d_timer->nlocks - 1))
+
 
 /*!
  * \brief Initialize the dialog timer handler
- * Initialize the dialog timer handler, allocate the lock and a global
- * timer in shared memory. The global timer handler will be set on success.
+ * Initialize the dialog timer handler, allocate the locks and the global
+ * timer wheel in shared memory. The global timer handler will be set on
+ * success.
  * \param hdl dialog timer handler
+ * \param wheel_size number of slots of the timer wheel
  * \return 0 on success, -1 on failure
  */
-int init_dlg_timer(dlg_timer_handler hdl)
+int init_dlg_timer(dlg_timer_handler hdl, int wheel_size)
 {
+	unsigned int size;
+	unsigned int i;
+
+	if(wheel_size <= 0) {
+		wheel_size = DLG_TIMER_WHEEL_SIZE;
+	}
+	/* round to the lower power of two */
+	for(size = 1; size <= (unsigned int)wheel_size / 2; size <<= 1)
+		;
+	if(size != (unsigned int)wheel_size) {
+		LM_WARN("timer wheel size is not a power of 2 -> rounding from %d to "
+				"%u\n",
+				wheel_size, size);
+	}
+
 	d_timer = (struct dlg_timer *)shm_malloc(sizeof(struct dlg_timer));
 	if(d_timer == 0) {
 		LM_ERR("no more shm mem\n");
@@ -54,23 +76,38 @@ int init_dlg_timer(dlg_timer_handler hdl)
 	}
 	memset(d_timer, 0, sizeof(struct dlg_timer));
 
-	d_timer->first.next = d_timer->first.prev = &(d_timer->first);
-
-	d_timer->lock = lock_alloc();
-	if(d_timer->lock == 0) {
-		LM_ERR("failed to alloc lock\n");
+	d_timer->slots =
+			(struct dlg_tl *)shm_malloc(size * sizeof(struct dlg_tl));
+	if(d_timer->slots == 0) {
+		LM_ERR("no more shm mem\n");
 		goto error0;
 	}
-
-	if(lock_init(d_timer->lock) == 0) {
-		LM_ERR("failed to init lock\n");
+	memset(d_timer->slots, 0, size * sizeof(struct dlg_tl));
+	for(i = 0; i < size; i++) {
+		d_timer->slots[i].next = d_timer->slots[i].prev = &d_timer->slots[i];
+	}
+	d_timer->size = size;
+	d_timer->nlocks =
+			(size < DLG_TIMER_WHEEL_LOCKS) ? size : DLG_TIMER_WHEEL_LOCKS;
+	d_timer->cursor = get_ticks();
+
+	d_timer->locks = lock_set_alloc(d_timer->nlocks);
+	if(d_timer->locks == 0) {
+		LM_ERR("failed to alloc lock set\n");
 		goto error1;
 	}
 
+	if(lock_set_init(d_timer->locks) == 0) {
+		LM_ERR("failed to init lock set\n");
+		goto error2;
+	}
+
 	timer_hdl = hdl;
 	return 0;
+error2:
+	lock_set_dealloc(d_timer->locks);
 error1:
-	lock_dealloc(d_timer->lock);
+	shm_free(d_timer->slots);
 error0:
 	shm_free(d_timer);
 	d_timer = 0;
@@ -86,34 +123,65 @@ void destroy_dlg_timer(void)
 	if(d_timer == 0)
 		return;
 
-	lock_destroy(d_timer->lock);
-	lock_dealloc(d_timer->lock);
+	lock_set_destroy(d_timer->locks);
+	lock_set_dealloc(d_timer->locks);
 
+	shm_free(d_timer->slots);
 	shm_free(d_timer);
 	d_timer = 0;
 }
 
 
+/*!
+ * \brief Lock the wheel slots of two timeout values
+ * \param l1 lock index of the first slot
+ * \param l2 lock index of the second slot
+ */
+static inline void dlg_timer_lock2(unsigned int l1, unsigned int l2)
+{
+	if(l1 == l2) {
+		lock_set_get(d_timer->locks, l1);
+	} else if(l1 < l2) {
+		lock_set_get(d_timer->locks, l1);
+		lock_set_get(d_timer->locks, l2);
+	} else {
+		lock_set_get(d_timer->locks, l2);
+		lock_set_get(d_timer->locks, l1);
+	}
+}
+
+
+/*!
+ * \brief Unlock the wheel slots locked with dlg_timer_lock2()
+ * \param l1 lock index of the first slot
+ * \param l2 lock index of the second slot
+ */
+static inline void dlg_timer_unlock2(unsigned int l1, unsigned int l2)
+{
+	lock_set_release(d_timer->locks, l1);
+	if(l1 != l2) {
+		lock_set_release(d_timer->locks, l2);
+	}
+}
+
+
 /*!
  * \brief Helper function for insert_dialog_timer
  * \see insert_dialog_timer
  * \param tl dialog timer list
+ * \note the lock of the wheel slot for tl->timeout must be held
  */
 static inline void insert_dialog_timer_unsafe(struct dlg_tl *tl)
 {
-	struct dlg_tl *ptr;
+	struct dlg_tl *head;
 
-	/* insert in sorted order */
-	for(ptr = d_timer->first.prev; ptr != &d_timer->first; ptr = ptr->prev) {
-		if(ptr->timeout <= tl->timeout)
-			break;
-	}
+	head = &d_timer->slots[dlg_timer_slot(tl->timeout)];
 
 	LM_DBG("inserting %p for %d\n", tl, tl->timeout);
-	tl->prev = ptr;
-	tl->next = ptr->next;
+	tl->next = head;
+	tl->prev = head->prev;
 	tl->prev->next = tl;
-	tl->next->prev = tl;
+	head->prev = tl;
 }
 
 
@@ -125,18 +193,34 @@ static inline void insert_dialog_timer_unsafe(struct dlg_tl *tl)
  */
 int insert_dlg_timer(struct dlg_tl *tl, int interval)
 {
-	lock_get(d_timer->lock);
+	unsigned int timeout;
+	unsigned int li;
+
+	if(interval < 0) {
+		interval = 0;
+	}
+	timeout = get_ticks() + interval;
+	li = dlg_timer_lock_idx(timeout);
+	lock_set_get(d_timer->locks, li);
 
 	if(tl->next != 0 || tl->prev != 0) {
 		LM_CRIT("Trying to insert a bogus dlg tl=%p tl->next=%p tl->prev=%p\n",
 				tl, tl->next, tl->prev);
-		lock_release(d_timer->lock);
+		lock_set_release(d_timer->locks, li);
 		return -1;
 	}
-	tl->timeout = get_ticks() + interval;
+	/* the timer routine went already past this tick - schedule the
+	 * timeout on the tick to be visited next */
+	while(timeout < d_timer->cursor) {
+		timeout = d_timer->cursor;
+		lock_set_release(d_timer->locks, li);
+		li = dlg_timer_lock_idx(timeout);
+		lock_set_get(d_timer->locks, li);
+	}
+	tl->timeout = timeout;
 	insert_dialog_timer_unsafe(tl);
 
-	lock_release(d_timer->lock);
+	lock_set_release(d_timer->locks, li);
 
 	return 0;
 }
@@ -162,17 +246,28 @@ static inline void remove_dialog_timer_unsafe(struct dlg_tl *tl)
  */
 int remove_dialog_timer(struct dlg_tl *tl)
 {
-	lock_get(d_timer->lock);
+	unsigned int timeout;
+	unsigned int li;
+
+	/* the timeout selects the slot lock, retry if it was changed meanwhile */
+	for(;;) {
+		timeout = tl->timeout;
+		li = dlg_timer_lock_idx(timeout);
+		lock_set_get(d_timer->locks, li);
+		if(tl->timeout == timeout)
+			break;
+		lock_set_release(d_timer->locks, li);
+	}
 
 	if(tl->prev == NULL && tl->timeout == 0) {
-		lock_release(d_timer->lock);
+		lock_set_release(d_timer->locks, li);
 		return 1;
 	}
 
 	if(tl->prev == NULL || tl->next == NULL) {
 		LM_CRIT("bogus tl=%p tl->prev=%p tl->next=%p\n", tl, tl->prev,
 				tl->next);
-		lock_release(d_timer->lock);
+		lock_set_release(d_timer->locks, li);
 		return -1;
 	}
 
@@ -181,7 +276,7 @@ int remove_dialog_timer(struct dlg_tl *tl)
 	tl->prev = NULL;
 	tl->timeout = 0;
 
-	lock_release(d_timer->lock);
+	lock_set_release(d_timer->locks, li);
 	return 0;
 }
 
@@ -195,70 +290,86 @@ int remove_dialog_timer(struct dlg_tl *tl)
  */
 int update_dlg_timer(struct dlg_tl *tl, int timeout)
 {
-	lock_get(d_timer->lock);
+	unsigned int old_timeout;
+	unsigned int new_timeout;
+	unsigned int lo;
+	unsigned int ln;
+
+	new_timeout = get_ticks() + timeout;
+	for(;;) {
+		old_timeout = tl->timeout;
+		lo = dlg_timer_lock_idx(old_timeout);
+		ln = dlg_timer_lock_idx(new_timeout);
+		dlg_timer_lock2(lo, ln);
+		if(tl->timeout == old_timeout && new_timeout >= d_timer->cursor)
+			break;
+		if(new_timeout < d_timer->cursor)
+			new_timeout = d_timer->cursor;
+		dlg_timer_unlock2(lo, ln);
+	}
 
 	if(tl->next == 0 || tl->prev == 0) {
 		LM_CRIT("Trying to update a bogus dlg tl=%p tl->next=%p tl->prev=%p\n",
 				tl, tl->next, tl->prev);
-		lock_release(d_timer->lock);
+		dlg_timer_unlock2(lo, ln);
 		return -1;
 	}
 	remove_dialog_timer_unsafe(tl);
-	tl->timeout = get_ticks() + timeout;
+	tl->timeout = new_timeout;
 	insert_dialog_timer_unsafe(tl);
 
-	lock_release(d_timer->lock);
+	dlg_timer_unlock2(lo, ln);
 	return 0;
 }
 
 
 /*!
  * \brief Helper function for dlg_timer_routine
+ *
+ * Visits the wheel slots of the ticks passed since the previous run (the
+ * last visited tick is visited again to catch late inserts) and detaches
+ * the timers that are due. Timers of later wheel rounds are left in place.
  * \param time time for expiration check
- * \return list of expired dialogs on success, 0 on failure
+ * \return list of expired dialogs linked by next, 0 if none
  */
 static inline struct dlg_tl *get_expired_dlgs(unsigned int time)
 {
-	struct dlg_tl *tl, *end, *ret;
-
-	lock_get(d_timer->lock);
+	struct dlg_tl *head, *tl, *ntl, *ret, **tail;
+	unsigned int t;
+	unsigned int li;
 
-	if(d_timer->first.next == &(d_timer->first)
-			|| d_timer->first.next->timeout > time) {
-		lock_release(d_timer->lock);
-		return 0;
-	}
+	ret = 0;
+	tail = &ret;
 
-	end = &d_timer->first;
-	tl = d_timer->first.next;
-	LM_DBG("start with tl=%p tl->prev=%p tl->next=%p (%d) at %d "
-		   "and end with end=%p end->prev=%p end->next=%p\n",
-			tl, tl->prev, tl->next, tl->timeout, time, end, end->prev,
-			end->next);
-	while(tl != end && tl->timeout <= time) {
-		LM_DBG("getting tl=%p tl->prev=%p tl->next=%p with %d\n", tl, tl->prev,
-				tl->next, tl->timeout);
-		tl->prev = 0;
-		tl->timeout = 0;
-		tl = tl->next;
+	t = d_timer->cursor;
+	if(time - t >= d_timer->size) {
+		/* one full round covers all slots */
+		t = time - d_timer->size + 1;
 	}
-	LM_DBG("end with tl=%p tl->prev=%p tl->next=%p and "
-		   "d_timer->first.next->prev=%p\n",
-			tl, tl->prev, tl->next, d_timer->first.next->prev);
 
-	if(tl == end && d_timer->first.next->prev) {
-		ret = 0;
-	} else {
-		ret = d_timer->first.next;
-		if(tl->prev) {
-			tl->prev->next = 0;
+	for(;; t++) {
+		li = dlg_timer_lock_idx(t);
+		lock_set_get(d_timer->locks, li);
+		head = &d_timer->slots[dlg_timer_slot(t)];
+		for(tl = head->next; tl != head; tl = ntl) {
+			ntl = tl->next;
+			if(tl->timeout > time)
+				continue;
+			LM_DBG("getting tl=%p tl->prev=%p tl->next=%p with %d at %d\n", tl,
+					tl->prev, tl->next, tl->timeout, time);
+			remove_dialog_timer_unsafe(tl);
+			tl->prev = 0;
+			tl->timeout = 0;
+			tl->next = 0;
+			*tail = tl;
+			tail = &tl->next;
 		}
-		d_timer->first.next = tl;
-		tl->prev = &d_timer->first;
+		d_timer->cursor = t;
+		lock_set_release(d_timer->locks, li);
+		if(t == time)
+			break;
 	}
 
-	lock_release(d_timer->lock);
-
 	return ret;
 }
 
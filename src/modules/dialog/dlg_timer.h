@@ -44,11 +44,19 @@ typedef struct dlg_tl
 } dlg_tl_t;
 
 
-/*! dialog timer */
+/*! default number of slots of the dialog timer wheel */
+#define DLG_TIMER_WHEEL_SIZE 4096
+/*! maximum number of locks protecting the slots of the timer wheel */
+#define DLG_TIMER_WHEEL_LOCKS 256
+
+/*! dialog timer - hashed timing wheel indexed by the expire tick */
 typedef struct dlg_timer
 {
-	struct dlg_tl first; /*!< dialog timeout list */
-	gen_lock_t *lock;	 /*!< lock for the list */
+	struct dlg_tl *slots;	   /*!< wheel slots, each a circular list */
+	unsigned int size;		   /*!< number of slots (power of two) */
+	unsigned int nlocks;	   /*!< number of locks in the lock set */
+	gen_lock_set_t *locks;	   /*!< locks for the wheel slots */
+	volatile unsigned int cursor; /*!< last tick visited by the timer */
 } dlg_timer_t;
 
 
@@ -58,12 +66,14 @@ typedef void (*dlg_timer_handler)(struct dlg_tl *);
 
 /*!
  * \brief Initialize the dialog timer handler
- * Initialize the dialog timer handler, allocate the lock and a global
- * timer in shared memory. The global timer handler will be set on success.
+ * Initialize the dialog timer handler, allocate the locks and the global
+ * timer wheel in shared memory. The global timer handler will be set on
+ * success.
  * \param hdl dialog timer handler
+ * \param wheel_size number of slots of the timer wheel
  * \return 0 on success, -1 on failure
  */
-int init_dlg_timer(dlg_timer_handler);
+int init_dlg_timer(dlg_timer_handler hdl, int wheel_size);
 
 
 /*!
@@ -96,6 +96,8 @@ int dp_fetch_rows = 1000;
 int dp_match_dynamic = 0;
 int dp_append_branch = 1;
 int dp_reload_delta = 5;
+int dp_prefix_index = 1;
+int dp_dyn_pcre_cache_size = 64;
 
 static time_t *dp_rpc_reload_time = NULL;
 /* clang-format off */
@@ -115,6 +117,8 @@ static param_export_t mod_params[]={
 	{ "match_dynamic",	PARAM_INT,	&dp_match_dynamic },
 	{ "append_branch",	PARAM_INT,	&dp_append_branch },
 	{ "reload_delta",	PARAM_INT,	&dp_reload_delta },
+	{ "prefix_index",	PARAM_INT,	&dp_prefix_index },
+	{ "dyn_pcre_cache_size",	PARAM_INT,	&dp_dyn_pcre_cache_size },
 	{0,0,0}
 };
 
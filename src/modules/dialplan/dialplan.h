@@ -46,6 +46,9 @@
 #define DP_TFLAGS_PV_MATCH (1 << 0)
 #define DP_TFLAGS_PV_SUBST (1 << 1)
 
+#define DP_PREFIX_MAX 32	   /* max depth of the literal prefix tree */
+#define DP_PREFIX_MIN_RULES 8 /* min rules in an index to build the tree */
+
 extern pcre2_general_context *dpl_gctx;
 extern pcre2_compile_context *dpl_ctx;
 
@@ -63,16 +66,28 @@ typedef struct dpl_node
 	struct subst_expr *repl_comp; /* compiled replacement */
 	str attrs;					  /* attributes string */
 	unsigned int tflags;		  /* flags for type of values for matching */
+	int pos;					  /* position in the index list */
 
 	struct dpl_node *next; /* next rule */
 } dpl_node_t, *dpl_node_p;
 
+/*Literal prefix tree over the rules of an index*/
+typedef struct dpl_pnode
+{
+	unsigned char c;
+	int nrules;			/* rules with the prefix ending here */
+	dpl_node_t **rules; /* sorted by position in the index list */
+	struct dpl_pnode *child;
+	struct dpl_pnode *next; /* next sibling, sorted by c */
+} dpl_pnode_t, *dpl_pnode_p;
+
 /*For every distinct length of a matching string*/
 typedef struct dpl_index
 {
 	int len;
 	dpl_node_t *first_rule;
 	dpl_node_t *last_rule;
+	dpl_pnode_t *ptree; /* prefix tree, NULL if not built */
 
 	struct dpl_index *next;
 } dpl_index_t, *dpl_index_p;
@@ -86,6 +101,16 @@ typedef struct dpl_id
 } dpl_id_t, *dpl_id_p;
 
 
+/*Candidate rules of an index for an input, in priority order*/
+typedef struct dpl_cursor
+{
+	dpl_node_t *rulep; /* list walk if there is no prefix tree */
+	int n;
+	dpl_node_t **rules[DP_PREFIX_MAX + 1];
+	int nrules[DP_PREFIX_MAX + 1];
+} dpl_cursor_t;
+
+
 #define DP_VAL_INT 0
 #define DP_VAL_SPEC 1
 
@@ -105,6 +130,9 @@ int dp_load_db();
 
 dpl_id_p select_dpid(int id);
 
+void dpl_cursor_init(dpl_cursor_t *cur, dpl_index_p indexp, str *input);
+dpl_node_t *dpl_cursor_next(dpl_cursor_t *cur);
+
 struct subst_expr *repl_exp_parse(str subst);
 void repl_expr_free(struct subst_expr *se);
 int dp_translate_helper(
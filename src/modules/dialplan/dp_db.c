@@ -52,6 +52,7 @@ str attrs_column = str_init(ATTRS_COL);
 
 extern int dp_fetch_rows;
 extern int dp_match_dynamic;
+extern int dp_prefix_index;
 
 static db1_con_t *dp_db_handle = 0; /* database connection handle */
 static db_func_t dp_dbf;
@@ -77,6 +78,9 @@ int add_rule2hash(dpl_node_t *, int);
 void list_rule(dpl_node_t *);
 void list_hash(int h_index);
 
+static int dpl_build_indexes(int h_index);
+static void dpl_pnode_free(dpl_pnode_t *pn);
+
 
 static dpl_id_p *dp_rules_hash = NULL;
 static int *dp_crt_idx = NULL;
@@ -360,6 +364,10 @@ int dp_load_db(void)
 
 
 end:
+	if(dpl_build_indexes(*dp_next_idx) != 0) {
+		rule = 0;
+		goto err2;
+	}
 	/*update data*/
 	*dp_crt_idx = *dp_next_idx;
 	list_hash(*dp_crt_idx);
@@ -699,6 +707,7 @@ void destroy_hash(int index)
 				rulep = indexp->first_rule;
 			}
 			crt_idp->first_index = indexp->next;
+			dpl_pnode_free(indexp->ptree);
 			shm_free(indexp);
 			indexp = 0;
 			indexp = crt_idp->first_index;
@@ -746,6 +755,317 @@ void destroy_rule(dpl_node_t *rule)
 }
 
 
+/**
+ * get the literal prefix that an input must have to match the rule
+ * - return the prefix length, 0 if it cannot be detected
+ */
+static int dpl_rule_prefix(dpl_node_t *rule, char *buf)
+{
+	char *p, *end;
+	int depth;
+	int n;
+
+	p = rule->match_exp.s;
+	if(p == NULL || rule->match_exp.len <= 0)
+		return 0;
+	end = p + rule->match_exp.len;
+	n = 0;
+
+	switch(rule->matchop) {
+		case DP_EQUAL_OP:
+			n = (rule->match_exp.len < DP_PREFIX_MAX) ? rule->match_exp.len
+													  : DP_PREFIX_MAX;
+			memcpy(buf, p, n);
+			return n;
+
+		case DP_FNMATCH_OP:
+			while(p < end && n < DP_PREFIX_MAX && *p != '*' && *p != '?'
+					&& *p != '[' && *p != '\\') {
+				buf[n++] = *p++;
+			}
+			return n;
+
+		case DP_REGEX_OP:
+			if(rule->tflags & DP_TFLAGS_PV_MATCH)
+				return 0;
+			if(*p != '^')
+				return 0;
+			/* a top level alternative, an option setting or a verb can
+			 * make the prefix optional */
+			depth = 0;
+			for(; p < end; p++) {
+				switch(*p) {
+					case '\\':
+						if(p + 1 < end && p[1] == 'Q')
+							return 0;
+						p++;
+						break;
+					case '[':
+						p++;
+						if(p < end && *p == '^')
+							p++;
+						if(p < end && *p == ']')
+							p++;
+						while(p < end && *p != ']') {
+							if(*p == '\\')
+								p++;
+							p++;
+						}
+						break;
+					case '(':
+						if(p + 1 < end && (p[1] == '*' || p[1] == '?')
+								&& (p + 2 >= end || p[1] == '*' || p[2] != ':'))
+							return 0;
+						depth++;
+						break;
+					case ')':
+						depth--;
+						break;
+					case '|':
+						if(depth <= 0)
+							return 0;
+						break;
+				}
+			}
+			p = rule->match_exp.s + 1;
+			while(p < end && n < DP_PREFIX_MAX) {
+				if(*p == '\\') {
+					if(p + 1 >= end
+							|| (p[1] >= '0' && p[1] <= '9')
+							|| (p[1] >= 'a' && p[1] <= 'z')
+							|| (p[1] >= 'A' && p[1] <= 'Z'))
+						break;
+					p++;
+				} else if(strchr("^$.[|()?*+{", *p) != NULL) {
+					break;
+				}
+				buf[n++] = *p++;
+				/* the last char can be made optional by a quantifier */
+				if(p < end && (*p == '?' || *p == '*' || *p == '{')) {
+					n--;
+					break;
+				}
+			}
+			return n;
+	}
+	return 0;
+}
+
+
+static dpl_pnode_t *dpl_pnode_child(dpl_pnode_t *pn, unsigned char c)
+{
+	dpl_pnode_t *cn, *prev;
+
+	prev = NULL;
+	for(cn = pn->child; cn != NULL && cn->c < c; cn = cn->next)
+		prev = cn;
+	if(cn != NULL && cn->c == c)
+		return cn;
+
+	cn = (dpl_pnode_t *)shm_malloc(sizeof(dpl_pnode_t));
+	if(cn == NULL) {
+		SHM_MEM_ERROR;
+		return NULL;
+	}
+	memset(cn, 0, sizeof(dpl_pnode_t));
+	cn->c = c;
+	if(prev == NULL) {
+		cn->next = pn->child;
+		pn->child = cn;
+	} else {
+		cn->next = prev->next;
+		prev->next = cn;
+	}
+	return cn;
+}
+
+
+static int dpl_pnode_alloc(dpl_pnode_t *pn)
+{
+	for(; pn != NULL; pn = pn->next) {
+		if(pn->nrules > 0) {
+			pn->rules =
+					(dpl_node_t **)shm_malloc(pn->nrules * sizeof(dpl_node_t *));
+			if(pn->rules == NULL) {
+				SHM_MEM_ERROR;
+				return -1;
+			}
+			pn->nrules = 0;
+		}
+		if(dpl_pnode_alloc(pn->child) != 0)
+			return -1;
+	}
+	return 0;
+}
+
+
+static void dpl_pnode_free(dpl_pnode_t *pn)
+{
+	dpl_pnode_t *next;
+
+	while(pn != NULL) {
+		next = pn->next;
+		dpl_pnode_free(pn->child);
+		if(pn->rules)
+			shm_free(pn->rules);
+		shm_free(pn);
+		pn = next;
+	}
+}
+
+
+/**
+ * build the prefix tree of the rules in an index - each rule is stored
+ * in the node of its literal prefix, so only the rules on the path of
+ * the input have to be evaluated
+ */
+static int dpl_index_build(dpl_index_p indexp)
+{
+	char buf[DP_PREFIX_MAX];
+	dpl_node_p rulep;
+	dpl_pnode_t *root;
+	dpl_pnode_t *pn;
+	int npos, pass;
+	int plen, i;
+
+	npos = 0;
+	for(rulep = indexp->first_rule; rulep != NULL; rulep = rulep->next)
+		rulep->pos = npos++;
+
+	if(dp_prefix_index == 0 || npos < DP_PREFIX_MIN_RULES)
+		return 0;
+
+	root = (dpl_pnode_t *)shm_malloc(sizeof(dpl_pnode_t));
+	if(root == NULL) {
+		SHM_MEM_ERROR;
+		return -1;
+	}
+	memset(root, 0, sizeof(dpl_pnode_t));
+
+	/* count the rules per node, then store them */
+	for(pass = 0; pass < 2; pass++) {
+		for(rulep = indexp->first_rule; rulep != NULL; rulep = rulep->next) {
+			plen = dpl_rule_prefix(rulep, buf);
+			pn = root;
+			for(i = 0; i < plen; i++) {
+				pn = dpl_pnode_child(pn, (unsigned char)buf[i]);
+				if(pn == NULL)
+					goto error;
+			}
+			if(pass == 0)
+				pn->nrules++;
+			else
+				pn->rules[pn->nrules++] = rulep;
+		}
+		if(pass == 0) {
+			if(root->nrules == npos) {
+				/* no prefix to index */
+				dpl_pnode_free(root);
+				return 0;
+			}
+			if(dpl_pnode_alloc(root) != 0)
+				goto error;
+		}
+	}
+	LM_DBG("prefix tree built for index len %d with %d rules (%d without "
+		   "prefix)\n",
+			indexp->len, npos, root->nrules);
+	indexp->ptree = root;
+	return 0;
+
+error:
+	dpl_pnode_free(root);
+	return -1;
+}
+
+
+static int dpl_build_indexes(int h_index)
+{
+	dpl_id_p crt_idp;
+	dpl_index_p indexp;
+
+	for(crt_idp = dp_rules_hash[h_index]; crt_idp != NULL;
+			crt_idp = crt_idp->next) {
+		for(indexp = crt_idp->first_index; indexp != NULL;
+				indexp = indexp->next) {
+			if(dpl_index_build(indexp) != 0) {
+				LM_ERR("failed to build the index for dpid %d len %d\n",
+						crt_idp->dp_id, indexp->len);
+				return -1;
+			}
+		}
+	}
+	return 0;
+}
+
+
+/**
+ * init the walk over the rules of the index that can match the input
+ */
+void dpl_cursor_init(dpl_cursor_t *cur, dpl_index_p indexp, str *input)
+{
+	dpl_pnode_t *pn;
+	unsigned char c;
+	int i;
+
+	cur->n = 0;
+	cur->rulep = NULL;
+	if(indexp->ptree == NULL) {
+		cur->rulep = indexp->first_rule;
+		return;
+	}
+	pn = indexp->ptree;
+	if(pn->nrules > 0) {
+		cur->rules[cur->n] = pn->rules;
+		cur->nrules[cur->n] = pn->nrules;
+		cur->n++;
+	}
+	for(i = 0; i < input->len && i < DP_PREFIX_MAX; i++) {
+		c = (unsigned char)input->s[i];
+		for(pn = pn->child; pn != NULL && pn->c < c; pn = pn->next)
+			;
+		if(pn == NULL || pn->c != c)
+			break;
+		if(pn->nrules > 0) {
+			cur->rules[cur->n] = pn->rules;
+			cur->nrules[cur->n] = pn->nrules;
+			cur->n++;
+		}
+	}
+}
+
+
+/**
+ * get the next candidate rule, keeping the order of the index list
+ */
+dpl_node_t *dpl_cursor_next(dpl_cursor_t *cur)
+{
+	dpl_node_t *rulep;
+	int i, k;
+
+	if(cur->n == 0) {
+		rulep = cur->rulep;
+		if(rulep != NULL)
+			cur->rulep = rulep->next;
+		return rulep;
+	}
+	k = 0;
+	for(i = 1; i < cur->n; i++) {
+		if(cur->rules[i][0]->pos < cur->rules[k][0]->pos)
+			k = i;
+	}
+	rulep = cur->rules[k][0];
+	cur->rules[k]++;
+	cur->nrules[k]--;
+	if(cur->nrules[k] == 0) {
+		cur->n--;
+		cur->rules[k] = cur->rules[cur->n];
+		cur->nrules[k] = cur->nrules[cur->n];
+	}
+	return rulep;
+}
+
+
 dpl_id_p select_dpid(int id)
 {
 	dpl_id_p idp;
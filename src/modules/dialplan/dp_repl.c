@@ -36,17 +36,41 @@
 #include "../../core/re.h"
 #include "../../core/str_list.h"
 #include "../../core/mem/shm_mem.h"
+#include "../../core/hashes.h"
 #include "dialplan.h"
 
+extern int dp_dyn_pcre_cache_size;
+
+/* per process cache of compiled dynamic expressions, LRU bounded */
+typedef struct dpl_pcre_cache
+{
+	str expr; /* value of the expression */
+	unsigned int hid;
+	pcre2_code *re;
+	int cnt;
+	int refcnt; /* in use by a dynamic pcre list */
+
+	struct dpl_pcre_cache *prev; /* lru list, most recent first */
+	struct dpl_pcre_cache *next;
+	struct dpl_pcre_cache *hnext; /* next in hash slot */
+} dpl_pcre_cache_t;
+
 typedef struct dpl_dyn_pcre
 {
 	pcre2_code *re;
 	int cnt;
 	str expr;
+	dpl_pcre_cache_t *cache; /* cache entry owning re, if any */
 
 	struct dpl_dyn_pcre *next; /* next rule */
 } dpl_dyn_pcre_t, *dpl_dyn_pcre_p;
 
+static dpl_pcre_cache_t **_dpl_pcre_htable = NULL;
+static unsigned int _dpl_pcre_hsize = 0;
+static dpl_pcre_cache_t *_dpl_pcre_lru_head = NULL;
+static dpl_pcre_cache_t *_dpl_pcre_lru_tail = NULL;
+static int _dpl_pcre_count = 0;
+
 static void dpl_get_avp_val(avp_t *avp, str *dst)
 {
 	avp_value_t val;
@@ -221,6 +245,144 @@ pcre2_code *dpl_dyn_pcre_comp(
 	return re;
 }
 
+static void dpl_pcre_cache_unlink(dpl_pcre_cache_t *e)
+{
+	if(e->prev)
+		e->prev->next = e->next;
+	else
+		_dpl_pcre_lru_head = e->next;
+	if(e->next)
+		e->next->prev = e->prev;
+	else
+		_dpl_pcre_lru_tail = e->prev;
+	e->prev = e->next = NULL;
+}
+
+static void dpl_pcre_cache_link(dpl_pcre_cache_t *e)
+{
+	e->prev = NULL;
+	e->next = _dpl_pcre_lru_head;
+	if(_dpl_pcre_lru_head)
+		_dpl_pcre_lru_head->prev = e;
+	_dpl_pcre_lru_head = e;
+	if(_dpl_pcre_lru_tail == NULL)
+		_dpl_pcre_lru_tail = e;
+}
+
+/**
+ * drop the least recently used entry that is not in use
+ */
+static int dpl_pcre_cache_evict(void)
+{
+	dpl_pcre_cache_t *e;
+	dpl_pcre_cache_t **h;
+
+	for(e = _dpl_pcre_lru_tail; e != NULL && e->refcnt > 0; e = e->prev)
+		;
+	if(e == NULL)
+		return -1;
+	dpl_pcre_cache_unlink(e);
+	for(h = &_dpl_pcre_htable[e->hid & (_dpl_pcre_hsize - 1)]; *h != e;
+			h = &(*h)->hnext)
+		;
+	*h = e->hnext;
+	pcre2_code_free(e->re);
+	pkg_free(e);
+	_dpl_pcre_count--;
+	return 0;
+}
+
+/**
+ * get the compiled pcre for the value of a dynamic expression, from the
+ * cache if possible
+ */
+static pcre2_code *dpl_dyn_pcre_get(sip_msg_t *msg, str *expr, str *vexpr,
+		int *cap_cnt, dpl_pcre_cache_t **ce)
+{
+	dpl_pcre_cache_t *e;
+	pcre2_code *re;
+	unsigned int hid;
+
+	*ce = NULL;
+	if(dp_dyn_pcre_cache_size <= 0 || vexpr == NULL || vexpr->s == NULL
+			|| vexpr->len <= 0)
+		return dpl_dyn_pcre_comp(msg, expr, vexpr, cap_cnt);
+
+	if(_dpl_pcre_htable == NULL) {
+		for(_dpl_pcre_hsize = 1;
+				_dpl_pcre_hsize < (unsigned int)dp_dyn_pcre_cache_size;
+				_dpl_pcre_hsize <<= 1)
+			;
+		_dpl_pcre_htable = (dpl_pcre_cache_t **)pkg_malloc(
+				_dpl_pcre_hsize * sizeof(dpl_pcre_cache_t *));
+		if(_dpl_pcre_htable == NULL) {
+			PKG_MEM_ERROR;
+			_dpl_pcre_hsize = 0;
+			return dpl_dyn_pcre_comp(msg, expr, vexpr, cap_cnt);
+		}
+		memset(_dpl_pcre_htable, 0,
+				_dpl_pcre_hsize * sizeof(dpl_pcre_cache_t *));
+	}
+
+	hid = get_hash1_raw(vexpr->s, vexpr->len);
+	for(e = _dpl_pcre_htable[hid & (_dpl_pcre_hsize - 1)]; e != NULL;
+			e = e->hnext) {
+		if(e->hid == hid && e->expr.len == vexpr->len
+				&& memcmp(e->expr.s, vexpr->s, vexpr->len) == 0) {
+			LM_DBG("dynamic pcre expression found in cache: %.*s\n",
+					vexpr->len, vexpr->s);
+			if(e != _dpl_pcre_lru_head) {
+				dpl_pcre_cache_unlink(e);
+				dpl_pcre_cache_link(e);
+			}
+			if(cap_cnt)
+				*cap_cnt = e->cnt;
+			e->refcnt++;
+			*ce = e;
+			return e->re;
+		}
+	}
+
+	re = dpl_dyn_pcre_comp(msg, expr, vexpr, cap_cnt);
+	if(re == NULL)
+		return NULL;
+	if(_dpl_pcre_count >= dp_dyn_pcre_cache_size
+			&& dpl_pcre_cache_evict() < 0) {
+		/* all entries in use, do not cache this one */
+		return re;
+	}
+	e = (dpl_pcre_cache_t *)pkg_malloc(
+			sizeof(dpl_pcre_cache_t) + vexpr->len + 1);
+	if(e == NULL) {
+		PKG_MEM_ERROR;
+		return re;
+	}
+	memset(e, 0, sizeof(dpl_pcre_cache_t));
+	e->expr.s = (char *)e + sizeof(dpl_pcre_cache_t);
+	memcpy(e->expr.s, vexpr->s, vexpr->len);
+	e->expr.s[vexpr->len] = '\0';
+	e->expr.len = vexpr->len;
+	e->hid = hid;
+	e->re = re;
+	e->cnt = (cap_cnt) ? *cap_cnt : 0;
+	e->refcnt = 1;
+	e->hnext = _dpl_pcre_htable[hid & (_dpl_pcre_hsize - 1)];
+	_dpl_pcre_htable[hid & (_dpl_pcre_hsize - 1)] = e;
+	dpl_pcre_cache_link(e);
+	_dpl_pcre_count++;
+	*ce = e;
+	return re;
+}
+
+static void dpl_dyn_pcre_free(dpl_dyn_pcre_p rt)
+{
+	if(rt->cache)
+		rt->cache->refcnt--;
+	else if(rt->re)
+		pcre2_code_free(rt->re);
+	pkg_free(rt);
+}
+
 dpl_dyn_pcre_p dpl_dynamic_pcre_list(sip_msg_t *msg, str *expr)
 {
 	pv_elem_p elem = NULL;
@@ -230,6 +392,7 @@ dpl_dyn_pcre_p dpl_dynamic_pcre_list(sip_msg_t *msg, str *expr)
 	struct str_list *l = NULL;
 	struct str_list *t = NULL;
 	pcre2_code *re = NULL;
+	dpl_pcre_cache_t *ce = NULL;
 	int cnt = 0;
 	str vexpr = STR_NULL;
 
@@ -256,14 +419,19 @@ dpl_dyn_pcre_p dpl_dynamic_pcre_list(sip_msg_t *msg, str *expr)
 		}
 		t = l;
 		while(t) {
-			re = dpl_dyn_pcre_comp(msg, &(t->s), &(t->s), &cnt);
+			re = dpl_dyn_pcre_get(msg, &(t->s), &(t->s), &cnt, &ce);
 			if(re != NULL) {
 				rt = pkg_malloc(sizeof(dpl_dyn_pcre_t));
 				if(rt == NULL) {
 					PKG_MEM_ERROR;
+					if(ce)
+						ce->refcnt--;
+					else
+						pcre2_code_free(re);
 					goto error;
 				}
 				rt->re = re;
+				rt->cache = ce;
 				rt->expr.s = t->s.s;
 				rt->expr.len = t->s.len;
 				rt->cnt = cnt;
@@ -278,14 +446,19 @@ dpl_dyn_pcre_p dpl_dynamic_pcre_list(sip_msg_t *msg, str *expr)
 					expr->len, expr->s);
 			goto error;
 		}
-		re = dpl_dyn_pcre_comp(msg, expr, &vexpr, &cnt);
+		re = dpl_dyn_pcre_get(msg, expr, &vexpr, &cnt, &ce);
 		if(re != NULL) {
 			rt = pkg_malloc(sizeof(dpl_dyn_pcre_t));
 			if(rt == NULL) {
 				PKG_MEM_ERROR;
+				if(ce)
+					ce->refcnt--;
+				else
+					pcre2_code_free(re);
 				goto error;
 			}
 			rt->re = re;
+			rt->cache = ce;
 			rt->expr.s = expr->s;
 			rt->expr.len = expr->len;
 			rt->cnt = cnt;
@@ -297,9 +470,7 @@ dpl_dyn_pcre_p dpl_dynamic_pcre_list(sip_msg_t *msg, str *expr)
 error:
 	while(re_list) {
 		rt = re_list->next;
-		if(re_list->re)
-			pcre2_code_free(re_list->re);
-		pkg_free(re_list);
+		dpl_dyn_pcre_free(re_list);
 		re_list = rt;
 	}
 clean:
@@ -601,6 +772,7 @@ int dp_translate_helper(
 	static pcre2_match_data *pcre_md = NULL;
 	dpl_node_p rulep;
 	dpl_index_p indexp;
+	dpl_cursor_t cur;
 	int user_len, rez;
 	char b;
 	dpl_dyn_pcre_p re_list = NULL;
@@ -630,7 +802,8 @@ int dp_translate_helper(
 	}
 
 search_rule:
-	for(rulep = indexp->first_rule; rulep != NULL; rulep = rulep->next) {
+	dpl_cursor_init(&cur, indexp, input);
+	while((rulep = dpl_cursor_next(&cur)) != NULL) {
 		switch(rulep->matchop) {
 
 			case DP_REGEX_OP:
@@ -656,8 +829,7 @@ search_rule:
 							LM_DBG("match check skipped: [%.*s] %d\n",
 									re_list->expr.len, re_list->expr.s, rez);
 						rt = re_list->next;
-						pcre2_code_free(re_list->re);
-						pkg_free(re_list);
+						dpl_dyn_pcre_free(re_list);
 						re_list = rt;
 					} while(re_list);
 				} else {
@@ -752,8 +924,7 @@ repl:
 				LM_DBG("subst check skipped: [%.*s] %d\n", re_list->expr.len,
 						re_list->expr.s, rez);
 			rt = re_list->next;
-			pcre2_code_free(re_list->re);
-			pkg_free(re_list);
+			dpl_dyn_pcre_free(re_list);
 			re_list = rt;
 		} while(re_list);
 		if(rez < 0) {
@@ -58,6 +58,7 @@
 #include "../../core/kemi.h"
 #include "../../core/fmsg.h"
 #include "../../core/rand/ksrxrand.h"
+#include "../../core/hashes.h"
 
 #include "ds_ht.h"
 #include "api.h"
@@ -83,6 +84,7 @@
 #define DS_ALG_PARALLEL 12
 #define DS_ALG_LATENCY 13
 #define DS_ALG_RRSERIAL 14
+#define DS_ALG_CHASH 15
 #define DS_ALG_OVERLOAD 64 /* 2^6 - can be also used as a flag */
 
 #define DS_HN_SIZE 256
@@ -120,6 +122,10 @@ extern int ds_force_dst;
 extern str ds_event_callback;
 extern int ds_ping_latency_stats;
 extern int ds_ping_fr_timeout;
+extern int ds_ping_interval;
+extern int ds_ping_spread;
+extern int ds_ping_jitter;
+extern int ds_ping_max_inflight;
 extern int ds_retain_latency_stats;
 extern float ds_latency_estimator_alpha;
 extern int ds_attrs_none;
@@ -134,6 +140,20 @@ static db1_con_t *ds_db_handle = NULL;
 
 static ds_set_t **ds_lists = NULL;
 
+/* index of destinations by ip address, one per list */
+typedef struct _ds_addr_item {
+	ds_set_t *node; /* destination set */
+	int idx;		/* position of destination in set */
+} ds_addr_item_t;
+
+typedef struct _ds_addr_index {
+	unsigned int size;		/* number of slots (power of 2) */
+	unsigned int *slots;	/* start of each slot in items (size+1) */
+	ds_addr_item_t *items;	/* destinations grouped by slot */
+} ds_addr_index_t;
+
+static ds_addr_index_t **ds_addr_idx = NULL;
+
 static int *ds_list_nr = NULL;
 static int *ds_crt_idx = NULL;
 static int *ds_next_idx = NULL;
@@ -149,10 +169,12 @@ void ds_rctx_set_uri(ds_rctx_t *rctx, str *uri);
 static void ds_run_route(
 		struct sip_msg *msg, str *uri, char *route, ds_rctx_t *rctx);
 
-void shuffle_uint100array(unsigned int *arr);
 void shuffle_char100array(char *arr);
 int ds_reinit_rweight_on_state_change(
 		int old_state, int new_state, ds_set_t *dset);
+int ds_reinit_chash_on_state_change(
+		int old_state, int new_state, ds_set_t *dset);
+int ds_addr_index_build(int lidx);
 
 /**
  *
@@ -304,9 +326,17 @@ int ds_init_data(void)
 	}
 	memset(ds_lists, 0, 2 * sizeof(ds_set_t *));
 
+	ds_addr_idx = (ds_addr_index_t **)shm_malloc(2 * sizeof(ds_addr_index_t *));
+	if(!ds_addr_idx) {
+		shm_free(ds_lists);
+		SHM_MEM_ERROR;
+		return -1;
+	}
+	memset(ds_addr_idx, 0, 2 * sizeof(ds_addr_index_t *));
 
 	p = (int *)shm_malloc(3 * sizeof(int));
 	if(!p) {
+		shm_free(ds_addr_idx);
 		shm_free(ds_lists);
 		SHM_MEM_ERROR;
 		return -1;
@@ -367,12 +397,12 @@ int ds_set_attrs(ds_dest_t *dest, str *vattrs)
 				  && strncasecmp(pit->name.s, "weight", 6) == 0) {
 			tmp_ival = 0;
 			str2sint(&pit->body, &tmp_ival);
-			if(tmp_ival >= 1 && tmp_ival <= 100) {
+			if(tmp_ival >= 1 && tmp_ival <= DS_WEIGHT_MAX) {
 				dest->attrs.weight = tmp_ival;
 			} else {
 				dest->attrs.weight = 0;
-				LM_ERR("weight %d not in 1-100 range - ignoring destination\n",
-						tmp_ival);
+				LM_ERR("weight %d not in 1-%d range - ignoring destination\n",
+						tmp_ival, DS_WEIGHT_MAX);
 			}
 		} else if(pit->name.len == 7
 				  && strncasecmp(pit->name.s, "latency", 7) == 0) {
@@ -396,11 +426,12 @@ int ds_set_attrs(ds_dest_t *dest, str *vattrs)
 				  && strncasecmp(pit->name.s, "rweight", 7) == 0) {
 			tmp_ival = 0;
 			str2sint(&pit->body, &tmp_ival);
-			if(tmp_ival >= 1 && tmp_ival <= 100) {
+			if(tmp_ival >= 1 && tmp_ival <= DS_WEIGHT_MAX) {
 				dest->attrs.rweight = tmp_ival;
 			} else {
 				dest->attrs.rweight = 0;
-				LM_WARN("rweight %d not in 1-100 range - ignoring\n", tmp_ival);
+				LM_WARN("rweight %d not in 1-%d range - ignoring\n", tmp_ival,
+						DS_WEIGHT_MAX);
 			}
 		} else if(pit->name.len == 9
 				  && strncasecmp(pit->name.s, "ping_from", 9) == 0) {
@@ -769,6 +800,7 @@ ds_dest_t *add_dest2list(int id, str uri, int flags, int priority, str *attrs,
 		dp->latency_stats.estimate = latency_stats->estimate;
 		dp->latency_stats.count = latency_stats->count;
 		dp->latency_stats.timeout = latency_stats->timeout;
+		dp->latency_stats.failed = latency_stats->failed;
 	}
 
 	sp = ds_avl_insert(&ds_lists[list_idx], id, setn);
@@ -822,11 +854,11 @@ error:
 
 
 /* for internal usage; arr must be arr[100] */
-void shuffle_uint100array(unsigned int *arr)
+void shuffle_char100array(char *arr)
 {
 	int k;
 	int j;
-	unsigned int t;
+	char t;
 	if(arr == NULL)
 		return;
 	for(j = 0; j < 100; j++) {
@@ -838,159 +870,411 @@ void shuffle_uint100array(unsigned int *arr)
 }
 
 
-/* for internal usage; arr must be arr[100] */
-void shuffle_char100array(char *arr)
+/**
+ * Build the alias table (Vose method) for the weights of a destination set
+ * - the table has one column per destination, each column keeps its own
+ *   index with probability 'prob' (scaled to KSR_XRAND_MAX+1) or gives
+ *   the 'alias' index otherwise, so a selection costs two random numbers
+ * - weights can be any integer value, a destination with weight 0 is
+ *   never selected
+ * - return the number of columns, 0 if the sum of weights is 0, or -1
+ *   on error
+ */
+static int ds_walias_build(
+		unsigned int *weight, int nr, unsigned int *prob, unsigned int *alias)
 {
-	int k;
+	unsigned long long *scaled = NULL;
+	unsigned long long sum;
+	int *small = NULL;
+	int *large = NULL;
+	int ns;
+	int nl;
+	int s;
+	int l;
 	int j;
-	char t;
-	if(arr == NULL)
-		return;
-	for(j = 0; j < 100; j++) {
-		k = j + (ksr_xrand() % (100 - j));
-		t = arr[j];
-		arr[j] = arr[k];
-		arr[k] = t;
+
+	sum = 0;
+	for(j = 0; j < nr; j++)
+		sum += weight[j];
+	if(sum == 0)
+		return 0;
+
+	scaled = (unsigned long long *)pkg_malloc(
+			nr * (sizeof(unsigned long long) + 2 * sizeof(int)));
+	if(scaled == NULL) {
+		PKG_MEM_ERROR;
+		return -1;
 	}
+	small = (int *)(scaled + nr);
+	large = small + nr;
+
+	ns = nl = 0;
+	for(j = 0; j < nr; j++) {
+		/* probability of the column relative to 'sum' */
+		scaled[j] = (unsigned long long)weight[j] * nr;
+		if(scaled[j] < sum)
+			small[ns++] = j;
+		else
+			large[nl++] = j;
+	}
+	while(ns > 0 && nl > 0) {
+		s = small[--ns];
+		l = large[nl - 1];
+		prob[s] = (unsigned int)((double)scaled[s] / (double)sum
+								 * ((double)KSR_XRAND_MAX + 1.0));
+		alias[s] = (unsigned int)l;
+		scaled[l] -= sum - scaled[s];
+		if(scaled[l] < sum) {
+			nl--;
+			small[ns++] = l;
+		}
+	}
+	/* left columns are full (or rounding leftovers) */
+	while(nl > 0) {
+		l = large[--nl];
+		prob[l] = (unsigned int)KSR_XRAND_MAX + 1;
+		alias[l] = (unsigned int)l;
+	}
+	while(ns > 0) {
+		s = small[--ns];
+		prob[s] = (unsigned int)KSR_XRAND_MAX + 1;
+		alias[s] = (unsigned int)s;
+	}
+
+	pkg_free(scaled);
+	return nr;
+}
+
+/**
+ * Select a destination index using the alias table
+ */
+static inline unsigned int ds_walias_select(ds_walias_t *wa)
+{
+	unsigned int c;
+
+	if(wa->n == 0)
+		return 0;
+	c = (unsigned int)ksr_xrand() % wa->n;
+	if((unsigned int)ksr_xrand() < wa->prob[c])
+		return c;
+	return wa->alias[c];
 }
 
+/**
+ * Allocate the alias tables of a destination set
+ */
+static int ds_walias_alloc(ds_set_t *dset)
+{
+	unsigned int *p;
+
+	p = (unsigned int *)shm_malloc(4 * dset->nr * sizeof(unsigned int));
+	if(p == NULL) {
+		SHM_MEM_ERROR;
+		return -1;
+	}
+	memset(p, 0, 4 * dset->nr * sizeof(unsigned int));
+	dset->wtable.n = 0;
+	dset->wtable.prob = p;
+	dset->wtable.alias = p + dset->nr;
+	dset->rwtable.n = 0;
+	dset->rwtable.prob = p + 2 * dset->nr;
+	dset->rwtable.alias = p + 3 * dset->nr;
+	return 0;
+}
 
 /**
  * Initialize the relative weight distribution for a destination set
- * - fill the array of 0..99 elements where to keep the index of the
- *   destination address to be used. The Nth call will use
- *   the address with the index at possition N%100
+ * - build the alias table with the relative weights of the active
+ *   destinations, the inactive ones are never selected
  */
 int dp_init_relative_weights(ds_set_t *dset)
 {
 	int j;
-	int k;
-	int t;
-	int *ds_dests_flags = NULL;
-	int *ds_dests_rweights = NULL;
-	int current_slice;
-	int rw_sum;
-	unsigned int last_insert;
+	int n;
+	unsigned int *buf = NULL;
 
-	if(dset == NULL || dset->dlist == NULL || dset->nr < 2)
+	if(dset == NULL || dset->dlist == NULL || dset->nr < 2
+			|| dset->rwtable.prob == NULL)
 		return -1;
 
 	/* local copy to avoid synchronization problems */
-	ds_dests_flags = pkg_malloc(sizeof(int) * dset->nr);
-	if(ds_dests_flags == NULL) {
-		PKG_MEM_ERROR;
-		return -1;
-	}
-	ds_dests_rweights = pkg_malloc(sizeof(int) * dset->nr);
-	if(ds_dests_rweights == NULL) {
+	buf = pkg_malloc(3 * dset->nr * sizeof(unsigned int));
+	if(buf == NULL) {
 		PKG_MEM_ERROR;
-		pkg_free(ds_dests_flags);
 		return -1;
 	}
 
-
-	/* needed to sync the rwlist access */
-	lock_get(&dset->lock);
-	rw_sum = 0;
-	/* find the sum of relative weights */
 	for(j = 0; j < dset->nr; j++) {
-		ds_dests_flags[j] = dset->dlist[j].flags;
-		ds_dests_rweights[j] = dset->dlist[j].attrs.rweight;
-		if(ds_skip_dst(ds_dests_flags[j]))
-			continue;
-		rw_sum += ds_dests_rweights[j];
-	}
-
-	if(rw_sum == 0)
-		goto ret;
-
-	/* fill the array based on the relative weight of each destination */
-	t = 0;
-	for(j = 0; j < dset->nr; j++) {
-		if(ds_skip_dst(ds_dests_flags[j]))
-			continue;
-
-		current_slice = ds_dests_rweights[j] * 100 / rw_sum; /* truncate here */
-		LM_DBG("rw_sum[%d][%d][%d]\n", j, rw_sum, current_slice);
-		for(k = 0; k < current_slice; k++) {
-			dset->rwlist[t] = (unsigned int)j;
-			t++;
+		if(ds_skip_dst(dset->dlist[j].flags)
+				|| dset->dlist[j].attrs.rweight <= 0) {
+			buf[j] = 0;
+		} else {
+			buf[j] = (unsigned int)dset->dlist[j].attrs.rweight;
 		}
 	}
-
-	/* if the array was not completely filled (i.e., the sum of rweights is
-	 * less than 100 due to truncated), then use last address to fill the rest */
-	last_insert = t > 0 ? dset->rwlist[t - 1] : (unsigned int)(dset->nr - 1);
-	if(t < 100) {
-		LM_INFO("extra rweight %d for last active destination in group %d\n",
-				(100 - t), dset->id);
+	n = ds_walias_build(buf, dset->nr, buf + dset->nr, buf + 2 * dset->nr);
+	if(n < 0) {
+		pkg_free(buf);
+		return -1;
 	}
-	for(j = t; j < 100; j++)
-		dset->rwlist[j] = last_insert;
 
-	/* shuffle the content of the array in order to mix the selection
-	 * of the addresses (e.g., if first address has weight=20, avoid
-	 * sending first 20 calls to it, but ensure that within a 100 calls,
-	 * 20 go to first address */
-	shuffle_uint100array(dset->rwlist);
-	goto ret;
-
-ret:
+	/* needed to sync the rwtable access */
+	lock_get(&dset->lock);
+	if(n > 0) {
+		memcpy(dset->rwtable.prob, buf + dset->nr,
+				dset->nr * sizeof(unsigned int));
+		memcpy(dset->rwtable.alias, buf + 2 * dset->nr,
+				dset->nr * sizeof(unsigned int));
+	}
+	dset->rwtable.n = (unsigned int)n;
 	lock_release(&dset->lock);
-	pkg_free(ds_dests_flags);
-	pkg_free(ds_dests_rweights);
+
+	pkg_free(buf);
 	return 0;
 }
 
 
 /**
  * Initialize the weight distribution for a destination set
- * - fill the array of 0..99 elements where to keep the index of the
- *   destination address to be used. The Nth call will use
- *   the address with the index at possition N%100
+ * - build the alias table with the weights of the destinations
+ * - if the sum of weights is less than 100, the difference is added to the
+ *   last address, keeping the weight as percentage, otherwise the
+ *   destinations are selected proportionally to their weights
  */
 int dp_init_weights(ds_set_t *dset)
 {
 	int j;
-	int k;
-	int t;
+	int n;
+	unsigned long long sum;
+	unsigned int *buf = NULL;
 
-	if(dset == NULL || dset->dlist == NULL)
+	if(dset == NULL || dset->dlist == NULL || dset->wtable.prob == NULL)
 		return -1;
 
 	/* is weight set for dst list? (first address must have weight!=0) */
 	if(dset->dlist[0].attrs.weight == 0)
 		return 0;
 
-	/* first fill the array based on the weight of each destination
-	 * - the weight is the percentage (e.g., if weight=20, the afferent
-	 *   address gets its index 20 times in the array)
-	 * - if the sum of weights is more than 100, the addresses over the
-	 *   limit are ignored */
-	t = 0;
+	buf = pkg_malloc(dset->nr * sizeof(unsigned int));
+	if(buf == NULL) {
+		PKG_MEM_ERROR;
+		return -1;
+	}
+	sum = 0;
 	for(j = 0; j < dset->nr; j++) {
-		for(k = 0; k < dset->dlist[j].attrs.weight; k++) {
-			if(t >= 100)
-				goto randomize;
-			dset->wlist[t] = (unsigned int)j;
-			t++;
+		buf[j] = (dset->dlist[j].attrs.weight > 0)
+						 ? (unsigned int)dset->dlist[j].attrs.weight
+						 : 0;
+		sum += buf[j];
+	}
+	if(sum < 100) {
+		LM_INFO("extra weight %u for last destination in group %d\n",
+				(unsigned int)(100 - sum), dset->id);
+		buf[dset->nr - 1] += (unsigned int)(100 - sum);
+	}
+	n = ds_walias_build(buf, dset->nr, dset->wtable.prob, dset->wtable.alias);
+	pkg_free(buf);
+	if(n < 0)
+		return -1;
+	dset->wtable.n = (unsigned int)n;
+
+	return 0;
+}
+
+/* prime sizes for the consistent hashing lookup table */
+static unsigned int _ds_chash_sizes[] = {
+		251, 509, 1021, 2039, 4093, 8191, 16381, 32749, 65521, 0};
+
+#define DS_CHASH_NONE ((unsigned int)-1)
+
+/**
+ * mix the bits of a hash value before mapping it to the lookup table
+ */
+static inline unsigned int ds_chash_mix(unsigned int h)
+{
+	h ^= h >> 16;
+	h *= 0x85ebca6bU;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35U;
+	h ^= h >> 16;
+	return h;
+}
+
+/**
+ * Fill the consistent hashing lookup table (Maglev) of a destination set
+ * - each active destination walks its own permutation of the table slots,
+ *   derived from the hash of its address, and takes the first free slot
+ *   at each turn, getting turns proportionally to its weight
+ * - a destination going down frees only its slots, which are then taken
+ *   by the others, so the keys mapped to the other addresses are kept
+ * - return the number of destinations in the table or -1 on error
+ */
+static int ds_chash_fill(ds_set_t *dset, unsigned int *tbl)
+{
+	unsigned int *pos = NULL;
+	unsigned int *skip = NULL;
+	unsigned int *weight = NULL;
+	unsigned int *credit = NULL;
+	unsigned int wmax;
+	unsigned int filled;
+	unsigned int h;
+	int nr;
+	int n;
+	int j;
+
+	for(filled = 0; filled < dset->chsize; filled++)
+		tbl[filled] = DS_CHASH_NONE;
+
+	nr = dset->nr;
+	if(ds_use_default != 0 && nr > 1)
+		nr--;
+
+	pos = (unsigned int *)pkg_malloc(4 * nr * sizeof(unsigned int));
+	if(pos == NULL) {
+		PKG_MEM_ERROR;
+		return -1;
+	}
+	skip = pos + nr;
+	weight = skip + nr;
+	credit = weight + nr;
+
+	n = 0;
+	wmax = 0;
+	for(j = 0; j < nr; j++) {
+		credit[j] = 0;
+		if(ds_skip_dst(dset->dlist[j].flags)) {
+			weight[j] = 0;
+			continue;
+		}
+		weight[j] = (dset->dlist[j].attrs.weight > 0)
+							? (unsigned int)dset->dlist[j].attrs.weight
+							: 1;
+		if(weight[j] > wmax)
+			wmax = weight[j];
+		h = ds_get_hash(&dset->dlist[j].uri, NULL);
+		pos[j] = ds_chash_mix(h) % dset->chsize;
+		skip[j] = ds_chash_mix(h ^ 0x9e3779b9U) % (dset->chsize - 1) + 1;
+		n++;
+	}
+	if(n == 0)
+		goto done;
+
+	filled = 0;
+	while(filled < dset->chsize) {
+		for(j = 0; j < nr && filled < dset->chsize; j++) {
+			if(weight[j] == 0)
+				continue;
+			credit[j] += weight[j];
+			while(credit[j] >= wmax && filled < dset->chsize) {
+				credit[j] -= wmax;
+				while(tbl[pos[j]] != DS_CHASH_NONE)
+					pos[j] = (pos[j] + skip[j]) % dset->chsize;
+				tbl[pos[j]] = (unsigned int)j;
+				filled++;
+			}
 		}
 	}
-	/* if the array was not completely filled (i.e., the sum of weights is
-	 * less than 100), then use last address to fill the rest */
-	if(t < 100) {
-		LM_INFO("extra weight %d for last destination in group %d\n", (100 - t),
-				dset->id);
-	}
-	for(; t < 100; t++)
-		dset->wlist[t] = (unsigned int)(dset->nr - 1);
-randomize:
-	/* shuffle the content of the array in order to mix the selection
-	 * of the addresses (e.g., if first address has weight=20, avoid
-	 * sending first 20 calls to it, but ensure that within a 100 calls,
-	 * 20 go to first address */
-	shuffle_uint100array(dset->wlist);
 
+done:
+	pkg_free(pos);
+	return n;
+}
+
+/**
+ * Build the consistent hashing lookup table for a new destination set
+ * - if the set exists in the list in use, the remapped slots are counted
+ *   by comparing the addresses, to reflect the effect of the reload
+ */
+static int ds_chash_init(ds_set_t *dset, ds_set_t *oset)
+{
+	unsigned int moved;
+	unsigned int k;
+	int n;
+	int i;
+
+	for(k = 0; _ds_chash_sizes[k + 1] != 0; k++) {
+		if(_ds_chash_sizes[k] >= 100 * (unsigned int)dset->nr)
+			break;
+	}
+	dset->chsize = _ds_chash_sizes[k];
+	dset->chlist =
+			(unsigned int *)shm_malloc(dset->chsize * sizeof(unsigned int));
+	if(dset->chlist == NULL) {
+		SHM_MEM_ERROR;
+		return -1;
+	}
+	n = ds_chash_fill(dset, dset->chlist);
+	if(n < 0)
+		return -1;
+	dset->chnr = (unsigned int)n;
+
+	if(oset == NULL || oset->chlist == NULL)
+		return 0;
+
+	moved = 0;
+	lock_get(&oset->lock);
+	for(k = 0; k < dset->chsize; k++) {
+		i = (k < oset->chsize) ? (int)oset->chlist[k] : -1;
+		if(dset->chlist[k] == DS_CHASH_NONE || i < 0 || i >= oset->nr) {
+			if(dset->chlist[k] != DS_CHASH_NONE || i >= 0)
+				moved++;
+			continue;
+		}
+		if(oset->dlist[i].uri.len != dset->dlist[dset->chlist[k]].uri.len
+				|| strncasecmp(oset->dlist[i].uri.s,
+						   dset->dlist[dset->chlist[k]].uri.s,
+						   oset->dlist[i].uri.len)
+						   != 0)
+			moved++;
+	}
+	dset->chrebuilds = oset->chrebuilds + 1;
+	dset->chmovedsum = oset->chmovedsum + moved;
+	lock_release(&oset->lock);
+	dset->chmoved = moved;
+
+	return 0;
+}
+
+/**
+ * Rebuild the consistent hashing lookup table after a state change
+ */
+int ds_chash_rebuild(ds_set_t *dset)
+{
+	unsigned int *tbl = NULL;
+	unsigned int moved;
+	unsigned int k;
+	int n;
+
+	if(dset == NULL || dset->chlist == NULL)
+		return -1;
+
+	tbl = (unsigned int *)pkg_malloc(dset->chsize * sizeof(unsigned int));
+	if(tbl == NULL) {
+		PKG_MEM_ERROR;
+		return -1;
+	}
+	n = ds_chash_fill(dset, tbl);
+	if(n < 0) {
+		pkg_free(tbl);
+		return -1;
+	}
+
+	lock_get(&dset->lock);
+	moved = 0;
+	for(k = 0; k < dset->chsize; k++) {
+		if(dset->chlist[k] != tbl[k])
+			moved++;
+	}
+	memcpy(dset->chlist, tbl, dset->chsize * sizeof(unsigned int));
+	dset->chnr = (unsigned int)n;
+	dset->chrebuilds++;
+	dset->chmoved = moved;
+	dset->chmovedsum += moved;
+	lock_release(&dset->lock);
+
+	LM_DBG("set %d - remapped %u of %u slots\n", dset->id, moved,
+			dset->chsize);
+	pkg_free(tbl);
 	return 0;
 }
 
@@ -1034,8 +1318,13 @@ int reindex_dests(ds_set_t *node)
 		dp = NULL;
 	}
 	node->dlist = dp0;
+	if(ds_walias_alloc(node) != 0)
+		goto err1;
 	dp_init_weights(node);
 	dp_init_relative_weights(node);
+	if(ds_chash_init(node, ds_avl_find(ds_lists[*ds_crt_idx], node->id))
+			!= 0)
+		goto err1;
 
 	return 0;
 
@@ -1164,7 +1453,8 @@ int ds_load_list(char *lfile)
 		p = fgets(line, 1024, f);
 	}
 
-	if(reindex_dests(ds_lists[*ds_next_idx]) != 0) {
+	if(reindex_dests(ds_lists[*ds_next_idx]) != 0
+			|| ds_addr_index_build(*ds_next_idx) != 0) {
 		LM_ERR("error on reindex\n");
 		goto error;
 	}
@@ -1422,7 +1712,8 @@ int ds_load_db(void)
 			}
 		}
 	}
-	if(reindex_dests(ds_lists[*ds_next_idx]) != 0) {
+	if(reindex_dests(ds_lists[*ds_next_idx]) != 0
+			|| ds_addr_index_build(*ds_next_idx) != 0) {
 		LM_ERR("error on reindex\n");
 		goto err2;
 	}
@@ -1457,6 +1748,13 @@ int ds_destroy_list(void)
 		ds_avl_destroy(&ds_lists[1]);
 		shm_free(ds_lists);
 	}
+	if(ds_addr_idx) {
+		if(ds_addr_idx[0])
+			shm_free(ds_addr_idx[0]);
+		if(ds_addr_idx[1])
+			shm_free(ds_addr_idx[1]);
+		shm_free(ds_addr_idx);
+	}
 
 	if(ds_crt_idx)
 		shm_free(ds_crt_idx);
@@ -2677,10 +2975,7 @@ int ds_manage_routes(sip_msg_t *msg, ds_select_state_t *rstate)
 			hash = 0;
 			break;
 		case DS_ALG_WEIGHT: /* 9 - weight based distribution */
-			lock_get(&idx->lock);
-			hash = idx->wlist[idx->wlast];
-			idx->wlast = (idx->wlast + 1) % 100;
-			lock_release(&idx->lock);
+			hash = ds_walias_select(&idx->wtable);
 			break;
 		case DS_ALG_CALLLOAD: /* 10 - call load based distribution */
 			/* only INVITE can start a call */
@@ -2711,13 +3006,23 @@ int ds_manage_routes(sip_msg_t *msg, ds_select_state_t *rstate)
 			break;
 		case DS_ALG_RELWEIGHT: /* 11 - relative weight based distribution */
 			lock_get(&idx->lock);
-			hash = idx->rwlist[idx->rwlast];
-			idx->rwlast = (idx->rwlast + 1) % 100;
+			hash = ds_walias_select(&idx->rwtable);
 			lock_release(&idx->lock);
 			break;
 		case DS_ALG_PARALLEL: /* 12 - parallel dispatching */
 			hash = 0;
 			break;
+		case DS_ALG_CHASH: /* 15 - consistent hashing on PV value */
+			if(ds_hash_pvar(msg, &hash) != 0) {
+				LM_ERR("can't get PV hash\n");
+				return -1;
+			}
+			lock_get(&idx->lock);
+			if(idx->chnr > 0) {
+				hash = idx->chlist[ds_chash_mix(hash) % idx->chsize];
+			}
+			lock_release(&idx->lock);
+			break;
 		case DS_ALG_LATENCY: /* 13 - latency optimized round-robin with failover */
 			lock_get(&idx->lock);
 			hash = ds_manage_route_algo13(idx, rstate);
@@ -2956,7 +3261,8 @@ int ds_add_dst(int group, str *address, int flags, int priority, str *attrs)
 		}
 	}
 
-	if(reindex_dests(ds_lists[*ds_next_idx]) != 0) {
+	if(reindex_dests(ds_lists[*ds_next_idx]) != 0
+			|| ds_addr_index_build(*ds_next_idx) != 0) {
 		LM_ERR("error on reindex\n");
 		goto error;
 	}
@@ -3027,7 +3333,8 @@ int ds_remove_dst(int group, str *address)
 	// add existing destinations except destination that matches group & address
 	ds_iter_set(_ds_list, &ds_filter_dest_cb, &filter_arg);
 
-	if(reindex_dests(ds_lists[*ds_next_idx]) != 0) {
+	if(reindex_dests(ds_lists[*ds_next_idx]) != 0
+			|| ds_addr_index_build(*ds_next_idx) != 0) {
 		LM_ERR("error on reindex\n");
 		goto error;
 	}
@@ -3271,6 +3578,9 @@ int ds_update_latency(int group, str *address, int code)
 			}
 			if(code == 408 && latency_stats->timeout < UINT32_MAX)
 				latency_stats->timeout++;
+			if(!(code >= 200 && code <= 299) && !ds_ping_check_rplcode(code)
+					&& latency_stats->failed < UINT32_MAX)
+				latency_stats->failed++;
 
 			if(latency_stats->start.tv_sec == 0
 					&& latency_stats->start.tv_usec == 0) {
@@ -3488,6 +3798,8 @@ int ds_update_state(sip_msg_t *msg, int group, str *address, int state,
 			if(idx->dlist[i].attrs.rweight > 0)
 				ds_reinit_rweight_on_state_change(
 						old_state, idx->dlist[i].flags, idx);
+			ds_reinit_chash_on_state_change(
+					old_state, idx->dlist[i].flags, idx);
 
 			LM_DBG("old state was %d, set new state to %d\n", old_state,
 					idx->dlist[i].flags);
@@ -3619,6 +3931,23 @@ int ds_reinit_rweight_on_state_change(
 }
 
 
+/**
+ * rebuild consistent hashing table if some destination state was changed
+ */
+int ds_reinit_chash_on_state_change(
+		int old_state, int new_state, ds_set_t *dset)
+{
+	if(dset == NULL) {
+		LM_ERR("destination set is null\n");
+		return -1;
+	}
+	if(!ds_skip_dst(old_state) != !ds_skip_dst(new_state)) {
+		return ds_chash_rebuild(dset);
+	}
+
+	return 0;
+}
+
 /**
  *
  */
@@ -3651,6 +3980,8 @@ int ds_reinit_state(int group, str *address, int state)
 				ds_reinit_rweight_on_state_change(
 						old_state, idx->dlist[i].flags, idx);
 			}
+			ds_reinit_chash_on_state_change(
+					old_state, idx->dlist[i].flags, idx);
 
 			return 0;
 		}
@@ -3692,6 +4023,8 @@ int ds_reinit_duid_state(int group, str *vduid, int state)
 				ds_reinit_rweight_on_state_change(
 						old_state, idx->dlist[i].flags, idx);
 			}
+			ds_reinit_chash_on_state_change(
+					old_state, idx->dlist[i].flags, idx);
 
 			return 0;
 		}
@@ -3707,6 +4040,7 @@ int ds_reinit_duid_state(int group, str *vduid, int state)
 int ds_reinit_state_all(int group, int state)
 {
 	int i = 0;
+	int chchanged = 0;
 	ds_set_t *idx = NULL;
 
 	if(_ds_list == NULL || _ds_list_nr <= 0) {
@@ -3730,7 +4064,11 @@ int ds_reinit_state_all(int group, int state)
 			ds_reinit_rweight_on_state_change(
 					old_state, idx->dlist[i].flags, idx);
 		}
+		if(!ds_skip_dst(old_state) != !ds_skip_dst(idx->dlist[i].flags))
+			chchanged = 1;
 	}
+	if(chchanged)
+		ds_chash_rebuild(idx);
 	return 0;
 }
 
@@ -3823,6 +4161,200 @@ static int ds_set_vars(
 	return 1;
 }
 
+/**
+ * Check if the destination at position idx in the set is matching the
+ * address attributes
+ * - return 0 if not matching, otherwise the result of setting the vars
+ */
+static int ds_is_addr_match(sip_msg_t *_m, ip_addr_t *ipa,
+		struct ip_addr *pipaddr, unsigned short tport, unsigned short tproto,
+		ds_set_t *node, int j, int mode, int export_set_pv)
+{
+	int node_strictness;
+
+	if(ip_addr_cmp(pipaddr, ipa)
+			&& ((mode & DS_MATCH_NOPORT) || node->dlist[j].port == 0
+					|| tport == node->dlist[j].port
+					|| (mode & DS_MATCH_MIXSOCKPRPORT))
+			&& ((mode & DS_MATCH_NOPROTO) || tproto == node->dlist[j].proto
+					|| (mode & DS_MATCH_MIXSOCKPRPORT))
+			&& (((mode & DS_MATCH_ACTIVE) && !ds_skip_dst(node->dlist[j].flags))
+					|| !(mode & DS_MATCH_ACTIVE))
+			&& (((mode & DS_MATCH_SOCKET)
+						&& node->dlist[j].sock == _m->rcv.bind_address)
+					|| !node->dlist[j].sock || !(mode & DS_MATCH_SOCKET))) {
+
+		if(mode & DS_MATCH_MIXSOCKPRPORT) {
+			node_strictness = DS_MATCHED_ADDR;
+			if(node->dlist[j].port) {
+				if(tport == node->dlist[j].port) {
+					node_strictness |= DS_MATCHED_PORT;
+				}
+			}
+
+			if(node->dlist[j].proto) {
+				if(tproto == node->dlist[j].proto) {
+					node_strictness |= DS_MATCHED_PROTO;
+				}
+			}
+
+			if(node->dlist[j].sock) {
+				if(node->dlist[j].sock == _m->rcv.bind_address) {
+					node_strictness |= DS_MATCHED_SOCK;
+				}
+			}
+
+			if(node_strictness
+					== (DS_MATCHED_ADDR | DS_MATCHED_PORT | DS_MATCHED_PROTO
+							| DS_MATCHED_SOCK)) {
+				ds_strictest_match = node_strictness;
+				ds_strictest_node = node;
+				ds_strictest_idx = j;
+				return ds_set_vars(_m, node, j, export_set_pv);
+			}
+
+			if(ds_strictest_match < node_strictness) {
+				ds_strictest_match = node_strictness;
+				ds_strictest_node = node;
+				ds_strictest_idx = j;
+			}
+			return 0;
+		}
+
+		return ds_set_vars(_m, node, j, export_set_pv);
+	}
+	return 0;
+}
+
+/**
+ * hash slot of an ip address in the destinations index
+ */
+static inline unsigned int ds_addr_index_slot(
+		ds_addr_index_t *dai, struct ip_addr *ip)
+{
+	return core_hash_idx(
+			get_hash1_raw((const char *)ip->u.addr, ip->len), dai->size);
+}
+
+/**
+ * walk the sets in the same order as ds_is_addr_from_set_r()
+ * - if dai is NULL, only count the destinations with ip address
+ * - if pos is NULL, count the destinations per slot in dai->slots[k+1]
+ * - otherwise add the destinations at pos[k] in slot k
+ */
+static int ds_addr_index_walk(
+		ds_set_t *node, ds_addr_index_t *dai, unsigned int *pos)
+{
+	int i;
+	int n = 0;
+	unsigned int k;
+
+	if(!node)
+		return 0;
+
+	for(i = 0; i < 2; ++i)
+		n += ds_addr_index_walk(node->next[i], dai, pos);
+
+	for(i = 0; i < node->nr; i++) {
+		if(node->dlist[i].irmode & DS_IRMODE_NOIPADDR)
+			continue;
+		n++;
+		if(dai == NULL)
+			continue;
+		k = ds_addr_index_slot(dai, &node->dlist[i].ip_address);
+		if(pos == NULL) {
+			dai->slots[k + 1]++;
+		} else {
+			dai->items[pos[k]].node = node;
+			dai->items[pos[k]].idx = i;
+			pos[k]++;
+		}
+	}
+	return n;
+}
+
+/**
+ * build the index by ip address for the destinations in the list lidx
+ */
+int ds_addr_index_build(int lidx)
+{
+	ds_addr_index_t *dai = NULL;
+	unsigned int *pos = NULL;
+	unsigned int size;
+	unsigned int k;
+	int n;
+
+	if(ds_addr_idx[lidx] != NULL) {
+		shm_free(ds_addr_idx[lidx]);
+		ds_addr_idx[lidx] = NULL;
+	}
+
+	n = ds_addr_index_walk(ds_lists[lidx], NULL, NULL);
+	for(size = 16; size < (unsigned int)n; size <<= 1)
+		;
+
+	dai = (ds_addr_index_t *)shm_malloc(sizeof(ds_addr_index_t)
+										+ n * sizeof(ds_addr_item_t)
+										+ (size + 1) * sizeof(unsigned int));
+	if(dai == NULL) {
+		SHM_MEM_ERROR;
+		return -1;
+	}
+	dai->size = size;
+	dai->items = (ds_addr_item_t *)(dai + 1);
+	dai->slots = (unsigned int *)(dai->items + n);
+	memset(dai->slots, 0, (size + 1) * sizeof(unsigned int));
+
+	pos = (unsigned int *)pkg_malloc(size * sizeof(unsigned int));
+	if(pos == NULL) {
+		PKG_MEM_ERROR;
+		shm_free(dai);
+		return -1;
+	}
+
+	/* count the destinations per slot, then fill the slots keeping the
+	 * order of walking through sets, for same matching as the list scan */
+	ds_addr_index_walk(ds_lists[lidx], dai, NULL);
+	for(k = 0; k < size; k++)
+		dai->slots[k + 1] += dai->slots[k];
+	memcpy(pos, dai->slots, size * sizeof(unsigned int));
+	ds_addr_index_walk(ds_lists[lidx], dai, pos);
+	pkg_free(pos);
+
+	ds_addr_idx[lidx] = dai;
+	LM_DBG("indexed %d destinations in %u slots\n", n, size);
+	return 0;
+}
+
+/**
+ * Match the address attributes using the index of the list in use
+ * - same result as walking the sets, group -1 for all sets
+ */
+static int ds_is_addr_from_index(sip_msg_t *_m, struct ip_addr *pipaddr,
+		unsigned short tport, unsigned short tproto, int group, int mode,
+		int export_set_pv)
+{
+	ds_addr_index_t *dai;
+	ds_set_t *node;
+	unsigned int k;
+	unsigned int i;
+	int rc;
+
+	dai = ds_addr_idx[*ds_crt_idx];
+	k = ds_addr_index_slot(dai, pipaddr);
+	for(i = dai->slots[k]; i < dai->slots[k + 1]; i++) {
+		node = dai->items[i].node;
+		if(group != -1 && node->id != group)
+			continue;
+		rc = ds_is_addr_match(_m, &node->dlist[dai->items[i].idx].ip_address,
+				pipaddr, tport, tproto, node, dai->items[i].idx, mode,
+				export_set_pv);
+		if(rc != 0)
+			return rc;
+	}
+	return -1;
+}
+
 int ds_is_addr_from_set(sip_msg_t *_m, struct ip_addr *pipaddr,
 		unsigned short tport, unsigned short tproto, ds_set_t *node, int mode,
 		int export_set_pv)
@@ -3832,7 +4364,7 @@ int ds_is_addr_from_set(sip_msg_t *_m, struct ip_addr *pipaddr,
 	char hn[DS_HN_SIZE];
 	struct hostent *he;
 	int j;
-	int node_strictness;
+	int rc;
 	unsigned short sport = 0;
 	char sproto = PROTO_NONE;
 
@@ -3873,58 +4405,10 @@ int ds_is_addr_from_set(sip_msg_t *_m, struct ip_addr *pipaddr,
 				ipa = &ipaddress;
 			}
 		}
-		if(ip_addr_cmp(pipaddr, ipa)
-				&& ((mode & DS_MATCH_NOPORT) || node->dlist[j].port == 0
-						|| tport == node->dlist[j].port
-						|| (mode & DS_MATCH_MIXSOCKPRPORT))
-				&& ((mode & DS_MATCH_NOPROTO) || tproto == node->dlist[j].proto
-						|| (mode & DS_MATCH_MIXSOCKPRPORT))
-				&& (((mode & DS_MATCH_ACTIVE)
-							&& !ds_skip_dst(node->dlist[j].flags))
-						|| !(mode & DS_MATCH_ACTIVE))
-				&& (((mode & DS_MATCH_SOCKET)
-							&& node->dlist[j].sock == _m->rcv.bind_address)
-						|| !node->dlist[j].sock || !(mode & DS_MATCH_SOCKET))) {
-
-			if(mode & DS_MATCH_MIXSOCKPRPORT) {
-				node_strictness = DS_MATCHED_ADDR;
-				if(node->dlist[j].port) {
-					if(tport == node->dlist[j].port) {
-						node_strictness |= DS_MATCHED_PORT;
-					}
-				}
-
-				if(node->dlist[j].proto) {
-					if(tproto == node->dlist[j].proto) {
-						node_strictness |= DS_MATCHED_PROTO;
-					}
-				}
-
-				if(node->dlist[j].sock) {
-					if(node->dlist[j].sock == _m->rcv.bind_address) {
-						node_strictness |= DS_MATCHED_SOCK;
-					}
-				}
-
-				if(node_strictness
-						== (DS_MATCHED_ADDR | DS_MATCHED_PORT | DS_MATCHED_PROTO
-								| DS_MATCHED_SOCK)) {
-					ds_strictest_match = node_strictness;
-					ds_strictest_node = node;
-					ds_strictest_idx = j;
-					return ds_set_vars(_m, node, j, export_set_pv);
-				}
-
-				if(ds_strictest_match < node_strictness) {
-					ds_strictest_match = node_strictness;
-					ds_strictest_node = node;
-					ds_strictest_idx = j;
-				}
-				continue;
-			}
-
-			return ds_set_vars(_m, node, j, export_set_pv);
-		}
+		rc = ds_is_addr_match(_m, ipa, pipaddr, tport, tproto, node, j, mode,
+				export_set_pv);
+		if(rc != 0)
+			return rc;
 	}
 	return -1;
 }
@@ -4015,7 +4499,12 @@ int ds_is_addr_from_list(sip_msg_t *_m, int group, str *uri, int mode)
 		ds_strictest_node = NULL;
 	}
 
-	if(group == -1) {
+	if(ds_addr_idx[*ds_crt_idx] != NULL
+			&& !(ds_dns_mode & (DS_DNS_MODE_ALWAYS | DS_DNS_MODE_TIMER))) {
+		/* addresses do not change at runtime - use the index */
+		rc = ds_is_addr_from_index(_m, pipaddr, tport, tproto, group, mode,
+				group == -1 ? 1 : 0);
+	} else if(group == -1) {
 		rc = ds_is_addr_from_set_r(
 				_m, pipaddr, tport, tproto, _ds_list, mode, 1);
 	} else {
@@ -4069,6 +4558,45 @@ int ds_is_active_uri(sip_msg_t *msg, int group, str *uri)
 	return -1;
 }
 
+/**
+ * Update the number of pings waiting for reply in a group
+ */
+static void ds_ping_inflight_update(ds_set_t *node, int delta)
+{
+	lock_get(&node->lock);
+	node->ping_inflight += delta;
+	if(node->ping_inflight < 0)
+		node->ping_inflight = 0;
+	lock_release(&node->lock);
+}
+
+/**
+ * Decide if a destination has to be pinged now when spreading pings
+ * - the first ping is at an offset inside the interval given by the hash
+ *   of the address, the next ones after the interval changed randomly by
+ *   up to ds_ping_jitter percents
+ */
+static int ds_ping_due(ds_dest_t *dst, time_t now)
+{
+	int jitter;
+
+	if(dst->ping_next == 0) {
+		dst->ping_next =
+				now + (time_t)(ds_get_hash(&dst->uri, NULL) % ds_ping_interval);
+	}
+	if(dst->ping_next > now)
+		return 0;
+
+	jitter = ds_ping_interval * ds_ping_jitter / 100;
+	dst->ping_next = now + ds_ping_interval;
+	if(jitter > 0) {
+		dst->ping_next += (time_t)(ksr_xrand() % (2 * jitter + 1)) - jitter;
+	}
+	if(dst->ping_next <= now)
+		dst->ping_next = now + 1;
+	return 1;
+}
+
 /*! \brief
  * Callback-Function for the OPTIONS-Request
  * This Function is called, as soon as the Transaction is finished
@@ -4081,7 +4609,9 @@ static void ds_options_callback(
 	str uri = {0, 0};
 	sip_msg_t *fmsg;
 	int state;
+	int dstate;
 	ds_rctx_t rctx;
+	ds_set_t *idx = NULL;
 
 	/* The param contains the group, in which the failed host
 	 * can be found.*/
@@ -4119,10 +4649,15 @@ static void ds_options_callback(
 	rctx.setid = group;
 	ds_rctx_set_uri(&rctx, &uri);
 
-	/* Check if in the meantime someone disabled probing of the target
-	 * through RPC or reload */
-	if(ds_probing_mode == DS_PROBE_ONLYFLAGGED
-			&& !(ds_get_state(group, &uri) & DS_PROBING_DST)) {
+	if(ds_ping_max_inflight > 0
+			&& ds_get_index(group, *ds_crt_idx, &idx) == 0) {
+		ds_ping_inflight_update(idx, -1);
+	}
+
+	/* current state, to check if in the meantime someone disabled probing
+	 * or the target through RPC or reload */
+	dstate = ds_get_state(group, &uri);
+	if(ds_probing_mode == DS_PROBE_ONLYFLAGGED && !(dstate & DS_PROBING_DST)) {
 		return;
 	}
 
@@ -4134,11 +4669,11 @@ static void ds_options_callback(
 		state = 0;
 		if(ds_probing_mode == DS_PROBE_ALL
 				|| ((ds_probing_mode == DS_PROBE_ONLYFLAGGED)
-						&& (ds_get_state(group, &uri) & DS_PROBING_DST)))
+						&& (dstate & DS_PROBING_DST)))
 			state |= DS_PROBING_DST;
 
 		/* Check if in the meantime someone disabled the target through RPC */
-		if(!(ds_get_state(group, &uri) & DS_DISABLED_DST)
+		if(!(dstate & DS_DISABLED_DST)
 				&& ds_update_state(fmsg, group, &uri, state, 0, &rctx) != 0) {
 			LM_ERR("Setting the state failed (%.*s, group %d)\n", uri.len,
 					uri.s, group);
@@ -4148,7 +4683,7 @@ static void ds_options_callback(
 		if(ds_probing_mode != DS_PROBE_NONE)
 			state |= DS_PROBING_DST;
 		/* Check if in the meantime someone disabled the target through RPC */
-		if(!(ds_get_state(group, &uri) & DS_DISABLED_DST)
+		if(!(dstate & DS_DISABLED_DST)
 				&& ds_update_state(fmsg, group, &uri, state, 0, &rctx) != 0) {
 			LM_ERR("Setting the probing state failed (%.*s, group %d)\n",
 					uri.len, uri.s, group);
@@ -4195,6 +4730,7 @@ void ds_ping_set(ds_set_t *node)
 	str obproxy;
 	int state;
 	ds_rctx_t rctx;
+	time_t now = 0;
 
 	if(!node)
 		return;
@@ -4214,6 +4750,18 @@ void ds_ping_set(ds_set_t *node)
 			continue;
 		/* If the Flag of the entry has "Probing set, send a probe:	*/
 		if(ds_ping_result_helper(node, j)) {
+			if(ds_ping_max_inflight > 0
+					&& node->ping_inflight >= ds_ping_max_inflight) {
+				/* too many pings waiting for reply - try later */
+				LM_DBG("max pings in flight reached for set #%d\n", node->id);
+				continue;
+			}
+			if(ds_ping_spread) {
+				if(now == 0)
+					now = time(NULL);
+				if(!ds_ping_due(&node->dlist[j], now))
+					continue;
+			}
 			LM_DBG("probing set #%d, URI %.*s\n", node->id,
 					node->dlist[j].uri.len, node->dlist[j].uri.s);
 
@@ -4267,11 +4815,21 @@ void ds_ping_set(ds_set_t *node)
 
 			gettimeofday(&node->dlist[j].latency_stats.start, NULL);
 
+			if(ds_ping_max_inflight > 0) {
+				ds_ping_inflight_update(node, 1);
+			}
 			if(tmb.t_request(&uac_r, &node->dlist[j].uri, &node->dlist[j].uri,
 					   &ping_from, &obproxy)
 					< 0) {
 				LM_ERR("unable to ping [%.*s] in group [%d]\n",
 						node->dlist[j].uri.len, node->dlist[j].uri.s, node->id);
+				if(ds_ping_max_inflight > 0) {
+					ds_ping_inflight_update(node, -1);
+				}
+				if(ds_ping_latency_stats
+						&& node->dlist[j].latency_stats.failed < UINT32_MAX) {
+					node->dlist[j].latency_stats.failed++;
+				}
 				state = DS_TRYING_DST;
 				if(ds_probing_mode != DS_PROBE_NONE) {
 					state |= DS_PROBING_DST;
@@ -4517,6 +5075,10 @@ void ds_avl_destroy(ds_set_t **node_ptr)
 	}
 	if(node->dlist != NULL)
 		shm_free(node->dlist);
+	if(node->chlist != NULL)
+		shm_free(node->chlist);
+	if(node->wtable.prob != NULL)
+		shm_free(node->wtable.prob);
 	shm_free(node);
 
 	*node_ptr = NULL;
@@ -52,6 +52,8 @@
 
 #define ds_skip_dst(flags)	((flags) & (DS_INACTIVE_DST|DS_DISABLED_DST))
 
+#define DS_WEIGHT_MAX		1000000 /*!< upper limit for weight and rweight */
+
 #define DS_PROBE_NONE		0
 #define DS_PROBE_ALL		1
 #define DS_PROBE_INACTIVE	2
@@ -227,6 +229,7 @@ typedef struct _ds_latency_stats {
 	double m2;      // sum of squares, used for recursive variance calculation
 	int32_t count;
 	uint32_t timeout;
+	uint32_t failed; // failed probes (timeout included)
 } ds_latency_stats_t;
 
 void latency_stats_init(ds_latency_stats_t *latency_stats, int latency, int count);
@@ -257,23 +260,35 @@ typedef struct _ds_dest {
 	unsigned short int port; 	/*!< port of the URI */
 	unsigned short int proto; 	/*!< protocol of the URI */
 	int probing_count;
+	time_t ping_next;	/*!< time of next ping when spreading pings */
 	struct timeval dnstime;
 	ds_ocdata_t ocdata;	/*!< overload control attributes */
 	struct _ds_dest *next;
 } ds_dest_t;
 
+typedef struct _ds_walias {
+	unsigned int n;			/*!< number of columns (0 - not set) */
+	unsigned int *prob;		/*!< probability to keep the column */
+	unsigned int *alias;	/*!< index used when the column is not kept */
+} ds_walias_t;
+
 typedef struct _ds_set {
 	int id;				/*!< id of dst set */
 	int nr;				/*!< number of items in dst set */
 	int last;			/*!< last used item in dst set (round robin) */
-	int wlast;			/*!< last used item in dst set (by weight) */
-	int rwlast;			/*!< last used item in dst set (by relative weight) */
 	ds_dest_t *dlist;
-	unsigned int wlist[100];
-	unsigned int rwlist[100];
+	ds_walias_t wtable;	/*!< selection table by weight */
+	ds_walias_t rwtable;	/*!< selection table by relative weight */
+	unsigned int *chlist; /*!< consistent hashing lookup table */
+	unsigned int chsize;  /*!< size of consistent hashing table */
+	unsigned int chnr;    /*!< active items in consistent hashing table */
+	unsigned int chrebuilds;   /*!< rebuilds of consistent hashing table */
+	unsigned int chmoved;      /*!< slots remapped by last rebuild */
+	unsigned long chmovedsum;  /*!< slots remapped by all rebuilds */
 	struct _ds_set *next[2];
 	int longer;
 	int rrserial;		/*!< round-robin or serial flag */
+	int ping_inflight;	/*!< pings waiting for reply */
 	gen_lock_t lock;
 } ds_set_t;
 
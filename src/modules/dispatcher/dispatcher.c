@@ -101,7 +101,10 @@ int inactive_threshold = 1; /* number of replied requests, before a destination
 							 * is taken into back in active state */
 str ds_ping_method = str_init("OPTIONS");
 str ds_ping_from   = str_init("sip:dispatcher@localhost");
-static int ds_ping_interval = 0;
+int ds_ping_interval = 0;
+int ds_ping_spread = 0;
+int ds_ping_jitter = 10;
+int ds_ping_max_inflight = 0;
 int ds_ping_latency_stats = 0;
 int ds_ping_fr_timeout = 0;
 int ds_retain_latency_stats = 0;
@@ -307,6 +310,9 @@ static param_export_t params[]={
 	{"ds_ping_method",     PARAM_STR, &ds_ping_method},
 	{"ds_ping_from",       PARAM_STR, &ds_ping_from},
 	{"ds_ping_interval",   PARAM_INT, &ds_ping_interval},
+	{"ds_ping_spread",     PARAM_INT, &ds_ping_spread},
+	{"ds_ping_jitter",     PARAM_INT, &ds_ping_jitter},
+	{"ds_ping_max_inflight", PARAM_INT, &ds_ping_max_inflight},
 	{"ds_ping_fr_timeout", PARAM_INT, &ds_ping_fr_timeout},
 	{"ds_ping_latency_stats", PARAM_INT, &ds_ping_latency_stats},
 	{"ds_retain_latency_stats", PARAM_INT, &ds_retain_latency_stats},
@@ -543,12 +549,23 @@ static int mod_init(void)
 		}
 		/*****************************************************
 		 * Register the PING-Timer
+		 * - with spreading, it runs every second and sends the
+		 *   pings that are due
 		 *****************************************************/
+		if(ds_ping_jitter < 0 || ds_ping_jitter > 100) {
+			LM_WARN("invalid ds_ping_jitter value %d - using 0\n",
+					ds_ping_jitter);
+			ds_ping_jitter = 0;
+		}
 		if(ds_timer_mode == 1) {
-			if(sr_wtimer_add(ds_check_timer, NULL, ds_ping_interval) < 0)
+			if(sr_wtimer_add(ds_check_timer, NULL,
+					   (ds_ping_spread) ? 1 : ds_ping_interval)
+					< 0)
 				return -1;
 		} else {
-			if(register_timer(ds_check_timer, NULL, ds_ping_interval) < 0)
+			if(register_timer(ds_check_timer, NULL,
+					   (ds_ping_spread) ? 1 : ds_ping_interval)
+					< 0)
 				return -1;
 		}
 	}
@@ -2110,12 +2127,13 @@ int ds_rpc_print_set(
 				rpc->fault(ctx, 500, "Internal error creating dest");
 				return -1;
 			}
-			if(rpc->struct_add(lh, "fffdd", "AVG",
+			if(rpc->struct_add(lh, "fffddu", "AVG",
 					   node->dlist[j].latency_stats.average, "STD",
 					   node->dlist[j].latency_stats.stdev, "EST",
 					   node->dlist[j].latency_stats.estimate, "MAX",
 					   node->dlist[j].latency_stats.max, "TIMEOUT",
-					   node->dlist[j].latency_stats.timeout)
+					   node->dlist[j].latency_stats.timeout, "FAILED",
+					   node->dlist[j].latency_stats.failed)
 					< 0) {
 				rpc->fault(ctx, 500, "Internal error creating dest struct");
 				return -1;
@@ -2489,6 +2507,65 @@ static void dispatcher_rpc_oclist(rpc_t *rpc, void *ctx)
 	}
 }
 
+static const char *dispatcher_rpc_chash_stats_doc[2] = {
+		"Return consistent hashing statistics for dispatcher sets", 0};
+
+/**
+ *
+ */
+static int ds_rpc_chash_stats_set(ds_set_t *node, rpc_t *rpc, void *ctx)
+{
+	int i;
+	void *th = NULL;
+	unsigned int chnr;
+	unsigned int chrebuilds;
+	unsigned int chmoved;
+	unsigned long chmovedsum;
+
+	if(!node)
+		return 0;
+
+	for(i = 0; i < 2; ++i) {
+		if(ds_rpc_chash_stats_set(node->next[i], rpc, ctx) != 0)
+			return -1;
+	}
+
+	lock_get(&node->lock);
+	chnr = node->chnr;
+	chrebuilds = node->chrebuilds;
+	chmoved = node->chmoved;
+	chmovedsum = node->chmovedsum;
+	lock_release(&node->lock);
+
+	if(rpc->add(ctx, "{", &th) < 0) {
+		rpc->fault(ctx, 500, "Internal error root reply");
+		return -1;
+	}
+	if(rpc->struct_add(th, "duuuujf", "group", node->id, "size", node->chsize,
+			   "active", chnr, "rebuilds", chrebuilds, "moved", chmoved,
+			   "moved_total", chmovedsum, "remapped",
+			   (node->chsize > 0) ? (double)chmoved / node->chsize : 0.0)
+			< 0) {
+		rpc->fault(ctx, 500, "Internal error main structure");
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * RPC command to list consistent hashing statistics
+ */
+static void dispatcher_rpc_chash_stats(rpc_t *rpc, void *ctx)
+{
+	ds_set_t *list = ds_get_list();
+
+	if(list == NULL || ds_get_list_nr() <= 0) {
+		rpc->fault(ctx, 404, "Destination Group Not Found");
+		return;
+	}
+	ds_rpc_chash_stats_set(list, rpc, ctx);
+}
+
 /* clang-format off */
 rpc_export_t dispatcher_rpc_cmds[] = {
 	{"dispatcher.reload", dispatcher_rpc_reload,
@@ -2509,6 +2586,8 @@ rpc_export_t dispatcher_rpc_cmds[] = {
 		dispatcher_rpc_hash_doc, 0},
 	{"dispatcher.oclist", dispatcher_rpc_oclist,
 		dispatcher_rpc_oclist_doc, RPC_RET_ARRAY},
+	{"dispatcher.chash_stats", dispatcher_rpc_chash_stats,
+		dispatcher_rpc_chash_stats_doc, RPC_RET_ARRAY},
 	{0, 0, 0, 0}
 };
 /* clang-format on */
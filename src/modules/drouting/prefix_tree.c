@@ -36,25 +36,39 @@ extern int inode;
 extern int unode;
 
 
-static inline int check_time(dr_tmrec_t *time_rec)
+static inline int check_time(rt_info_t *rt)
 {
+	dr_tmrec_t *time_rec = rt->time_rec;
 	dr_ac_tm_t att;
+	time_t now;
+	int ret;
 
 	/* shortcut: if there is no dstart, timerec is valid */
 	if(time_rec->dtstart == 0)
 		return 1;
 
+	now = time(0);
+
+	/* the result does not change until the next interval bound */
+	if(tr_cache_get(&rt->time_cache, now, &ret) == 0)
+		return (ret == 0) ? 1 : 0;
+
 	memset(&att, 0, sizeof(att));
 
 	/* set current time */
-	if(dr_ac_tm_set_time(&att, time(0)))
+	if(dr_ac_tm_set_time(&att, now))
 		return 0;
 
 	/* does the recv_time match the specified interval?  */
-	if(dr_check_tmrec(time_rec, &att, 0) != 0)
-		return 0;
+	ret = dr_check_tmrec(time_rec, &att, 0);
+	if(ret >= 0) {
+		tr_cache_set(&rt->time_cache, now,
+				tr_next_change(time_rec->dtstart, time_rec->duration,
+						time_rec->until, &time_rec->ts, now, &att.t),
+				ret);
+	}
 
-	return 1;
+	return (ret == 0) ? 1 : 0;
 }
 
 
@@ -76,7 +90,7 @@ static inline rt_info_t *internal_check_rt(ptree_node_t *ptn, unsigned int rgid)
 		LM_DBG("found rgid %d (rule list %p)\n", rgid, rg[i].rtlw);
 		rtlw = rg[i].rtlw;
 		while(rtlw != NULL) {
-			if(check_time(rtlw->rtl->time_rec))
+			if(check_time(rtlw->rtl))
 				return rtlw->rtl;
 			rtlw = rtlw->next;
 		}
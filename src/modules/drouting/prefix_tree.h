@@ -27,6 +27,7 @@
 
 #include "../../core/str.h"
 #include "../../core/ip_addr.h"
+#include "../../core/utils/tmrec_cache.h"
 #include "../keepalive/api.h"
 #include "dr_time.h"
 
@@ -83,6 +84,8 @@ typedef struct rt_info_
 {
 	unsigned int priority;
 	dr_tmrec_t *time_rec;
+	/* last result of time_rec check */
+	tr_cache_t time_cache;
 	/* array of pointers into the PSTN gw list */
 	pgw_list_t *pgwl;
 	/* length of the PSTN gw array */
@@ -34,16 +34,32 @@
 #include "../../core/action.h"
 #include "../../core/route.h"
 #include "../../core/kemi.h"
+#include "../../core/pt.h"
+#include "../../core/bit_scan.h"
 
 #include "ht_api.h"
 #include "ht_db.h"
 
 
 extern str ht_event_callback;
+extern int ht_timer_interval;
 
 ht_t *_ht_root = NULL;
 ht_cell_t *ht_expired_cell;
 
+/* reader epochs for tables with lock-free reads */
+static ht_epoch_t *_ht_epoch = NULL;
+
+/* retired items in a slot that trigger a reclaim attempt */
+#define HT_RETIRED_BATCH 16
+/* lock-free read attempts before falling back to slot locking */
+#define HT_LF_RETRIES 3
+
+/* number of ticks in the expiry wheel */
+#define HT_WHEEL_SIZE 128
+/* seconds per expiry wheel tick */
+static unsigned int _ht_wheel_step = 20;
+
 typedef struct _keyvalue
 {
 	str key;
@@ -150,8 +166,17 @@ void ht_slot_lock(ht_t *ht, int idx)
 
 	mypid = my_pid();
 	if(likely(atomic_get(&ht->entries[idx].locker_pid) != mypid)) {
-		lock_get(&ht->entries[idx].lock);
+		if(lock_try(&ht->entries[idx].lock) != 0) {
+			lock_get(&ht->entries[idx].lock);
+			ht->entries[idx].nwaits++;
+		}
+		ht->entries[idx].nlocks++;
 		atomic_set(&ht->entries[idx].locker_pid, mypid);
+		if(ht->lockfree) {
+			/* odd value tells lock-free readers the slot is changing */
+			ht->entries[idx].seq++;
+			membar_write();
+		}
 	} else {
 		/* locked within the same process that executed us */
 		ht->entries[idx].rec_lock_level++;
@@ -164,6 +189,10 @@ void ht_slot_lock(ht_t *ht, int idx)
 void ht_slot_unlock(ht_t *ht, int idx)
 {
 	if(likely(ht->entries[idx].rec_lock_level == 0)) {
+		if(ht->lockfree) {
+			membar_write();
+			ht->entries[idx].seq++;
+		}
 		atomic_set(&ht->entries[idx].locker_pid, 0);
 		lock_release(&ht->entries[idx].lock);
 	} else {
@@ -172,6 +201,33 @@ void ht_slot_unlock(ht_t *ht, int idx)
 	}
 }
 
+/**
+ * flag the slot in the expiry wheel at the tick of the expire time
+ * - the flag of the earliest tick has to be set for each item with expire
+ * - an expire time already past is flagged at the next tick, the past ticks
+ *   being visited again only after a full round
+ */
+void ht_wheel_mark(ht_t *ht, unsigned int idx, time_t expire)
+{
+	atomic_t *w;
+	unsigned long etick;
+	unsigned long ctick;
+	unsigned int tick;
+	int bit;
+
+	if(ht->wheel == NULL || expire == 0)
+		return;
+	etick = (unsigned long)expire / _ht_wheel_step;
+	ctick = (unsigned long)time(NULL) / _ht_wheel_step;
+	if(etick < ctick)
+		etick = ctick + 1;
+	tick = (unsigned int)(etick % HT_WHEEL_SIZE);
+	w = &ht->wheel[tick * ht->wsize + (idx >> 5)];
+	bit = (int)(1U << (idx & 31));
+	if(!(atomic_get(w) & bit))
+		atomic_or(w, bit);
+}
+
 ht_cell_t *ht_cell_new(str *name, int type, int_str *val, unsigned int cellid)
 {
 	ht_cell_t *cell;
@@ -223,6 +279,145 @@ int ht_cell_pkg_free(ht_cell_t *cell)
 	return 0;
 }
 
+/**
+ * init the reader epochs used by tables with lock-free reads
+ * - to be done after all processes were registered
+ */
+int ht_epoch_init(void)
+{
+	int nprocs;
+
+	if(_ht_epoch != NULL || !ht_has_lockfree())
+		return 0;
+
+	nprocs = get_max_procs();
+	_ht_epoch = (ht_epoch_t *)shm_malloc(
+			sizeof(ht_epoch_t) + nprocs * sizeof(atomic_t));
+	if(_ht_epoch == NULL) {
+		LM_ERR("no more shm\n");
+		return -1;
+	}
+	memset(_ht_epoch, 0, sizeof(ht_epoch_t) + nprocs * sizeof(atomic_t));
+	_ht_epoch->active = (atomic_t *)((char *)_ht_epoch + sizeof(ht_epoch_t));
+	_ht_epoch->nprocs = nprocs;
+	atomic_set(&_ht_epoch->global, 1);
+	return 0;
+}
+
+/**
+ * mark the process as reader of the items linked in the tables
+ * - return: 0 on success, -1 if lock-free reads are not possible
+ */
+static int ht_epoch_enter(void)
+{
+	int e;
+
+	if(_ht_epoch == NULL || process_no < 0
+			|| process_no >= _ht_epoch->nprocs)
+		return -1;
+	do {
+		e = atomic_get(&_ht_epoch->global);
+		atomic_set(&_ht_epoch->active[process_no], e);
+		membar();
+	} while(e != atomic_get(&_ht_epoch->global));
+	return 0;
+}
+
+static void ht_epoch_leave(void)
+{
+	membar();
+	atomic_set(&_ht_epoch->active[process_no], 0);
+}
+
+/**
+ * oldest epoch still in use by a reader
+ */
+static int ht_epoch_min(void)
+{
+	int i;
+	int e;
+	int emin;
+
+	emin = atomic_get(&_ht_epoch->global);
+	for(i = 0; i < _ht_epoch->nprocs; i++) {
+		e = atomic_get(&_ht_epoch->active[i]);
+		if(e != 0 && (int)((unsigned int)e - (unsigned int)emin) < 0)
+			emin = e;
+	}
+	return emin;
+}
+
+/**
+ * release an item unlinked from the slot
+ * - for tables with lock-free reads, the item is kept in the slot retired
+ *   list until no reader can reference it
+ * - the slot must be locked
+ */
+void ht_cell_retire(ht_t *ht, int idx, ht_cell_t *cell)
+{
+	if(!ht->lockfree || _ht_epoch == NULL) {
+		ht_cell_free(cell);
+		return;
+	}
+	membar();
+	/* retired items are linked via prev */
+	cell->epoch = (unsigned int)atomic_get(&_ht_epoch->global);
+	if(atomic_inc_and_test(&_ht_epoch->global)) {
+		/* zero marks an idle reader */
+		atomic_inc(&_ht_epoch->global);
+	}
+	cell->prev = ht->entries[idx].retired;
+	ht->entries[idx].retired = cell;
+	ht->entries[idx].nretired++;
+	if(ht->entries[idx].nretired >= HT_RETIRED_BATCH)
+		ht_cell_reclaim(ht, idx);
+}
+
+/**
+ * free the retired items of the slot that are no longer visible to readers
+ * - the slot must be locked
+ */
+void ht_cell_reclaim(ht_t *ht, int idx)
+{
+	ht_cell_t *it;
+	ht_cell_t *it0;
+	ht_cell_t **pit;
+	int emin;
+
+	if(ht->entries[idx].retired == NULL)
+		return;
+	if(_ht_epoch == NULL) {
+		emin = 0;
+	} else {
+		emin = ht_epoch_min();
+	}
+	pit = &ht->entries[idx].retired;
+	it = *pit;
+	while(it) {
+		it0 = it->prev;
+		if(_ht_epoch == NULL
+				|| (int)(it->epoch - (unsigned int)emin) < 0) {
+			*pit = it0;
+			ht->entries[idx].nretired--;
+			ht_cell_free(it);
+		} else {
+			pit = &it->prev;
+		}
+		it = it0;
+	}
+}
+
+int ht_has_lockfree(void)
+{
+	ht_t *ht;
+
+	for(ht = _ht_root; ht != NULL; ht = ht->next) {
+		if(ht->lockfree)
+			return 1;
+	}
+	return 0;
+}
+
 
 ht_t *ht_get_root(void)
 {
@@ -255,7 +450,7 @@ ht_t *ht_get_table(str *name)
 
 int ht_add_table(str *name, int autoexp, str *dbtable, str *dbcols, int size,
 		int dbmode, int itype, int_str *ival, int updateexpire,
-		int dmqreplicate, char coldelim, char colnull)
+		int dmqreplicate, char coldelim, char colnull, int lockfree)
 {
 	unsigned int htid;
 	ht_t *ht;
@@ -303,6 +498,7 @@ int ht_add_table(str *name, int autoexp, str *dbtable, str *dbcols, int size,
 	if(ival != NULL)
 		ht->initval = *ival;
 	ht->dmqreplicate = dmqreplicate;
+	ht->lockfree = (lockfree != 0) ? 1 : 0;
 
 	if(dbcols != NULL && dbcols->s != NULL && dbcols->len > 0) {
 		ht->scols[0].s = (char *)shm_malloc((1 + dbcols->len) * sizeof(char));
@@ -356,6 +552,8 @@ int ht_init_tables(void)
 	ht_t *ht;
 	int i;
 
+	if(ht_timer_interval > 0)
+		_ht_wheel_step = ht_timer_interval;
 	ht = _ht_root;
 
 	while(ht) {
@@ -396,6 +594,20 @@ int ht_init_tables(void)
 		}
 		memset(ht->entries, 0, ht->htsize * sizeof(ht_entry_t));
 
+		if(ht->htexpire > 0) {
+			ht->wsize = (ht->htsize + 31) / 32;
+			ht->wheel = (atomic_t *)shm_malloc(
+					HT_WHEEL_SIZE * ht->wsize * sizeof(atomic_t));
+			if(ht->wheel == NULL) {
+				LM_ERR("no more shared memory for [%.*s]\n", ht->name.len,
+						ht->name.s);
+				shm_free(ht->entries);
+				ht->entries = NULL;
+				return -1;
+			}
+			memset(ht->wheel, 0, HT_WHEEL_SIZE * ht->wsize * sizeof(atomic_t));
+		}
+
 		for(i = 0; i < ht->htsize; i++) {
 			if(lock_init(&ht->entries[i].lock) == 0) {
 				LM_ERR("cannot initialize lock[%d] in [%.*s]\n", i,
@@ -407,6 +619,10 @@ int ht_init_tables(void)
 				}
 				shm_free(ht->entries);
 				ht->entries = NULL;
+				if(ht->wheel != NULL) {
+					shm_free(ht->wheel);
+					ht->wheel = NULL;
+				}
 				return -1;
 			}
 		}
@@ -438,11 +654,20 @@ int ht_destroy(void)
 					it = it->next;
 					ht_cell_free(it0);
 				}
+				/* free retired entries */
+				it = ht->entries[i].retired;
+				while(it) {
+					it0 = it;
+					it = it->prev;
+					ht_cell_free(it0);
+				}
 				/* free locks */
 				lock_destroy(&ht->entries[i].lock);
 			}
 			shm_free(ht->entries);
 		}
+		if(ht->wheel != NULL)
+			shm_free(ht->wheel);
 		shm_free(ht);
 		ht = ht0;
 	}
@@ -500,6 +725,7 @@ int ht_set_cell_ex(
 						} else {
 							it->expire = now + exv;
 						}
+						ht_wheel_mark(ht, idx, it->expire);
 					} else {
 						/* new */
 						cell = ht_cell_new(name, type, val, hid);
@@ -514,15 +740,16 @@ int ht_set_cell_ex(
 						if(exv <= 0) {
 							HT_COPY_EXPIRE(ht, cell, now, it);
 						} else {
-							it->expire = now + exv;
+							cell->expire = now + exv;
 						}
+						ht_wheel_mark(ht, idx, cell->expire);
 						if(it->prev)
 							it->prev->next = cell;
 						else
 							ht->entries[idx].first = cell;
 						if(it->next)
 							it->next->prev = cell;
-						ht_cell_free(it);
+						ht_cell_retire(ht, idx, it);
 					}
 				} else {
 					it->flags &= ~AVP_VAL_STR;
@@ -533,6 +760,7 @@ int ht_set_cell_ex(
 					} else {
 						it->expire = now + exv;
 					}
+					ht_wheel_mark(ht, idx, it->expire);
 				}
 				if(mode)
 					ht_slot_unlock(ht, idx);
@@ -550,8 +778,9 @@ int ht_set_cell_ex(
 					if(exv <= 0) {
 						HT_COPY_EXPIRE(ht, cell, now, it);
 					} else {
-						it->expire = now + exv;
+						cell->expire = now + exv;
 					}
+					ht_wheel_mark(ht, idx, cell->expire);
 
 					cell->next = it->next;
 					cell->prev = it->prev;
@@ -561,7 +790,7 @@ int ht_set_cell_ex(
 						ht->entries[idx].first = cell;
 					if(it->next)
 						it->next->prev = cell;
-					ht_cell_free(it);
+					ht_cell_retire(ht, idx, it);
 				} else {
 					it->value.n = val->n;
 
@@ -570,6 +799,7 @@ int ht_set_cell_ex(
 					} else {
 						it->expire = now + exv;
 					}
+					ht_wheel_mark(ht, idx, it->expire);
 				}
 				if(mode)
 					ht_slot_unlock(ht, idx);
@@ -592,6 +822,7 @@ int ht_set_cell_ex(
 	} else {
 		cell->expire = now + exv;
 	}
+	ht_wheel_mark(ht, idx, cell->expire);
 	if(prev == NULL) {
 		if(ht->entries[idx].first != NULL) {
 			cell->next = ht->entries[idx].first;
@@ -683,8 +914,8 @@ int ht_del_cell_confirm(ht_t *ht, str *name)
 				&& strncmp(name->s, it->name.s, name->len) == 0) {
 			/* found */
 			ht_cell_unlink(ht, idx, it);
+			ht_cell_retire(ht, idx, it);
 			ht_slot_unlock(ht, idx);
-			ht_cell_free(it);
 			return 1;
 		}
 		it = it->next;
@@ -693,6 +924,148 @@ int ht_del_cell_confirm(ht_t *ht, str *name)
 	return 0;
 }
 
+/**
+ * lock-free search of an item in the slot, validated with the slot changes
+ * counter
+ * - if cpy is set, the item is cloned in pkg (reusing old if large enough),
+ *   otherwise *res is set to a non-NULL value if the item exists
+ * - return: 1 if the result is consistent, 0 if the slot was changed meanwhile
+ */
+static int ht_cell_lf_find(ht_t *ht, unsigned int idx, unsigned int hid,
+		str *name, int cpy, ht_cell_t *old, ht_cell_t **res)
+{
+	ht_cell_t *it;
+	ht_cell_t *cell;
+	unsigned int seq;
+	unsigned int msize;
+
+	*res = NULL;
+	cell = NULL;
+	seq = ht->entries[idx].seq;
+	membar_read();
+	if(seq & 1)
+		return 0;
+	it = ht->entries[idx].first;
+	while(it != NULL && it->cellid < hid) {
+		it = it->next;
+		if(ht->entries[idx].seq != seq)
+			return 0;
+	}
+	while(it != NULL && it->cellid == hid) {
+		if(name->len == it->name.len
+				&& strncmp(name->s, it->name.s, name->len) == 0) {
+			/* found */
+			if(ht->htexpire > 0 && it->expire != 0 && it->expire < time(NULL)) {
+				/* entry has expired */
+				break;
+			}
+			if(cpy == 0) {
+				cell = it;
+				break;
+			}
+			/* msize does not change during the life of the item */
+			msize = it->msize;
+			if(old != NULL && old->msize >= msize) {
+				cell = old;
+			} else {
+				cell = (ht_cell_t *)pkg_malloc(msize);
+				if(cell == NULL)
+					break;
+			}
+			memcpy(cell, it, msize);
+			cell->name.s = (char *)cell + sizeof(ht_cell_t);
+			if(cell->flags & AVP_VAL_STR) {
+				cell->value.s.s = (char *)cell->name.s + cell->name.len + 1;
+			}
+			break;
+		}
+		it = it->next;
+		if(ht->entries[idx].seq != seq)
+			return 0;
+	}
+	membar_read();
+	if(ht->entries[idx].seq != seq) {
+		if(cpy != 0 && cell != NULL && cell != old)
+			pkg_free(cell);
+		return 0;
+	}
+	*res = cell;
+	return 1;
+}
+
+/**
+ * lock-free lookup of an item, within a reader epoch
+ * - return: 1 if the result in *res is valid, 0 if the caller has to
+ *   fall back to the locked lookup
+ */
+static int ht_cell_lf_lookup(ht_t *ht, unsigned int idx, unsigned int hid,
+		str *name, int cpy, ht_cell_t *old, ht_cell_t **res)
+{
+	int i;
+	int ret;
+
+	if(ht_epoch_enter() < 0)
+		return 0;
+	ret = 0;
+	for(i = 0; i < HT_LF_RETRIES; i++) {
+		ret = ht_cell_lf_find(ht, idx, hid, name, cpy, old, res);
+		if(ret == 1)
+			break;
+		atomic_inc(&ht->lfretries);
+	}
+	ht_epoch_leave();
+	if(ret == 0)
+		atomic_inc(&ht->lffallbacks);
+	return ret;
+}
+
+/**
+ * lock-free increment of an integer item, within a reader epoch
+ * - the item is found with a validated lock-free search, then its value is
+ *   updated with an atomic operation
+ * - an increment racing with the removal of the item is as if it was done
+ *   before the removal
+ * - return: 1 if the increment was done (*res has the pkg copy of the item),
+ *   0 if the caller has to fall back to the locked update
+ */
+static int ht_cell_lf_value_add(ht_t *ht, unsigned int idx, unsigned int hid,
+		str *name, int val, time_t now, ht_cell_t *old, ht_cell_t **res)
+{
+	ht_cell_t *it;
+	ht_cell_t *cell;
+	unsigned int msize;
+	long v;
+
+	if(ht_epoch_enter() < 0)
+		return 0;
+	/* not found and expired items are handled with the slot locked */
+	if(ht_cell_lf_find(ht, idx, hid, name, 0, NULL, &it) == 0 || it == NULL
+			|| (it->flags & AVP_VAL_STR)) {
+		ht_epoch_leave();
+		atomic_inc(&ht->lffallbacks);
+		return 0;
+	}
+	v = atomic_add_long((volatile long *)&it->value.n, (long)val);
+	if(ht->updateexpire) {
+		it->expire = now + ht->htexpire;
+		ht_wheel_mark(ht, idx, it->expire);
+	}
+	msize = it->msize;
+	if(old != NULL && old->msize >= msize) {
+		cell = old;
+	} else {
+		cell = (ht_cell_t *)pkg_malloc(msize);
+	}
+	if(cell != NULL) {
+		memcpy(cell, it, msize);
+		cell->name.s = (char *)cell + sizeof(ht_cell_t);
+		cell->value.n = v;
+	}
+	ht_epoch_leave();
+	*res = cell;
+	return 1;
+}
+
 ht_cell_t *ht_cell_value_add(ht_t *ht, str *name, int val, ht_cell_t *old)
 {
 	unsigned int idx;
@@ -700,6 +1073,7 @@ ht_cell_t *ht_cell_value_add(ht_t *ht, str *name, int val, ht_cell_t *old)
 	ht_cell_t *it, *prev, *cell;
 	time_t now;
 	int_str isval;
+	long v;
 
 	if(ht == NULL || ht->entries == NULL)
 		return NULL;
@@ -715,6 +1089,11 @@ ht_cell_t *ht_cell_value_add(ht_t *ht, str *name, int val, ht_cell_t *old)
 	now = 0;
 	if(ht->htexpire > 0)
 		now = time(NULL);
+
+	if(ht->lockfree
+			&& ht_cell_lf_value_add(ht, idx, hid, name, val, now, old, &cell))
+		return cell;
+
 	prev = NULL;
 	ht_slot_lock(ht, idx);
 	it = ht->entries[idx].first;
@@ -736,7 +1115,12 @@ ht_cell_t *ht_cell_value_add(ht_t *ht, str *name, int val, ht_cell_t *old)
 				if(ht->flags == PV_VAL_INT) {
 					/* initval is integer, use it to create a fresh entry */
 					it->flags &= ~AVP_VAL_STR;
-					it->value.n = ht->initval.n;
+					if(ht->lockfree) {
+						atomic_set_long(
+								(volatile long *)&it->value.n, ht->initval.n);
+					} else {
+						it->value.n = ht->initval.n;
+					}
 					/* increment will be done below */
 				} else {
 					ht_slot_unlock(ht, idx);
@@ -749,19 +1133,26 @@ ht_cell_t *ht_cell_value_add(ht_t *ht, str *name, int val, ht_cell_t *old)
 				ht_slot_unlock(ht, idx);
 				return NULL;
 			} else {
-				it->value.n += val;
+				/* the lock-free increments do not take the slot lock */
+				if(ht->lockfree) {
+					v = atomic_add_long(
+							(volatile long *)&it->value.n, (long)val);
+				} else {
+					it->value.n += val;
+					v = it->value.n;
+				}
 				if(ht->updateexpire)
 					it->expire = now + ht->htexpire;
-				if(old != NULL) {
-					if(old->msize >= it->msize) {
-						memcpy(old, it, it->msize);
-						ht_slot_unlock(ht, idx);
-						return old;
-					}
+				ht_wheel_mark(ht, idx, it->expire);
+				if(old != NULL && old->msize >= it->msize) {
+					cell = old;
+				} else {
+					cell = (ht_cell_t *)pkg_malloc(it->msize);
 				}
-				cell = (ht_cell_t *)pkg_malloc(it->msize);
-				if(cell != NULL)
+				if(cell != NULL) {
 					memcpy(cell, it, it->msize);
+					cell->value.n = v;
+				}
 
 				ht_slot_unlock(ht, idx);
 				return cell;
@@ -783,6 +1174,7 @@ ht_cell_t *ht_cell_value_add(ht_t *ht, str *name, int val, ht_cell_t *old)
 		return NULL;
 	}
 	it->expire = now + ht->htexpire;
+	ht_wheel_mark(ht, idx, it->expire);
 	if(prev == NULL) {
 		if(ht->entries[idx].first != NULL) {
 			it->next = ht->entries[idx].first;
@@ -834,6 +1226,9 @@ ht_cell_t *ht_cell_pkg_copy(ht_t *ht, str *name, ht_cell_t *old)
 	if(ht->entries[idx].first == NULL)
 		return NULL;
 
+	if(ht->lockfree && ht_cell_lf_lookup(ht, idx, hid, name, 1, old, &cell))
+		return cell;
+
 	ht_slot_lock(ht, idx);
 	it = ht->entries[idx].first;
 	while(it != NULL && it->cellid < hid)
@@ -893,6 +1288,9 @@ int ht_cell_exists(ht_t *ht, str *name)
 	if(ht->entries[idx].first == NULL)
 		return 0;
 
+	if(ht->lockfree && ht_cell_lf_lookup(ht, idx, hid, name, 0, NULL, &it))
+		return (it != NULL) ? 1 : 0;
+
 	ht_slot_lock(ht, idx);
 	it = ht->entries[idx].first;
 	while(it != NULL && it->cellid < hid)
@@ -961,6 +1359,7 @@ int ht_table_spec(char *spec)
 	unsigned int dmqreplicate = 0;
 	char coldelim = ',';
 	char colnull = '*';
+	unsigned int lockfree = 0;
 	str in;
 	str tok;
 	param_t *pit = NULL;
@@ -1047,13 +1446,21 @@ int ht_table_spec(char *spec)
 			}
 
 			LM_DBG("htable [%.*s] - colnull [%c]\n", name.len, name.s, colnull);
+		} else if(pit->name.len == 8
+				  && strncmp(pit->name.s, "lockfree", 8) == 0) {
+			if(str2int(&tok, &lockfree) != 0)
+				goto error;
+
+			LM_DBG("htable [%.*s] - lockfree [%u]\n", name.len, name.s,
+					lockfree);
 		} else {
 			goto error;
 		}
 	}
 
 	return ht_add_table(&name, autoexpire, &dbtable, &dbcols, size, dbmode,
-			itype, &ival, updateexpire, dmqreplicate, coldelim, colnull);
+			itype, &ival, updateexpire, dmqreplicate, coldelim, colnull,
+			lockfree);
 
 error:
 	LM_ERR("invalid htable parameter [%.*s]\n", in.len, in.s);
@@ -1115,12 +1522,87 @@ int ht_has_autoexpire(void)
 
 extern int ht_timer_procs;
 
-void ht_timer(unsigned int ticks, void *param)
+/**
+ * remove the expired items in the slot and flag the slot in the expiry wheel
+ * for the earliest expire of the remaining items
+ */
+static void ht_slot_expire(ht_t *ht, int idx, time_t now)
 {
-	ht_t *ht;
 	ht_cell_t *it;
 	ht_cell_t *it0;
+	time_t emin;
+
+	emin = 0;
+	ht_slot_lock(ht, idx);
+	it = ht->entries[idx].first;
+	while(it) {
+		it0 = it->next;
+		if(it->expire != 0 && it->expire < now) {
+			/* expired */
+			ht_handle_expired_record(ht, it);
+			if(it->prev == NULL)
+				ht->entries[idx].first = it->next;
+			else
+				it->prev->next = it->next;
+			if(it->next)
+				it->next->prev = it->prev;
+			ht->entries[idx].esize--;
+			ht_cell_retire(ht, idx, it);
+		} else if(it->expire != 0 && (emin == 0 || it->expire < emin)) {
+			emin = it->expire;
+		}
+		it = it0;
+	}
+	ht_wheel_mark(ht, idx, emin);
+	ht_slot_unlock(ht, idx);
+}
+
+/**
+ * visit the slots flagged in the expiry wheel at tick, which are handled by
+ * the timer process (slot index modulo istep is istart)
+ */
+static void ht_wheel_expire(
+		ht_t *ht, unsigned int tick, time_t now, int istart, int istep)
+{
+	atomic_t *w;
+	unsigned int bits;
+	unsigned int mask;
+	unsigned int k;
+	int b;
+
+	w = &ht->wheel[tick * ht->wsize];
+	for(k = 0; k < ht->wsize; k++) {
+		bits = (unsigned int)atomic_get(&w[k]);
+		if(bits == 0)
+			continue;
+		if(istep > 1) {
+			mask = 0;
+			for(b = 0; b < 32; b++) {
+				if((k * 32 + b) % istep == istart)
+					mask |= 1U << b;
+			}
+			bits &= mask;
+			if(bits == 0)
+				continue;
+		}
+		/* clear before visiting, items may flag the slot again */
+		atomic_and(&w[k], (int)~bits);
+		while(bits) {
+			b = bit_scan_forward32(bits);
+			bits &= bits - 1;
+			ht_slot_expire(ht, k * 32 + b, now);
+		}
+	}
+}
+
+void ht_timer(unsigned int ticks, void *param)
+{
+	static unsigned long last = 0;
+	ht_t *ht;
 	time_t now;
+	unsigned long ctick;
+	unsigned long ftick;
+	unsigned long t;
 	int i;
 	int istart;
 	int istep;
@@ -1136,34 +1618,34 @@ void ht_timer(unsigned int ticks, void *param)
 	else
 		istep = ht_timer_procs;
 
+	/* the last visited tick is visited again, being only partially due at
+	 * that time; all ticks are visited on first run or after a long pause */
+	ctick = (unsigned long)now / _ht_wheel_step;
+	if(last == 0 || ctick - last >= HT_WHEEL_SIZE)
+		ftick = ctick - HT_WHEEL_SIZE + 1;
+	else
+		ftick = last;
+
 	ht = _ht_root;
 	while(ht) {
-		if(ht->htexpire > 0) {
+		if(ht->lockfree) {
 			for(i = istart; i < ht->htsize; i += istep) {
-				/* free entries */
+				if(ht->entries[i].retired == NULL)
+					continue;
 				ht_slot_lock(ht, i);
-				it = ht->entries[i].first;
-				while(it) {
-					it0 = it->next;
-					if(it->expire != 0 && it->expire < now) {
-						/* expired */
-						ht_handle_expired_record(ht, it);
-						if(it->prev == NULL)
-							ht->entries[i].first = it->next;
-						else
-							it->prev->next = it->next;
-						if(it->next)
-							it->next->prev = it->prev;
-						ht->entries[i].esize--;
-						ht_cell_free(it);
-					}
-					it = it0;
-				}
+				ht_cell_reclaim(ht, i);
 				ht_slot_unlock(ht, i);
 			}
 		}
+		if(ht->htexpire > 0 && ht->wheel != NULL) {
+			for(t = ftick; t <= ctick; t++) {
+				ht_wheel_expire(
+						ht, (unsigned int)(t % HT_WHEEL_SIZE), now, istart, istep);
+			}
+		}
 		ht = ht->next;
 	}
+	last = ctick;
 	return;
 }
 
@@ -1259,6 +1741,7 @@ int ht_set_cell_expire(ht_t *ht, str *name, int type, int_str *val)
 				&& strncmp(name->s, it->name.s, name->len) == 0) {
 			/* update value */
 			it->expire = now;
+			ht_wheel_mark(ht, idx, it->expire);
 			ht_slot_unlock(ht, idx);
 			return 0;
 		}
@@ -1350,7 +1833,7 @@ int ht_rm_cell_re(str *sre, ht_t *ht, int mode)
 				if(it->next)
 					it->next->prev = it->prev;
 				ht->entries[i].esize--;
-				ht_cell_free(it);
+				ht_cell_retire(ht, i, it);
 			}
 			it = it0;
 		}
@@ -1432,7 +1915,7 @@ int ht_rm_cell_op(str *sre, ht_t *ht, int mode, int op)
 				if(it->next)
 					it->next->prev = it->prev;
 				ht->entries[i].esize--;
-				ht_cell_free(it);
+				ht_cell_retire(ht, i, it);
 			}
 			it = it0;
 		}
@@ -1546,7 +2029,7 @@ int ht_reset_content(ht_t *ht)
 			if(it->next)
 				it->next->prev = it->prev;
 			ht->entries[i].esize--;
-			ht_cell_free(it);
+			ht_cell_retire(ht, i, it);
 			it = it0;
 		}
 		ht_slot_unlock(ht, i);
@@ -1869,7 +2352,7 @@ int ht_iterator_rm(str *iname)
 	_ht_iterators[k].it = _ht_iterators[k].it->next;
 
 	ht_cell_unlink(_ht_iterators[k].ht, _ht_iterators[k].slot, itb);
-	ht_cell_free(itb);
+	ht_cell_retire(_ht_iterators[k].ht, _ht_iterators[k].slot, itb);
 
 	if(_ht_iterators[k].it != NULL) {
 		/* next item is in the same slot */
@@ -1953,7 +2436,7 @@ int ht_iterator_sets(str *iname, str *sval)
 		_ht_iterators[k].ht->entries[_ht_iterators[k].slot].first = cell;
 	if(itb->next)
 		itb->next->prev = cell;
-	ht_cell_free(itb);
+	ht_cell_retire(_ht_iterators[k].ht, _ht_iterators[k].slot, itb);
 	_ht_iterators[k].it = cell;
 
 	return 0;
@@ -2015,6 +2498,7 @@ int ht_iterator_setex(str *iname, int exval)
 
 	/* update expire */
 	itb->expire = time(NULL) + exval;
+	ht_wheel_mark(_ht_iterators[k].ht, _ht_iterators[k].slot, itb->expire);
 
 	return 0;
 }
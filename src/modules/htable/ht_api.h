@@ -40,6 +40,7 @@ typedef struct _ht_cell
 	str name;
 	int_str value;
 	time_t expire;
+	unsigned int epoch; /* reader epoch when the item was retired */
 	struct _ht_cell *prev;
 	struct _ht_cell *next;
 } ht_cell_t;
@@ -51,8 +52,21 @@ typedef struct _ht_entry
 	gen_lock_t lock;	 /* mutex to access items in the slot */
 	atomic_t locker_pid; /* pid of the process that holds the lock */
 	int rec_lock_level;	 /* recursive lock count */
+	volatile unsigned int seq; /* slot changes counter - odd while locked */
+	ht_cell_t *retired;		   /* unlinked items not yet released */
+	unsigned int nretired;	   /* number of retired items */
+	unsigned long nlocks;	   /* number of lock acquisitions */
+	unsigned long nwaits;	   /* number of contended lock acquisitions */
 } ht_entry_t;
 
+/* per process reader epochs for tables with lock-free reads */
+typedef struct _ht_epoch
+{
+	atomic_t global; /* advanced for each retired item */
+	int nprocs;		 /* size of active array */
+	atomic_t *active; /* epoch of the reader in each process, 0 if none */
+} ht_epoch_t;
+
 #define HT_MAX_COLS 8
 #define HT_EVEX_NAME_SIZE 64
 
@@ -72,10 +86,15 @@ typedef struct _ht
 	int updateexpire;
 	unsigned int htsize;
 	int dmqreplicate;
+	int lockfree;
+	atomic_t lfretries;
+	atomic_t lffallbacks;
 	int evex_index;
 	char evex_name_buf[HT_EVEX_NAME_SIZE];
 	str evex_name;
 	ht_entry_t *entries;
+	atomic_t *wheel;	/* expiry wheel - per tick bitmap of slots */
+	unsigned int wsize; /* number of bitmap words per tick */
 	struct _ht *next;
 } ht_t;
 
@@ -88,7 +107,7 @@ typedef struct _ht_pv
 
 int ht_add_table(str *name, int autoexp, str *dbtable, str *dbcols, int size,
 		int dbmode, int itype, int_str *ival, int updateexpire,
-		int dmqreplicate, char coldelim, char colnull);
+		int dmqreplicate, char coldelim, char colnull, int lockfree);
 int ht_init_tables(void);
 int ht_destroy(void);
 int ht_set_cell(ht_t *ht, str *name, int type, int_str *val, int mode);
@@ -101,6 +120,10 @@ int ht_dbg(void);
 ht_cell_t *ht_cell_pkg_copy(ht_t *ht, str *name, ht_cell_t *old);
 int ht_cell_pkg_free(ht_cell_t *cell);
 int ht_cell_free(ht_cell_t *cell);
+void ht_cell_retire(ht_t *ht, int idx, ht_cell_t *cell);
+void ht_cell_reclaim(ht_t *ht, int idx);
+int ht_epoch_init(void);
+int ht_has_lockfree(void);
 
 int ht_table_spec(char *spec);
 ht_t *ht_get_table(str *name);
@@ -141,6 +164,8 @@ int ht_iterator_seti(str *iname, int ival);
 int ht_iterator_setex(str *iname, int exval);
 ht_cell_t *ht_iterator_get_current(str *iname);
 
+void ht_wheel_mark(ht_t *ht, unsigned int idx, time_t expire);
+
 void ht_slot_lock(ht_t *ht, int idx);
 void ht_slot_unlock(ht_t *ht, int idx);
 
@@ -23,6 +23,12 @@
  */
 
 
+#include "../../core/mem/shm_mem.h"
+#include "../../core/mem/mem.h"
+#include "../../core/hashes.h"
+#include "../../core/timer.h"
+#include "../../core/timer_ticks.h"
+
 #include "ht_dmq.h"
 #include "ht_api.h"
 
@@ -45,6 +51,56 @@ typedef struct _ht_dmq_jdoc_cell_group
 	srjson_t *jdoc_cells;
 } ht_dmq_jdoc_cell_group_t;
 
+/* queued action for batched replication */
+typedef struct _ht_dmq_qitem
+{
+	int action;
+	int type;
+	int mode;
+	long intval;
+	str htname;
+	str cname;
+	str strval;
+	ticks_t qtime; /* time when queued */
+	struct _ht_dmq_qitem *next;
+	struct _ht_dmq_qitem *hnext;
+} ht_dmq_qitem_t;
+
+#define HT_DMQ_QINDEX_SIZE 1024
+
+typedef struct _ht_dmq_queue
+{
+	gen_lock_t lock;  /* queue access */
+	gen_lock_t slock; /* sending of batches, keeps them in order */
+	ht_dmq_qitem_t *first;
+	ht_dmq_qitem_t *last;
+	unsigned int depth;
+	unsigned int voided;
+	unsigned long enqueued;
+	unsigned long coalesced;
+	unsigned long sent;
+	unsigned long batches;
+	unsigned int lastlag;
+	unsigned int maxlag;
+	/* latest queued item per key, to coalesce updates */
+	ht_dmq_qitem_t *index[HT_DMQ_QINDEX_SIZE];
+} ht_dmq_queue_t;
+
+/* binary batch encoding - magic and version */
+#define HT_DMQ_BATCH_MAGIC "HTB\x01"
+#define HT_DMQ_BATCH_MAGIC_LEN 4
+/* record flags, combined with action in the first byte */
+#define HT_DMQ_BF_SAMETABLE (1 << 4)
+#define HT_DMQ_BF_CNAME (1 << 5)
+#define HT_DMQ_BF_VALUE (1 << 6)
+#define HT_DMQ_BF_STRVAL (1 << 7)
+
+static ht_dmq_queue_t *_ht_dmq_queue = NULL;
+static str ht_dmq_batch_content_type = str_init("application/octet-stream");
+extern int ht_dmq_batch_interval;
+extern int ht_dmq_batch_size;
+extern int ht_dmq_queue_size;
+
 static str ht_dmq_content_type = str_init("application/json");
 static str dmq_200_rpl = str_init("OK");
 static str dmq_400_rpl = str_init("Bad Request");
@@ -254,6 +310,475 @@ int ht_dmq_send(str *body, dmq_node_t *node)
 	return 0;
 }
 
+/**
+ * init the queue for batched replication
+ */
+int ht_dmq_queue_init(void)
+{
+	if(_ht_dmq_queue != NULL)
+		return 0;
+
+	_ht_dmq_queue = (ht_dmq_queue_t *)shm_malloc(sizeof(ht_dmq_queue_t));
+	if(_ht_dmq_queue == NULL) {
+		LM_ERR("no more shm\n");
+		return -1;
+	}
+	memset(_ht_dmq_queue, 0, sizeof(ht_dmq_queue_t));
+	if(lock_init(&_ht_dmq_queue->lock) == 0
+			|| lock_init(&_ht_dmq_queue->slock) == 0) {
+		LM_ERR("cannot init the queue locks\n");
+		shm_free(_ht_dmq_queue);
+		_ht_dmq_queue = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+static int ht_dmq_varint_set(char *p, unsigned long v)
+{
+	int n;
+
+	n = 0;
+	while(v >= 0x80) {
+		p[n++] = (char)((v & 0x7f) | 0x80);
+		v >>= 7;
+	}
+	p[n++] = (char)v;
+	return n;
+}
+
+static int ht_dmq_varint_get(
+		unsigned char **p, unsigned char *end, unsigned long *v)
+{
+	unsigned long r;
+	int shift;
+
+	r = 0;
+	for(shift = 0; *p < end && shift < 64; shift += 7) {
+		r |= (unsigned long)(**p & 0x7f) << shift;
+		if(!(*(*p)++ & 0x80)) {
+			*v = r;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+/**
+ * encode a queued action, with table and key name relative to the previous
+ * action in the batch
+ * - record: flags|action, [htname], [key prefix len, key rest], [value], mode
+ * - return: number of written bytes
+ */
+static int ht_dmq_batch_encode(char *p, ht_dmq_qitem_t *qi, ht_dmq_qitem_t *prev)
+{
+	char *p0;
+	int flags;
+	int plen;
+
+	p0 = p;
+	flags = qi->action & 0x0f;
+	if(prev != NULL && prev->htname.len == qi->htname.len
+			&& memcmp(prev->htname.s, qi->htname.s, qi->htname.len) == 0)
+		flags |= HT_DMQ_BF_SAMETABLE;
+	if(qi->cname.s != NULL)
+		flags |= HT_DMQ_BF_CNAME;
+	if(qi->action != HT_DMQ_DEL_CELL) {
+		flags |= HT_DMQ_BF_VALUE;
+		if(qi->type & AVP_VAL_STR)
+			flags |= HT_DMQ_BF_STRVAL;
+	}
+	*p++ = (char)flags;
+	if(!(flags & HT_DMQ_BF_SAMETABLE)) {
+		p += ht_dmq_varint_set(p, qi->htname.len);
+		memcpy(p, qi->htname.s, qi->htname.len);
+		p += qi->htname.len;
+	}
+	if(flags & HT_DMQ_BF_CNAME) {
+		plen = 0;
+		if(prev != NULL && prev->cname.s != NULL) {
+			while(plen < prev->cname.len && plen < qi->cname.len
+					&& prev->cname.s[plen] == qi->cname.s[plen])
+				plen++;
+		}
+		p += ht_dmq_varint_set(p, plen);
+		p += ht_dmq_varint_set(p, qi->cname.len - plen);
+		memcpy(p, qi->cname.s + plen, qi->cname.len - plen);
+		p += qi->cname.len - plen;
+	}
+	if(flags & HT_DMQ_BF_STRVAL) {
+		p += ht_dmq_varint_set(p, qi->strval.len);
+		memcpy(p, qi->strval.s, qi->strval.len);
+		p += qi->strval.len;
+	} else if(flags & HT_DMQ_BF_VALUE) {
+		/* zigzag encoding keeps small negative values short */
+		p += ht_dmq_varint_set(p,
+				((unsigned long)qi->intval << 1)
+						^ (unsigned long)(qi->intval >> (sizeof(long) * 8 - 1)));
+	}
+	p += ht_dmq_varint_set(p, (unsigned long)qi->mode);
+	return (int)(p - p0);
+}
+
+static int ht_dmq_batch_bcast(str *body, int nitems)
+{
+	LM_DBG("sending batch of %d actions (%d bytes)\n", nitems, body->len);
+	if(ht_dmqb.bcast_message(
+			   ht_dmq_peer, body, 0, NULL, 1, &ht_dmq_batch_content_type)
+			< 0) {
+		LM_ERR("failed to send batch of %d actions\n", nitems);
+		return -1;
+	}
+	_ht_dmq_queue->sent += nitems;
+	_ht_dmq_queue->batches++;
+	return 0;
+}
+
+/**
+ * encode the list of queued actions in batches and send them, releasing
+ * the items - to be done with the send lock
+ */
+static int ht_dmq_batch_send(ht_dmq_qitem_t *list)
+{
+	ht_dmq_qitem_t *qi;
+	ht_dmq_qitem_t *qn;
+	ht_dmq_qitem_t *prev;
+	str body = STR_NULL;
+	char *nbuf;
+	int bsize;
+	int need;
+	int nitems;
+	int ret;
+
+	ret = 0;
+	bsize = 0;
+	nitems = 0;
+	prev = NULL;
+	for(qi = list; qi != NULL; qi = qn) {
+		qn = qi->next;
+		if(qi->action == HT_DMQ_NONE) {
+			/* coalesced with a later update */
+			shm_free(qi);
+			continue;
+		}
+		need = HT_DMQ_BATCH_MAGIC_LEN + 32 + qi->htname.len + qi->cname.len
+			   + qi->strval.len;
+		if(body.len + need > bsize) {
+			bsize = body.len + need;
+			if(bsize < ht_dmq_batch_size + need)
+				bsize = ht_dmq_batch_size + need;
+			nbuf = (char *)pkg_realloc(body.s, bsize);
+			if(nbuf == NULL) {
+				PKG_MEM_ERROR;
+				ret = -1;
+				shm_free(qi);
+				continue;
+			}
+			body.s = nbuf;
+		}
+		if(body.len == 0) {
+			memcpy(body.s, HT_DMQ_BATCH_MAGIC, HT_DMQ_BATCH_MAGIC_LEN);
+			body.len = HT_DMQ_BATCH_MAGIC_LEN;
+		}
+		body.len += ht_dmq_batch_encode(body.s + body.len, qi, prev);
+		nitems++;
+		if(prev != NULL)
+			shm_free(prev);
+		prev = qi;
+		if(body.len >= ht_dmq_batch_size) {
+			if(ht_dmq_batch_bcast(&body, nitems) < 0)
+				ret = -1;
+			body.len = 0;
+			nitems = 0;
+			shm_free(prev);
+			prev = NULL;
+		}
+	}
+	if(body.len > 0 && ht_dmq_batch_bcast(&body, nitems) < 0)
+		ret = -1;
+	if(prev != NULL)
+		shm_free(prev);
+	if(body.s != NULL)
+		pkg_free(body.s);
+	return ret;
+}
+
+/**
+ * send the queued actions
+ */
+static int ht_dmq_queue_flush(void)
+{
+	ht_dmq_qitem_t *list;
+	unsigned int lag;
+	int ret;
+
+	lock_get(&_ht_dmq_queue->slock);
+	lock_get(&_ht_dmq_queue->lock);
+	list = _ht_dmq_queue->first;
+	if(list != NULL) {
+		lag = TICKS_TO_MS(get_ticks_raw() - list->qtime);
+		_ht_dmq_queue->lastlag = lag;
+		if(lag > _ht_dmq_queue->maxlag)
+			_ht_dmq_queue->maxlag = lag;
+	}
+	_ht_dmq_queue->first = NULL;
+	_ht_dmq_queue->last = NULL;
+	_ht_dmq_queue->depth = 0;
+	_ht_dmq_queue->voided = 0;
+	memset(_ht_dmq_queue->index, 0, sizeof(_ht_dmq_queue->index));
+	lock_release(&_ht_dmq_queue->lock);
+
+	ret = 0;
+	if(list != NULL)
+		ret = ht_dmq_batch_send(list);
+	lock_release(&_ht_dmq_queue->slock);
+	return ret;
+}
+
+/**
+ * add an action to the replication queue
+ * - a pending update of the same item with the same action is replaced
+ *   by the new one, which is queued at the end to keep the order with
+ *   other actions
+ */
+static int ht_dmq_queue_add(ht_dmq_action_t action, str *htname, str *cname,
+		int type, int_str *val, int mode)
+{
+	ht_dmq_qitem_t *qi;
+	ht_dmq_qitem_t *it;
+	ht_dmq_qitem_t **pit;
+	unsigned int hidx;
+	int indexed;
+	int size;
+	char *p;
+
+	size = sizeof(ht_dmq_qitem_t) + htname->len;
+	if(cname != NULL)
+		size += cname->len;
+	if(val != NULL && (type & AVP_VAL_STR))
+		size += val->s.len;
+	qi = (ht_dmq_qitem_t *)shm_malloc(size);
+	if(qi == NULL) {
+		LM_ERR("no more shm\n");
+		return -1;
+	}
+	memset(qi, 0, sizeof(ht_dmq_qitem_t));
+	qi->action = action;
+	qi->type = type;
+	qi->mode = mode;
+	p = (char *)qi + sizeof(ht_dmq_qitem_t);
+	qi->htname.s = p;
+	qi->htname.len = htname->len;
+	memcpy(p, htname->s, htname->len);
+	p += htname->len;
+	if(cname != NULL) {
+		qi->cname.s = p;
+		qi->cname.len = cname->len;
+		memcpy(p, cname->s, cname->len);
+		p += cname->len;
+	}
+	if(val != NULL) {
+		if(type & AVP_VAL_STR) {
+			qi->strval.s = p;
+			qi->strval.len = val->s.len;
+			memcpy(p, val->s.s, val->s.len);
+		} else {
+			qi->intval = val->n;
+		}
+	}
+	qi->qtime = get_ticks_raw();
+
+	/* only actions on one item can be coalesced */
+	indexed = (cname != NULL
+			   && (action == HT_DMQ_SET_CELL || action == HT_DMQ_SET_CELL_EXPIRE
+					   || action == HT_DMQ_DEL_CELL));
+	hidx = 0;
+	if(indexed)
+		hidx = core_hash(htname, cname, HT_DMQ_QINDEX_SIZE);
+
+	if(_ht_dmq_queue->depth >= ht_dmq_queue_size) {
+		/* queue is full - send it now */
+		ht_dmq_queue_flush();
+	}
+
+	lock_get(&_ht_dmq_queue->lock);
+	if(indexed) {
+		pit = &_ht_dmq_queue->index[hidx];
+		for(it = *pit; it != NULL; pit = &it->hnext, it = it->hnext) {
+			if(it->cname.len == cname->len && it->htname.len == htname->len
+					&& memcmp(it->cname.s, cname->s, cname->len) == 0
+					&& memcmp(it->htname.s, htname->s, htname->len) == 0)
+				break;
+		}
+		if(it != NULL) {
+			*pit = it->hnext;
+			it->hnext = NULL;
+			if(it->action == action && action != HT_DMQ_DEL_CELL) {
+				it->action = HT_DMQ_NONE;
+				_ht_dmq_queue->voided++;
+				_ht_dmq_queue->coalesced++;
+			}
+		}
+		qi->hnext = _ht_dmq_queue->index[hidx];
+		_ht_dmq_queue->index[hidx] = qi;
+	}
+	if(_ht_dmq_queue->last == NULL) {
+		_ht_dmq_queue->first = qi;
+	} else {
+		_ht_dmq_queue->last->next = qi;
+	}
+	_ht_dmq_queue->last = qi;
+	_ht_dmq_queue->depth++;
+	_ht_dmq_queue->enqueued++;
+	lock_release(&_ht_dmq_queue->lock);
+	return 0;
+}
+
+/**
+ * timer routine sending the queued actions
+ */
+void ht_dmq_queue_timer(unsigned int ticks, void *param)
+{
+	if(_ht_dmq_queue == NULL || _ht_dmq_queue->first == NULL)
+		return;
+	ht_dmq_queue_flush();
+}
+
+int ht_dmq_queue_stats(ht_dmq_qstats_t *qs)
+{
+	if(_ht_dmq_queue == NULL)
+		return -1;
+
+	memset(qs, 0, sizeof(ht_dmq_qstats_t));
+	lock_get(&_ht_dmq_queue->lock);
+	qs->depth = _ht_dmq_queue->depth;
+	qs->pending = _ht_dmq_queue->depth - _ht_dmq_queue->voided;
+	qs->enqueued = _ht_dmq_queue->enqueued;
+	qs->coalesced = _ht_dmq_queue->coalesced;
+	qs->sent = _ht_dmq_queue->sent;
+	qs->batches = _ht_dmq_queue->batches;
+	qs->lastlag = _ht_dmq_queue->lastlag;
+	qs->maxlag = _ht_dmq_queue->maxlag;
+	if(_ht_dmq_queue->first != NULL)
+		qs->lag = TICKS_TO_MS(get_ticks_raw() - _ht_dmq_queue->first->qtime);
+	lock_release(&_ht_dmq_queue->lock);
+	return 0;
+}
+
+/**
+ * replay the actions from a binary batch
+ */
+static int ht_dmq_batch_handle(str *body)
+{
+	unsigned char *p;
+	unsigned char *end;
+	unsigned long v;
+	unsigned long plen;
+	int flags;
+	int action;
+	int type;
+	int mode;
+	str htname = STR_NULL;
+	str cname = STR_NULL;
+	str ename = str_init("");
+	str kbuf = STR_NULL;
+	str vbuf = STR_NULL;
+	int ksize = 0;
+	int vsize = 0;
+	int_str val;
+	char *nbuf;
+	int ret = -1;
+
+	p = (unsigned char *)body->s + HT_DMQ_BATCH_MAGIC_LEN;
+	end = (unsigned char *)body->s + body->len;
+	kbuf.len = 0;
+	while(p < end) {
+		flags = *p++;
+		action = flags & 0x0f;
+		if(action == HT_DMQ_NONE || action == HT_DMQ_SYNC
+				|| action > HT_DMQ_RM_CELL_IN) {
+			LM_ERR("invalid action %d in batch\n", action);
+			goto done;
+		}
+		if(!(flags & HT_DMQ_BF_SAMETABLE)) {
+			if(ht_dmq_varint_get(&p, end, &v) < 0 || v > end - p)
+				goto malformed;
+			htname.s = (char *)p;
+			htname.len = (int)v;
+			p += v;
+		} else if(htname.s == NULL) {
+			goto malformed;
+		}
+		if(flags & HT_DMQ_BF_CNAME) {
+			if(ht_dmq_varint_get(&p, end, &plen) < 0 || plen > kbuf.len
+					|| ht_dmq_varint_get(&p, end, &v) < 0 || v > end - p)
+				goto malformed;
+			if(plen + v + 1 > ksize) {
+				ksize = plen + v + 1;
+				nbuf = (char *)pkg_realloc(kbuf.s, ksize);
+				if(nbuf == NULL) {
+					PKG_MEM_ERROR;
+					goto done;
+				}
+				kbuf.s = nbuf;
+			}
+			memcpy(kbuf.s + plen, p, v);
+			kbuf.len = (int)(plen + v);
+			kbuf.s[kbuf.len] = '\0';
+			p += v;
+			cname = kbuf;
+		} else {
+			cname = ename;
+		}
+		type = 0;
+		memset(&val, 0, sizeof(int_str));
+		if(flags & HT_DMQ_BF_STRVAL) {
+			if(ht_dmq_varint_get(&p, end, &v) < 0 || v > end - p)
+				goto malformed;
+			/* kept zero terminated, it can be a regular expression */
+			if(v + 1 > vsize) {
+				vsize = v + 1;
+				nbuf = (char *)pkg_realloc(vbuf.s, vsize);
+				if(nbuf == NULL) {
+					PKG_MEM_ERROR;
+					goto done;
+				}
+				vbuf.s = nbuf;
+			}
+			memcpy(vbuf.s, p, v);
+			vbuf.len = (int)v;
+			vbuf.s[vbuf.len] = '\0';
+			p += v;
+			val.s = vbuf;
+			type = AVP_VAL_STR;
+		} else if(flags & HT_DMQ_BF_VALUE) {
+			if(ht_dmq_varint_get(&p, end, &v) < 0)
+				goto malformed;
+			val.n = (long)(v >> 1) ^ -(long)(v & 1);
+		}
+		if(ht_dmq_varint_get(&p, end, &v) < 0)
+			goto malformed;
+		mode = (int)v;
+		if(ht_dmq_replay_action(action, &htname, &cname, type, &val, mode)
+				!= 0) {
+			LM_WARN("failed to replay action %d on %.*s=>%.*s\n", action,
+					htname.len, htname.s, cname.len, cname.s);
+		}
+	}
+	ret = 0;
+	goto done;
+
+malformed:
+	LM_ERR("malformed batch at offset %d\n",
+			(int)((char *)p - body->s));
+done:
+	if(kbuf.s != NULL)
+		pkg_free(kbuf.s);
+	if(vbuf.s != NULL)
+		pkg_free(vbuf.s);
+	return ret;
+}
+
 /**
  * @brief ht dmq callback
  */
@@ -296,6 +821,18 @@ int ht_dmq_handle_msg(
 	/* parse body */
 	LM_DBG("body: %.*s\n", body.len, body.s);
 
+	if(body.len >= HT_DMQ_BATCH_MAGIC_LEN
+			&& memcmp(body.s, HT_DMQ_BATCH_MAGIC, HT_DMQ_BATCH_MAGIC_LEN)
+					   == 0) {
+		/* binary batch of actions */
+		if(ht_dmq_batch_handle(&body) < 0)
+			goto invalid;
+		srjson_DestroyDoc(&jdoc);
+		resp->reason = dmq_200_rpl;
+		resp->resp_code = 200;
+		return 0;
+	}
+
 	jdoc.buf = body;
 
 	if(jdoc.root == NULL) {
@@ -369,6 +906,10 @@ int ht_dmq_replicate_action(ht_dmq_action_t action, str *htname, str *cname,
 
 	srjson_doc_t jdoc;
 
+	if(_ht_dmq_queue != NULL) {
+		return ht_dmq_queue_add(action, htname, cname, type, val, mode);
+	}
+
 	LM_DBG("replicating action to dmq peers...\n");
 
 	srjson_InitDoc(&jdoc, NULL);
@@ -55,4 +55,22 @@ int ht_dmq_replay_action(ht_dmq_action_t action, str *htname, str *cname,
 int ht_dmq_request_sync(str *htname);
 int ht_dmq_request_sync_all();
 
+/* replication queue statistics */
+typedef struct _ht_dmq_qstats
+{
+	unsigned int depth;			/* items in queue, including coalesced */
+	unsigned int pending;		/* items to be sent */
+	unsigned long enqueued;		/* items added to queue */
+	unsigned long coalesced;	/* items replaced by a later update */
+	unsigned long sent;			/* items sent */
+	unsigned long batches;		/* messages sent */
+	unsigned int lag;			/* age of the oldest pending item (ms) */
+	unsigned int lastlag;		/* age of the oldest item at last flush (ms) */
+	unsigned int maxlag;		/* max age of the oldest item at flush (ms) */
+} ht_dmq_qstats_t;
+
+int ht_dmq_queue_init(void);
+void ht_dmq_queue_timer(unsigned int ticks, void *param);
+int ht_dmq_queue_stats(ht_dmq_qstats_t *qs);
+
 #endif
@@ -56,6 +56,9 @@ int ht_db_expires_flag = 0;
 int ht_enable_dmq = 0;
 int ht_dmq_init_sync = 0;
 int ht_timer_procs = 0;
+int ht_dmq_batch_interval = 0;
+int ht_dmq_batch_size = 60000;
+int ht_dmq_queue_size = 100000;
 static int ht_event_callback_mode = 0;
 
 str ht_event_callback = STR_NULL;
@@ -182,6 +185,9 @@ static param_export_t params[] = {
 	{"enable_dmq", PARAM_INT, &ht_enable_dmq},
 	{"dmq_init_sync", PARAM_INT, &ht_dmq_init_sync},
 	{"timer_procs", PARAM_INT, &ht_timer_procs},
+	{"dmq_batch_interval", PARAM_INT, &ht_dmq_batch_interval},
+	{"dmq_batch_size", PARAM_INT, &ht_dmq_batch_size},
+	{"dmq_queue_size", PARAM_INT, &ht_dmq_queue_size},
 	{"event_callback", PARAM_STR, &ht_event_callback},
 	{"event_callback_mode", PARAM_INT, &ht_event_callback_mode},
 	{0, 0, 0}
@@ -228,7 +234,7 @@ static int mod_init(void)
 		}
 		ht_db_close_con();
 	}
-	if(ht_has_autoexpire()) {
+	if(ht_has_autoexpire() || ht_has_lockfree()) {
 		LM_DBG("starting auto-expire timer\n");
 		if(ht_timer_interval <= 0)
 			ht_timer_interval = 20;
@@ -246,6 +252,17 @@ static int mod_init(void)
 		LM_ERR("failed to initialize dmq integration\n");
 		return -1;
 	}
+	if(ht_enable_dmq > 0 && ht_dmq_batch_interval > 0) {
+		if(ht_dmq_batch_size <= 0)
+			ht_dmq_batch_size = 60000;
+		if(ht_dmq_queue_size <= 0)
+			ht_dmq_queue_size = 100000;
+		if(ht_dmq_queue_init() != 0) {
+			LM_ERR("failed to initialize dmq replication queue\n");
+			return -1;
+		}
+		register_basic_timers(1);
+	}
 
 	ht_iterator_init();
 
@@ -267,7 +284,7 @@ static int child_init(int rank)
 	LM_DBG("rank is (%d)\n", rank);
 
 	if(rank == PROC_MAIN) {
-		if(ht_has_autoexpire() && ht_timer_procs > 0) {
+		if((ht_has_autoexpire() || ht_has_lockfree()) && ht_timer_procs > 0) {
 			for(i = 0; i < ht_timer_procs; i++) {
 				if(fork_sync_timer(PROC_TIMER, "HTable Timer", 1 /*socks flag*/,
 						   ht_timer, (void *)(long)i, ht_timer_interval)
@@ -277,6 +294,20 @@ static int child_init(int rank)
 				}
 			}
 		}
+		if(ht_enable_dmq > 0 && ht_dmq_batch_interval > 0) {
+			if(fork_basic_utimer(PROC_TIMER, "HTable DMQ Timer",
+					   1 /*socks flag*/, ht_dmq_queue_timer, NULL,
+					   1000 * ht_dmq_batch_interval /*milliseconds*/)
+					< 0) {
+				LM_ERR("failed to start dmq timer routine as process\n");
+				return -1; /* error */
+			}
+		}
+	}
+
+	if(rank == PROC_INIT) {
+		if(ht_epoch_init() < 0)
+			return -1;
 	}
 
 	if(ht_event_callback_mode == 0 && rank != PROC_INIT)
@@ -1532,6 +1563,10 @@ static const char *htable_stats_doc[2] = {
 	"Statistics about htables.",
 	0
 };
+static const char *htable_lockstats_doc[2] = {
+	"Slot locks contention and lock-free reads statistics about htables.",
+	0
+};
 static const char *htable_flush_doc[2] = {
 	"Flush hash table.",
 	0
@@ -1548,6 +1583,10 @@ static const char *htable_dmqsync_doc[2] = {
 	"Perform DMQ sync action.",
 	0
 };
+static const char *htable_dmqstats_doc[2] = {
+	"Statistics about the DMQ replication queue.",
+	0
+};
 static const char *htable_dmqresync_doc[2] = {
 	"Perform DMQ resync action (flush and sync).",
 	0
@@ -1975,6 +2014,56 @@ error:
 	return;
 }
 
+static void htable_rpc_lockstats(rpc_t *rpc, void *c)
+{
+	ht_t *ht;
+	void *th;
+	unsigned long locks;
+	unsigned long waits;
+	unsigned long maxwaits;
+	unsigned long retired;
+	unsigned int i;
+
+	ht = ht_get_root();
+	if(ht == NULL) {
+		rpc->fault(c, 500, "No htables");
+		return;
+	}
+	while(ht != NULL) {
+		if(rpc->add(c, "{", &th) < 0) {
+			rpc->fault(c, 500, "Internal error creating structure rpc");
+			return;
+		}
+		locks = 0;
+		waits = 0;
+		maxwaits = 0;
+		retired = 0;
+		/* counters are read without locking, values are indicative */
+		for(i = 0; i < ht->htsize; i++) {
+			locks += ht->entries[i].nlocks;
+			waits += ht->entries[i].nwaits;
+			if(ht->entries[i].nwaits > maxwaits)
+				maxwaits = ht->entries[i].nwaits;
+			retired += ht->entries[i].nretired;
+		}
+		if(rpc->struct_add(th, "Sddjjjjdd", "name", &ht->name, /* str */
+				   "slots", (int)ht->htsize,				   /* uint */
+				   "lockfree", ht->lockfree,				   /* int */
+				   "locks", locks,							   /* ulong */
+				   "waits", waits,							   /* ulong */
+				   "maxwaits", maxwaits,					   /* ulong */
+				   "retired", retired,						   /* ulong */
+				   "lfretries", atomic_get(&ht->lfretries),   /* int */
+				   "lffallbacks", atomic_get(&ht->lffallbacks) /* int */
+				   )
+				< 0) {
+			rpc->fault(c, 500, "Internal error creating rpc structure");
+			return;
+		}
+		ht = ht->next;
+	}
+}
+
 /*! \brief RPC htable.flush command to empty a hash table */
 static void htable_rpc_flush(rpc_t *rpc, void *c)
 {
@@ -2038,6 +2127,8 @@ static void htable_rpc_reload(rpc_t *rpc, void *c)
 	}
 
 	memcpy(&nht, ht, sizeof(ht_t));
+	/* temporary table is not visible to readers */
+	nht.lockfree = 0;
 	/* it's temporary operation - use system malloc */
 	nht.entries = (ht_entry_t *)malloc(nht.htsize * sizeof(ht_entry_t));
 	if(nht.entries == NULL) {
@@ -2069,6 +2160,14 @@ static void htable_rpc_reload(rpc_t *rpc, void *c)
 		first = ht->entries[i].first;
 		ht->entries[i].first = nht.entries[i].first;
 		ht->entries[i].esize = nht.entries[i].esize;
+		if(ht->lockfree) {
+			/* old entries may still be used by lock-free readers */
+			while(first) {
+				it = first;
+				first = first->next;
+				ht_cell_retire(ht, i, it);
+			}
+		}
 		ht_slot_unlock(ht, i);
 		nht.entries[i].first = first;
 	}
@@ -2182,6 +2281,29 @@ static void htable_rpc_dmqresync(rpc_t *rpc, void *c)
 	rpc->rpl_printf(c, "Ok");
 }
 
+static void htable_rpc_dmqstats(rpc_t *rpc, void *c)
+{
+	ht_dmq_qstats_t qs;
+	void *th;
+
+	if(ht_dmq_queue_stats(&qs) < 0) {
+		rpc->fault(c, 500, "DMQ replication queue not enabled");
+		return;
+	}
+	if(rpc->add(c, "{", &th) < 0) {
+		rpc->fault(c, 500, "Internal error creating rpc structure");
+		return;
+	}
+	if(rpc->struct_add(th, "uujjjjuuu", "depth", qs.depth, "pending",
+			   qs.pending, "enqueued", qs.enqueued, "coalesced", qs.coalesced,
+			   "sent", qs.sent, "batches", qs.batches, "lag_ms", qs.lag,
+			   "last_lag_ms", qs.lastlag, "max_lag_ms", qs.maxlag)
+			< 0) {
+		rpc->fault(c, 500, "Internal error adding rpc structure fields");
+		return;
+	}
+}
+
 /* clang-format off */
 rpc_export_t htable_rpc[] = {
 	{"htable.dump", htable_rpc_dump, htable_dump_doc, RET_ARRAY},
@@ -2196,9 +2318,11 @@ rpc_export_t htable_rpc[] = {
 	{"htable.reload", htable_rpc_reload, htable_reload_doc, 0},
 	{"htable.store", htable_rpc_store, htable_store_doc, 0},
 	{"htable.stats", htable_rpc_stats, htable_stats_doc, RET_ARRAY},
+	{"htable.lockstats", htable_rpc_lockstats, htable_lockstats_doc, RET_ARRAY},
 	{"htable.flush", htable_rpc_flush, htable_flush_doc, 0},
 	{"htable.dmqsync", htable_rpc_dmqsync, htable_dmqsync_doc, 0},
 	{"htable.dmqresync", htable_rpc_dmqresync, htable_dmqresync_doc, 0},
+	{"htable.dmqstats", htable_rpc_dmqstats, htable_dmqstats_doc, 0},
 	{0, 0, 0, 0}
 };
 /* clang-format on */
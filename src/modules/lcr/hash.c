@@ -41,7 +41,8 @@ int rule_hash_table_insert(struct rule_info **hash_table, unsigned int lcr_id,
 		unsigned short from_uri_len, char *from_uri, pcre2_code *from_uri_re,
 		unsigned short mt_tvalue_len, char *mt_tvalue,
 		unsigned short request_uri_len, char *request_uri,
-		pcre2_code *request_uri_re, unsigned short stopper)
+		pcre2_code *request_uri_re, unsigned short re_owner,
+		unsigned short stopper)
 {
 	struct rule_info *rule;
 	str prefix_str;
@@ -51,9 +52,9 @@ int rule_hash_table_insert(struct rule_info **hash_table, unsigned int lcr_id,
 	rule = (struct rule_info *)shm_malloc(sizeof(struct rule_info));
 	if(rule == NULL) {
 		SHM_MEM_ERROR_FMT("for rule hash table entry\n");
-		if(from_uri_re)
+		if(from_uri_re && (re_owner & LCR_RE_FROM_OWNER))
 			pcre2_code_free(from_uri_re);
-		if(request_uri_re)
+		if(request_uri_re && (re_owner & LCR_RE_RURI_OWNER))
 			pcre2_code_free(request_uri_re);
 		return 0;
 	}
@@ -81,6 +82,7 @@ int rule_hash_table_insert(struct rule_info **hash_table, unsigned int lcr_id,
 		(rule->request_uri)[request_uri_len] = '\0';
 		rule->request_uri_re = request_uri_re;
 	}
+	rule->re_owner = re_owner;
 	rule->stopper = stopper;
 	rule->targets = (struct target *)NULL;
 
@@ -100,9 +102,9 @@ int rule_hash_table_insert(struct rule_info **hash_table, unsigned int lcr_id,
 	rid = (struct rule_id_info *)pkg_malloc(sizeof(struct rule_id_info));
 	if(rid == NULL) {
 		PKG_MEM_ERROR_FMT("for rule_id hash table entry\n");
-		if(from_uri_re)
+		if(from_uri_re && (re_owner & LCR_RE_FROM_OWNER))
 			pcre2_code_free(from_uri_re);
-		if(request_uri_re)
+		if(request_uri_re && (re_owner & LCR_RE_RURI_OWNER))
 			pcre2_code_free(request_uri_re);
 		shm_free(rule);
 		return 0;
@@ -210,10 +212,10 @@ void rule_hash_table_contents_free(struct rule_info **hash_table)
 	for(i = 0; i <= lcr_rule_hash_size_param; i++) {
 		r = hash_table[i];
 		while(r) {
-			if(r->from_uri_re) {
+			if(r->from_uri_re && (r->re_owner & LCR_RE_FROM_OWNER)) {
 				pcre2_code_free(r->from_uri_re);
 			}
-			if(r->request_uri_re)
+			if(r->request_uri_re && (r->re_owner & LCR_RE_RURI_OWNER))
 				pcre2_code_free(r->request_uri_re);
 			t = r->targets;
 			while(t) {
@@ -67,6 +67,7 @@
 #include "../../core/socket_info.h"
 #include "../../core/pvar.h"
 #include "../../core/rand/kam_rand.h"
+#include "../../core/hashes.h"
 #include "../../core/kemi.h"
 #include "hash.h"
 #include "lcr_rpc.h"
@@ -210,6 +211,30 @@ str mtree_param = {"lcr", 3};
 static pcre2_general_context *lcr_gctx = NULL;
 static pcre2_compile_context *lcr_ctx = NULL;
 
+/* Match data of the process, reused for all rule regular expressions */
+static pcre2_match_data *lcr_md = NULL;
+
+#define LCR_RE_MEMO_SIZE 16
+
+/* Results of the regular expressions already matched against a subject */
+struct re_memo
+{
+	pcre2_code *re[LCR_RE_MEMO_SIZE];
+	int rc[LCR_RE_MEMO_SIZE];
+	int n;
+};
+
+/* Regular expressions compiled while reloading the rules of an lcr
+ * instance, so that rules with the same pattern share the compiled code */
+struct re_entry
+{
+	str pattern;
+	pcre2_code *re;
+	struct re_entry *next;
+};
+
+static struct re_entry **re_table = NULL;
+
 /*
  * Other module types and variables
  */
@@ -826,6 +851,10 @@ static int child_init(int rank)
 static void destroy(void)
 {
 	lcr_db_close();
+	if(lcr_md) {
+		pcre2_match_data_free(lcr_md);
+		lcr_md = NULL;
+	}
 	if(lcr_ctx) {
 		pcre2_compile_context_free(lcr_ctx);
 	}
@@ -942,6 +971,100 @@ static pcre2_code *reg_ex_comp(const char *pattern)
 }
 
 
+/*
+ * Return compiled pattern from re_table or compile and add it.  Sets
+ * *owner to 1 if the pattern was compiled for the caller.
+ */
+static pcre2_code *re_table_get(char *pattern, int len, int *owner)
+{
+	struct re_entry *e;
+	str pattern_str;
+	unsigned int hash_val;
+
+	*owner = 0;
+	pattern_str.s = pattern;
+	pattern_str.len = len;
+	hash_val = core_hash(&pattern_str, 0, lcr_rule_hash_size_param);
+	for(e = re_table[hash_val]; e; e = e->next) {
+		if(e->pattern.len == len && memcmp(e->pattern.s, pattern, len) == 0)
+			return e->re;
+	}
+
+	e = (struct re_entry *)pkg_malloc(sizeof(struct re_entry) + len);
+	if(e == NULL) {
+		PKG_MEM_ERROR_FMT("for regex table entry\n");
+		return NULL;
+	}
+	e->re = reg_ex_comp(pattern);
+	if(e->re == NULL) {
+		pkg_free(e);
+		return NULL;
+	}
+	e->pattern.s = (char *)(e + 1);
+	e->pattern.len = len;
+	memcpy(e->pattern.s, pattern, len);
+	e->next = re_table[hash_val];
+	re_table[hash_val] = e;
+	*owner = 1;
+	return e->re;
+}
+
+
+/* Free contents of re_table, the compiled patterns are owned by rules */
+static void re_table_contents_free(void)
+{
+	int i;
+	struct re_entry *e, *next_e;
+
+	if(re_table == NULL)
+		return;
+
+	for(i = 0; i < lcr_rule_hash_size_param; i++) {
+		e = re_table[i];
+		while(e) {
+			next_e = e->next;
+			pkg_free(e);
+			e = next_e;
+		}
+		re_table[i] = NULL;
+	}
+}
+
+
+/*
+ * Match subject against re.  The result is remembered in memo, so a
+ * pattern shared by many rules is evaluated only once per request.
+ * The patterns of a prefix are not joined in one alternation, which
+ * would report only the first matching pattern and would break back
+ * references.  Returns pcre2_match() result.
+ */
+static int re_memo_match(struct re_memo *memo, pcre2_code *re, str *subject)
+{
+	int i, rc;
+
+	for(i = 0; i < memo->n; i++) {
+		if(memo->re[i] == re)
+			return memo->rc[i];
+	}
+
+	if(lcr_md == NULL) {
+		lcr_md = pcre2_match_data_create(1, NULL);
+		if(lcr_md == NULL) {
+			LM_ERR("failed to create pcre2 match data\n");
+			return PCRE2_ERROR_NOMEMORY;
+		}
+	}
+	rc = pcre2_match(re, (PCRE2_SPTR)subject->s, (PCRE2_SIZE)subject->len, 0,
+			0, lcr_md, NULL);
+	if(memo->n < LCR_RE_MEMO_SIZE) {
+		memo->re[memo->n] = re;
+		memo->rc[memo->n] = rc;
+		memo->n++;
+	}
+	return rc;
+}
+
+
 /*
  * Compare gateways based on their IP address
  */
@@ -1441,6 +1564,8 @@ int reload_tables()
 	unsigned int i, n, lcr_id, rule_id, gw_id, from_uri_len, mt_tvalue_len,
 			request_uri_len, stopper, prefix_len, enabled, gw_cnt,
 			null_gw_ip_addr, priority, weight, tmp;
+	int owner;
+	unsigned short re_owner;
 	char *prefix, *from_uri, *mt_tvalue, *request_uri;
 	db1_res_t *res = NULL;
 	db_row_t *row;
@@ -1502,6 +1627,13 @@ int reload_tables()
 	memset(rule_id_hash_table, 0,
 			sizeof(struct rule_id_info *) * lcr_rule_hash_size_param);
 
+	re_table = pkg_malloc(sizeof(struct re_entry *) * lcr_rule_hash_size_param);
+	if(!re_table) {
+		PKG_MEM_ERROR_FMT("for regex table\n");
+		goto err;
+	}
+	memset(re_table, 0, sizeof(struct re_entry *) * lcr_rule_hash_size_param);
+
 	for(lcr_id = 1; lcr_id <= lcr_count_param; lcr_id++) {
 
 		/* Reload rules */
@@ -1509,6 +1641,7 @@ int reload_tables()
 		rules = rule_pt[0];
 		rule_hash_table_contents_free(rules);
 		rule_id_hash_table_contents_free();
+		re_table_contents_free();
 
 		if(lcr_dbf.use_table(dbh, &lcr_rule_table) < 0) {
 			LM_ERR("error while trying to use lcr_rule table\n");
@@ -1542,6 +1675,7 @@ int reload_tables()
 			for(i = 0; i < RES_ROW_N(res); i++) {
 
 				request_uri_re = from_uri_re = 0;
+				re_owner = 0;
 				row = RES_ROWS(res) + i;
 
 				if((VAL_NULL(ROW_VALUES(row)) == 1)
@@ -1633,7 +1767,9 @@ int reload_tables()
 					goto err;
 				}
 				if(from_uri_len > 0) {
-					from_uri_re = reg_ex_comp(from_uri);
+					from_uri_re = re_table_get(from_uri, from_uri_len, &owner);
+					if(owner)
+						re_owner |= LCR_RE_FROM_OWNER;
 					if(from_uri_re == 0) {
 						LM_ERR("failed to compile lcr rule <%u> from_uri "
 							   "<%s>\n",
@@ -1694,7 +1830,10 @@ int reload_tables()
 					goto err;
 				}
 				if(request_uri_len > 0) {
-					request_uri_re = reg_ex_comp(request_uri);
+					request_uri_re =
+							re_table_get(request_uri, request_uri_len, &owner);
+					if(owner)
+						re_owner |= LCR_RE_RURI_OWNER;
 					if(request_uri_re == 0) {
 						LM_ERR("failed to compile lcr rule <%u> request_uri "
 							   "<%s>\n",
@@ -1708,7 +1847,7 @@ int reload_tables()
 				if(!rule_hash_table_insert(rules, lcr_id, rule_id, prefix_len,
 						   prefix, from_uri_len, from_uri, from_uri_re,
 						   mt_tvalue_len, mt_tvalue, request_uri_len,
-						   request_uri, request_uri_re, stopper)
+						   request_uri, request_uri_re, re_owner, stopper)
 						|| !prefix_len_insert(rules, prefix_len)) {
 					goto err;
 				}
@@ -1899,6 +2038,10 @@ int reload_tables()
 	rule_id_hash_table_contents_free();
 	if(rule_id_hash_table)
 		pkg_free(rule_id_hash_table);
+	re_table_contents_free();
+	if(re_table)
+		pkg_free(re_table);
+	re_table = NULL;
 	return 1;
 
 err:
@@ -1907,6 +2050,10 @@ err:
 	rule_id_hash_table_contents_free();
 	if(rule_id_hash_table)
 		pkg_free(rule_id_hash_table);
+	re_table_contents_free();
+	if(re_table)
+		pkg_free(re_table);
+	re_table = NULL;
 	return -1;
 }
 
@@ -2170,7 +2317,7 @@ int load_gws_dummy(int lcr_id, str *ruri_user, str *from_uri, str *request_uri,
 	struct rule_info **rules, *rule, *pl;
 	struct gw_info *gws;
 	struct target *t;
-	pcre2_match_data *pcre_md = NULL;
+	struct re_memo from_memo, ruri_memo;
 	struct matched_gw_info matched_gws[MAX_NO_OF_GWS + 1];
 	struct sip_uri furi;
 	struct usr_avp *avp;
@@ -2193,6 +2340,7 @@ int load_gws_dummy(int lcr_id, str *ruri_user, str *from_uri, str *request_uri,
 	gws = gw_pt[lcr_id];
 	pl = rules[lcr_rule_hash_size_param];
 	gw_index = 0;
+	from_memo.n = ruri_memo.n = 0;
 
 	if((from_uri->len > 0) && mt_pv_values_param) {
 		if(parse_uri(from_uri->s, from_uri->len, &furi) < 0) {
@@ -2216,14 +2364,7 @@ int load_gws_dummy(int lcr_id, str *ruri_user, str *from_uri, str *request_uri,
 				goto next;
 
 			if(rule->from_uri_len != 0) {
-				pcre_md = pcre2_match_data_create_from_pattern(
-						rule->from_uri_re, NULL);
-				rc = pcre2_match(rule->from_uri_re, (PCRE2_SPTR)from_uri->s,
-						(PCRE2_SIZE)from_uri->len, 0, 0, pcre_md, NULL);
-				if(pcre_md) {
-					pcre2_match_data_free(pcre_md);
-					pcre_md = NULL;
-				}
+				rc = re_memo_match(&from_memo, rule->from_uri_re, from_uri);
 				if(rc < 0)
 					goto next;
 			}
@@ -2259,15 +2400,8 @@ int load_gws_dummy(int lcr_id, str *ruri_user, str *from_uri, str *request_uri,
 						   "param has not been given.\n");
 					return -1;
 				}
-				pcre_md = pcre2_match_data_create_from_pattern(
-						rule->request_uri_re, NULL);
-				rc = pcre2_match(rule->request_uri_re,
-						(PCRE2_SPTR)request_uri->s,
-						(PCRE2_SIZE)request_uri->len, 0, 0, pcre_md, NULL);
-				if(pcre_md) {
-					pcre2_match_data_free(pcre_md);
-					pcre_md = NULL;
-				}
+				rc = re_memo_match(
+						&ruri_memo, rule->request_uri_re, request_uri);
 				if(rc < 0)
 					goto next;
 			}
@@ -2335,7 +2469,7 @@ static int ki_load_gws_furi(
 	int i, j, rc;
 	unsigned int gw_index, now, dex;
 	int_str val;
-	pcre2_match_data *pcre_md = NULL;
+	struct re_memo from_memo, ruri_memo;
 	struct matched_gw_info matched_gws[MAX_NO_OF_GWS + 1];
 	struct rule_info **rules, *rule, *pl;
 	struct gw_info *gws;
@@ -2373,6 +2507,7 @@ static int ki_load_gws_furi(
 
 	pl = rules[lcr_rule_hash_size_param];
 	gw_index = 0;
+	from_memo.n = ruri_memo.n = 0;
 
 	if(defunct_capability_param > 0) {
 		delete_avp(defunct_gw_avp_type, defunct_gw_avp);
@@ -2395,14 +2530,7 @@ static int ki_load_gws_furi(
 
 			/* Match from uri */
 			if(rule->from_uri_len != 0) {
-				pcre_md = pcre2_match_data_create_from_pattern(
-						rule->from_uri_re, NULL);
-				rc = pcre2_match(rule->from_uri_re, (PCRE2_SPTR)from_uri->s,
-						(PCRE2_SIZE)from_uri->len, 0, 0, pcre_md, NULL);
-				if(pcre_md) {
-					pcre2_match_data_free(pcre_md);
-					pcre_md = NULL;
-				}
+				rc = re_memo_match(&from_memo, rule->from_uri_re, from_uri);
 				if(rc < 0) {
 					LM_DBG("from uri <%.*s> did not match to from regex "
 						   "<%.*s>\n",
@@ -2439,15 +2567,8 @@ static int ki_load_gws_furi(
 
 			/* Match request uri */
 			if(rule->request_uri_len != 0) {
-				pcre_md = pcre2_match_data_create_from_pattern(
-						rule->request_uri_re, NULL);
-				rc = pcre2_match(rule->request_uri_re,
-						(PCRE2_SPTR)request_uri->s,
-						(PCRE2_SIZE)request_uri->len, 0, 0, pcre_md, NULL);
-				if(pcre_md) {
-					pcre2_match_data_free(pcre_md);
-					pcre_md = NULL;
-				}
+				rc = re_memo_match(
+						&ruri_memo, rule->request_uri_re, request_uri);
 				if(rc < 0) {
 					LM_DBG("request uri <%.*s> did not match to request regex "
 						   "<%.*s>\n",
@@ -55,6 +55,11 @@
 
 typedef enum sip_protos uri_transport;
 
+/* rule_info re_owner flags, a compiled regex can be shared by the rules
+ * with the same pattern and it is freed only with its owner rule */
+#define LCR_RE_FROM_OWNER (1 << 0)
+#define LCR_RE_RURI_OWNER (1 << 1)
+
 struct rule_info
 {
 	unsigned int rule_id;
@@ -68,6 +73,7 @@ struct rule_info
 	char request_uri[MAX_URI_LEN + 1];
 	unsigned short request_uri_len;
 	pcre2_code *request_uri_re;
+	unsigned short re_owner;
 	unsigned short stopper;
 	unsigned int enabled;
 	struct target *targets;
@@ -31,8 +31,16 @@
 
 #include "lcr_rpc.h"
 
+#include <time.h>
+
 #include "lcr_mod.h"
 #include "../../core/ip_addr.h"
+#include "../../core/ut.h"
+
+#define LCR_BENCH_USERS 256
+#define LCR_BENCH_USER_LEN (MAX_PREFIX_LEN + 8)
+/* the reload lock is held while the bench is running */
+#define LCR_BENCH_ROUNDS_MAX 10000
 
 
 static const char *reload_doc[2] = {"Reload lcr tables from database.", 0};
@@ -305,6 +313,88 @@ static void load_gws(rpc_t *rpc, void *c)
 	return;
 }
 
+static const char *bench_doc[2] = {
+		"Time load_gws for users built from the rule prefixes of an lcr "
+		"instance.  Parameters are lcr_id and optional number of rounds "
+		"(default 100, at most 10000).",
+		0};
+
+
+static void bench(rpc_t *rpc, void *c)
+{
+	static char users[LCR_BENCH_USERS][LCR_BENCH_USER_LEN];
+	static char uri[LCR_BENCH_USER_LEN + 16];
+	unsigned int gw_indexes[MAX_NO_OF_GWS];
+	struct rule_info **rules, *rule;
+	struct timespec t0, t1;
+	str uri_user, caller_uri;
+	long long ns;
+	long long calls;
+	unsigned long gws;
+	int lcr_id, rounds, nusers, i, r, ret;
+	void *th;
+
+	rounds = 100;
+	if(rpc->scan(c, "d*d", &lcr_id, &rounds) < 1) {
+		rpc->fault(c, 400, "lcr_id parameter required");
+		return;
+	}
+	if(lcr_id < 1 || lcr_id > lcr_count_param || rounds < 1
+			|| rounds > LCR_BENCH_ROUNDS_MAX) {
+		rpc->fault(c, 400, "invalid parameter value");
+		return;
+	}
+
+	lock_get(reload_lock);
+
+	/* one user per rule prefix, followed by digits to reach the longer
+	 * prefixes of the same tree */
+	rules = rule_pt[lcr_id];
+	nusers = 0;
+	for(i = 0; i < lcr_rule_hash_size_param && nusers < LCR_BENCH_USERS;
+			i++) {
+		for(rule = rules[i]; rule && nusers < LCR_BENCH_USERS;
+				rule = rule->next) {
+			memcpy(users[nusers], rule->prefix, rule->prefix_len);
+			memcpy(users[nusers] + rule->prefix_len, "1234567", 8);
+			nusers++;
+		}
+	}
+	if(nusers == 0) {
+		lock_release(reload_lock);
+		rpc->fault(c, 404, "no rules");
+		return;
+	}
+
+	gws = 0;
+	ksr_clock_gettime(&t0);
+	for(r = 0; r < rounds; r++) {
+		for(i = 0; i < nusers; i++) {
+			uri_user.s = users[i];
+			uri_user.len = strlen(users[i]);
+			caller_uri.s = uri;
+			caller_uri.len = snprintf(
+					uri, sizeof(uri), "sip:%s@localhost", users[i]);
+			ret = load_gws_dummy(lcr_id, &uri_user, &caller_uri, &caller_uri,
+					gw_indexes);
+			if(ret > 0)
+				gws += ret;
+		}
+	}
+	ksr_clock_gettime(&t1);
+
+	lock_release(reload_lock);
+
+	ns = (long long)(t1.tv_sec - t0.tv_sec) * 1000000000LL
+		 + (t1.tv_nsec - t0.tv_nsec);
+	calls = (long long)nusers * rounds;
+	if(rpc->add(c, "{", &th) < 0)
+		return;
+	rpc->struct_add(th, "dddLjj", "lcr_id", lcr_id, "users", nusers,
+			"rounds", rounds, "calls", calls, "gws", gws / rounds, "avg_ns",
+			(unsigned long)(ns / calls));
+}
+
 /* clang-format off */
 rpc_export_t lcr_rpc[] = {
     {"lcr.reload", reload, reload_doc, 0},
@@ -312,6 +402,7 @@ rpc_export_t lcr_rpc[] = {
     {"lcr.dump_rules", dump_rules, dump_rules_doc, 0},
     {"lcr.defunct_gw", defunct_gw, defunct_gw_doc, 0},
     {"lcr.load_gws", load_gws, load_gws_doc, 0},
+    {"lcr.bench", bench, bench_doc, 0},
     {0, 0, 0, 0}
 };
 /* clang-format on */
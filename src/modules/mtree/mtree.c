@@ -35,6 +35,7 @@
 #include "../../core/pvar.h"
 #include "../../core/lvalue.h"
 #include "../../core/shm_init.h"
+#include "../../core/atomic_ops.h"
 
 #include "mtree.h"
 
@@ -48,10 +49,17 @@ extern pv_spec_t pv_count;
 extern int _mt_tree_type;
 extern int _mt_ignore_duplicates;
 extern int _mt_allow_duplicates;
+extern int _mt_compact_tree;
+extern str _mt_tree_file;
 
 /** structures containing prefix-value pairs */
 static m_tree_t **_ptree = NULL;
 
+/** tree file mapped in the current process and its generation */
+static ptf_map_t _mt_ptf_map;
+static unsigned int _mt_ptf_lgen = 0;
+static unsigned int *_mt_ptf_sgen = NULL;
+
 /* quick translation table */
 #define MT_CHAR_TABLE_SIZE 256
 #define MT_CHAR_TABLE_NOTSET 255
@@ -102,6 +110,87 @@ int mt_init_list_head(void)
 	return 0;
 }
 
+/**
+ *
+ */
+int mt_ptf_init(void)
+{
+	if(_mt_ptf_sgen != NULL)
+		return 0;
+	_mt_ptf_sgen = (unsigned int *)shm_malloc(sizeof(unsigned int));
+	if(_mt_ptf_sgen == NULL) {
+		SHM_MEM_ERROR;
+		return -1;
+	}
+	*_mt_ptf_sgen = 1;
+	return 0;
+}
+
+/**
+ * processes map the file again on next lookup
+ */
+void mt_ptf_next_gen(void)
+{
+	if(_mt_ptf_sgen == NULL)
+		return;
+	(*_mt_ptf_sgen)++;
+	membar_write();
+}
+
+/**
+ * return the tree file mapped in the current process, updated to the
+ * last reload
+ */
+ptf_map_t *mt_ptf_get(void)
+{
+	if(_mt_ptf_sgen == NULL)
+		return NULL;
+	if(ptf_map_sync(&_mt_ptf_map, _mt_tree_file.s, &_mt_ptf_lgen,
+			   *_mt_ptf_sgen)
+			< 0) {
+		LM_ERR("cannot map tree file [%.*s]\n", _mt_tree_file.len,
+				_mt_tree_file.s);
+	}
+	return (_mt_ptf_map.base != NULL) ? &_mt_ptf_map : NULL;
+}
+
+/**
+ * return the file tree for pt, located by name if the file was replaced
+ * since the tree list was built
+ */
+ptf_tree_t *mt_ptf_tree(m_tree_t *pt, ptf_map_t **map)
+{
+	ptf_tree_t *tr;
+
+	*map = mt_ptf_get();
+	if(*map == NULL)
+		return NULL;
+	if(pt->ptfidx > 0 && pt->ptfidx <= (*map)->ntrees) {
+		tr = &(*map)->trees[pt->ptfidx - 1];
+		if(tr->namelen == pt->tname.len
+				&& memcmp((*map)->base + tr->name, pt->tname.s, pt->tname.len)
+						   == 0)
+			return tr;
+	}
+	return ptf_get_tree(*map, pt->tname.s, pt->tname.len);
+}
+
+static void mt_ptf_tvalue(m_tree_t *pt, ptf_value_t *v, is_t *tvalue)
+{
+	str s;
+
+	s.s = v->s;
+	s.len = v->len;
+	if(pt->type == MT_TREE_IVAL) {
+		tvalue->n = 0;
+		if(str2sint(&s, &tvalue->n) != 0) {
+			LM_ERR("bad integer string <%.*s>\n", s.len, s.s);
+		}
+	} else {
+		tvalue->s = s;
+	}
+}
+
 /**
  *
  */
@@ -339,17 +428,417 @@ m_tree_t *mt_get_first_tree()
 }
 
 
+/**
+ * count the used entries of a node array, return index of last one
+ */
+static int mt_node_nrentries(mt_node_t *pn, int *last)
+{
+	int i;
+	int n = 0;
+
+	if(pn == NULL)
+		return 0;
+	for(i = 0; i < MT_NODE_SIZE; i++) {
+		if(pn[i].tvalues != NULL || pn[i].child != NULL) {
+			n++;
+			*last = i;
+		}
+	}
+	return n;
+}
+
+/**
+ * follow the chain of single child entries without values starting
+ * at pn[i] - the char indexes are stored in label
+ */
+static mt_node_t *mt_node_chain(
+		mt_node_t *pn, int i, unsigned char *label, int *llen)
+{
+	mt_node_t *itn;
+	int j = 0;
+
+	*llen = 0;
+	label[(*llen)++] = (unsigned char)i;
+	itn = &pn[i];
+	while(itn->tvalues == NULL && *llen < MT_MAX_DEPTH
+			&& mt_node_nrentries(itn->child, &j) == 1) {
+		label[(*llen)++] = (unsigned char)j;
+		itn = &itn->child[j];
+	}
+	return itn;
+}
+
+static void mt_ctree_count(mt_node_t *pn, unsigned int *nrnodes,
+		unsigned int *lsize, unsigned char *label)
+{
+	mt_node_t *itn;
+	int i, llen;
+
+	if(pn == NULL)
+		return;
+	for(i = 0; i < MT_NODE_SIZE; i++) {
+		if(pn[i].tvalues == NULL && pn[i].child == NULL)
+			continue;
+		itn = mt_node_chain(pn, i, label, &llen);
+		(*nrnodes)++;
+		*lsize += llen;
+		mt_ctree_count(itn->child, nrnodes, lsize, label);
+	}
+}
+
+/**
+ * fill the children of compact node idx from node array pn - the siblings
+ * are allocated next to each other, before descending in the subtrees
+ */
+static void mt_ctree_fill(mt_ctree_t *ct, unsigned int idx, mt_node_t *pn)
+{
+	mt_cnode_t *cn;
+	mt_node_t *itn;
+	unsigned int first;
+	int i, k, llen;
+
+	k = 0;
+	ct->nodes[idx].nchild = (unsigned short)mt_node_nrentries(pn, &k);
+	if(ct->nodes[idx].nchild == 0)
+		return;
+	first = ct->nrnodes;
+	ct->nodes[idx].child = first;
+	ct->nrnodes += ct->nodes[idx].nchild;
+
+	k = 0;
+	for(i = 0; i < MT_NODE_SIZE; i++) {
+		if(pn[i].tvalues == NULL && pn[i].child == NULL)
+			continue;
+		cn = &ct->nodes[first + k];
+		itn = mt_node_chain(pn, i, ct->labels + ct->lsize, &llen);
+		cn->key = (unsigned char)i;
+		cn->label = ct->lsize;
+		cn->llen = (unsigned char)llen;
+		cn->tvalues = itn->tvalues;
+		cn->data = itn->data;
+		ct->lsize += llen;
+		mt_ctree_fill(ct, first + k, itn->child);
+		k++;
+	}
+}
+
+/**
+ * collect the compact nodes with values along the path of tomatch
+ * - depth (if not NULL) is set to the number of chars walked, like for
+ *   the node array layout (the char without child node is counted)
+ * - return the number of nodes, -1 on invalid char
+ */
+static int mt_ctree_path(mt_ctree_t *ct, str *tomatch, mt_cnode_t **path,
+		int *plen, int *depth)
+{
+	mt_cnode_t *cn;
+	mt_cnode_t *cc;
+	unsigned char *lb;
+	unsigned char mtch;
+	int i, l, n, d;
+
+	l = n = 0;
+	cn = &ct->nodes[0];
+	while(l < tomatch->len && l < MT_MAX_DEPTH) {
+		/* end of the tree - the next char is not checked, like for the
+		 * node array layout */
+		if(cn->nchild == 0)
+			break;
+		mtch = _mt_char_table[(unsigned char)tomatch->s[l]];
+		if(mtch == MT_CHAR_TABLE_NOTSET)
+			return -1;
+		cc = NULL;
+		for(i = 0; i < cn->nchild; i++) {
+			if(ct->nodes[cn->child + i].key >= mtch) {
+				if(ct->nodes[cn->child + i].key == mtch)
+					cc = &ct->nodes[cn->child + i];
+				break;
+			}
+		}
+		if(cc == NULL) {
+			d = l + 1;
+			goto done;
+		}
+		lb = ct->labels + cc->label;
+		for(i = 1; i < cc->llen; i++) {
+			if(l + i >= tomatch->len) {
+				d = l + i;
+				goto done;
+			}
+			mtch = _mt_char_table[(unsigned char)tomatch->s[l + i]];
+			if(mtch == MT_CHAR_TABLE_NOTSET)
+				return -1;
+			if(lb[i] != mtch) {
+				d = l + i + 1;
+				goto done;
+			}
+		}
+		l += cc->llen;
+		if(cc->tvalues != NULL) {
+			path[n] = cc;
+			plen[n] = l;
+			n++;
+		}
+		cn = cc;
+	}
+	d = l;
+
+done:
+	if(depth != NULL)
+		*depth = d;
+	return n;
+}
+
+/**
+ * longest prefix walk in node array layout, without logging
+ */
+static mt_is_t *mt_node_lookup(mt_node_t *itn, str *tomatch)
+{
+	mt_is_t *tvalues = NULL;
+	unsigned char mtch;
+	int l = 0;
+
+	while(itn != NULL && l < tomatch->len && l < MT_MAX_DEPTH) {
+		mtch = _mt_char_table[(unsigned char)tomatch->s[l]];
+		if(mtch == MT_CHAR_TABLE_NOTSET)
+			return NULL;
+		if(itn[mtch].tvalues != NULL)
+			tvalues = itn[mtch].tvalues;
+		itn = itn[mtch].child;
+		l++;
+	}
+	return tvalues;
+}
+
+#define MT_BENCH_KEYS 256
+#define MT_BENCH_ROUNDS 8
+
+static void mt_bench_keys(mt_node_t *pn, char *code, int len, char *keys,
+		int *nkeys, int *cnt, int step)
+{
+	int i;
+
+	if(pn == NULL || len >= MT_MAX_DEPTH - 1 || *nkeys >= MT_BENCH_KEYS)
+		return;
+	for(i = 0; i < MT_NODE_SIZE && *nkeys < MT_BENCH_KEYS; i++) {
+		code[len] = mt_char_list.s[i];
+		if(pn[i].tvalues != NULL && ((*cnt)++ % step) == 0) {
+			memcpy(keys + (*nkeys) * MT_MAX_DEPTH, code, len + 1);
+			keys[(*nkeys) * MT_MAX_DEPTH + MT_MAX_DEPTH - 1] = (char)(len + 1);
+			(*nkeys)++;
+		}
+		mt_bench_keys(pn[i].child, code, len + 1, keys, nkeys, cnt, step);
+	}
+}
+
+static unsigned int mt_bench_elapsed(struct timespec *t0, int nr)
+{
+	struct timespec t1;
+	long long ns;
+
+	ksr_clock_gettime(&t1);
+	ns = (long long)(t1.tv_sec - t0->tv_sec) * 1000000000LL
+		 + (t1.tv_nsec - t0->tv_nsec);
+	if(ns < 0 || nr <= 0)
+		return 0;
+	return (unsigned int)(ns / nr);
+}
+
+/**
+ * measure the average lookup time over a sample of the loaded prefixes,
+ * for the node array layout and the compact layout (if built)
+ */
+static void mt_tree_bench(m_tree_t *pt)
+{
+	char code[MT_MAX_DEPTH];
+	mt_cnode_t *path[MT_MAX_DEPTH];
+	int plen[MT_MAX_DEPTH];
+	struct timespec t0;
+	volatile long sink = 0;
+	char *keys;
+	str key;
+	int nkeys, cnt, step, i, r;
+
+	pt->lookup_ns = 0;
+	pt->clookup_ns = 0;
+	if(pt->head == NULL)
+		return;
+
+	keys = (char *)pkg_malloc(MT_BENCH_KEYS * MT_MAX_DEPTH);
+	if(keys == NULL) {
+		PKG_MEM_ERROR;
+		return;
+	}
+	nkeys = cnt = 0;
+	step = pt->nritems / MT_BENCH_KEYS + 1;
+	mt_bench_keys(pt->head, code, 0, keys, &nkeys, &cnt, step);
+	if(nkeys == 0)
+		goto done;
+
+	ksr_clock_gettime(&t0);
+	for(r = 0; r < MT_BENCH_ROUNDS; r++) {
+		for(i = 0; i < nkeys; i++) {
+			key.s = keys + i * MT_MAX_DEPTH;
+			key.len = (int)key.s[MT_MAX_DEPTH - 1];
+			sink += (long)mt_node_lookup(pt->head, &key);
+		}
+	}
+	pt->lookup_ns = mt_bench_elapsed(&t0, nkeys * MT_BENCH_ROUNDS);
+
+	if(pt->ctree != NULL) {
+		ksr_clock_gettime(&t0);
+		for(r = 0; r < MT_BENCH_ROUNDS; r++) {
+			for(i = 0; i < nkeys; i++) {
+				key.s = keys + i * MT_MAX_DEPTH;
+				key.len = (int)key.s[MT_MAX_DEPTH - 1];
+				sink += mt_ctree_path(pt->ctree, &key, path, plen, NULL);
+			}
+		}
+		pt->clookup_ns = mt_bench_elapsed(&t0, nkeys * MT_BENCH_ROUNDS);
+	}
+	LM_DBG("tree [%.*s] lookup time: %u ns (array) %u ns (compact)\n",
+			pt->tname.len, pt->tname.s, pt->lookup_ns, pt->clookup_ns);
+
+done:
+	pkg_free(keys);
+}
+
+static void mt_free_node_skel(mt_node_t *pn)
+{
+	int i;
+
+	if(pn == NULL)
+		return;
+	for(i = 0; i < MT_NODE_SIZE; i++) {
+		if(pn[i].child != NULL)
+			mt_free_node_skel(pn[i].child);
+	}
+	shm_free(pn);
+}
+
+/**
+ * build the compact layout of the tree - when enabled, the node arrays
+ * are released and the values are owned by the compact nodes
+ */
+int mt_tree_compact(m_tree_t *pt)
+{
+	unsigned char label[MT_MAX_DEPTH];
+	unsigned int nrnodes;
+	unsigned int lsize;
+	unsigned int size;
+	mt_ctree_t *ct;
+
+	if(pt == NULL)
+		return -1;
+	pt->ctree = NULL;
+	pt->cnrnodes = 0;
+	pt->cmemsize = 0;
+	if(_mt_compact_tree == 0 || pt->head == NULL) {
+		mt_tree_bench(pt);
+		return 0;
+	}
+
+	nrnodes = 1;
+	lsize = 0;
+	mt_ctree_count(pt->head, &nrnodes, &lsize, label);
+	size = sizeof(mt_ctree_t) + nrnodes * sizeof(mt_cnode_t) + lsize;
+	ct = (mt_ctree_t *)shm_malloc(size);
+	if(ct == NULL) {
+		LM_ERR("no more shm memory for compact tree\n");
+		return -1;
+	}
+	memset(ct, 0, size);
+	ct->nodes = (mt_cnode_t *)((char *)ct + sizeof(mt_ctree_t));
+	ct->labels = (unsigned char *)(ct->nodes + nrnodes);
+	ct->nrnodes = 1;
+	mt_ctree_fill(ct, 0, pt->head);
+	ct->memsize = size;
+
+	pt->ctree = ct;
+	mt_tree_bench(pt);
+
+	pt->cnrnodes = ct->nrnodes;
+	pt->cmemsize =
+			size + pt->memsize - pt->nrnodes * MT_NODE_SIZE * sizeof(mt_node_t);
+	LM_DBG("tree [%.*s] compacted from %u nodes (%u bytes) to %u nodes (%u"
+		   " bytes)\n",
+			pt->tname.len, pt->tname.s, pt->nrnodes, pt->memsize, pt->cnrnodes,
+			pt->cmemsize);
+
+	mt_free_node_skel(pt->head);
+	pt->head = NULL;
+	return 0;
+}
+
+void mt_ctree_free(mt_ctree_t *ct, int type)
+{
+	unsigned int i;
+	mt_is_t *tvalues, *next;
+	mt_dw_t *dw, *dwn;
+
+	if(ct == NULL)
+		return;
+	for(i = 0; i < ct->nrnodes; i++) {
+		tvalues = ct->nodes[i].tvalues;
+		while(tvalues != NULL) {
+			if((type == MT_TREE_SVAL) && (tvalues->tvalue.s.s != NULL))
+				shm_free(tvalues->tvalue.s.s);
+			next = tvalues->next;
+			shm_free(tvalues);
+			tvalues = next;
+		}
+		if(type == MT_TREE_DW) {
+			dw = (mt_dw_t *)ct->nodes[i].data;
+			while(dw) {
+				dwn = dw->next;
+				shm_free(dw);
+				dw = dwn;
+			}
+		}
+	}
+	shm_free(ct);
+}
+
 is_t *mt_get_tvalue(m_tree_t *pt, str *tomatch, int *len)
 {
 	int l;
 	mt_node_t *itn;
 	is_t *tvalue;
+	mt_cnode_t *path[MT_MAX_DEPTH];
+	int plen[MT_MAX_DEPTH];
+	ptf_map_t *map;
+	ptf_tree_t *ptr;
+	ptf_node_t *ppath[PTF_MAX_DEPTH];
+	static is_t ptvalue;
 
 	if(pt == NULL || tomatch == NULL || tomatch->s == NULL || len == NULL) {
 		LM_ERR("bad parameters\n");
 		return NULL;
 	}
 
+	if(pt->ptfidx > 0) {
+		ptr = mt_ptf_tree(pt, &map);
+		if(ptr == NULL)
+			return NULL;
+		l = ptf_match(map, ptr, tomatch->s, tomatch->len, ppath, plen);
+		if(l == 0)
+			return NULL;
+		*len = plen[l - 1];
+		mt_ptf_tvalue(pt, ptf_node_value(map, ppath[l - 1]), &ptvalue);
+		return &ptvalue;
+	}
+
+	if(pt->ctree != NULL) {
+		l = mt_ctree_path(pt->ctree, tomatch, path, plen, len);
+		if(l < 0) {
+			LM_DBG("not matching char in [%.*s]\n", tomatch->len, tomatch->s);
+			return NULL;
+		}
+		if(l == 0)
+			return NULL;
+		return &path[l - 1]->tvalues->tvalue;
+	}
+
 	l = 0;
 	itn = pt->head;
 	tvalue = NULL;
@@ -377,14 +866,44 @@ is_t *mt_get_tvalue(m_tree_t *pt, str *tomatch, int *len)
 	return tvalue;
 }
 
+static int mt_add_tvalues_avps(m_tree_t *pt, mt_is_t *tvalues,
+		avp_flags_t values_name_type, avp_name_t values_avp_name)
+{
+	avp_value_t val;
+	int n = 0;
+
+	while(tvalues != NULL) {
+		if(pt->type == MT_TREE_IVAL) {
+			val.n = tvalues->tvalue.n;
+			LM_DBG("adding avp <%.*s> with value <i:%ld>\n",
+					values_avp_name.s.len, values_avp_name.s.s, val.n);
+			add_avp(values_name_type, values_avp_name, val);
+		} else { /* pt->type == MT_TREE_SVAL */
+			val.s = tvalues->tvalue.s;
+			LM_DBG("adding avp <%.*s> with value <s:%.*s>\n",
+					values_avp_name.s.len, values_avp_name.s.s, val.s.len,
+					val.s.s);
+			add_avp(values_name_type | AVP_VAL_STR, values_avp_name, val);
+		}
+		n++;
+		tvalues = tvalues->next;
+	}
+	return n;
+}
+
 int mt_add_tvalues(struct sip_msg *msg, m_tree_t *pt, str *tomatch)
 {
-	int l, n;
+	int l, n, i;
 	mt_node_t *itn;
-	avp_value_t val;
 	avp_name_t values_avp_name;
 	avp_flags_t values_name_type;
-	mt_is_t *tvalues;
+	mt_cnode_t *path[MT_MAX_DEPTH];
+	int plen[MT_MAX_DEPTH];
+	ptf_map_t *map;
+	ptf_tree_t *ptr;
+	ptf_node_t *ppath[PTF_MAX_DEPTH];
+	ptf_value_t *pv;
+	mt_is_t ptvalues;
 
 	if(pt == NULL || tomatch == NULL || tomatch->s == NULL) {
 		LM_ERR("bad parameters\n");
@@ -400,6 +919,36 @@ int mt_add_tvalues(struct sip_msg *msg, m_tree_t *pt, str *tomatch)
 	destroy_avps(values_name_type, values_avp_name, 1);
 
 	l = n = 0;
+	if(pt->ptfidx > 0) {
+		ptr = mt_ptf_tree(pt, &map);
+		if(ptr == NULL)
+			return -1;
+		l = ptf_match(map, ptr, tomatch->s, tomatch->len, ppath, plen);
+		ptvalues.next = NULL;
+		for(i = 0; i < l; i++) {
+			for(pv = ptf_node_value(map, ppath[i]); pv != NULL;
+					pv = ptf_value_next(map, pv)) {
+				mt_ptf_tvalue(pt, pv, &ptvalues.tvalue);
+				n += mt_add_tvalues_avps(
+						pt, &ptvalues, values_name_type, values_avp_name);
+			}
+		}
+		return (n > 0) ? 0 : -1;
+	}
+
+	if(pt->ctree != NULL) {
+		l = mt_ctree_path(pt->ctree, tomatch, path, plen, NULL);
+		if(l < 0) {
+			LM_ERR("invalid char in [%.*s]\n", tomatch->len, tomatch->s);
+			return -1;
+		}
+		for(i = 0; i < l; i++) {
+			n += mt_add_tvalues_avps(
+					pt, path[i]->tvalues, values_name_type, values_avp_name);
+		}
+		return (n > 0) ? 0 : -1;
+	}
+
 	itn = pt->head;
 
 	while(itn != NULL && l < tomatch->len && l < MT_MAX_DEPTH) {
@@ -411,23 +960,8 @@ int mt_add_tvalues(struct sip_msg *msg, m_tree_t *pt, str *tomatch)
 					tomatch->s);
 			return -1;
 		}
-		tvalues = itn[mtch].tvalues;
-		while(tvalues != NULL) {
-			if(pt->type == MT_TREE_IVAL) {
-				val.n = tvalues->tvalue.n;
-				LM_DBG("adding avp <%.*s> with value <i:%ld>\n",
-						values_avp_name.s.len, values_avp_name.s.s, val.n);
-				add_avp(values_name_type, values_avp_name, val);
-			} else { /* pt->type == MT_TREE_SVAL */
-				val.s = tvalues->tvalue.s;
-				LM_DBG("adding avp <%.*s> with value <s:%.*s>\n",
-						values_avp_name.s.len, values_avp_name.s.s, val.s.len,
-						val.s.s);
-				add_avp(values_name_type | AVP_VAL_STR, values_avp_name, val);
-			}
-			n++;
-			tvalues = tvalues->next;
-		}
+		n += mt_add_tvalues_avps(
+				pt, itn[mtch].tvalues, values_name_type, values_avp_name);
 
 		itn = itn[mtch].child;
 		l++;
@@ -443,7 +977,10 @@ int mt_match_prefix(struct sip_msg *msg, m_tree_t *it, str *tomatch, int mode)
 {
 	int l, len, n;
 	int i, j, k = 0;
+	int np;
 	mt_node_t *itn;
+	mt_cnode_t *path[MT_MAX_DEPTH];
+	int plen[MT_MAX_DEPTH];
 	is_t *tvalue;
 	avp_name_t dstid_avp_name;
 	avp_flags_t dstid_name_type;
@@ -507,6 +1044,27 @@ int mt_match_prefix(struct sip_msg *msg, m_tree_t *it, str *tomatch, int mode)
 	itn = it->head;
 	memset(tmp_list, 0, sizeof(unsigned int) * 2 * (MT_MAX_DST_LIST + 1));
 
+	if(it->ctree != NULL) {
+		itn = NULL;
+		np = mt_ctree_path(it->ctree, tomatch, path, plen, NULL);
+		if(np < 0) {
+			LM_ERR("invalid char in [%.*s]\n", tomatch->len, tomatch->s);
+			return -1;
+		}
+		for(i = 0; i < np && n < MT_MAX_DST_LIST; i++) {
+			dw = (mt_dw_t *)path[i]->data;
+			while(dw) {
+				tmp_list[2 * n] = dw->dstid;
+				tmp_list[2 * n + 1] = dw->weight;
+				n++;
+				if(n == MT_MAX_DST_LIST)
+					break;
+				dw = dw->next;
+			}
+			len = plen[i];
+		}
+	}
+
 	while(itn != NULL && l < tomatch->len && l < MT_MAX_DEPTH) {
 		unsigned char mtch = _mt_char_table[(unsigned char)tomatch->s[l]];
 
@@ -619,6 +1177,8 @@ void mt_free_tree(m_tree_t *pt)
 
 	if(pt->head != NULL)
 		mt_free_node(pt->head, pt->type);
+	if(pt->ctree != NULL)
+		mt_ctree_free(pt->ctree, pt->type);
 	if(pt->next != NULL)
 		mt_free_tree(pt->next);
 	if(pt->dbtable.s != NULL)
@@ -657,6 +1217,36 @@ int mt_print_node(mt_node_t *pn, char *code, int len, int type)
 	return 0;
 }
 
+static int mt_print_cnode(
+		mt_ctree_t *ct, unsigned int idx, char *code, int len, int type)
+{
+	mt_cnode_t *cn;
+	mt_is_t *tvalues;
+	int i, k;
+
+	for(i = 0; i < ct->nodes[idx].nchild; i++) {
+		cn = &ct->nodes[ct->nodes[idx].child + i];
+		if(len + cn->llen > MT_MAX_DEPTH)
+			continue;
+		for(k = 0; k < cn->llen; k++)
+			code[len + k] = mt_char_list.s[ct->labels[cn->label + k]];
+		tvalues = cn->tvalues;
+		while(tvalues != NULL) {
+			if(type == MT_TREE_IVAL) {
+				LM_INFO("[%.*s] [i:%d]\n", len + cn->llen, code,
+						tvalues->tvalue.n);
+			} else if(tvalues->tvalue.s.s != NULL) {
+				LM_INFO("[%.*s] [s:%.*s]\n", len + cn->llen, code,
+						tvalues->tvalue.s.len, tvalues->tvalue.s.s);
+			}
+			tvalues = tvalues->next;
+		}
+		mt_print_cnode(ct, ct->nodes[idx].child + i, code, len + cn->llen, type);
+	}
+
+	return 0;
+}
+
 static char mt_code_buf[MT_MAX_DEPTH + 1];
 int mt_print_tree(m_tree_t *pt)
 {
@@ -669,7 +1259,10 @@ int mt_print_tree(m_tree_t *pt)
 
 	LM_INFO("[%.*s]\n", pt->tname.len, pt->tname.s);
 	len = 0;
-	mt_print_node(pt->head, mt_code_buf, len, pt->type);
+	if(pt->ctree != NULL)
+		mt_print_cnode(pt->ctree, 0, mt_code_buf, len, pt->type);
+	else
+		mt_print_node(pt->head, mt_code_buf, len, pt->type);
 	return mt_print_tree(pt->next);
 }
 
@@ -906,11 +1499,47 @@ int mt_defined_trees(void)
 	return 0;
 }
 
+static int mt_rpc_add_tvalues_list(rpc_t *rpc, void *ctx, m_tree_t *pt,
+		mt_is_t *tvalues, str *prefix, void **vstruct)
+{
+	while(tvalues != NULL) {
+		if(rpc->add(ctx, "{", vstruct) < 0) {
+			rpc->fault(ctx, 500, "Internal error adding struct");
+			return -1;
+		}
+		if(rpc->struct_add(*vstruct, "S", "PREFIX", prefix) < 0) {
+			rpc->fault(ctx, 500, "Internal error adding prefix");
+			return -1;
+		}
+		if(pt->type == MT_TREE_IVAL) {
+			if(rpc->struct_add(*vstruct, "d", "TVALUE", tvalues->tvalue.n)
+					< 0) {
+				rpc->fault(ctx, 500, "Internal error adding tvalue");
+				return -1;
+			}
+		} else { /* pt->type == MT_TREE_SVAL */
+			if(rpc->struct_add(*vstruct, "S", "TVALUE", &tvalues->tvalue.s)
+					< 0) {
+				rpc->fault(ctx, 500, "Internal error adding tvalue");
+				return -1;
+			}
+		}
+		tvalues = tvalues->next;
+	}
+	return 0;
+}
+
 int mt_rpc_add_tvalues(rpc_t *rpc, void *ctx, m_tree_t *pt, str *tomatch)
 {
-	int l;
+	int l, i;
 	mt_node_t *itn;
-	mt_is_t *tvalues;
+	mt_cnode_t *path[MT_MAX_DEPTH];
+	int plen[MT_MAX_DEPTH];
+	ptf_map_t *map;
+	ptf_tree_t *ptr;
+	ptf_node_t *ppath[PTF_MAX_DEPTH];
+	ptf_value_t *pv;
+	mt_is_t ptvalues;
 	void *vstruct = NULL;
 	str prefix = STR_NULL;
 
@@ -920,6 +1549,42 @@ int mt_rpc_add_tvalues(rpc_t *rpc, void *ctx, m_tree_t *pt, str *tomatch)
 	}
 	prefix = *tomatch;
 
+	if(pt->ptfidx > 0) {
+		ptr = mt_ptf_tree(pt, &map);
+		if(ptr == NULL)
+			return -1;
+		l = ptf_match(map, ptr, tomatch->s, tomatch->len, ppath, plen);
+		ptvalues.next = NULL;
+		for(i = 0; i < l; i++) {
+			prefix.len = plen[i];
+			for(pv = ptf_node_value(map, ppath[i]); pv != NULL;
+					pv = ptf_value_next(map, pv)) {
+				mt_ptf_tvalue(pt, pv, &ptvalues.tvalue);
+				if(mt_rpc_add_tvalues_list(
+						   rpc, ctx, pt, &ptvalues, &prefix, &vstruct)
+						< 0)
+					return -1;
+			}
+		}
+		return (vstruct == NULL) ? -1 : 0;
+	}
+
+	if(pt->ctree != NULL) {
+		l = mt_ctree_path(pt->ctree, tomatch, path, plen, NULL);
+		if(l < 0) {
+			LM_ERR("invalid char in [%.*s]\n", tomatch->len, tomatch->s);
+			return -1;
+		}
+		for(i = 0; i < l; i++) {
+			prefix.len = plen[i];
+			if(mt_rpc_add_tvalues_list(
+					   rpc, ctx, pt, path[i]->tvalues, &prefix, &vstruct)
+					< 0)
+				return -1;
+		}
+		return (vstruct == NULL) ? -1 : 0;
+	}
+
 	l = 0;
 	itn = pt->head;
 
@@ -932,32 +1597,11 @@ int mt_rpc_add_tvalues(rpc_t *rpc, void *ctx, m_tree_t *pt, str *tomatch)
 					tomatch->s);
 			return -1;
 		}
-		tvalues = itn[mtch].tvalues;
-		while(tvalues != NULL) {
-			prefix.len = l + 1;
-			if(rpc->add(ctx, "{", &vstruct) < 0) {
-				rpc->fault(ctx, 500, "Internal error adding struct");
-				return -1;
-			}
-			if(rpc->struct_add(vstruct, "S", "PREFIX", &prefix) < 0) {
-				rpc->fault(ctx, 500, "Internal error adding prefix");
-				return -1;
-			}
-			if(pt->type == MT_TREE_IVAL) {
-				if(rpc->struct_add(vstruct, "d", "TVALUE", tvalues->tvalue.n)
-						< 0) {
-					rpc->fault(ctx, 500, "Internal error adding tvalue");
-					return -1;
-				}
-			} else { /* pt->type == MT_TREE_SVAL */
-				if(rpc->struct_add(vstruct, "S", "TVALUE", &tvalues->tvalue.s)
-						< 0) {
-					rpc->fault(ctx, 500, "Internal error adding tvalue");
-					return -1;
-				}
-			}
-			tvalues = tvalues->next;
-		}
+		prefix.len = l + 1;
+		if(mt_rpc_add_tvalues_list(
+				   rpc, ctx, pt, itn[mtch].tvalues, &prefix, &vstruct)
+				< 0)
+			return -1;
 
 		itn = itn[mtch].child;
 		l++;
@@ -974,7 +1618,10 @@ int mt_rpc_match_prefix(
 {
 	int l, len, n;
 	int i, j;
+	int np;
 	mt_node_t *itn;
+	mt_cnode_t *path[MT_MAX_DEPTH];
+	int plen[MT_MAX_DEPTH];
 	is_t *tvalue;
 	mt_dw_t *dw;
 	int tprefix_len = 0;
@@ -1036,6 +1683,27 @@ int mt_rpc_match_prefix(
 	itn = it->head;
 	memset(tmp_list, 0, sizeof(unsigned int) * 2 * (MT_MAX_DST_LIST + 1));
 
+	if(it->ctree != NULL) {
+		itn = NULL;
+		np = mt_ctree_path(it->ctree, tomatch, path, plen, NULL);
+		if(np < 0) {
+			LM_ERR("invalid char in [%.*s]\n", tomatch->len, tomatch->s);
+			return -1;
+		}
+		for(i = 0; i < np && n < MT_MAX_DST_LIST; i++) {
+			dw = (mt_dw_t *)path[i]->data;
+			while(dw) {
+				tmp_list[2 * n] = dw->dstid;
+				tmp_list[2 * n + 1] = dw->weight;
+				n++;
+				if(n == MT_MAX_DST_LIST)
+					break;
+				dw = dw->next;
+			}
+			len = plen[i];
+		}
+	}
+
 	while(itn != NULL && l < tomatch->len && l < MT_MAX_DEPTH) {
 		unsigned char mtch = _mt_char_table[(unsigned char)tomatch->s[l]];
 
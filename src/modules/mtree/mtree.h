@@ -30,6 +30,7 @@
 #include "../../core/str.h"
 #include "../../core/parser/msg_parser.h"
 #include "../../core/rpc.h"
+#include "../../lib/trie/ptfile.h"
 
 #define MT_TREE_SVAL 0
 #define MT_TREE_DW 1
@@ -63,6 +64,27 @@ typedef struct _mt_node
 
 #define MT_MAX_DEPTH 64
 
+/* compact (path compressed) layout of a tree, built at load time */
+typedef struct _mt_cnode
+{
+	mt_is_t *tvalues;
+	void *data;
+	unsigned int child;	   /* index of first child, siblings are adjacent */
+	unsigned int label;	   /* offset of the edge label in labels buffer */
+	unsigned short nchild; /* number of children, sorted by key */
+	unsigned char llen;	   /* length of the edge label */
+	unsigned char key;	   /* first char index of the edge label */
+} mt_cnode_t;
+
+typedef struct _mt_ctree
+{
+	mt_cnode_t *nodes; /* nodes[0] is the root */
+	unsigned char *labels;
+	unsigned int nrnodes;
+	unsigned int lsize;
+	unsigned int memsize;
+} mt_ctree_t;
+
 #define MT_NODE_SIZE mt_char_list.len
 
 #define MT_MAX_COLS 8
@@ -80,7 +102,13 @@ typedef struct _m_tree
 	unsigned int memsize;
 	unsigned int reload_count;
 	uint64_t reload_time;
+	unsigned int cnrnodes;
+	unsigned int cmemsize;
+	unsigned int lookup_ns;
+	unsigned int clookup_ns;
+	unsigned int ptfidx; /* 1-based index in the tree file, 0 if not used */
 	mt_node_t *head;
+	mt_ctree_t *ctree;
 	struct _m_tree *next;
 } m_tree_t;
 
@@ -99,6 +127,13 @@ m_tree_t *mt_init_tree(
 void mt_free_tree(m_tree_t *pt);
 int mt_print_tree(m_tree_t *pt);
 void mt_free_node(mt_node_t *pn, int type);
+int mt_tree_compact(m_tree_t *pt);
+void mt_ctree_free(mt_ctree_t *ct, int type);
+
+int mt_ptf_init(void);
+void mt_ptf_next_gen(void);
+ptf_map_t *mt_ptf_get(void);
+ptf_tree_t *mt_ptf_tree(m_tree_t *pt, ptf_map_t **map);
 
 void mt_char_table_init(void);
 int mt_node_set_payload(mt_node_t *node, int type);
@@ -100,6 +100,8 @@ pv_spec_t pv_count;
 int _mt_tree_type = MT_TREE_SVAL;
 int _mt_ignore_duplicates = 0;
 int _mt_allow_duplicates = 0;
+int _mt_compact_tree = 0;
+str _mt_tree_file = STR_NULL;
 
 /* lock, ref counter and flag used for reloading the date */
 static gen_lock_t *mt_lock = 0;
@@ -121,6 +123,8 @@ static int mt_match(sip_msg_t *msg, str *tname, str *tomatch, int mval);
 
 static int mt_load_db(m_tree_t *pt);
 static int mt_load_db_trees();
+static int mt_init_file_trees(void);
+static int mt_load_file_trees(void);
 
 /* clang-format off */
 static cmd_export_t cmds[] = {
@@ -148,6 +152,8 @@ static param_export_t params[] = {
 	{"mt_tree_type", PARAM_INT, &_mt_tree_type},
 	{"mt_ignore_duplicates", PARAM_INT, &_mt_ignore_duplicates},
 	{"mt_allow_duplicates", PARAM_INT, &_mt_allow_duplicates},
+	{"mt_compact_tree", PARAM_INT, &_mt_compact_tree},
+	{"mt_tree_file", PARAM_STR, &_mt_tree_file},
 	{0, 0, 0}
 };
 
@@ -214,6 +220,10 @@ static int mod_init(void)
 	LM_DBG("mt_char_list=%s \n", mt_char_list.s);
 	mt_char_table_init();
 
+	if(_mt_tree_file.len > 0) {
+		return mt_init_file_trees();
+	}
+
 	/* binding to database module */
 	if(db_bind_mod(&db_url, &mt_dbf)) {
 		LM_ERR("database module not found\n");
@@ -309,6 +319,10 @@ static int child_init(int rank)
 	if(rank == PROC_INIT || rank == PROC_MAIN || rank == PROC_TCP_MAIN)
 		return 0;
 
+	/* no database with prebuilt tree file */
+	if(_mt_tree_file.len > 0)
+		return 0;
+
 	db_con = mt_dbf.init(&db_url);
 	if(db_con == NULL) {
 		LM_ERR("failed to connect to database\n");
@@ -499,6 +513,7 @@ static int mt_load_db(m_tree_t *pt)
 	m_tree_t new_tree;
 	m_tree_t *old_tree = NULL;
 	mt_node_t *bk_head = NULL;
+	mt_ctree_t *bk_ctree = NULL;
 
 	if(pt->ncols > 0) {
 		for(c = 0; c < pt->ncols; c++) {
@@ -527,6 +542,7 @@ static int mt_load_db(m_tree_t *pt)
 	}
 	memcpy(&new_tree, old_tree, sizeof(m_tree_t));
 	new_tree.head = 0;
+	new_tree.ctree = 0;
 	new_tree.next = 0;
 	new_tree.nrnodes = 0;
 	new_tree.nritems = 0;
@@ -622,6 +638,10 @@ static int mt_load_db(m_tree_t *pt)
 dbreloaded:
 	mt_dbf.free_result(db_con, db_res);
 
+	if(mt_tree_compact(&new_tree) < 0) {
+		LM_ERR("cannot build compact tree\n");
+		goto error_tree;
+	}
 
 	/* block all readers */
 	lock_get(mt_lock);
@@ -633,10 +653,16 @@ dbreloaded:
 	}
 
 	bk_head = old_tree->head;
+	bk_ctree = old_tree->ctree;
 	old_tree->head = new_tree.head;
+	old_tree->ctree = new_tree.ctree;
 	old_tree->nrnodes = new_tree.nrnodes;
 	old_tree->nritems = new_tree.nritems;
 	old_tree->memsize = new_tree.memsize;
+	old_tree->cnrnodes = new_tree.cnrnodes;
+	old_tree->cmemsize = new_tree.cmemsize;
+	old_tree->lookup_ns = new_tree.lookup_ns;
+	old_tree->clookup_ns = new_tree.clookup_ns;
 	old_tree->reload_count = new_tree.reload_count;
 	old_tree->reload_time = new_tree.reload_time;
 
@@ -645,11 +671,14 @@ dbreloaded:
 	/* free old data */
 	if(bk_head != NULL)
 		mt_free_node(bk_head, new_tree.type);
+	if(bk_ctree != NULL)
+		mt_ctree_free(bk_ctree, new_tree.type);
 
 	return 0;
 
 error:
 	mt_dbf.free_result(db_con, db_res);
+error_tree:
 	if(new_tree.head != NULL)
 		mt_free_node(new_tree.head, new_tree.type);
 	return -1;
@@ -748,6 +777,13 @@ static int mt_load_db_trees()
 	} while(RES_ROW_N(db_res) > 0);
 	mt_dbf.free_result(db_con, db_res);
 
+	for(new_tree = new_head; new_tree != NULL; new_tree = new_tree->next) {
+		if(mt_tree_compact(new_tree) < 0) {
+			LM_ERR("cannot build compact tree\n");
+			goto error_tree;
+		}
+	}
+
 	/* block all readers */
 	lock_get(mt_lock);
 	mt_reload_flag = 1;
@@ -768,11 +804,106 @@ static int mt_load_db_trees()
 
 error:
 	mt_dbf.free_result(db_con, db_res);
+error_tree:
 	if(new_head != NULL)
 		mt_free_tree(new_head);
 	return -1;
 }
 
+/**
+ * build the list of trees from the prebuilt tree file - the nodes stay
+ * in the file, mapped read-only by each process
+ */
+static int mt_load_file_trees(void)
+{
+	ptf_map_t map;
+	m_tree_t *new_head = NULL;
+	m_tree_t *new_tree = NULL;
+	m_tree_t *old_head = NULL;
+	m_tree_t *old_tree = NULL;
+	str tname;
+	unsigned int i;
+
+	/* validate the new file before using it */
+	if(ptf_map_file(_mt_tree_file.s, &map) < 0) {
+		LM_ERR("cannot load tree file [%.*s]\n", _mt_tree_file.len,
+				_mt_tree_file.s);
+		return -1;
+	}
+	for(i = 0; i < map.ntrees; i++) {
+		tname.s = map.base + map.trees[i].name;
+		tname.len = map.trees[i].namelen;
+		new_tree = mt_add_tree(
+				&new_head, &tname, &_mt_tree_file, NULL, _mt_tree_type, 0);
+		if(new_tree == NULL) {
+			LM_ERR("New tree cannot be initialized\n");
+			goto error;
+		}
+		new_tree->ptfidx = i + 1;
+		new_tree->nrnodes = map.trees[i].nrnodes;
+		new_tree->nritems = map.trees[i].nritems;
+		old_tree = mt_get_tree(&tname);
+		new_tree->reload_count = (old_tree) ? old_tree->reload_count + 1 : 0;
+	}
+	ptf_unmap_file(&map);
+
+	/* block all readers */
+	lock_get(mt_lock);
+	mt_reload_flag = 1;
+	lock_release(mt_lock);
+
+	while(mt_tree_refcnt) {
+		sleep_us(10);
+	}
+
+	old_head = mt_swap_list_head(new_head);
+	mt_ptf_next_gen();
+
+	mt_reload_flag = 0;
+	/* free old data */
+	if(old_head != NULL)
+		mt_free_tree(old_head);
+
+	return 0;
+
+error:
+	ptf_unmap_file(&map);
+	if(new_head != NULL)
+		mt_free_tree(new_head);
+	return -1;
+}
+
+static int mt_init_file_trees(void)
+{
+	if(_mt_tree_type == MT_TREE_DW) {
+		LM_ERR("tree type %d is not supported with tree file\n", MT_TREE_DW);
+		return -1;
+	}
+	if((mt_lock = lock_alloc()) == 0) {
+		LM_CRIT("failed to alloc lock\n");
+		return -1;
+	}
+	if(lock_init(mt_lock) == 0) {
+		LM_CRIT("failed to init lock\n");
+		lock_dealloc(mt_lock);
+		mt_lock = 0;
+		return -1;
+	}
+	if(mt_init_list_head() < 0 || mt_ptf_init() < 0) {
+		LM_ERR("unable to init trees list head\n");
+		return -1;
+	}
+	if(mt_load_file_trees() != 0) {
+		LM_ERR("cannot load trees from file\n");
+		return -1;
+	}
+	/* map it here to be inherited by children */
+	if(mt_ptf_get() == NULL) {
+		return -1;
+	}
+	return 0;
+}
+
 
 /* RPC commands */
 void rpc_mtree_summary(rpc_t *rpc, void *c)
@@ -831,6 +962,27 @@ void rpc_mtree_summary(rpc_t *rpc, void *c)
 				rpc->fault(c, 500, "Internal error adding items");
 				return;
 			}
+			if(rpc->struct_add(ih, "d", "compact", (pt->ctree != NULL) ? 1 : 0)
+					< 0) {
+				rpc->fault(c, 500, "Internal error adding compact");
+				return;
+			}
+			if(rpc->struct_add(ih, "d", "cmemsize", pt->cmemsize) < 0) {
+				rpc->fault(c, 500, "Internal error adding cmemsize");
+				return;
+			}
+			if(rpc->struct_add(ih, "d", "cnrnodes", pt->cnrnodes) < 0) {
+				rpc->fault(c, 500, "Internal error adding cnodes");
+				return;
+			}
+			if(rpc->struct_add(ih, "d", "lookup_ns", pt->lookup_ns) < 0) {
+				rpc->fault(c, 500, "Internal error adding lookup time");
+				return;
+			}
+			if(rpc->struct_add(ih, "d", "clookup_ns", pt->clookup_ns) < 0) {
+				rpc->fault(c, 500, "Internal error adding lookup time");
+				return;
+			}
 			if(rpc->struct_add(ih, "j", "reload_count", pt->reload_count) < 0) {
 				rpc->fault(c, 500, "Internal error adding items");
 				return;
@@ -860,6 +1012,16 @@ void rpc_mtree_reload(rpc_t *rpc, void *c)
 	m_tree_t *pt = NULL;
 	int treeloaded = 0;
 
+	if(_mt_tree_file.len > 0) {
+		/* map the new tree file */
+		if(mt_load_file_trees() != 0) {
+			rpc->fault(c, 500, "Can not reload Mtrees from file.");
+			LM_ERR("RPC failed: cannot reload mtrees from file\n");
+			return;
+		}
+		rpc->rpl_printf(c, "Ok. Mtrees reloaded.");
+		return;
+	}
 	if(db_table.len > 0) {
 		/* re-loading all information from database */
 		if(mt_load_db_trees() != 0) {
@@ -970,59 +1132,141 @@ static const char *rpc_mtree_match_doc[6] = {"Match prefix value against mtree",
 		"prefix - prefix for matching", "mode - mode for matching (0 or 2)", 0};
 
 
-int rpc_mtree_print_node(rpc_t *rpc, void *ctx, m_tree_t *tree, mt_node_t *pt,
-		char *code, int len)
+static int rpc_mtree_print_tvalues(rpc_t *rpc, void *ctx, m_tree_t *tree,
+		mt_is_t *tvalues, char *code, int len)
 {
-	int i;
-	mt_is_t *tvalues;
 	str val;
 	void *th = NULL;
 	void *ih = NULL;
 
+	/* add structure node */
+	if(rpc->add(ctx, "{", &th) < 0) {
+		rpc->fault(ctx, 500, "Internal error - node structure");
+		return -1;
+	}
+
+	val.s = code;
+	val.len = len;
+	if(rpc->struct_add(th, "SS[", "tname", &tree->tname, "tprefix", &val,
+			   "tvalue", &ih)
+			< 0) {
+		rpc->fault(ctx, 500, "Internal error - attribute fields");
+		return -1;
+	}
+
+	while(tvalues != NULL) {
+		if(tree->type == MT_TREE_IVAL) {
+			if(rpc->array_add(ih, "u", (unsigned long)tvalues->tvalue.n) < 0) {
+				rpc->fault(ctx, 500, "Internal error - int val");
+				return -1;
+			}
+		} else {
+			if(rpc->array_add(ih, "S", &tvalues->tvalue.s) < 0) {
+				rpc->fault(ctx, 500, "Internal error - str val");
+				return -1;
+			}
+		}
+		tvalues = tvalues->next;
+	}
+	return 0;
+}
+
+int rpc_mtree_print_node(rpc_t *rpc, void *ctx, m_tree_t *tree, mt_node_t *pt,
+		char *code, int len)
+{
+	int i;
+
 	if(pt == NULL || len >= MT_MAX_DEPTH)
 		return 0;
 
 	for(i = 0; i < MT_NODE_SIZE; i++) {
 		code[len] = mt_char_list.s[i];
-		tvalues = pt[i].tvalues;
-		if(tvalues != NULL) {
-			/* add structure node */
+		if(pt[i].tvalues != NULL) {
+			if(rpc_mtree_print_tvalues(
+					   rpc, ctx, tree, pt[i].tvalues, code, len + 1)
+					< 0)
+				return -1;
+		}
+		if(rpc_mtree_print_node(rpc, ctx, tree, pt[i].child, code, len + 1) < 0)
+			goto error;
+	}
+	return 0;
+error:
+	return -1;
+}
+
+int rpc_mtree_print_pnode(rpc_t *rpc, void *ctx, m_tree_t *tree,
+		ptf_map_t *map, ptf_tree_t *ptr, unsigned int idx, char *code, int len)
+{
+	ptf_node_t *nodes = ptf_tree_nodes(map, ptr);
+	ptf_node_t *pn;
+	ptf_value_t *pv;
+	str val;
+	void *th = NULL;
+	void *ih = NULL;
+	int i;
+
+	for(i = 0; i < nodes[idx].nchild; i++) {
+		pn = &nodes[nodes[idx].child + i];
+		if(len + pn->llen > MT_MAX_DEPTH)
+			continue;
+		memcpy(code + len, ptf_node_label(map, pn), pn->llen);
+		pv = ptf_node_value(map, pn);
+		if(pv != NULL) {
 			if(rpc->add(ctx, "{", &th) < 0) {
 				rpc->fault(ctx, 500, "Internal error - node structure");
 				return -1;
 			}
-
 			val.s = code;
-			val.len = len + 1;
+			val.len = len + pn->llen;
 			if(rpc->struct_add(th, "SS[", "tname", &tree->tname, "tprefix",
 					   &val, "tvalue", &ih)
 					< 0) {
 				rpc->fault(ctx, 500, "Internal error - attribute fields");
 				return -1;
 			}
-
-			while(tvalues != NULL) {
-				if(tree->type == MT_TREE_IVAL) {
-					if(rpc->array_add(ih, "u", (unsigned long)tvalues->tvalue.n)
-							< 0) {
-						rpc->fault(ctx, 500, "Internal error - int val");
-						return -1;
-					}
-				} else {
-					if(rpc->array_add(ih, "S", &tvalues->tvalue.s) < 0) {
-						rpc->fault(ctx, 500, "Internal error - str val");
-						return -1;
-					}
+			for(; pv != NULL; pv = ptf_value_next(map, pv)) {
+				val.s = pv->s;
+				val.len = pv->len;
+				if(rpc->array_add(ih, "S", &val) < 0) {
+					rpc->fault(ctx, 500, "Internal error - str val");
+					return -1;
 				}
-				tvalues = tvalues->next;
 			}
 		}
-		if(rpc_mtree_print_node(rpc, ctx, tree, pt[i].child, code, len + 1) < 0)
-			goto error;
+		if(rpc_mtree_print_pnode(rpc, ctx, tree, map, ptr,
+				   nodes[idx].child + i, code, len + pn->llen)
+				< 0)
+			return -1;
+	}
+	return 0;
+}
+
+int rpc_mtree_print_cnode(rpc_t *rpc, void *ctx, m_tree_t *tree,
+		unsigned int idx, char *code, int len)
+{
+	mt_ctree_t *ct = tree->ctree;
+	mt_cnode_t *cn;
+	int i, k;
+
+	for(i = 0; i < ct->nodes[idx].nchild; i++) {
+		cn = &ct->nodes[ct->nodes[idx].child + i];
+		if(len + cn->llen > MT_MAX_DEPTH)
+			continue;
+		for(k = 0; k < cn->llen; k++)
+			code[len + k] = mt_char_list.s[ct->labels[cn->label + k]];
+		if(cn->tvalues != NULL) {
+			if(rpc_mtree_print_tvalues(
+					   rpc, ctx, tree, cn->tvalues, code, len + cn->llen)
+					< 0)
+				return -1;
+		}
+		if(rpc_mtree_print_cnode(rpc, ctx, tree, ct->nodes[idx].child + i,
+				   code, len + cn->llen)
+				< 0)
+			return -1;
 	}
 	return 0;
-error:
-	return -1;
 }
 
 /**
@@ -1037,6 +1281,8 @@ void rpc_mtree_list(rpc_t *rpc, void *ctx)
 	m_tree_t *pt;
 	static char code_buf[MT_MAX_DEPTH + 1];
 	int len;
+	ptf_map_t *map;
+	ptf_tree_t *ptr;
 
 	if(!mt_defined_trees()) {
 		rpc->fault(ctx, 500, "Empty tree list.");
@@ -1056,8 +1302,21 @@ void rpc_mtree_list(rpc_t *rpc, void *ctx)
 						&& strncmp(pt->tname.s, tname.s, tname.len) == 0)) {
 			len = 0;
 			code_buf[0] = '\0';
-			if(rpc_mtree_print_node(rpc, ctx, pt, pt->head, code_buf, len)
-					< 0) {
+			if(pt->ptfidx > 0) {
+				ptr = mt_ptf_tree(pt, &map);
+				if(ptr != NULL
+						&& rpc_mtree_print_pnode(
+								   rpc, ctx, pt, map, ptr, 0, code_buf, len)
+								   < 0) {
+					goto error;
+				}
+			} else if(pt->ctree != NULL) {
+				if(rpc_mtree_print_cnode(rpc, ctx, pt, 0, code_buf, len) < 0) {
+					goto error;
+				}
+			} else if(rpc_mtree_print_node(
+							  rpc, ctx, pt, pt->head, code_buf, len)
+					  < 0) {
 				goto error;
 			}
 		}
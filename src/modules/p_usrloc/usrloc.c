@@ -64,6 +64,7 @@ int bind_usrloc(usrloc_api_t *api)
 	api->insert_urecord = insert_urecord;
 	api->delete_urecord = delete_urecord;
 	api->get_urecord = get_urecord;
+	api->get_urecord_cached = get_urecord;
 	api->lock_udomain = lock_udomain;
 	api->unlock_udomain = unlock_udomain;
 	api->release_urecord = release_urecord;
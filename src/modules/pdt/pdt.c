@@ -47,6 +47,8 @@
 #include "../../core/rpc.h"
 #include "../../core/rpc_lookup.h"
 #include "../../core/kemi.h"
+#include "../../core/atomic_ops.h"
+#include "../../lib/trie/ptfile.h"
 
 #include "pdtree.h"
 
@@ -73,6 +75,12 @@ static str sdomain_column = str_init("sdomain");
 static str prefix_column = str_init("prefix");
 static str domain_column = str_init("domain");
 static int pdt_check_domain = 1;
+static str pdt_tree_file = STR_NULL;
+
+/** prebuilt tree file mapped in the current process */
+static ptf_map_t pdt_ptf_map;
+static unsigned int pdt_ptf_lgen = 0;
+static unsigned int *pdt_ptf_sgen = NULL;
 
 /** translation prefix */
 str pdt_prefix = {"", 0};
@@ -98,6 +106,8 @@ static int fixup_free_translate(void **param, int param_no);
 
 static int update_new_uri(struct sip_msg *msg, int plen, str *d, int mode);
 static int pdt_init_rpc(void);
+static int pdt_init_file(void);
+static int pdt_load_file(void);
 
 /* clang-format off */
 static cmd_export_t cmds[] = {
@@ -123,6 +133,7 @@ static param_export_t params[] = {
 	{"fetch_rows", PARAM_INT, &pdt_fetch_rows},
 	{"check_domain", PARAM_INT, &pdt_check_domain},
 	{"mode", PARAM_INT, &_pdt_mode},
+	{"tree_file", PARAM_STR, &pdt_tree_file},
 	{0, 0, 0}
 };
 
@@ -140,6 +151,47 @@ struct module_exports exports = {
 };
 /* clang-format on */
 
+/**
+ * lookup the domain for the prefix in the tree file
+ */
+static str *pdt_file_get_domain(str *sdomain, str *code, int *plen)
+{
+	static str domain;
+	ptf_node_t *path[PTF_MAX_DEPTH];
+	int pl[PTF_MAX_DEPTH];
+	ptf_tree_t *tr;
+	ptf_value_t *val;
+	int n;
+
+	if(ptf_map_sync(&pdt_ptf_map, pdt_tree_file.s, &pdt_ptf_lgen,
+			   *pdt_ptf_sgen)
+			< 0) {
+		LM_ERR("cannot map tree file [%.*s]\n", pdt_tree_file.len,
+				pdt_tree_file.s);
+	}
+	if(pdt_ptf_map.base == NULL)
+		return NULL;
+	tr = ptf_get_tree(&pdt_ptf_map, sdomain->s, sdomain->len);
+	if(tr == NULL)
+		return NULL;
+	n = ptf_match(&pdt_ptf_map, tr, code->s,
+			(code->len < PDT_MAX_DEPTH) ? code->len : PDT_MAX_DEPTH, path, pl);
+	if(n == 0)
+		return NULL;
+	val = ptf_node_value(&pdt_ptf_map, path[n - 1]);
+	domain.s = val->s;
+	domain.len = val->len;
+	*plen = pl[n - 1];
+	return &domain;
+}
+
+static str *pdt_lookup_domain(str *sdomain, str *code, int *plen)
+{
+	if(pdt_tree_file.len > 0)
+		return pdt_file_get_domain(sdomain, code, plen);
+	return pdt_get_domain(*_ptree, sdomain, code, plen);
+}
+
 /**
  * init module function
  */
@@ -160,6 +212,10 @@ static int mod_init(void)
 	}
 	LM_INFO("pdt_char_list=%s \n", pdt_char_list.s);
 
+	if(pdt_tree_file.len > 0) {
+		return pdt_init_file();
+	}
+
 	/* binding to mysql module */
 	if(db_bind_mod(&db_url, &pdt_dbf)) {
 		LM_ERR("database module not found\n");
@@ -242,6 +298,9 @@ static int child_init(int rank)
 	if(rank == PROC_INIT || rank == PROC_MAIN || rank == PROC_TCP_MAIN)
 		return 0; /* do nothing for the main process */
 
+	if(pdt_tree_file.len > 0)
+		return 0; /* no database with prebuilt tree file */
+
 	if(pdt_init_db() < 0) {
 		LM_ERR("cannot initialize database connection\n");
 		return -1;
@@ -267,6 +326,10 @@ static void mod_destroy(void)
 		lock_dealloc(pdt_lock);
 		pdt_lock = 0;
 	}
+	if(pdt_ptf_sgen != NULL) {
+		shm_free(pdt_ptf_sgen);
+		pdt_ptf_sgen = NULL;
+	}
 }
 
 
@@ -391,10 +454,9 @@ again:
 	lock_release(pdt_lock);
 
 
-	if((d = pdt_get_domain(*_ptree, sdomain, &p, &plen)) == NULL) {
+	if((d = pdt_lookup_domain(sdomain, &p, &plen)) == NULL) {
 		plen = 0;
-		if((fmode == 0)
-				|| (d = pdt_get_domain(*_ptree, &sdall, &p, &plen)) == NULL) {
+		if((fmode == 0) || (d = pdt_lookup_domain(&sdall, &p, &plen)) == NULL) {
 			LM_INFO("no prefix PDT prefix matched [%.*s]\n", p.len, p.s);
 			goto error;
 		}
@@ -661,6 +723,64 @@ error:
 	return -1;
 }
 
+/**
+ * validate the tree file and make all processes map it again
+ */
+static int pdt_load_file(void)
+{
+	ptf_map_t map;
+
+	if(ptf_map_file(pdt_tree_file.s, &map) < 0) {
+		LM_ERR("cannot load tree file [%.*s]\n", pdt_tree_file.len,
+				pdt_tree_file.s);
+		return -1;
+	}
+	LM_DBG("tree file with %u sdomains\n", map.ntrees);
+	ptf_unmap_file(&map);
+
+	/* block all readers */
+	lock_get(pdt_lock);
+	pdt_reload_flag = 1;
+	lock_release(pdt_lock);
+
+	while(pdt_tree_refcnt) {
+		sleep_us(10);
+	}
+
+	(*pdt_ptf_sgen)++;
+	membar_write();
+
+	pdt_reload_flag = 0;
+
+	return 0;
+}
+
+static int pdt_init_file(void)
+{
+	if((pdt_lock = lock_alloc()) == 0) {
+		LM_CRIT("failed to alloc lock\n");
+		return -1;
+	}
+	if(lock_init(pdt_lock) == 0) {
+		LM_CRIT("failed to init lock\n");
+		lock_dealloc(pdt_lock);
+		pdt_lock = 0;
+		return -1;
+	}
+	pdt_ptf_sgen = (unsigned int *)shm_malloc(sizeof(unsigned int));
+	if(pdt_ptf_sgen == NULL) {
+		SHM_MEM_ERROR;
+		return -1;
+	}
+	*pdt_ptf_sgen = 0;
+	if(pdt_load_file() < 0) {
+		return -1;
+	}
+	/* map it here to be inherited by children */
+	return ptf_map_sync(
+			&pdt_ptf_map, pdt_tree_file.s, &pdt_ptf_lgen, *pdt_ptf_sgen);
+}
+
 
 /* return the pointer to char list */
 str *pdt_get_char_list(void)
@@ -685,6 +805,12 @@ static const char *pdt_rpc_reload_doc[2] = {"Reload PDT database records", 0};
  */
 static void pdt_rpc_reload(rpc_t *rpc, void *ctx)
 {
+	if(pdt_tree_file.len > 0) {
+		if(pdt_load_file() < 0) {
+			rpc->fault(ctx, 500, "Reload Failed");
+		}
+		return;
+	}
 	if(pdt_load_db() < 0) {
 		LM_ERR("cannot re-load pdt records from database\n");
 		rpc->fault(ctx, 500, "Reload Failed");
@@ -789,6 +915,11 @@ static void pdt_rpc_list(rpc_t *rpc, void *ctx)
 	void *th;
 	void *ih;
 
+	if(pdt_tree_file.len > 0) {
+		rpc->fault(ctx, 501, "Not available with tree file");
+		return;
+	}
+
 	ptree = pdt_get_ptree();
 
 	if(ptree == NULL || *ptree == NULL) {
@@ -51,6 +51,9 @@ extern int _perm_subnet_match_mode;
 
 #define PERM_MAX_SUBNETS _perm_max_subnets
 
+#define subnet_table_tree(_t) \
+	((struct subnet_tree *)&(_t)[PERM_MAX_SUBNETS + 1])
+
 /*
  * Parse and set tag AVP specs
  */
@@ -256,13 +259,12 @@ int hash_table_insert(struct trusted_list **table, char *src_ip, char *proto,
  * Returns number of matches or -1 if none matched.
  */
 int match_hash_table(struct trusted_list **table, struct sip_msg *msg,
-		char *src_ip_c_str, int proto, char *from_uri)
+		char *src_ip_c_str, int proto, char *from_uri, str *ctags)
 {
 	LM_DBG("match_hash_table src_ip: %s, proto: %d, uri: %s\n", src_ip_c_str,
 			proto, from_uri);
 	str ruri;
 	char ruri_string[MAX_URI_SIZE + 1];
-	regex_t preg;
 	struct trusted_list *np;
 	str src_ip;
 	int_str val;
@@ -293,29 +295,14 @@ int match_hash_table(struct trusted_list **table, struct sip_msg *msg,
 					(np->tag.s ? np->tag.s : "null"));
 
 			if(IS_SIP(msg)) {
-				if(np->pattern) {
-					if(regcomp(&preg, np->pattern, REG_NOSUB)) {
-						LM_ERR("invalid regular expression\n");
-						if(!np->pattern) {
-							continue;
-						}
-					}
-					if(regexec(&preg, from_uri, 0, (regmatch_t *)0, 0)) {
-						regfree(&preg);
-						continue;
-					}
-					regfree(&preg);
+				if(np->pattern
+						&& trusted_regex_match(np->pattern, from_uri) != 1) {
+					continue;
 				}
-				if(np->ruri_pattern) {
-					if(regcomp(&preg, np->ruri_pattern, REG_NOSUB)) {
-						LM_ERR("invalid regular expression\n");
-						continue;
-					}
-					if(regexec(&preg, ruri_string, 0, (regmatch_t *)0, 0)) {
-						regfree(&preg);
-						continue;
-					}
-					regfree(&preg);
+				if(np->ruri_pattern
+						&& trusted_regex_match(np->ruri_pattern, ruri_string)
+								   != 1) {
+					continue;
 				}
 			}
 			/* Found a match */
@@ -325,6 +312,7 @@ int match_hash_table(struct trusted_list **table, struct sip_msg *msg,
 					LM_ERR("setting of tag_avp failed\n");
 					return -1;
 				}
+				trusted_tags_add(ctags, &np->tag);
 			}
 			if(!perm_peer_tag_mode)
 				return 1;
@@ -478,7 +466,7 @@ int addr_hash_table_insert(struct addr_list **table, unsigned int grp,
 	}
 
 	addr_str.s = (char *)addr->u.addr;
-	addr_str.len = 4;
+	addr_str.len = addr->len;
 	hash_val = perm_hash(addr_str);
 	np->next = table[hash_val];
 	table[hash_val] = np;
@@ -499,7 +487,7 @@ int match_addr_hash_table(struct addr_list **table, unsigned int group,
 	avp_value_t val;
 
 	addr_str.s = (char *)addr->u.addr;
-	addr_str.len = 4;
+	addr_str.len = addr->len;
 
 	for(np = table[perm_hash(addr_str)]; np != NULL; np = np->next) {
 		if((np->grp == group) && ((np->port == 0) || (np->port == port))
@@ -534,7 +522,7 @@ int find_group_in_addr_hash_table(
 	avp_value_t val;
 
 	addr_str.s = (char *)addr->u.addr;
-	addr_str.len = 4;
+	addr_str.len = addr->len;
 
 	for(np = table[perm_hash(addr_str)]; np != NULL; np = np->next) {
 		if(((np->port == 0) || (np->port == port))
@@ -626,16 +614,19 @@ void empty_addr_hash_table(struct addr_list **table)
 struct subnet *new_subnet_table(void)
 {
 	struct subnet *ptr;
+	int len;
 
 	/* subnet record [PERM_MAX_SUBNETS] contains in its grp field
-	 * the number of subnet records in the subnet table */
-	ptr = (struct subnet *)shm_malloc(
-			sizeof(struct subnet) * (PERM_MAX_SUBNETS + 1));
+	 * the number of subnet records in the subnet table and it is
+	 * followed by the prefix tree */
+	len = sizeof(struct subnet) * (PERM_MAX_SUBNETS + 1)
+		  + sizeof(struct subnet_tree);
+	ptr = (struct subnet *)shm_malloc(len);
 	if(!ptr) {
 		LM_ERR("no shm memory for subnet table\n");
 		return 0;
 	}
-	memset(ptr, 0, sizeof(struct subnet) * (PERM_MAX_SUBNETS + 1));
+	memset(ptr, 0, len);
 	return ptr;
 }
 
@@ -692,78 +683,234 @@ int subnet_table_insert(struct subnet *table, unsigned int grp,
 
 
 /*
- * Check if an entry exists in subnet table that matches given group, ip_addr,
- * and port.  Port 0 in subnet table matches any port.
+ * Get bit b of the address (0 is the most significant bit)
  */
-int match_subnet_table(struct subnet *table, unsigned int grp, ip_addr_t *addr,
-		unsigned int port)
+static inline int subnet_addr_bit(unsigned char *addr, unsigned int b)
 {
-	unsigned int count, i;
-	avp_value_t val;
-	int best_idx = -1;
-	unsigned int best_mask = 0;
+	return (addr[b >> 3] >> (7 - (b & 7))) & 1;
+}
 
-	count = table[PERM_MAX_SUBNETS].grp;
 
-	i = 0;
-	while((i < count) && (table[i].grp < grp))
-		i++;
+/*
+ * Check if the first bits of addr are the prefix of the tree node
+ */
+static inline int subnet_tnode_match(
+		struct subnet_tnode *tn, unsigned char *addr)
+{
+	unsigned int n;
 
-	if(i == count)
-		return -1;
+	n = tn->bits >> 3;
+	if(n > 0 && memcmp(tn->addr, addr, n) != 0)
+		return 0;
+	if((tn->bits & 7) == 0)
+		return 1;
+	return (addr[n] & (unsigned char)(0xff << (8 - (tn->bits & 7))))
+		   == tn->addr[n];
+}
 
-	while((i < count) && (table[i].grp == grp)) {
-		if(((table[i].port == port) || (table[i].port == 0))
-				&& (ip_addr_match_net(addr, &table[i].subnet, table[i].mask)
-						== 0)) {
-			if(table[i].mask > best_mask) {
-				best_mask = table[i].mask;
-				best_idx = i;
-			}
-			if(_perm_subnet_match_mode == 0) {
-				/* use the first match */
-				break;
-			}
+
+/*
+ * Get a new tree node with the first bits of addr as prefix
+ */
+static int subnet_tnode_new(
+		struct subnet_tree *tree, unsigned char *addr, unsigned int bits)
+{
+	struct subnet_tnode *tn;
+	unsigned int n;
+
+	tn = &tree->nodes[tree->nnodes];
+	memset(tn, 0, sizeof(struct subnet_tnode));
+	n = bits >> 3;
+	memcpy(tn->addr, addr, n);
+	if((bits & 7) != 0)
+		tn->addr[n] = addr[n] & (unsigned char)(0xff << (8 - (bits & 7)));
+	tn->bits = bits;
+	tn->first = -1;
+	return tree->nnodes++;
+}
+
+
+/*
+ * Append the subnet record to the records of the tree node, the list is
+ * kept in the order of the table
+ */
+static void subnet_tnode_add(struct subnet_tree *tree, int ni, int idx)
+{
+	int *p;
+
+	p = &tree->nodes[ni].first;
+	while(*p >= 0)
+		p = &tree->next[*p];
+	*p = idx;
+	tree->next[idx] = -1;
+}
+
+
+/*
+ * Insert the subnet record in the tree under root node ni - it adds at
+ * most two nodes
+ */
+static void subnet_tree_insert(struct subnet_tree *tree, int ni, int idx,
+		unsigned char *addr, unsigned int bits)
+{
+	struct subnet_tnode *tn;
+	struct subnet_tnode *cn;
+	int ci, ki, b;
+	unsigned int cl;
+
+	while(1) {
+		tn = &tree->nodes[ni];
+		if(tn->bits == bits) {
+			subnet_tnode_add(tree, ni, idx);
+			return;
 		}
-		i++;
+		b = subnet_addr_bit(addr, tn->bits);
+		ci = tn->child[b];
+		if(ci == 0) {
+			ki = subnet_tnode_new(tree, addr, bits);
+			tree->nodes[ni].child[b] = ki;
+			subnet_tnode_add(tree, ki, idx);
+			return;
+		}
+		cn = &tree->nodes[ci];
+		/* common prefix of the child and the record */
+		cl = tn->bits + 1;
+		while(cl < cn->bits && cl < bits
+				&& subnet_addr_bit(addr, cl) == subnet_addr_bit(cn->addr, cl))
+			cl++;
+		if(cl == cn->bits) {
+			ni = ci;
+			continue;
+		}
+		/* split the edge to the child */
+		ki = subnet_tnode_new(tree, addr, cl);
+		tree->nodes[ki].child[subnet_addr_bit(tree->nodes[ci].addr, cl)] = ci;
+		tree->nodes[ni].child[b] = ki;
+		if(cl == bits) {
+			subnet_tnode_add(tree, ki, idx);
+		} else {
+			ci = subnet_tnode_new(tree, addr, bits);
+			tree->nodes[ki].child[subnet_addr_bit(addr, cl)] = ci;
+			subnet_tnode_add(tree, ci, idx);
+		}
+		return;
 	}
+}
 
-	if(best_idx >= 0) {
-		if(tag_avp.n && table[best_idx].tag.s) {
-			val.s = table[best_idx].tag;
-			if(add_avp(tag_avp_type | AVP_VAL_STR, tag_avp, val) != 0) {
-				LM_ERR("setting of tag_avp failed\n");
-				return -1;
-			}
-		}
-		return 1;
+
+/*
+ * Release the prefix tree of the subnet table
+ */
+static void subnet_tree_free(struct subnet_tree *tree)
+{
+	if(tree->nodes != NULL)
+		shm_free(tree->nodes);
+	memset(tree, 0, sizeof(struct subnet_tree));
+}
+
+
+/*
+ * Build the prefix tree of the records in subnet table
+ */
+int subnet_table_index(struct subnet *table)
+{
+	struct subnet_tree *tree;
+	unsigned int count, i;
+	int size;
+
+	tree = subnet_table_tree(table);
+	subnet_tree_free(tree);
+	count = table[PERM_MAX_SUBNETS].grp;
+	if(count == 0)
+		return 0;
+
+	/* two roots and at most two nodes per record */
+	size = 2 * count + 2;
+	tree->nodes = (struct subnet_tnode *)shm_malloc(
+			size * sizeof(struct subnet_tnode) + count * sizeof(int));
+	if(tree->nodes == NULL) {
+		SHM_MEM_ERROR;
+		return -1;
 	}
+	tree->next = (int *)(tree->nodes + size);
+	tree->size = size;
 
-	return -1;
+	memset(tree->nodes, 0, 2 * sizeof(struct subnet_tnode));
+	tree->nodes[0].first = -1;
+	tree->nodes[1].first = -1;
+	tree->nnodes = 2;
+	for(i = 0; i < count; i++) {
+		if(table[i].subnet.af == AF_INET && table[i].mask <= 32) {
+			subnet_tree_insert(
+					tree, 0, i, table[i].subnet.u.addr, table[i].mask);
+		} else if(table[i].subnet.af == AF_INET6 && table[i].mask <= 128) {
+			subnet_tree_insert(
+					tree, 1, i, table[i].subnet.u.addr, table[i].mask);
+		}
+	}
+	LM_DBG("indexed %u subnets in %d tree nodes\n", count, tree->nnodes);
+	return 0;
 }
 
 
 /*
- * Check if an entry exists in subnet table that matches given ip_addr,
- * and port.  Port 0 in subnet table matches any port.  Return group of
- * first match or -1 if no match is found.
+ * Find the index of the matching subnet record for the address and port,
+ * only in group grp if anygrp is 0 - the first record in table order or
+ * the longest prefix, according to subnet_match_mode
  */
-int find_group_in_subnet_table(
-		struct subnet *table, ip_addr_t *addr, unsigned int port)
+static int subnet_table_lookup(struct subnet *table, int anygrp,
+		unsigned int grp, ip_addr_t *addr, unsigned int port)
 {
+	struct subnet_tree *tree;
+	struct subnet_tnode *tn;
 	unsigned int count, i;
-	avp_value_t val;
 	int best_idx = -1;
 	unsigned int best_mask = 0;
+	int ni, j;
+
+	tree = subnet_table_tree(table);
+	if(tree->nnodes > 0) {
+		if(addr->af != AF_INET && addr->af != AF_INET6)
+			return -1;
+		ni = (addr->af == AF_INET) ? 0 : 1;
+		/* the masks of the records grow along the path */
+		while(1) {
+			tn = &tree->nodes[ni];
+			if(!subnet_tnode_match(tn, addr->u.addr))
+				break;
+			for(j = tn->first; j >= 0; j = tree->next[j]) {
+				if((anygrp || table[j].grp == grp)
+						&& (table[j].port == port || table[j].port == 0)) {
+					if(best_idx < 0 || _perm_subnet_match_mode != 0
+							|| j < best_idx) {
+						best_idx = j;
+					}
+					break;
+				}
+			}
+			if(tn->bits >= addr->len * 8)
+				break;
+			ni = tn->child[subnet_addr_bit(addr->u.addr, tn->bits)];
+			if(ni == 0)
+				break;
+		}
+		return best_idx;
+	}
 
 	count = table[PERM_MAX_SUBNETS].grp;
 
 	i = 0;
-	while(i < count) {
+	if(!anygrp) {
+		while((i < count) && (table[i].grp < grp))
+			i++;
+	}
+
+	while((i < count) && (anygrp || table[i].grp == grp)) {
 		if(((table[i].port == port) || (table[i].port == 0))
 				&& (ip_addr_match_net(addr, &table[i].subnet, table[i].mask)
 						== 0)) {
-			if(table[i].mask > best_mask) {
+			/* same as the tree lookup - a /0 record matches any address */
+			if(best_idx < 0 || table[i].mask > best_mask) {
 				best_mask = table[i].mask;
 				best_idx = i;
 			}
@@ -775,18 +922,60 @@ int find_group_in_subnet_table(
 		i++;
 	}
 
-	if(best_idx >= 0) {
-		if(tag_avp.n && table[best_idx].tag.s) {
-			val.s = table[best_idx].tag;
-			if(add_avp(tag_avp_type | AVP_VAL_STR, tag_avp, val) != 0) {
-				LM_ERR("setting of tag_avp failed\n");
-				return -1;
-			}
+	return best_idx;
+}
+
+
+/*
+ * Set the tag AVP of the matched subnet record
+ */
+static int subnet_table_set_tag(struct subnet *table, int idx)
+{
+	avp_value_t val;
+
+	if(tag_avp.n && table[idx].tag.s) {
+		val.s = table[idx].tag;
+		if(add_avp(tag_avp_type | AVP_VAL_STR, tag_avp, val) != 0) {
+			LM_ERR("setting of tag_avp failed\n");
+			return -1;
 		}
-		return table[best_idx].grp;
 	}
+	return 0;
+}
 
-	return -1;
+
+/*
+ * Check if an entry exists in subnet table that matches given group, ip_addr,
+ * and port.  Port 0 in subnet table matches any port.
+ */
+int match_subnet_table(struct subnet *table, unsigned int grp, ip_addr_t *addr,
+		unsigned int port)
+{
+	int best_idx;
+
+	best_idx = subnet_table_lookup(table, 0, grp, addr, port);
+	if(best_idx < 0 || subnet_table_set_tag(table, best_idx) < 0)
+		return -1;
+
+	return 1;
+}
+
+
+/*
+ * Check if an entry exists in subnet table that matches given ip_addr,
+ * and port.  Port 0 in subnet table matches any port.  Return group of
+ * first match or -1 if no match is found.
+ */
+int find_group_in_subnet_table(
+		struct subnet *table, ip_addr_t *addr, unsigned int port)
+{
+	int best_idx;
+
+	best_idx = subnet_table_lookup(table, 1, 0, addr, port);
+	if(best_idx < 0 || subnet_table_set_tag(table, best_idx) < 0)
+		return -1;
+
+	return table[best_idx].grp;
 }
 
 
@@ -838,6 +1027,7 @@ void empty_subnet_table(struct subnet *table)
 {
 	int i;
 	table[PERM_MAX_SUBNETS].grp = 0;
+	subnet_tree_free(subnet_table_tree(table));
 	for(i = 0; i < PERM_MAX_SUBNETS; i++) {
 		if(table[i].tag.s != NULL) {
 			shm_free(table[i].tag.s);
@@ -856,6 +1046,7 @@ void free_subnet_table(struct subnet *table)
 	int i;
 	if(!table)
 		return;
+	subnet_tree_free(subnet_table_tree(table));
 	for(i = 0; i < PERM_MAX_SUBNETS; i++) {
 		if(table[i].tag.s != NULL) {
 			shm_free(table[i].tag.s);
@@ -89,10 +89,11 @@ int hash_table_insert(struct trusted_list **hash_table, char *src_ip,
 
 /*
  * Check if an entry exists in hash table that has given src_ip and protocol
- * value and pattern or ruri_pattern that matches to provided URI.
+ * value and pattern or ruri_pattern that matches to provided URI. The tags
+ * of the matched entries are also collected in ctags, if not NULL.
  */
 int match_hash_table(struct trusted_list **table, struct sip_msg *msg,
-		char *scr_ip, int proto, char *uri);
+		char *scr_ip, int proto, char *uri, str *ctags);
 
 
 /*
@@ -189,12 +190,45 @@ struct subnet
 };
 
 
+/*
+ * Node of the subnet tree - a path compressed binary trie over the
+ * address bits, with the subnet records of each prefix
+ */
+struct subnet_tnode
+{
+	unsigned char addr[16]; /* prefix, the bits after it are 0 */
+	unsigned int bits;		/* prefix length */
+	int child[2];			/* child node per next bit, 0 if none */
+	int first;				/* first subnet record of prefix, -1 if none */
+};
+
+
+/*
+ * Longest prefix match index of a subnet table, kept after the last
+ * record so it is switched together with the table
+ */
+struct subnet_tree
+{
+	int nnodes;
+	int size;
+	struct subnet_tnode *nodes; /* [0] is IPv4 root, [1] is IPv6 root */
+	int *next; /* next subnet record with same prefix, -1 at the end */
+};
+
+
 /*
  * Create a subnet table
  */
 struct subnet *new_subnet_table(void);
 
 
+/*
+ * Build the prefix tree of the records in subnet table, the lookups fall
+ * back to scanning the table if it fails
+ */
+int subnet_table_index(struct subnet *table);
+
+
 /*
  * Check if an entry exists in subnet table that matches given group, ip_addr,
  * and port.  Port 0 in subnet table matches any port.
@@ -76,6 +76,8 @@ str perm_tag_col = str_init("tag");			  /* Name of tag column */
 str perm_priority_col = str_init("priority"); /* Name of priority column */
 str perm_tag_avp_param = {NULL, 0};			  /* Peer tag AVP spec */
 int perm_peer_tag_mode = 0; /* Add tags form all mathcing peers to avp */
+int perm_trusted_cache_size = 0; /* Slots of allow_trusted result cache */
+int perm_trusted_cache_ttl = 60; /* Lifetime of cached results */
 
 /* for allow_address function */
 str perm_address_table = str_init("address"); /* Name of address table */
@@ -192,6 +194,8 @@ static param_export_t params[] = {
 	{"priority_col", PARAM_STR, &perm_priority_col},
 	{"peer_tag_avp", PARAM_STR, &perm_tag_avp_param},
 	{"peer_tag_mode", PARAM_INT, &perm_peer_tag_mode},
+	{"trusted_cache_size", PARAM_INT, &perm_trusted_cache_size},
+	{"trusted_cache_ttl", PARAM_INT, &perm_trusted_cache_ttl},
 	{"address_table", PARAM_STR, &perm_address_table},
 	{"address_file", PARAM_STR, &perm_address_file_param},
 	{"grp_col", PARAM_STR, &perm_grp_col},
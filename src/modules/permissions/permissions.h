@@ -62,6 +62,8 @@ extern str perm_ip_addr_col;   /* Name of ip address column */
 extern str perm_mask_col;	   /* Name of mask column */
 extern str perm_port_col;	   /* Name of port column */
 extern int perm_peer_tag_mode; /* Matching mode */
+extern int perm_trusted_cache_size; /* Slots of allow_trusted result cache */
+extern int perm_trusted_cache_ttl;	/* Lifetime of cached results */
 extern int perm_reload_delta;  /* seconds between RPC reloads */
 extern int
 		perm_trusted_table_interval; /* interval of timer to clean old trusted data */
@@ -29,17 +29,24 @@
 
 #include "permissions.h"
 #include "hash.h"
+#include "trusted.h"
 #include "../../core/config.h"
 #include "../../lib/srdb1/db.h"
 #include "../../core/ip_addr.h"
 #include "../../core/mod_fix.h"
+#include "../../core/mem/mem.h"
 #include "../../core/mem/shm_mem.h"
 #include "../../core/parser/msg_parser.h"
 #include "../../core/parser/parse_from.h"
 #include "../../core/usr_avp.h"
+#include "../../core/hashes.h"
 
 #define TABLE_VERSION 6
 
+/* buckets and max items of the per process cache of compiled patterns */
+#define TRUSTED_RE_HASH_SIZE 64
+#define TRUSTED_RE_MAX_ITEMS 1024
+
 struct trusted_list ***perm_trust_table =
 		0; /* Pointer to current hash table pointer */
 struct trusted_list **perm_trust_table_1 = 0; /* Pointer to hash table 1 */
@@ -49,6 +56,43 @@ struct trusted_list **perm_trust_table_2 = 0; /* Pointer to hash table 2 */
 static db1_con_t *perm_db_handle = 0;
 static db_func_t perm_dbf;
 
+/* incremented on each reload of trusted table */
+static unsigned int *perm_trust_gen = 0;
+
+/*
+ * Compiled pattern, kept in private memory of the process because the
+ * regex_t internals are allocated by libc
+ */
+typedef struct trusted_re
+{
+	unsigned int hid;
+	int valid; /* 0 if the pattern cannot be compiled */
+	regex_t re;
+	struct trusted_re *next;
+	char pattern[1];
+} trusted_re_t;
+
+static trusted_re_t *_trusted_re_table[TRUSTED_RE_HASH_SIZE];
+static int _trusted_re_items = 0;
+static unsigned int _trusted_re_gen = 0;
+
+/*
+ * Cached result of allow_trusted() for a source, protocol, From URI
+ * and R-URI
+ */
+typedef struct trusted_centry
+{
+	unsigned int hid;
+	unsigned int gen;
+	int proto;
+	int result;
+	time_t expires; /* 0 if the slot has no result */
+	str key;		/* source, From URI and R-URI, each zero terminated */
+	str tags;		/* tags of the matched entries, each zero terminated */
+} trusted_centry_t;
+
+static trusted_centry_t *_trusted_cache = NULL;
+
 
 /*
  * Reload trusted table to new hash table and when done, make new hash table
@@ -170,6 +214,8 @@ int reload_trusted_table(void)
 	perm_dbf.free_result(perm_db_handle, res);
 
 	*perm_trust_table = new_hash_table;
+	if(perm_trust_gen)
+		(*perm_trust_gen)++;
 
 	LM_DBG("trusted table reloaded successfully.\n");
 
@@ -203,6 +249,13 @@ int init_trusted(void)
 	perm_trust_table_1 = perm_trust_table_2 = 0;
 	perm_trust_table = 0;
 
+	perm_trust_gen = (unsigned int *)shm_malloc(sizeof(unsigned int));
+	if(!perm_trust_gen) {
+		SHM_MEM_ERROR;
+		return -1;
+	}
+	*perm_trust_gen = 0;
+
 	if(perm_db_mode == ENABLE_CACHE) {
 		perm_db_handle = perm_dbf.init(&perm_db_url);
 		if(!perm_db_handle) {
@@ -327,6 +380,90 @@ void clean_trusted(void)
 		free_hash_table(perm_trust_table_2);
 	if(perm_trust_table)
 		shm_free(perm_trust_table);
+	if(perm_trust_gen)
+		shm_free(perm_trust_gen);
+}
+
+
+/*
+ * Release the compiled patterns of the process
+ */
+static void trusted_regex_flush(void)
+{
+	trusted_re_t *it, *next;
+	int i;
+
+	for(i = 0; i < TRUSTED_RE_HASH_SIZE; i++) {
+		for(it = _trusted_re_table[i]; it != NULL; it = next) {
+			next = it->next;
+			if(it->valid)
+				regfree(&it->re);
+			pkg_free(it);
+		}
+		_trusted_re_table[i] = NULL;
+	}
+	_trusted_re_items = 0;
+}
+
+
+int trusted_regex_match(char *pattern, char *s)
+{
+	trusted_re_t *it;
+	unsigned int hid;
+	int len;
+
+	if(perm_trust_gen && *perm_trust_gen != _trusted_re_gen) {
+		/* drop the patterns of the previous table */
+		trusted_regex_flush();
+		_trusted_re_gen = *perm_trust_gen;
+	}
+
+	len = strlen(pattern);
+	hid = get_hash1_raw(pattern, len);
+	for(it = _trusted_re_table[hid % TRUSTED_RE_HASH_SIZE]; it != NULL;
+			it = it->next) {
+		if(it->hid == hid && strcmp(it->pattern, pattern) == 0)
+			break;
+	}
+
+	if(it == NULL) {
+		if(_trusted_re_items >= TRUSTED_RE_MAX_ITEMS)
+			trusted_regex_flush();
+		it = (trusted_re_t *)pkg_malloc(sizeof(trusted_re_t) + len);
+		if(it == NULL) {
+			PKG_MEM_ERROR;
+			return -1;
+		}
+		memset(it, 0, sizeof(trusted_re_t));
+		memcpy(it->pattern, pattern, len + 1);
+		it->hid = hid;
+		if(regcomp(&it->re, pattern, REG_NOSUB) == 0) {
+			it->valid = 1;
+		} else {
+			LM_ERR("invalid regular expression: %s\n", pattern);
+		}
+		it->next = _trusted_re_table[hid % TRUSTED_RE_HASH_SIZE];
+		_trusted_re_table[hid % TRUSTED_RE_HASH_SIZE] = it;
+		_trusted_re_items++;
+	}
+
+	if(!it->valid)
+		return -1;
+	return (regexec(&it->re, s, 0, (regmatch_t *)0, 0) == 0) ? 1 : 0;
+}
+
+
+void trusted_tags_add(str *ctags, str *tag)
+{
+	if(ctags == NULL || ctags->len < 0)
+		return;
+	if(ctags->len + tag->len + 1 > TRUSTED_TAGS_SIZE) {
+		ctags->len = -1;
+		return;
+	}
+	memcpy(ctags->s + ctags->len, tag->s, tag->len);
+	ctags->len += tag->len;
+	ctags->s[ctags->len++] = '\0';
 }
 
 
@@ -395,7 +532,8 @@ static inline int match_proto(const char *proto_string, int proto_int)
  * Matches from uri against patterns returned from database.  Returns number
  * of matches or -1 if none of the patterns match.
  */
-static int match_res(struct sip_msg *msg, int proto, db1_res_t *_r, char *uri)
+static int match_res(
+		struct sip_msg *msg, int proto, db1_res_t *_r, char *uri, str *ctags)
 {
 	int i, tag_avp_type;
 	str ruri;
@@ -403,7 +541,6 @@ static int match_res(struct sip_msg *msg, int proto, db1_res_t *_r, char *uri)
 	char ruri_string[MAX_URI_SIZE + 1];
 	db_row_t *row;
 	db_val_t *val;
-	regex_t preg;
 	int_str tag_avp, avp_val;
 	int count = 0;
 
@@ -440,29 +577,16 @@ static int match_res(struct sip_msg *msg, int proto, db1_res_t *_r, char *uri)
 					VAL_STRING(val + 3));
 
 			if(IS_SIP(msg)) {
-				if(!VAL_NULL(val + 1)) {
-					if(regcomp(&preg, (char *)VAL_STRING(val + 1), REG_NOSUB)) {
-						LM_ERR("invalid regular expression\n");
-						if(VAL_NULL(val + 2)) {
-							continue;
-						}
-					}
-					if(regexec(&preg, uri, 0, (regmatch_t *)0, 0)) {
-						regfree(&preg);
-						continue;
-					}
-					regfree(&preg);
+				if(!VAL_NULL(val + 1)
+						&& trusted_regex_match((char *)VAL_STRING(val + 1), uri)
+								   != 1) {
+					continue;
 				}
-				if(!VAL_NULL(val + 2)) {
-					if(regcomp(&preg, (char *)VAL_STRING(val + 2), REG_NOSUB)) {
-						LM_ERR("invalid regular expression\n");
-						continue;
-					}
-					if(regexec(&preg, ruri_string, 0, (regmatch_t *)0, 0)) {
-						regfree(&preg);
-						continue;
-					}
-					regfree(&preg);
+				if(!VAL_NULL(val + 2)
+						&& trusted_regex_match(
+								   (char *)VAL_STRING(val + 2), ruri_string)
+								   != 1) {
+					continue;
 				}
 			}
 			/* Found a match */
@@ -473,6 +597,7 @@ static int match_res(struct sip_msg *msg, int proto, db1_res_t *_r, char *uri)
 					LM_ERR("failed to set of tag_avp failed\n");
 					return -1;
 				}
+				trusted_tags_add(ctags, &avp_val.s);
 			}
 			if(!perm_peer_tag_mode)
 				return 1;
@@ -483,6 +608,109 @@ static int match_res(struct sip_msg *msg, int proto, db1_res_t *_r, char *uri)
 	return (count == 0 ? -1 : count);
 }
 
+/*
+ * Get the result cache slot for the request attributes, the slot is reset
+ * if it holds the result for other attributes or if it has expired.
+ * Returns NULL if the result cannot be cached.
+ */
+static trusted_centry_t *trusted_cache_slot(
+		struct sip_msg *msg, char *src_ip, int proto, char *from_uri)
+{
+	static char kbuf[2 * MAX_URI_SIZE + 128];
+	trusted_centry_t *e;
+	str ruri;
+	str key;
+	int l1, l2;
+	unsigned int hid;
+
+	if(perm_trusted_cache_size <= 0 || !IS_SIP(msg))
+		return NULL;
+
+	l1 = strlen(src_ip);
+	l2 = strlen(from_uri);
+	ruri = msg->first_line.u.request.uri;
+	if(l1 + l2 + ruri.len + 3 > sizeof(kbuf))
+		return NULL;
+	memcpy(kbuf, src_ip, l1 + 1);
+	memcpy(kbuf + l1 + 1, from_uri, l2 + 1);
+	memcpy(kbuf + l1 + l2 + 2, ruri.s, ruri.len);
+	kbuf[l1 + l2 + 2 + ruri.len] = '\0';
+	key.s = kbuf;
+	key.len = l1 + l2 + ruri.len + 3;
+
+	if(_trusted_cache == NULL) {
+		_trusted_cache = (trusted_centry_t *)pkg_malloc(
+				perm_trusted_cache_size * sizeof(trusted_centry_t));
+		if(_trusted_cache == NULL) {
+			PKG_MEM_ERROR;
+			perm_trusted_cache_size = 0;
+			return NULL;
+		}
+		memset(_trusted_cache, 0,
+				perm_trusted_cache_size * sizeof(trusted_centry_t));
+	}
+
+	hid = get_hash1_raw(key.s, key.len);
+	e = &_trusted_cache[hid % perm_trusted_cache_size];
+	if(e->expires > 0 && e->hid == hid && e->proto == proto
+			&& e->key.len == key.len && memcmp(e->key.s, key.s, key.len) == 0
+			&& e->expires > time(NULL)
+			&& (perm_trust_gen == NULL || e->gen == *perm_trust_gen)) {
+		return e;
+	}
+
+	/* the tags are stored after the key */
+	if(e->key.s != NULL)
+		pkg_free(e->key.s);
+	memset(e, 0, sizeof(trusted_centry_t));
+	e->key.s = (char *)pkg_malloc(key.len + TRUSTED_TAGS_SIZE);
+	if(e->key.s == NULL) {
+		PKG_MEM_ERROR;
+		return NULL;
+	}
+	memcpy(e->key.s, key.s, key.len);
+	e->key.len = key.len;
+	e->hid = hid;
+	e->proto = proto;
+	return e;
+}
+
+/*
+ * Set the tag AVPs of the cached result and return it
+ */
+static int trusted_cache_result(trusted_centry_t *e)
+{
+	int_str tag_avp, avp_val;
+	int tag_avp_type;
+	char *p;
+
+	get_tag_avp(&tag_avp, &tag_avp_type);
+	for(p = e->tags.s; p < e->tags.s + e->tags.len; p += avp_val.s.len + 1) {
+		avp_val.s.s = p;
+		avp_val.s.len = strlen(p);
+		if(add_avp(tag_avp_type | AVP_VAL_STR, tag_avp, avp_val) != 0) {
+			LM_ERR("setting of tag_avp failed\n");
+			return -1;
+		}
+	}
+	return e->result;
+}
+
+/*
+ * Store the result and the collected tags in the cache slot
+ */
+static void trusted_cache_store(trusted_centry_t *e, int result, str *ctags)
+{
+	if(ctags->len < 0)
+		return;
+	e->tags.s = e->key.s + e->key.len;
+	memcpy(e->tags.s, ctags->s, ctags->len);
+	e->tags.len = ctags->len;
+	e->result = result;
+	e->gen = (perm_trust_gen) ? *perm_trust_gen : 0;
+	e->expires = time(NULL) + perm_trusted_cache_ttl;
+}
+
 /*
  * Checks based on given source IP address and protocol, and From URI
  * of request if request can be trusted without authentication.
@@ -493,11 +721,20 @@ int allow_trusted(struct sip_msg *msg, char *src_ip, int proto, char *from_uri)
 			from_uri);
 	int result;
 	db1_res_t *res = NULL;
+	trusted_centry_t *e;
+	char tbuf[TRUSTED_TAGS_SIZE];
+	str ctags = {tbuf, 0};
 
 	db_key_t keys[1];
 	db_val_t vals[1];
 	db_key_t cols[4];
 
+	e = trusted_cache_slot(msg, src_ip, proto, from_uri);
+	if(e != NULL && e->expires > 0) {
+		LM_DBG("cached result %d for src_ip: %s\n", e->result, src_ip);
+		return trusted_cache_result(e);
+	}
+
 	if(perm_db_mode == DISABLE_CACHE) {
 		db_key_t order = &perm_priority_col;
 
@@ -529,17 +766,20 @@ int allow_trusted(struct sip_msg *msg, char *src_ip, int proto, char *from_uri)
 		}
 
 		if(RES_ROW_N(res) == 0) {
-			perm_dbf.free_result(perm_db_handle, res);
-			return -1;
+			result = -1;
+		} else {
+			result = match_res(msg, proto, res, from_uri,
+					(e != NULL) ? &ctags : NULL);
 		}
-
-		result = match_res(msg, proto, res, from_uri);
 		perm_dbf.free_result(perm_db_handle, res);
-		return result;
 	} else {
-		return match_hash_table(
-				*perm_trust_table, msg, src_ip, proto, from_uri);
+		result = match_hash_table(*perm_trust_table, msg, src_ip, proto,
+				from_uri, (e != NULL) ? &ctags : NULL);
 	}
+
+	if(e != NULL)
+		trusted_cache_store(e, result, &ctags);
+	return result;
 }
 
 
@@ -68,7 +68,7 @@ int ki_allow_trusted(sip_msg_t *_msg);
 /*
  * Check if request comes from trusted ip address with matching from URI
  */
-int allow_trusted(struct sip_msg *_msg, char *_s1, char *_s2);
+int allow_trusted(struct sip_msg *msg, char *src_ip, int proto, char *from_uri);
 
 
 /*
@@ -93,4 +93,22 @@ int allow_trusted_3(struct sip_msg *_msg, char *_src_ip_sp, char *_proto_sp,
 
 int reload_trusted_table_cmd(void);
 
+/*
+ * Size of the buffer for the tags collected by one allow_trusted() call
+ */
+#define TRUSTED_TAGS_SIZE 512
+
+/*
+ * Match the string against the regular expression, compiled once and
+ * cached in the process until the trusted table is reloaded. Returns 1
+ * on match, 0 on no match and -1 if the pattern is invalid.
+ */
+int trusted_regex_match(char *pattern, char *s);
+
+/*
+ * Append the tag to the collected tags, if ctags is not NULL. The length
+ * is set to -1 if the buffer is too small.
+ */
+void trusted_tags_add(str *ctags, str *tag);
+
 #endif /* TRUSTED_H */
@@ -29,6 +29,7 @@
 #include <assert.h>
 
 #include "../../core/dprint.h"
+#include "../../core/timer.h"
 #include "../../core/mem/shm_mem.h"
 #include "ip_tree.h"
 
@@ -202,6 +203,8 @@ static inline pike_ip_node_t *new_ip_node(unsigned char byte)
 	}
 	memset(new_node, 0, sizeof(pike_ip_node_t));
 	new_node->byte = byte;
+	/* not idle since startup for the first timer check */
+	new_node->last_hit = get_ticks();
 	return new_node;
 }
 
@@ -272,9 +275,9 @@ pike_node_status_t node_status(pike_ip_node_t *node)
 }
 
 
-/* mark with one more hit the given IP address - */
+/* mark with nhits more hits the given IP address - */
 pike_ip_node_t *mark_node(unsigned char *ip, int ip_len,
-		pike_ip_node_t **father, unsigned char *flag)
+		pike_ip_node_t **father, unsigned char *flag, unsigned int nhits)
 {
 	pike_ip_node_t *node;
 	pike_ip_node_t *kid;
@@ -306,9 +309,12 @@ pike_ip_node_t *mark_node(unsigned char *ip, int ip_len,
 		/* we found the entire address */
 		node->flags |= NODE_IPLEAF_FLAG;
 		/* increment it, but be careful not to overflow the value */
-		if(node->leaf_hits[CURR_POS]
-				< MAX_TYPE_VAL(node->leaf_hits[CURR_POS]) - 1)
-			node->leaf_hits[CURR_POS]++;
+		if(node->leaf_hits[CURR_POS] + nhits
+				< MAX_TYPE_VAL(node->leaf_hits[CURR_POS]))
+			node->leaf_hits[CURR_POS] += nhits;
+		else
+			node->leaf_hits[CURR_POS] =
+					MAX_TYPE_VAL(node->leaf_hits[CURR_POS]) - 1;
 		/* becoming red node? */
 		if((node->flags & NODE_ISRED_FLAG) == 0) {
 			if(is_hot_leaf(node)) {
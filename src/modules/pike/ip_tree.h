@@ -49,6 +49,7 @@
 typedef struct pike_ip_node
 {
 	unsigned int expires;
+	unsigned int last_hit; /* ticks of last hit, checked by the timer */
 	unsigned short leaf_hits[2];
 	unsigned short hits[2];
 	unsigned char byte;
@@ -73,6 +74,12 @@ typedef struct ip_tree
 } pike_ip_tree_t;
 
 
+/* expire time, taking in account the hits after it was set in timer list */
+#define node_expires(_node, _timeout)                         \
+	(((_node)->last_hit + (_timeout) > (_node)->expires)      \
+					? (_node)->last_hit + (_timeout)          \
+					: (_node)->expires)
+
 #define ll2ipnode(ptr)                \
 	((pike_ip_node_t *)((char *)(ptr) \
 						- (unsigned long)(&((pike_ip_node_t *)0)->timer_ll)))
@@ -81,7 +88,7 @@ typedef struct ip_tree
 int init_ip_tree(int);
 void destroy_ip_tree(void);
 pike_ip_node_t *mark_node(unsigned char *ip, int ip_len,
-		pike_ip_node_t **father, unsigned char *flag);
+		pike_ip_node_t **father, unsigned char *flag, unsigned int nhits);
 void remove_node(pike_ip_node_t *node);
 int is_node_hot_leaf(pike_ip_node_t *node);
 
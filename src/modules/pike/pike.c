@@ -57,6 +57,8 @@ static int pike_time_unit = 2;
 static int pike_max_reqs = 30;
 int pike_timeout = 120;
 int pike_log_level = L_WARN;
+static int pike_ipv6_prefix = 128;
+int pike_ipv6_bytes = 16;
 
 /* global variables */
 gen_lock_t *pike_timer_lock = 0;
@@ -76,6 +78,7 @@ static param_export_t params[] = {
 	{"reqs_density_per_unit", PARAM_INT, &pike_max_reqs},
 	{"remove_latency", PARAM_INT, &pike_timeout},
 	{"pike_log_level", PARAM_INT, &pike_log_level},
+	{"ipv6_prefix", PARAM_INT, &pike_ipv6_prefix},
 	{0, 0, 0}
 };
 
@@ -97,6 +100,16 @@ static int pike_init(void)
 {
 	LOG(L_INFO, "PIKE - initializing\n");
 
+	/* the tree is keyed by the address bytes, a prefix up to 32 bits would
+	 * share the nodes of the IPv4 addresses */
+	if(pike_ipv6_prefix <= 32 || pike_ipv6_prefix > 128
+			|| pike_ipv6_prefix % 8 != 0) {
+		LM_ERR("invalid ipv6_prefix value %d (multiple of 8 from 40 to 128)\n",
+				pike_ipv6_prefix);
+		return -1;
+	}
+	pike_ipv6_bytes = pike_ipv6_prefix / 8;
+
 	if(rpc_register_array(pike_rpc_methods) != 0) {
 		LM_ERR("failed to register RPC commands\n");
 		return -1;
@@ -128,6 +141,13 @@ static int pike_init(void)
 	}
 	pike_timer->next = pike_timer->prev = pike_timer;
 
+	pike_period = (unsigned int *)shm_malloc(sizeof(unsigned int));
+	if(pike_period == 0) {
+		SHM_MEM_ERROR;
+		goto error4;
+	}
+	*pike_period = 0;
+
 	/* registering timing functions  */
 	register_timer(clean_routine, 0, 1);
 	register_timer(swap_routine, 0, pike_time_unit);
@@ -136,6 +156,9 @@ static int pike_init(void)
 	pike_counter_init();
 
 	return 0;
+error4:
+	shm_free(pike_timer);
+	pike_timer = 0;
 error3:
 	destroy_ip_tree();
 error2:
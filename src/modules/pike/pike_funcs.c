@@ -34,6 +34,7 @@
 #include "../../core/resolve.h"
 #include "../../core/counters.h"
 #include "../../core/mod_fix.h"
+#include "../../core/hashes.h"
 #include "ip_tree.h"
 #include "pike_funcs.h"
 #include "timer.h"
@@ -43,9 +44,28 @@ extern gen_lock_t *pike_timer_lock;
 extern pike_list_link_t *pike_timer;
 extern int pike_timeout;
 extern int pike_log_level;
+extern int pike_ipv6_bytes;
 
 counter_handle_t blocked;
 
+/* sampling period, incremented by swap routine */
+unsigned int *pike_period = 0;
+
+#define PIKE_RED_CACHE_SIZE 256
+
+/* per process cache of blocked addresses - during a sampling period their
+ * hits are counted here and added to the tree in batches, to avoid the
+ * locking on each request of a flood */
+typedef struct pike_red_entry
+{
+	unsigned char ip[16];
+	int ip_len;			 /* 0 if the slot is not used */
+	unsigned int period; /* sampling period when found blocked */
+	unsigned int hits;	 /* hits not added yet to the tree */
+} pike_red_entry_t;
+
+static pike_red_entry_t _pike_red_cache[PIKE_RED_CACHE_SIZE];
+
 void pike_counter_init()
 {
 	counter_register(&blocked, "pike", "blocked_ips", 0, 0, 0,
@@ -57,11 +77,32 @@ int pike_check_ipaddr(sip_msg_t *msg, ip_addr_t *ip)
 {
 	pike_ip_node_t *node;
 	pike_ip_node_t *father;
+	pike_red_entry_t *re;
 	unsigned char flags;
+	unsigned int nhits;
+	int ip_len;
+
+	/* IPv6 addresses can be aggregated by prefix */
+	ip_len = (ip->af == AF_INET6) ? pike_ipv6_bytes : ip->len;
+
+	/* a blocked address stays blocked until the end of sampling period */
+	nhits = 1;
+	re = &_pike_red_cache[get_hash1_raw((char *)ip->u.addr, ip_len)
+						  % PIKE_RED_CACHE_SIZE];
+	if(re->ip_len == ip_len && memcmp(re->ip, ip->u.addr, ip_len) == 0) {
+		if(re->period == *pike_period && re->hits + 1 < get_max_hits() >> 2) {
+			re->hits++;
+			return -1;
+		}
+		/* the hits left from a previous sampling period are added too, so
+		 * the ones held back by all the processes are not lost */
+		nhits += re->hits;
+		re->ip_len = 0;
+	}
 
-	/* first lock the proper tree branch and mark the IP with one more hit*/
+	/* first lock the proper tree branch and mark the IP with more hits */
 	lock_tree_branch(ip->u.addr[0]);
-	node = mark_node(ip->u.addr, ip->len, &father, &flags);
+	node = mark_node(ip->u.addr, ip_len, &father, &flags, nhits);
 	if(node == 0) {
 		unlock_tree_branch(ip->u.addr[0]);
 		/* even if this is an error case, we return true in script to avoid
@@ -76,8 +117,8 @@ int pike_check_ipaddr(sip_msg_t *msg, ip_addr_t *ip)
 			flags);
 
 	/* update the timer */
-	lock_get(pike_timer_lock);
 	if(flags & NEW_NODE) {
+		lock_get(pike_timer_lock);
 		/* put this node into the timer list and remove its
 		 * father only if this has one kid and is not a LEAF_NODE*/
 		node->expires = get_ticks() + pike_timeout;
@@ -101,37 +142,33 @@ int pike_check_ipaddr(sip_msg_t *msg, ip_addr_t *ip)
 				}
 			}
 		}
+		/*print_timer_list( pike_timer );*/ /* debug*/
+		lock_release(pike_timer_lock);
 	} else {
 		/* update the timer -> in timer can be only nodes
 		 * as IP-leaf(complete address) or tree-leaf */
 		if(node->flags & NODE_IPLEAF_FLAG || node->kids == 0) {
 			/* tree leafs which are not potential red nodes are not update in
-			 * order to make them to expire */
-			/* debug */
-			assert(has_timer_set(&(node->timer_ll))
-					&& (node->flags & (NODE_EXPIRED_FLAG | NODE_INTIMER_FLAG)));
-			/* if node expired, ignore the current hit and let is
-			 * expire in timer process */
-			if(!(flags & NO_UPDATE) && !(node->flags & NODE_EXPIRED_FLAG)) {
-				node->expires = get_ticks() + pike_timeout;
-				update_in_timer(pike_timer, &(node->timer_ll));
-			}
+			 * order to make them to expire; the others get only the time of
+			 * hit, checked by the timer routine when the node expires, so
+			 * the timer lock is not needed here */
+			if(!(flags & NO_UPDATE))
+				node->last_hit = get_ticks();
 		} else {
 			/* debug */
-			assert(!has_timer_set(&(node->timer_ll))
-					&& !(node->flags
-							& (NODE_INTIMER_FLAG | NODE_EXPIRED_FLAG)));
-			/* debug */
 			assert(!(node->flags & NODE_IPLEAF_FLAG) && node->kids);
 		}
 	}
-	/*print_timer_list( pike_timer );*/ /* debug*/
-	lock_release(pike_timer_lock);
 
 	unlock_tree_branch(ip->u.addr[0]);
 	/*print_tree( 0 );*/ /* debug */
 
 	if(flags & RED_NODE) {
+		/* count the next hits in the cache of the process */
+		memcpy(re->ip, ip->u.addr, ip_len);
+		re->ip_len = ip_len;
+		re->period = *pike_period;
+		re->hits = 0;
 		if(flags & NEWRED_NODE) {
 			LM_GEN1(pike_log_level, "PIKE - BLOCKing ip %s, node=%p\n",
 					ip_addr2a(ip), node);
@@ -326,6 +363,8 @@ void swap_routine(unsigned int ticks, void *param)
 	int i;
 
 	/* LM_DBG("entering \n"); */
+	/* end of sampling period - blocked addresses have to be checked again */
+	(*pike_period)++;
 	for(i = 0; i < MAX_IP_BRANCHES; i++) {
 		node = get_tree_branch(i);
 		if(node) {
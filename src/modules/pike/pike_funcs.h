@@ -28,6 +28,8 @@
 #include "../../core/locking.h"
 
 
+extern unsigned int *pike_period;
+
 void pike_counter_init(void);
 int pike_check_req(sip_msg_t *msg);
 int pike_check_ip(sip_msg_t *msg, str *strip);
@@ -31,6 +31,8 @@
 #include "../../core/ut.h"
 #include "pike_top.h"
 
+extern int pike_timeout;
+
 #include <stdlib.h>
 #include <unistd.h>
 #include <assert.h>
@@ -63,11 +65,13 @@ static void traverse_subtree(pike_ip_node_t *node, int depth, int options)
 			case NODE_STATUS_HOT:
 				if(ns & NODE_STATUS_HOT)
 					pike_top_add_entry(ip_addr, depth + 1, node->leaf_hits,
-							node->hits, node->expires - get_ticks(), ns);
+							node->hits,
+							node_expires(node, pike_timeout) - get_ticks(), ns);
 				break;
 			case NODE_STATUS_ALL:
 				pike_top_add_entry(ip_addr, depth + 1, node->leaf_hits,
-						node->hits, node->expires - get_ticks(), ns);
+						node->hits, node_expires(node, pike_timeout) - get_ticks(),
+						ns);
 				break;
 		}
 	} else if(!node->kids) {
@@ -28,6 +28,7 @@
 #include "timer.h"
 #include "ip_tree.h"
 
+extern int pike_timeout;
 
 void append_to_timer(pike_list_link_t *head, pike_list_link_t *new_ll)
 {
@@ -58,6 +59,7 @@ void check_and_split_timer(pike_list_link_t *head, unsigned int time,
 		pike_list_link_t *split, unsigned char *mask)
 {
 	pike_list_link_t *ll;
+	pike_list_link_t *next;
 	pike_ip_node_t *node;
 	unsigned char b;
 	int i;
@@ -68,6 +70,16 @@ void check_and_split_timer(pike_list_link_t *head, unsigned int time,
 
 	ll = head->next;
 	while(ll != head && (node = ll2ipnode(ll))->expires <= time) {
+		if(node->last_hit + pike_timeout > time) {
+			/* hit after it was put in timer list - the position in list
+			 * is not updated on each hit, move it now at the end */
+			next = ll->next;
+			node->expires = node->last_hit + pike_timeout;
+			remove_from_timer(head, ll);
+			append_to_timer(head, ll);
+			ll = next;
+			continue;
+		}
 		LM_DBG("splitting %p(%p,%p)node=%p\n", ll, ll->prev, ll->next, node);
 		/* mark the node as expired and un-mark it as being in timer list */
 		node->flags |= NODE_EXPIRED_FLAG;
@@ -38,6 +38,7 @@
 #include <sys/types.h>
 #include <regex.h>
 #include <math.h>
+#include <time.h>
 
 #include "../../core/mem/mem.h"
 #include "../../core/mem/shm_mem.h"
@@ -61,6 +62,7 @@
 #include "pl_statistics.h"
 #include "pl_ht.h"
 #include "pl_db.h"
+#include "pl_dmq.h"
 
 MODULE_VERSION
 
@@ -124,6 +126,7 @@ static int pl_load_fetch = 1;
 
 /** module functions */
 static int mod_init(void);
+static int child_init(int rank);
 static ticks_t pl_timer_handle(ticks_t, struct timer_ln *, void *);
 static void pl_timer_exec(unsigned int ticks, void *param);
 static int w_pl_check(struct sip_msg *, char *, char *);
@@ -166,6 +169,9 @@ static param_export_t params[] = {
 	{"hash_size", PARAM_INT, &pl_hash_size},
 	{"load_fetch", PARAM_INT, &pl_load_fetch},
 	{"clean_unused", PARAM_INT, &pl_clean_unused},
+	{"enable_dmq", PARAM_INT, &pl_enable_dmq},
+	{"dmq_sync_interval", PARAM_INT, &pl_dmq_sync_interval},
+	{"dmq_stale_time", PARAM_INT, &pl_dmq_stale_time},
 
 	{0, 0, 0}
 };
@@ -182,7 +188,7 @@ struct module_exports exports = {
 	0,				 /* exported pseudo-variables */
 	0,				 /* response handling function */
 	mod_init,		 /* module initialization function */
-	0,				 /* per-child init function */
+	child_init,		 /* per-child init function */
 	destroy			 /* module exit function */
 };
 /* clang-format on */
@@ -433,12 +439,35 @@ static int mod_init(void)
 	*_pl_pid_setpoint = 0.01 * (double)_pl_cfg_setpoint;
 	*drop_rate = 0;
 
+	if(pl_enable_dmq > 0) {
+		if(pl_dmq_init() < 0) {
+			LM_ERR("failed to initialize dmq integration\n");
+			return -1;
+		}
+		register_basic_timers(1);
+	}
+
+	return 0;
+}
+
+static int child_init(int rank)
+{
+	if(rank == PROC_MAIN && pl_enable_dmq > 0) {
+		if(fork_basic_utimer(PROC_TIMER, "PipeLimit DMQ Timer",
+				   1 /*socks flag*/, pl_dmq_timer, NULL,
+				   1000 * pl_dmq_sync_interval /*milliseconds*/)
+				< 0) {
+			LM_ERR("failed to start dmq timer routine as process\n");
+			return -1; /* error */
+		}
+	}
 	return 0;
 }
 
 
 static void destroy(void)
 {
+	pl_dmq_destroy();
 	LM_DBG("done");
 }
 
@@ -533,6 +562,69 @@ int hash[100] = {18, 50, 51, 39, 49, 68, 8, 78, 61, 75, 53, 32, 45, 77, 31, 12,
 		71, 23, 2, 67, 36, 65, 27, 1, 19, 59, 89, 48};
 
 
+/**
+ * monotonic time in microseconds, it may wrap on 32bit systems
+ */
+static inline long pl_gcra_now(void)
+{
+	struct timespec ts;
+
+#if defined(CLOCK_MONOTONIC_RAW)
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+#else
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+	return (long)((unsigned long)ts.tv_sec * 1000000UL
+				  + (unsigned long)ts.tv_nsec / 1000UL);
+}
+
+/**
+ * messages of the peers in the last interval, ignored once they did not
+ * send updates for longer than dmq_stale_time
+ * (expects the pipe slot to be locked)
+ */
+static inline int pl_remote(pl_pipe_t *pipe)
+{
+	if(pipe->remote <= 0
+			|| TICKS_TO_MS(get_ticks_raw() - pipe->remote_time)
+					   > pl_dmq_stale_time)
+		return 0;
+	return pipe->remote;
+}
+
+/**
+ * generic cell rate algorithm - spreads the limit over the timer interval,
+ * allowing bursts of up to limit messages, without depending on the timer
+ * (expects the pipe slot to be locked)
+ * \return	-1 if drop needed, 1 if allowed
+ */
+static int pl_gcra_check(pl_pipe_t *pipe)
+{
+	long now, diff;
+	long t, tau;
+	int limit;
+
+	/* in cluster mode, the peers use part of the limit */
+	limit = pipe->limit - pl_remote(pipe);
+	if(limit <= 0)
+		return -1;
+	t = ((long)pl_timer_interval * 1000000L) / limit;
+	if(t <= 0)
+		t = 1;
+	tau = (long)pl_timer_interval * 1000000L - t;
+
+	now = pl_gcra_now();
+	diff = (long)((unsigned long)pipe->tat - (unsigned long)now);
+	if(diff < 0 || diff > tau + t) {
+		/* idle pipe (or state from before a limit change) */
+		diff = 0;
+	}
+	if(diff > tau)
+		return -1;
+	pipe->tat = (long)((unsigned long)now + diff + t);
+	return 1;
+}
+
 /**
  * runs the pipe's algorithm
  * (expects pl_lock to be taken), TODO revert to "return" instead of "ret ="
@@ -551,7 +643,7 @@ static int pipe_push_direct(pl_pipe_t *pipe)
 			ret = 2;
 			break;
 		case PIPE_ALGO_TAILDROP:
-			ret = (pipe->counter <= pipe->limit) ? 1 : -1;
+			ret = (pipe->counter + pl_remote(pipe) <= pipe->limit) ? 1 : -1;
 			break;
 		case PIPE_ALGO_RED:
 			if(pipe->load == 0)
@@ -565,10 +657,15 @@ static int pipe_push_direct(pl_pipe_t *pipe)
 		case PIPE_ALGO_NETWORK:
 			ret = -1 * pipe->load;
 			break;
+		case PIPE_ALGO_GCRA:
+			ret = pl_gcra_check(pipe);
+			break;
 		default:
 			LM_ERR("unknown ratelimit algorithm: %d\n", pipe->algo);
 			ret = 1;
 	}
+	if(pl_enable_dmq && ret == 1)
+		pipe->dmq_counter++;
 	LM_DBG("pipe=%.*s algo=%d limit=%d pkg_load=%d counter=%d "
 		   "load=%2.1lf network_load=%d => %s\n",
 			pipe->name.len, pipe->name.s, pipe->algo, pipe->limit, pipe->load,
@@ -646,7 +743,8 @@ static int pl_check_limit(sip_msg_t *msg, str *pipeid, str *alg, int limit)
 	} else {
 		if(limit > 0)
 			pipe->limit = limit;
-		pl_pipe_release(&pipe->name);
+		/* slot still locked - avoid a second lookup */
+		return pipe_push_direct(pipe);
 	}
 
 	return pl_check(msg, pipeid);
@@ -787,6 +885,9 @@ const char *rpc_pl_set_pid_doc[2] = {
 <ki> <kp> <kd>",
 		0};
 
+const char *rpc_pl_dmq_stats_doc[2] = {
+		"Print the statistics of the pipe counters sync over dmq", 0};
+
 const char *rpc_pl_push_load_doc[2] = {
 		"Force the value of the load parameter for FEEDBACK algorithm: \
 <load>",
@@ -855,6 +956,7 @@ static rpc_export_t rpc_methods[] = {
 		{"pl.get_pid", rpc_pl_get_pid, rpc_pl_get_pid_doc, 0},
 		{"pl.set_pid", rpc_pl_set_pid, rpc_pl_set_pid_doc, 0},
 		{"pl.push_load", rpc_pl_push_load, rpc_pl_push_load_doc, 0},
+		{"pl.dmq_stats", rpc_pl_dmq_stats, rpc_pl_dmq_stats_doc, 0},
 		{0, 0, 0, 0}};
 
 static int ki_pl_drop(sip_msg_t *msg)
@@ -0,0 +1,389 @@
+/*
+ * pipelimit module
+ *
+ * Copyright (C) 2026 Kamailio.org
+ *
+ * This file is part of Kamailio, a free SIP server.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Kamailio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * Kamailio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*! \file
+ * \ingroup pipelimit
+ * \brief pipelimit :: pl_dmq - cluster wide limits over DMQ
+ *
+ * Each node sends periodically to the peers the number of messages accepted
+ * by each pipe since the previous sync. The counts received from all peers
+ * during a timer interval give the remote rate used for the next interval.
+ */
+
+#include <string.h>
+#include <limits.h>
+
+#include "../../core/dprint.h"
+#include "../../core/locking.h"
+#include "../../core/timer.h"
+#include "../../core/mem/mem.h"
+#include "../../core/mem/shm_mem.h"
+#include "../../core/parser/msg_parser.h"
+#include "../../core/parser/parse_content.h"
+#include "../dmq/bind_dmq.h"
+
+#include "pl_ht.h"
+#include "pl_dmq.h"
+
+int pl_enable_dmq = 0;
+int pl_dmq_sync_interval = 500;
+int pl_dmq_stale_time = 2000;
+
+/* binary batch encoding - magic and version, then the records:
+ * varint name length, name, varint number of accepted messages */
+#define PL_DMQ_BATCH_MAGIC "PLB\x01"
+#define PL_DMQ_BATCH_MAGIC_LEN 4
+#define PL_DMQ_BATCH_SIZE 60000
+#define PL_DMQ_VARINT_MAX 10
+
+typedef struct pl_dmq_stats
+{
+	gen_lock_t lock;
+	unsigned long sent_batches;
+	unsigned long sent_records;
+	unsigned long sent_bytes;
+	unsigned long recv_batches;
+	unsigned long recv_records;
+	unsigned long recv_bytes;
+	unsigned long recv_unknown; /* records for pipes not defined locally */
+	unsigned long recv_invalid; /* malformed messages */
+} pl_dmq_stats_t;
+
+/* pipes collected by the sync timer */
+typedef struct pl_dmq_batch
+{
+	str buf;
+	int size;
+	int *cuts; /* offsets where each batch starts */
+	int ncuts;
+	int nrecords;
+} pl_dmq_batch_t;
+
+static str pl_dmq_content_type = str_init("application/octet-stream");
+static str pl_dmq_200_rpl = str_init("OK");
+static str pl_dmq_400_rpl = str_init("Bad Request");
+
+static dmq_api_t pl_dmqb;
+static dmq_peer_t *pl_dmq_peer = NULL;
+static pl_dmq_stats_t *_pl_dmq_stats = NULL;
+
+static int pl_dmq_handle_msg(
+		struct sip_msg *msg, peer_reponse_t *resp, dmq_node_t *node);
+
+/**
+ * register the pipelimit dmq peer
+ */
+int pl_dmq_init(void)
+{
+	dmq_peer_t not_peer;
+
+	/* the sync timer takes the interval in microseconds */
+	if(pl_dmq_sync_interval <= 0 || pl_dmq_sync_interval > INT_MAX / 1000) {
+		LM_ERR("invalid dmq sync interval: %d\n", pl_dmq_sync_interval);
+		return -1;
+	}
+	_pl_dmq_stats = (pl_dmq_stats_t *)shm_malloc(sizeof(pl_dmq_stats_t));
+	if(_pl_dmq_stats == NULL) {
+		SHM_MEM_ERROR;
+		return -1;
+	}
+	memset(_pl_dmq_stats, 0, sizeof(pl_dmq_stats_t));
+	if(lock_init(&_pl_dmq_stats->lock) == 0) {
+		LM_ERR("cannot init the stats lock\n");
+		shm_free(_pl_dmq_stats);
+		_pl_dmq_stats = NULL;
+		return -1;
+	}
+
+	if(dmq_load_api(&pl_dmqb) != 0) {
+		LM_ERR("cannot load dmq api\n");
+		return -1;
+	}
+
+	memset(&not_peer, 0, sizeof(dmq_peer_t));
+	not_peer.callback = pl_dmq_handle_msg;
+	not_peer.init_callback = NULL;
+	not_peer.description.s = "pipelimit";
+	not_peer.description.len = 9;
+	not_peer.peer_id.s = "pipelimit";
+	not_peer.peer_id.len = 9;
+	pl_dmq_peer = pl_dmqb.register_dmq_peer(&not_peer);
+	if(pl_dmq_peer == NULL) {
+		LM_ERR("error in register_dmq_peer\n");
+		return -1;
+	}
+	LM_DBG("dmq peer registered\n");
+	return 0;
+}
+
+void pl_dmq_destroy(void)
+{
+	if(_pl_dmq_stats != NULL) {
+		lock_destroy(&_pl_dmq_stats->lock);
+		shm_free(_pl_dmq_stats);
+		_pl_dmq_stats = NULL;
+	}
+}
+
+static int pl_dmq_varint_set(char *p, unsigned long v)
+{
+	int n;
+
+	n = 0;
+	while(v >= 0x80) {
+		p[n++] = (char)((v & 0x7f) | 0x80);
+		v >>= 7;
+	}
+	p[n++] = (char)v;
+	return n;
+}
+
+static int pl_dmq_varint_get(
+		unsigned char **p, unsigned char *end, unsigned long *v)
+{
+	unsigned long r;
+	int shift;
+
+	r = 0;
+	for(shift = 0; *p < end && shift < (int)(sizeof(unsigned long) * 8);
+			shift += 7) {
+		r |= (unsigned long)(**p & 0x7f) << shift;
+		if(!(*(*p)++ & 0x80)) {
+			*v = r;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+/**
+ * add the messages accepted by a pipe since the last sync to the batches
+ * (called with the pipe slot locked)
+ */
+static int pl_dmq_collect(pl_pipe_t *pipe, void *param)
+{
+	pl_dmq_batch_t *b;
+	char *nbuf;
+	int *ncuts;
+	int need;
+
+	if(pipe->dmq_counter <= 0)
+		return 0;
+
+	b = (pl_dmq_batch_t *)param;
+	need = PL_DMQ_BATCH_MAGIC_LEN + 2 * PL_DMQ_VARINT_MAX + pipe->name.len;
+	if(b->buf.len + need > b->size) {
+		b->size = 2 * b->size + need;
+		nbuf = (char *)pkg_realloc(b->buf.s, b->size);
+		if(nbuf == NULL) {
+			PKG_MEM_ERROR;
+			return -1;
+		}
+		b->buf.s = nbuf;
+	}
+	if(b->ncuts == 0
+			|| b->buf.len - b->cuts[b->ncuts - 1] >= PL_DMQ_BATCH_SIZE) {
+		/* start a new batch */
+		ncuts = (int *)pkg_realloc(b->cuts, (b->ncuts + 1) * sizeof(int));
+		if(ncuts == NULL) {
+			PKG_MEM_ERROR;
+			return -1;
+		}
+		b->cuts = ncuts;
+		b->cuts[b->ncuts++] = b->buf.len;
+		memcpy(b->buf.s + b->buf.len, PL_DMQ_BATCH_MAGIC,
+				PL_DMQ_BATCH_MAGIC_LEN);
+		b->buf.len += PL_DMQ_BATCH_MAGIC_LEN;
+	}
+	b->buf.len +=
+			pl_dmq_varint_set(b->buf.s + b->buf.len, (unsigned long)pipe->name.len);
+	memcpy(b->buf.s + b->buf.len, pipe->name.s, pipe->name.len);
+	b->buf.len += pipe->name.len;
+	b->buf.len += pl_dmq_varint_set(
+			b->buf.s + b->buf.len, (unsigned long)pipe->dmq_counter);
+	b->nrecords++;
+	pipe->dmq_counter = 0;
+
+	return 0;
+}
+
+/**
+ * sync timer - send the counters of the active pipes to the peers
+ */
+void pl_dmq_timer(unsigned int ticks, void *param)
+{
+	pl_dmq_batch_t b;
+	str body;
+	int nsent;
+	int nbytes;
+	int i;
+
+	if(pl_dmq_peer == NULL)
+		return;
+
+	memset(&b, 0, sizeof(pl_dmq_batch_t));
+	if(pl_pipe_walk(pl_dmq_collect, &b) < 0)
+		LM_ERR("failed to collect all pipe counters\n");
+
+	nsent = 0;
+	nbytes = 0;
+	for(i = 0; i < b.ncuts; i++) {
+		body.s = b.buf.s + b.cuts[i];
+		body.len = ((i + 1 < b.ncuts) ? b.cuts[i + 1] : b.buf.len) - b.cuts[i];
+		if(pl_dmqb.bcast_message(
+				   pl_dmq_peer, &body, 0, NULL, 1, &pl_dmq_content_type)
+				< 0) {
+			LM_ERR("failed to send batch of %d bytes\n", body.len);
+			continue;
+		}
+		nsent++;
+		nbytes += body.len;
+	}
+	if(b.nrecords > 0) {
+		LM_DBG("sent %d pipe counters in %d batches (%d bytes)\n", b.nrecords,
+				nsent, nbytes);
+		lock_get(&_pl_dmq_stats->lock);
+		_pl_dmq_stats->sent_batches += nsent;
+		if(nsent == b.ncuts)
+			_pl_dmq_stats->sent_records += b.nrecords;
+		_pl_dmq_stats->sent_bytes += nbytes;
+		lock_release(&_pl_dmq_stats->lock);
+	}
+
+	if(b.buf.s != NULL)
+		pkg_free(b.buf.s);
+	if(b.cuts != NULL)
+		pkg_free(b.cuts);
+}
+
+/**
+ * add the counters received from a peer to the pipes
+ */
+static int pl_dmq_handle_msg(
+		struct sip_msg *msg, peer_reponse_t *resp, dmq_node_t *node)
+{
+	unsigned char *p;
+	unsigned char *end;
+	unsigned long v;
+	pl_pipe_t *pipe;
+	str body = STR_NULL;
+	str name = STR_NULL;
+	int nrecords;
+	int nunknown;
+
+	nrecords = 0;
+	nunknown = 0;
+	if(!msg->content_length) {
+		LM_ERR("no content length header found\n");
+		goto invalid;
+	}
+	body.len = get_content_length(msg);
+	body.s = get_body(msg);
+	if(body.len < PL_DMQ_BATCH_MAGIC_LEN || body.s == NULL
+			|| memcmp(body.s, PL_DMQ_BATCH_MAGIC, PL_DMQ_BATCH_MAGIC_LEN)
+					   != 0) {
+		LM_ERR("invalid message body\n");
+		goto invalid;
+	}
+
+	p = (unsigned char *)body.s + PL_DMQ_BATCH_MAGIC_LEN;
+	end = (unsigned char *)body.s + body.len;
+	while(p < end) {
+		if(pl_dmq_varint_get(&p, end, &v) < 0 || v == 0 || v > end - p)
+			goto malformed;
+		name.s = (char *)p;
+		name.len = (int)v;
+		p += v;
+		if(pl_dmq_varint_get(&p, end, &v) < 0)
+			goto malformed;
+		if(v > INT_MAX)
+			v = INT_MAX;
+		nrecords++;
+		pipe = pl_pipe_get(&name, 1);
+		if(pipe == NULL) {
+			/* no local traffic for it yet */
+			nunknown++;
+			continue;
+		}
+		if(pipe->remote_counter < INT_MAX - (int)v)
+			pipe->remote_counter += (int)v;
+		else
+			pipe->remote_counter = INT_MAX;
+		pipe->remote_time = get_ticks_raw();
+		pl_pipe_release(&name);
+	}
+
+	lock_get(&_pl_dmq_stats->lock);
+	_pl_dmq_stats->recv_batches++;
+	_pl_dmq_stats->recv_records += nrecords;
+	_pl_dmq_stats->recv_bytes += body.len;
+	_pl_dmq_stats->recv_unknown += nunknown;
+	lock_release(&_pl_dmq_stats->lock);
+
+	resp->reason = pl_dmq_200_rpl;
+	resp->resp_code = 200;
+	return 0;
+
+malformed:
+	LM_ERR("malformed batch after %d records\n", nrecords);
+invalid:
+	if(_pl_dmq_stats != NULL) {
+		lock_get(&_pl_dmq_stats->lock);
+		_pl_dmq_stats->recv_invalid++;
+		lock_release(&_pl_dmq_stats->lock);
+	}
+	resp->reason = pl_dmq_400_rpl;
+	resp->resp_code = 400;
+	return 0;
+}
+
+void rpc_pl_dmq_stats(rpc_t *rpc, void *c)
+{
+	pl_dmq_stats_t st;
+	void *th;
+
+	if(_pl_dmq_stats == NULL) {
+		rpc->fault(c, 500, "DMQ not enabled");
+		return;
+	}
+	lock_get(&_pl_dmq_stats->lock);
+	memcpy(&st, _pl_dmq_stats, sizeof(pl_dmq_stats_t));
+	lock_release(&_pl_dmq_stats->lock);
+
+	if(rpc->add(c, "{", &th) < 0) {
+		rpc->fault(c, 500, "Internal error creating rpc");
+		return;
+	}
+	if(rpc->struct_add(th, "dddjjjjjjjj", "sync_interval",
+			   pl_dmq_sync_interval, "stale_time", pl_dmq_stale_time,
+			   "batch_size", PL_DMQ_BATCH_SIZE, "sent_batches",
+			   st.sent_batches, "sent_records", st.sent_records, "sent_bytes",
+			   st.sent_bytes, "recv_batches", st.recv_batches, "recv_records",
+			   st.recv_records, "recv_bytes", st.recv_bytes, "recv_unknown",
+			   st.recv_unknown, "recv_invalid", st.recv_invalid)
+			< 0) {
+		rpc->fault(c, 500, "Internal error adding stats");
+		return;
+	}
+}
@@ -0,0 +1,44 @@
+/*
+ * pipelimit module
+ *
+ * Copyright (C) 2026 Kamailio.org
+ *
+ * This file is part of Kamailio, a free SIP server.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Kamailio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * Kamailio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*! \file
+ * \ingroup pipelimit
+ * \brief pipelimit :: pl_dmq - cluster wide limits over DMQ
+ */
+
+#ifndef _PL_DMQ_H_
+#define _PL_DMQ_H_
+
+#include "../../core/rpc.h"
+
+extern int pl_enable_dmq;
+extern int pl_dmq_sync_interval;
+extern int pl_dmq_stale_time;
+
+int pl_dmq_init(void);
+void pl_dmq_destroy(void);
+void pl_dmq_timer(unsigned int ticks, void *param);
+void rpc_pl_dmq_stats(rpc_t *rpc, void *c);
+
+#endif
@@ -39,8 +39,10 @@
 #include "../../core/hashes.h"
 #include "../../core/mem/shm_mem.h"
 #include "../../core/rpc_lookup.h"
+#include "../../core/timer.h"
 
 #include "pl_ht.h"
+#include "pl_dmq.h"
 
 static rlp_htable_t *_pl_pipes_ht = NULL;
 extern int pl_clean_unused;
@@ -51,6 +53,7 @@ str_map_t algo_names[] = {
 		{str_init("TAILDROP"), PIPE_ALGO_TAILDROP},
 		{str_init("FEEDBACK"), PIPE_ALGO_FEEDBACK},
 		{str_init("NETWORK"), PIPE_ALGO_NETWORK},
+		{str_init("GCRA"), PIPE_ALGO_GCRA},
 		{{0, 0}, 0},
 };
 
@@ -320,6 +323,30 @@ int pl_print_pipes(void)
 	return 0;
 }
 
+/**
+ * run f for each pipe, with the slot locked - stops if f returns < 0
+ */
+int pl_pipe_walk(pl_pipe_walk_f f, void *param)
+{
+	int i;
+	pl_pipe_t *it;
+
+	if(_pl_pipes_ht == NULL)
+		return -1;
+
+	for(i = 0; i < _pl_pipes_ht->htsize; i++) {
+		lock_get(&_pl_pipes_ht->slots[i].lock);
+		for(it = _pl_pipes_ht->slots[i].first; it != NULL; it = it->next) {
+			if(f(it, param) < 0) {
+				lock_release(&_pl_pipes_ht->slots[i].lock);
+				return -1;
+			}
+		}
+		lock_release(&_pl_pipes_ht->slots[i].lock);
+	}
+	return 0;
+}
+
 int pl_pipe_check_feedback_setpoints(int *cfgsp)
 {
 	int i, sp;
@@ -394,11 +421,21 @@ void pl_pipe_timer_update(int interval, int netload)
 					}
 				}
 			}
+			if(pl_enable_dmq) {
+				if(it->remote_counter > 0) {
+					it->remote = it->remote_counter;
+					it->remote_counter = 0;
+				} else if(it->remote > 0
+						  && TICKS_TO_MS(get_ticks_raw() - it->remote_time)
+									 > pl_dmq_stale_time) {
+					it->remote = 0;
+				}
+			}
 			if(it->algo != PIPE_ALGO_NOP) {
 				if(it->algo == PIPE_ALGO_NETWORK) {
 					it->load = (netload > it->limit) ? 1 : -1;
 				} else if(it->limit && interval) {
-					it->load = it->counter / it->limit;
+					it->load = (it->counter + it->remote) / it->limit;
 				}
 				it->last_counter = it->counter;
 				it->counter = 0;
@@ -516,6 +553,10 @@ int rpc_pl_list_pipe(rpc_t *rpc, void *c, pl_pipe_t *it)
 		rpc->fault(c, 500, "Internal error address list structure");
 		return -1;
 	}
+	if(pl_enable_dmq && rpc->struct_add(th, "d", "remote", it->remote) < 0) {
+		rpc->fault(c, 500, "Internal error address list structure");
+		return -1;
+	}
 	return 0;
 }
 
@@ -585,6 +626,7 @@ void rpc_pl_set_pipe(rpc_t *rpc, void *c)
 
 	it->algo = algo_id;
 	it->limit = limit;
+	it->tat = 0;
 	pl_pipe_release(&pipeid);
 
 	if(check_feedback_setpoints(0)) {
@@ -617,6 +659,8 @@ void rpc_pl_reset_pipe(rpc_t *rpc, void *c)
 	it->last_counter = 0;
 	it->load = 0;
 	it->unused_intervals = 0;
+	it->remote_counter = 0;
+	it->remote = 0;
 
 	pl_pipe_release(&pipeid);
 }
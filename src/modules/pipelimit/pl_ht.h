@@ -48,6 +48,13 @@ typedef struct _pl_pipe
 	int last_counter;
 	int load;
 	int unused_intervals;
+	long tat; /* GCRA theoretical arrival time (usec) */
+
+	/* cluster mode (dmq) */
+	int dmq_counter;	  /* accepted messages not yet sent to peers */
+	int remote_counter;	  /* messages of peers in current interval */
+	int remote;			  /* messages of peers in last interval */
+	unsigned int remote_time; /* ticks of last update from peers */
 
 	struct _pl_pipe *prev;
 	struct _pl_pipe *next;
@@ -75,6 +82,9 @@ int pl_print_pipes(void);
 int pl_pipe_check_feedback_setpoints(int *cfgsp);
 void pl_pipe_timer_update(int interval, int netload);
 
+typedef int (*pl_pipe_walk_f)(pl_pipe_t *pipe, void *param);
+int pl_pipe_walk(pl_pipe_walk_f f, void *param);
+
 void rpl_pipe_lock(int slot);
 void rpl_pipe_release(int slot);
 
@@ -89,7 +99,8 @@ enum
 	PIPE_ALGO_RED,
 	PIPE_ALGO_TAILDROP,
 	PIPE_ALGO_FEEDBACK,
-	PIPE_ALGO_NETWORK
+	PIPE_ALGO_NETWORK,
+	PIPE_ALGO_GCRA
 };
 
 typedef struct str_map
@@ -78,6 +78,17 @@ static void rpc_dump(rpc_t *rpc, void *c)
  */
 static void rpc_reload(rpc_t *rpc, void *c)
 {
+	if(tree_file_enabled()) {
+		LM_NOTICE("Reloading prefix route tree from file\n");
+		if(0 != tree_file_load()) {
+			LM_ERR("file load failed\n");
+			rpc->fault(c, 400, "failed to reload prefix routes");
+		} else {
+			rpc->rpl_printf(c, "Prefix routes reloaded successfully");
+		}
+		return;
+	}
+
 	LM_NOTICE("Reloading prefix route tree from DB\n");
 
 	if(0 != pr_db_load()) {
@@ -60,6 +60,7 @@ MODULE_VERSION
 static char *db_url = DEFAULT_DB_URL;
 static char *db_table = "prefix_route";
 static int prefix_route_exit = 1;
+static char *tree_file = NULL;
 
 static int add_route(
 		struct tree_item *root, const char *prefix, const char *route)
@@ -207,6 +208,15 @@ static int mod_init(void)
 		return -1;
 	}
 
+	/* Prebuilt tree file instead of database */
+	if(NULL != tree_file && '\0' != tree_file[0]) {
+		if(0 != tree_file_init(tree_file)) {
+			LM_CRIT("tree file load failed\n\n");
+			return -1;
+		}
+		return 0;
+	}
+
 	/* Populate database */
 	if(0 != pr_db_load()) {
 		LM_CRIT("db load failed\n\n");
@@ -340,6 +350,7 @@ static param_export_t params[] = {
 	{"db_url", PARAM_STRING, &db_url},
 	{"db_table", PARAM_STRING, &db_table},
 	{"exit", PARAM_INT, &prefix_route_exit},
+	{"tree_file", PARAM_STRING, &tree_file},
 	{0, 0, 0}
 };
 
@@ -36,6 +36,8 @@
 #include "../../core/str.h"
 #include "../../core/lock_alloc.h"
 #include "../../core/lock_ops.h"
+#include "../../core/route.h"
+#include "../../lib/trie/ptfile.h"
 #include "tree.h"
 
 
@@ -66,6 +68,12 @@ struct tree
 static struct tree **shared_tree = NULL;
 static gen_lock_t *shared_tree_lock;
 
+/* Prebuilt tree file, mapped by each process */
+static char *tree_file = NULL;
+static ptf_map_t tree_file_map;
+static unsigned int tree_file_lgen = 0;
+static unsigned int *tree_file_sgen = NULL;
+
 
 /**
  * Allocate and initialize a new tree item
@@ -383,11 +391,61 @@ int tree_swap(struct tree_item *root)
 }
 
 
+/**
+ * Get route number from username, using the tree file
+ */
+static int tree_file_route_get(const str *user)
+{
+	char digits[PTF_MAX_DEPTH];
+	ptf_node_t *path[PTF_MAX_DEPTH];
+	int plen[PTF_MAX_DEPTH];
+	ptf_value_t *val;
+	int i, n, len;
+	int route;
+
+	if(ptf_map_sync(&tree_file_map, tree_file, &tree_file_lgen, *tree_file_sgen)
+			< 0) {
+		LM_ERR("cannot map tree file %s\n", tree_file);
+	}
+	if(tree_file_map.base == NULL || tree_file_map.ntrees == 0)
+		return -1;
+	if(NULL == user || NULL == user->s || !user->len)
+		return -1;
+
+	/* Only digits are matched, as for the tree in memory */
+	len = 0;
+	for(i = 0; i < user->len && len < PTF_MAX_DEPTH; i++) {
+		if(isdigit(user->s[i]))
+			digits[len++] = user->s[i];
+	}
+
+	n = ptf_match(&tree_file_map, &tree_file_map.trees[0], digits, len, path,
+			plen);
+	/* The full username is not a match, as for the tree in memory */
+	while(n > 0 && plen[n - 1] >= len)
+		n--;
+	if(n == 0)
+		return 0;
+
+	val = ptf_node_value(&tree_file_map, path[n - 1]);
+	route = route_lookup(&main_rt, val->s);
+	if(route < 0 || route >= main_rt.entries) {
+		LM_ERR("route name '%s' is not defined\n", val->s);
+		return 0;
+	}
+
+	return route;
+}
+
+
 int tree_route_get(const str *user)
 {
 	struct tree *tree;
 	int route;
 
+	if(tree_file != NULL)
+		return tree_file_route_get(user);
+
 	/* Find match in tree */
 	tree = tree_ref();
 	if(NULL == tree) {
@@ -401,9 +459,49 @@ int tree_route_get(const str *user)
 }
 
 
+/**
+ * Print the nodes of the tree file
+ */
+static void tree_file_print(unsigned int idx, char *prefix, int len, FILE *f)
+{
+	ptf_node_t *nodes;
+	ptf_node_t *node;
+	ptf_value_t *val;
+	int i;
+
+	nodes = ptf_tree_nodes(&tree_file_map, &tree_file_map.trees[0]);
+	for(i = 0; i < nodes[idx].nchild; i++) {
+		node = &nodes[nodes[idx].child + i];
+		if(len + node->llen >= PTF_MAX_DEPTH)
+			continue;
+		memcpy(prefix + len, ptf_node_label(&tree_file_map, node), node->llen);
+		val = ptf_node_value(&tree_file_map, node);
+		if(val != NULL) {
+			fprintf(f, "%.*s \t--> route[%s]\n", len + node->llen, prefix,
+					val->s);
+		}
+		tree_file_print(nodes[idx].child + i, prefix, len + node->llen, f);
+	}
+}
+
+
 void tree_print(FILE *f)
 {
 	struct tree *tree;
+	char prefix[PTF_MAX_DEPTH];
+
+	if(tree_file != NULL) {
+		fprintf(f, "Prefix route tree file: %s\n", tree_file);
+		ptf_map_sync(
+				&tree_file_map, tree_file, &tree_file_lgen, *tree_file_sgen);
+		if(tree_file_map.base != NULL && tree_file_map.ntrees > 0) {
+			fprintf(f, " nodes: %u\n", tree_file_map.trees[0].nrnodes);
+			tree_file_print(0, prefix, 0, f);
+		} else {
+			fprintf(f, " (no tree)\n");
+		}
+		return;
+	}
 
 	tree = tree_ref();
 
@@ -418,3 +516,54 @@ void tree_print(FILE *f)
 
 	tree_deref(tree);
 }
+
+
+int tree_file_enabled(void)
+{
+	return (tree_file != NULL) ? 1 : 0;
+}
+
+
+/**
+ * Validate the tree file and make all processes map it again
+ */
+int tree_file_load(void)
+{
+	ptf_map_t map;
+
+	if(ptf_map_file(tree_file, &map) < 0)
+		return -1;
+	if(map.ntrees == 0) {
+		LM_ERR("no tree in file %s\n", tree_file);
+		ptf_unmap_file(&map);
+		return -1;
+	}
+	LM_NOTICE("Prefix route tree file %s: %u nodes, %u prefixes\n", tree_file,
+			map.trees[0].nrnodes, map.trees[0].nritems);
+	ptf_unmap_file(&map);
+
+	(*tree_file_sgen)++;
+	membar_write();
+
+	return 0;
+}
+
+
+int tree_file_init(char *path)
+{
+	tree_file = path;
+
+	tree_file_sgen = (unsigned int *)shm_malloc(sizeof(*tree_file_sgen));
+	if(NULL == tree_file_sgen) {
+		SHM_MEM_ERROR;
+		return -1;
+	}
+	*tree_file_sgen = 0;
+
+	if(0 != tree_file_load())
+		return -1;
+
+	/* Map it here to be inherited by children */
+	return ptf_map_sync(
+			&tree_file_map, tree_file, &tree_file_lgen, *tree_file_sgen);
+}
@@ -29,6 +29,7 @@
 #include <sys/types.h>
 #include <regex.h>
 #include <math.h>
+#include <time.h>
 
 
 #include "../../core/mem/mem.h"
@@ -39,6 +40,7 @@
 #include "../../core/timer_ticks.h"
 #include "../../core/ut.h"
 #include "../../core/locking.h"
+#include "../../core/atomic_ops.h"
 #include "../../core/mod_fix.h"
 #include "../../core/data_lump.h"
 #include "../../core/data_lump_rpl.h"
@@ -82,7 +84,8 @@ enum
 	PIPE_ALGO_RED,
 	PIPE_ALGO_TAILDROP,
 	PIPE_ALGO_FEEDBACK,
-	PIPE_ALGO_NETWORK
+	PIPE_ALGO_NETWORK,
+	PIPE_ALGO_GCRA
 };
 
 str_map_t algo_names[] = {
@@ -91,6 +94,7 @@ str_map_t algo_names[] = {
 		{str_init("TAILDROP"), PIPE_ALGO_TAILDROP},
 		{str_init("FEEDBACK"), PIPE_ALGO_FEEDBACK},
 		{str_init("NETWORK"), PIPE_ALGO_NETWORK},
+		{str_init("GCRA"), PIPE_ALGO_GCRA},
 		{{0, 0}, 0},
 };
 
@@ -126,6 +130,7 @@ typedef struct pipe
 	int *counter;
 	int *last_counter;
 	int *load;
+	volatile long *tat; /* GCRA theoretical arrival time (usec) */
 } pipe_t;
 
 typedef struct rl_queue
@@ -563,11 +568,17 @@ static int mod_init(void)
 			LM_ERR("oom for pipes[%d].last_counter\n", i);
 			return -1;
 		}
+		pipes[i].tat = shm_malloc(sizeof(long));
+		if(pipes[i].tat == NULL) {
+			LM_ERR("oom for pipes[%d].tat\n", i);
+			return -1;
+		}
 		*pipes[i].algo = pipes[i].algo_mp;
 		*pipes[i].limit = pipes[i].limit_mp;
 		*pipes[i].load = 0;
 		*pipes[i].counter = 0;
 		*pipes[i].last_counter = 0;
+		*pipes[i].tat = 0;
 	}
 
 	for(i = 0; i < *nqueues; i++) {
@@ -628,6 +639,10 @@ static void destroy(void)
 			shm_free(pipes[i].limit);
 			pipes[i].limit = NULL;
 		}
+		if(pipes[i].tat) {
+			shm_free((void *)pipes[i].tat);
+			pipes[i].tat = NULL;
+		}
 	}
 
 	if(nqueues) {
@@ -744,6 +759,57 @@ int hash[100] = {18, 50, 51, 39, 49, 68, 8, 78, 61, 75, 53, 32, 45, 77, 31, 12,
 		71, 23, 2, 67, 36, 65, 27, 1, 19, 59, 89, 48};
 
 
+/**
+ * monotonic time in microseconds, it may wrap on 32bit systems
+ */
+static inline long rl_gcra_now(void)
+{
+	struct timespec ts;
+
+#if defined(CLOCK_MONOTONIC_RAW)
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+#else
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+	return (long)((unsigned long)ts.tv_sec * 1000000UL
+				  + (unsigned long)ts.tv_nsec / 1000UL);
+}
+
+/**
+ * generic cell rate algorithm - the limit is per second, allowing bursts
+ * of up to limit messages; the state is only the theoretical arrival time,
+ * updated with a compare-and-swap, so it does not need rl_lock
+ * \return	-1 if drop needed, 1 if allowed
+ */
+static int rl_gcra_check(volatile long *tat, int limit)
+{
+	long now, otat, diff;
+	long t, tau;
+
+	if(limit <= 0)
+		return -1;
+	t = 1000000L / limit;
+	if(t <= 0)
+		t = 1;
+	tau = 1000000L - t;
+
+	now = rl_gcra_now();
+	do {
+		otat = atomic_get_long(tat);
+		diff = (long)((unsigned long)otat - (unsigned long)now);
+		if(diff < 0 || diff > tau + t) {
+			/* idle pipe (or state from before a limit change) */
+			diff = 0;
+		}
+		if(diff > tau)
+			return -1;
+	} while(atomic_cmpxchg_long(
+					tat, otat, (long)((unsigned long)now + diff + t))
+			!= otat);
+
+	return 1;
+}
+
 /**
  * runs the pipe's algorithm
  * (expects rl_lock to be taken), TODO revert to "return" instead of "ret ="
@@ -753,7 +819,8 @@ static int pipe_push(struct sip_msg *msg, int id)
 {
 	int ret;
 
-	(*pipes[id].counter)++;
+	/* also incremented without rl_lock for forced GCRA pipes */
+	atomic_inc_int((volatile int *)pipes[id].counter);
 
 	switch(*pipes[id].algo) {
 		case PIPE_ALGO_NOP:
@@ -777,6 +844,9 @@ static int pipe_push(struct sip_msg *msg, int id)
 		case PIPE_ALGO_NETWORK:
 			ret = -1 * *pipes[id].load;
 			break;
+		case PIPE_ALGO_GCRA:
+			ret = rl_gcra_check(pipes[id].tat, *pipes[id].limit);
+			break;
 		default:
 			LM_ERR("unknown ratelimit algorithm: %d\n", *pipes[id].algo);
 			ret = 1;
@@ -814,6 +884,15 @@ static int rl_check(struct sip_msg *msg, int forced_pipe)
 		return -1;
 	}
 
+	if(forced_pipe >= 0 && *pipes[forced_pipe].algo == PIPE_ALGO_GCRA) {
+		/* the pipe state is updated atomically, no need for rl_lock */
+		que_id = 0;
+		pipe_id = forced_pipe;
+		atomic_inc_int((volatile int *)pipes[pipe_id].counter);
+		ret = rl_gcra_check(pipes[pipe_id].tat, *pipes[pipe_id].limit);
+		goto done;
+	}
+
 	LOCK_GET(rl_lock);
 	if(forced_pipe < 0) {
 		if(find_queue(msg, &method, &que_id)) {
@@ -831,6 +910,7 @@ static int rl_check(struct sip_msg *msg, int forced_pipe)
 out_release:
 	LOCK_RELEASE(rl_lock);
 
+done:
 	/* no locks here because it's only read and pipes[pipe_id] is always alloc'ed */
 	LM_DBG("meth=%.*s queue=%d pipe=%d algo=%d limit=%d pkg_load=%d counter=%d "
 		   "load=%2.1lf network_load=%d => %s\n",
@@ -1057,6 +1137,7 @@ static int add_queue_params(modparam_t type, void *val)
 static ticks_t rl_timer_handle(ticks_t ticks, struct timer_ln *tl, void *data)
 {
 	int i, len;
+	int counter;
 	char *c, *p;
 
 	LOCK_GET(rl_lock);
@@ -1085,14 +1166,15 @@ static ticks_t rl_timer_handle(ticks_t ticks, struct timer_ln *tl, void *data)
 	}
 
 	for(i = 0; i < MAX_PIPES; i++) {
+		/* the counter is read and reset at once, being also incremented
+		 * without rl_lock for forced GCRA pipes */
+		counter = atomic_get_and_set_int((volatile int *)pipes[i].counter, 0);
 		if(*pipes[i].algo == PIPE_ALGO_NETWORK) {
 			*pipes[i].load = (*network_load_value > *pipes[i].limit) ? 1 : -1;
 		} else if(*pipes[i].limit && timer_interval) {
-			*pipes[i].load =
-					*pipes[i].counter / (*pipes[i].limit * timer_interval);
+			*pipes[i].load = counter / (*pipes[i].limit * timer_interval);
 		}
-		*pipes[i].last_counter = *pipes[i].counter;
-		*pipes[i].counter = 0;
+		*pipes[i].last_counter = counter;
 	}
 	LOCK_RELEASE(rl_lock);
 	return (ticks_t)(-1); /* periodical */
@@ -1211,6 +1293,7 @@ static void rpc_set_pipe(rpc_t *rpc, void *c)
 	LOCK_GET(rl_lock);
 	*pipes[pipe_no].algo = algo_id;
 	*pipes[pipe_no].limit = limit;
+	*pipes[pipe_no].tat = 0;
 
 	if(check_feedback_setpoints(0)) {
 		LM_ERR("feedback limits don't match\n");
@@ -324,7 +324,7 @@ int lookup_helper(struct sip_msg *_m, udomain_t *_d, str *_uri, int _mode)
 	if(puri.gr.s == NULL || puri.gr_val.len > 0) {
 		/* aor or pub-gruu lookup */
 		_reg_ul.lock_udomain(_d, &aor);
-		res = _reg_ul.get_urecord(_d, &aor, &r);
+		res = _reg_ul.get_urecord_cached(_d, &aor, &r);
 		if(res > 0) {
 			LM_DBG("'%.*s' Not found in usrloc\n", aor.len, ZSW(aor.s));
 			_reg_ul.unlock_udomain(_d, &aor);
@@ -845,7 +845,7 @@ int registered4(struct sip_msg *_m, udomain_t *_d, str *_uri, int match_flag,
 	}
 
 	_reg_ul.lock_udomain(_d, &aor);
-	res = _reg_ul.get_urecord(_d, &aor, &r);
+	res = _reg_ul.get_urecord_cached(_d, &aor, &r);
 
 	if(res < 0) {
 		_reg_ul.unlock_udomain(_d, &aor);
@@ -577,7 +577,7 @@ int pv_fetch_contacts_helper(
 	/* copy contacts */
 	ilen = sizeof(ucontact_t);
 	_reg_ul.lock_udomain(dt, &aor);
-	res = _reg_ul.get_urecord(dt, &aor, &r);
+	res = _reg_ul.get_urecord_cached(dt, &aor, &r);
 	if(res > 0) {
 		LM_DBG("'%.*s' Not found in usrloc\n", aor.len, ZSW(aor.s));
 		_reg_ul.unlock_udomain(dt, &aor);
@@ -889,7 +889,7 @@ int ki_lookup_xavp(
 
 	/* copy contacts */
 	_reg_ul.lock_udomain(dt, &aor);
-	res = _reg_ul.get_urecord(dt, &aor, &r);
+	res = _reg_ul.get_urecord_cached(dt, &aor, &r);
 	if(res > 0) {
 		LM_DBG("'%.*s' not found in usrloc\n", aor.len, ZSW(aor.s));
 		_reg_ul.unlock_udomain(dt, &aor);
@@ -1009,7 +1009,7 @@ int ki_reg_from_user(sip_msg_t *msg, str *utname, str *uri, int vmode)
 
 	/* copy contacts */
 	_reg_ul.lock_udomain(dt, &aor);
-	res = _reg_ul.get_urecord(dt, &aor, &r);
+	res = _reg_ul.get_urecord_cached(dt, &aor, &r);
 	if(res > 0) {
 		LM_DBG("'%.*s' not found in usrloc\n", aor.len, ZSW(aor.s));
 		_reg_ul.unlock_udomain(dt, &aor);
@@ -337,37 +337,18 @@ BLACKLIST AND WHITELIST
 /* Check if the current destination is allowed */
 static int ki_check_dst(struct sip_msg *msg, str *val)
 {
-	str dst;
-	struct str_list *list;
-
-	dst.s = val->s;
-	dst.len = val->len;
-
-	list = (*secf_data)->bl.dst;
-	while(list) {
-		if(secf_dst_exact_match == 1) {
-			/* Exact match */
-			if(list->s.len == dst.len) {
-				if(cmpi_str(&list->s, &dst) == 0) {
-					lock_get(secf_lock);
-					secf_stats[BL_DST]++;
-					lock_release(secf_lock);
-					return -2;
-				}
-			}
-		} else {
-			/* Any match */
-			dst.len = val->len;
-			if(dst.len > list->s.len)
-				dst.len = list->s.len;
-			if(cmpi_str(&list->s, &dst) == 0) {
-				lock_get(secf_lock);
-				secf_stats[BL_DST]++;
-				lock_release(secf_lock);
-				return -2;
-			}
-		}
-		list = list->next;
+	secf_match_p m;
+
+	m = (*secf_data)->match;
+	if(m == NULL)
+		return 1;
+
+	/* Exact match or any match (destination starting with the value) */
+	if(secf_trie_match(m->bl[SECF_M_DST], val, secf_dst_exact_match)) {
+		lock_get(secf_lock);
+		secf_stats[BL_DST]++;
+		lock_release(secf_lock);
+		return -2;
 	}
 
 	return 1;
@@ -390,46 +371,32 @@ Return codes:
 */
 static int ki_check_ua(struct sip_msg *msg)
 {
-	int res, len;
+	int res;
 	str ua;
-	struct str_list *list;
+	secf_match_p m;
 
 	res = secf_get_ua(msg, &ua);
 	if(res != 0)
 		return res;
 
-	len = ua.len;
+	m = (*secf_data)->match;
+	if(m == NULL)
+		return 1;
 
 	/* User-agent whitelisted */
-	list = (*secf_data)->wl.ua;
-	while(list) {
-		if(ua.len > list->s.len)
-			ua.len = list->s.len;
-		res = cmpi_str(&list->s, &ua);
-		if(res == 0) {
-			lock_get(secf_lock);
-			secf_stats[WL_UA]++;
-			lock_release(secf_lock);
-			return 2;
-		}
-		list = list->next;
-		ua.len = len;
+	if(secf_trie_match(m->wl[SECF_M_UA], &ua, 0)) {
+		lock_get(secf_lock);
+		secf_stats[WL_UA]++;
+		lock_release(secf_lock);
+		return 2;
 	}
 
 	/* User-agent blacklisted */
-	list = (*secf_data)->bl.ua;
-	while(list) {
-		if(ua.len > list->s.len)
-			ua.len = list->s.len;
-		res = cmpi_str(&list->s, &ua);
-		if(res == 0) {
-			lock_get(secf_lock);
-			secf_stats[BL_UA]++;
-			lock_release(secf_lock);
-			return -2;
-		}
-		list = list->next;
-		ua.len = len;
+	if(secf_trie_match(m->bl[SECF_M_UA], &ua, 0)) {
+		lock_get(secf_lock);
+		secf_stats[BL_UA]++;
+		lock_release(secf_lock);
+		return -2;
 	}
 
 	return 1;
@@ -493,8 +460,8 @@ static int check_user(struct sip_msg *msg, int type)
 	str user = STR_NULL;
 	str domain = STR_NULL;
 	int res = 0;
-	int nlen, ulen, dlen;
-	struct str_list *list = NULL;
+	unsigned int nid, uid;
+	secf_match_p m;
 
 	switch(type) {
 		case 1:
@@ -517,154 +484,114 @@ static int check_user(struct sip_msg *msg, int type)
 		return -1;
 	}
 
-	nlen = name.len;
-	ulen = user.len;
-	dlen = domain.len;
-
-	/* User whitelisted */
-	list = (*secf_data)->wl.user;
-	while(list) {
-		if(name.len > list->s.len)
-			name.len = list->s.len;
-		if(name.s != NULL) {
-			res = cmpi_str(&list->s, &name);
-			if(res == 0) {
-				lock_get(secf_lock);
-				switch(type) {
-					case 1:
-						secf_stats[WL_FNAME]++;
-						break;
-					case 2:
-						secf_stats[WL_TNAME]++;
-						break;
-					case 3:
-						secf_stats[WL_CNAME]++;
-						break;
-				}
-				lock_release(secf_lock);
-				return 4;
-			}
+	m = (*secf_data)->match;
+	if(m == NULL)
+		return 1;
+
+	/* User whitelisted - for the same value, the name is checked first */
+	nid = (name.s != NULL) ? secf_trie_match(m->wl[SECF_M_USER], &name, 0) : 0;
+	uid = secf_trie_match(m->wl[SECF_M_USER], &user, 0);
+	if(nid != 0 && (uid == 0 || nid <= uid)) {
+		lock_get(secf_lock);
+		switch(type) {
+			case 1:
+				secf_stats[WL_FNAME]++;
+				break;
+			case 2:
+				secf_stats[WL_TNAME]++;
+				break;
+			case 3:
+				secf_stats[WL_CNAME]++;
+				break;
 		}
-		if(user.len > list->s.len)
-			user.len = list->s.len;
-		res = cmpi_str(&list->s, &user);
-		if(res == 0) {
-			lock_get(secf_lock);
-			switch(type) {
-				case 1:
-					secf_stats[WL_FUSER]++;
-					break;
-				case 2:
-					secf_stats[WL_TUSER]++;
-					break;
-				case 3:
-					secf_stats[WL_CUSER]++;
-					break;
-			}
-			lock_release(secf_lock);
-			return 2;
+		lock_release(secf_lock);
+		return 4;
+	}
+	if(uid != 0) {
+		lock_get(secf_lock);
+		switch(type) {
+			case 1:
+				secf_stats[WL_FUSER]++;
+				break;
+			case 2:
+				secf_stats[WL_TUSER]++;
+				break;
+			case 3:
+				secf_stats[WL_CUSER]++;
+				break;
 		}
-		list = list->next;
-		name.len = nlen;
-		user.len = ulen;
+		lock_release(secf_lock);
+		return 2;
 	}
 	/* User blacklisted */
-	list = (*secf_data)->bl.user;
-	while(list) {
-		if(name.len > list->s.len)
-			name.len = list->s.len;
-		if(name.s != NULL) {
-			res = cmpi_str(&list->s, &name);
-			if(res == 0) {
-				lock_get(secf_lock);
-				switch(type) {
-					case 1:
-						secf_stats[BL_FNAME]++;
-						break;
-					case 2:
-						secf_stats[BL_TNAME]++;
-						break;
-					case 3:
-						secf_stats[BL_CNAME]++;
-						break;
-				}
-				lock_release(secf_lock);
-				return -4;
-			}
+	nid = (name.s != NULL) ? secf_trie_match(m->bl[SECF_M_USER], &name, 0) : 0;
+	uid = secf_trie_match(m->bl[SECF_M_USER], &user, 0);
+	if(nid != 0 && (uid == 0 || nid <= uid)) {
+		lock_get(secf_lock);
+		switch(type) {
+			case 1:
+				secf_stats[BL_FNAME]++;
+				break;
+			case 2:
+				secf_stats[BL_TNAME]++;
+				break;
+			case 3:
+				secf_stats[BL_CNAME]++;
+				break;
 		}
-		if(user.len > list->s.len)
-			user.len = list->s.len;
-		res = cmpi_str(&list->s, &user);
-		if(res == 0) {
-			lock_get(secf_lock);
-			switch(type) {
-				case 1:
-					secf_stats[BL_FUSER]++;
-					break;
-				case 2:
-					secf_stats[BL_TUSER]++;
-					break;
-				case 3:
-					secf_stats[BL_CUSER]++;
-					break;
-			}
-			lock_release(secf_lock);
-			return -2;
+		lock_release(secf_lock);
+		return -4;
+	}
+	if(uid != 0) {
+		lock_get(secf_lock);
+		switch(type) {
+			case 1:
+				secf_stats[BL_FUSER]++;
+				break;
+			case 2:
+				secf_stats[BL_TUSER]++;
+				break;
+			case 3:
+				secf_stats[BL_CUSER]++;
+				break;
 		}
-		list = list->next;
-		name.len = nlen;
-		user.len = ulen;
+		lock_release(secf_lock);
+		return -2;
 	}
 
 	/* Domain whitelisted */
-	list = (*secf_data)->wl.domain;
-	while(list) {
-		if(domain.len > list->s.len)
-			domain.len = list->s.len;
-		res = cmpi_str(&list->s, &domain);
-		if(res == 0) {
-			lock_get(secf_lock);
-			switch(type) {
-				case 1:
-					secf_stats[WL_FDOMAIN]++;
-					break;
-				case 2:
-					secf_stats[WL_TDOMAIN]++;
-					break;
-				case 3:
-					secf_stats[WL_CDOMAIN]++;
-					break;
-			}
-			lock_release(secf_lock);
-			return 3;
+	if(secf_trie_match(m->wl[SECF_M_DOMAIN], &domain, 0)) {
+		lock_get(secf_lock);
+		switch(type) {
+			case 1:
+				secf_stats[WL_FDOMAIN]++;
+				break;
+			case 2:
+				secf_stats[WL_TDOMAIN]++;
+				break;
+			case 3:
+				secf_stats[WL_CDOMAIN]++;
+				break;
 		}
-		list = list->next;
-		domain.len = dlen;
+		lock_release(secf_lock);
+		return 3;
 	}
 	/* Domain blacklisted */
-	list = (*secf_data)->bl.domain;
-	while(list) {
-		if(domain.len > list->s.len)
-			domain.len = list->s.len;
-		res = cmpi_str(&list->s, &domain);
-		if(res == 0) {
-			lock_get(secf_lock);
-			switch(type) {
-				case 1:
-					secf_stats[BL_FDOMAIN]++;
-					break;
-				case 2:
-					secf_stats[BL_TDOMAIN]++;
-					break;
-				case 3:
-					secf_stats[BL_CDOMAIN]++;
-					break;
-			}
-			lock_release(secf_lock);
-			return -3;
+	if(secf_trie_match(m->bl[SECF_M_DOMAIN], &domain, 0)) {
+		lock_get(secf_lock);
+		switch(type) {
+			case 1:
+				secf_stats[BL_FDOMAIN]++;
+				break;
+			case 2:
+				secf_stats[BL_TDOMAIN]++;
+				break;
+			case 3:
+				secf_stats[BL_CDOMAIN]++;
+				break;
 		}
-		list = list->next;
-		domain.len = dlen;
+		lock_release(secf_lock);
+		return -3;
 	}
 
 	return 1;
@@ -681,9 +608,8 @@ Return codes:
 */
 static int ki_check_ip(struct sip_msg *msg)
 {
-	int res, len;
 	str ip;
-	struct str_list *list;
+	secf_match_p m;
 
 	if(msg == NULL)
 		return -1;
@@ -691,37 +617,23 @@ static int ki_check_ip(struct sip_msg *msg)
 	ip.s = ip_addr2a(&msg->rcv.src_ip);
 	ip.len = strlen(ip.s);
 
-	len = ip.len;
+	m = (*secf_data)->match;
+	if(m == NULL)
+		return 1;
 
 	/* IP address whitelisted */
-	list = (*secf_data)->wl.ip;
-	while(list) {
-		if(ip.len > list->s.len)
-			ip.len = list->s.len;
-		res = cmpi_str(&list->s, &ip);
-		if(res == 0) {
-			lock_get(secf_lock);
-			secf_stats[WL_IP]++;
-			lock_release(secf_lock);
-			return 2;
-		}
-		list = list->next;
-		ip.len = len;
+	if(secf_trie_match(m->wl[SECF_M_IP], &ip, 0)) {
+		lock_get(secf_lock);
+		secf_stats[WL_IP]++;
+		lock_release(secf_lock);
+		return 2;
 	}
 	/* IP address blacklisted */
-	list = (*secf_data)->bl.ip;
-	while(list) {
-		if(ip.len > list->s.len)
-			ip.len = list->s.len;
-		res = cmpi_str(&list->s, &ip);
-		if(res == 0) {
-			lock_get(secf_lock);
-			secf_stats[BL_IP]++;
-			lock_release(secf_lock);
-			return -2;
-		}
-		list = list->next;
-		ip.len = len;
+	if(secf_trie_match(m->bl[SECF_M_IP], &ip, 0)) {
+		lock_get(secf_lock);
+		secf_stats[BL_IP]++;
+		lock_release(secf_lock);
+		return -2;
 	}
 
 	return 1;
@@ -741,44 +653,25 @@ Return codes:
 */
 static int ki_check_country(struct sip_msg *msg, str *val)
 {
-	int res, len;
-	str country;
-	struct str_list *list;
-
-	country.s = val->s;
-	country.len = val->len;
+	secf_match_p m;
 
-	len = country.len;
+	m = (*secf_data)->match;
+	if(m == NULL)
+		return 1;
 
 	/* Country whitelisted */
-	list = (*secf_data)->wl.country;
-	while(list) {
-		if(country.len > list->s.len)
-			country.len = list->s.len;
-		res = cmpi_str(&list->s, &country);
-		if(res == 0) {
-			lock_get(secf_lock);
-			secf_stats[WL_COUNTRY]++;
-			lock_release(secf_lock);
-			return 2;
-		}
-		list = list->next;
-		country.len = len;
+	if(secf_trie_match(m->wl[SECF_M_COUNTRY], val, 0)) {
+		lock_get(secf_lock);
+		secf_stats[WL_COUNTRY]++;
+		lock_release(secf_lock);
+		return 2;
 	}
 	/* Country blacklisted */
-	list = (*secf_data)->bl.country;
-	while(list) {
-		if(country.len > list->s.len)
-			country.len = list->s.len;
-		res = cmpi_str(&list->s, &country);
-		if(res == 0) {
-			lock_get(secf_lock);
-			secf_stats[BL_COUNTRY]++;
-			lock_release(secf_lock);
-			return -2;
-		}
-		list = list->next;
-		country.len = len;
+	if(secf_trie_match(m->bl[SECF_M_COUNTRY], val, 0)) {
+		lock_get(secf_lock);
+		secf_stats[BL_COUNTRY]++;
+		lock_release(secf_lock);
+		return -2;
 	}
 
 	return 1;
@@ -831,6 +724,7 @@ int secf_init_data(void)
 		shm_free(secf_data_2);
 		return -1;
 	}
+	*secf_data = secf_data_1;
 
 	secf_stats = shm_malloc(total_data * sizeof(int));
 	if(!secf_stats) {
@@ -994,6 +888,9 @@ void secf_ht_timer(unsigned int ticks, void *param)
 	if(secf_rpc_reload_time == NULL)
 		return;
 
+	/* compiled lists replaced by rpc commands */
+	secf_match_free_retired(*secf_data, time(NULL) - secf_reload_interval);
+
 	if(*secf_rpc_reload_time != 0
 			&& *secf_rpc_reload_time > time(NULL) - secf_reload_interval)
 		return;
@@ -1021,6 +918,8 @@ void secf_free_data(secf_data_p secf_fdata)
 	memset(&secf_fdata->bl_last, 0, sizeof(secf_info_t));
 	LM_DBG("so, ua[%p] should be NULL\n", secf_fdata->bl.ua);
 
+	secf_match_free_all(secf_fdata);
+
 	lock_release(&secf_fdata->lock);
 }
 
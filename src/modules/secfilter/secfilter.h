@@ -41,6 +41,38 @@ typedef struct _secf_info
 	struct str_list *dst;
 } secf_info_t, *secf_info_p;
 
+/* lists compiled in prefix trees */
+#define SECF_M_UA 0
+#define SECF_M_COUNTRY 1
+#define SECF_M_DOMAIN 2
+#define SECF_M_USER 3
+#define SECF_M_IP 4
+#define SECF_M_DST 5
+#define SECF_M_SIZE 6
+
+typedef struct _secf_tnode
+{
+	unsigned int child;	   /* index of the first child */
+	unsigned int id;	   /* list position + 1 of the first value ending here */
+	unsigned short nchild; /* children are sorted by key */
+	unsigned char key;	   /* lower case char leading to this node */
+} secf_tnode_t;
+
+typedef struct _secf_trie
+{
+	unsigned int nnodes;
+	secf_tnode_t *nodes; /* node 0 is the root */
+} secf_trie_t, *secf_trie_p;
+
+typedef struct _secf_match
+{
+	secf_trie_p wl[SECF_M_SIZE];
+	secf_trie_p bl[SECF_M_SIZE];
+	unsigned int own; /* bits of the lists freed with the set */
+	time_t retired;
+	struct _secf_match *next;
+} secf_match_t, *secf_match_p;
+
 typedef struct _secf_data
 {
 	gen_lock_t lock;
@@ -48,6 +80,8 @@ typedef struct _secf_data
 	secf_info_t wl_last;
 	secf_info_t bl; /* blacklist info */
 	secf_info_t bl_last;
+	secf_match_p match;	  /* compiled lists, replaced on each change */
+	secf_match_p retired; /* replaced compiled lists, freed by the timer */
 } secf_data_t, *secf_data_p;
 
 extern secf_data_p *secf_data;
@@ -60,6 +94,13 @@ void secf_reset_stats(void);
 int secf_append_rule(int action, int type, str *value);
 int secf_remove_rule(int action, int type, str *value);
 
+/* Compiled lists */
+int secf_match_build(secf_data_p data);
+int secf_match_build_list(secf_data_p data, int action, int type);
+void secf_match_free_retired(secf_data_p data, time_t before);
+void secf_match_free_all(secf_data_p data);
+unsigned int secf_trie_match(secf_trie_p trie, str *val, int exact);
+
 /* Get header values from message */
 int secf_get_ua(struct sip_msg *msg, str *ua);
 int secf_get_from(struct sip_msg *msg, str *name, str *user, str *domain);
@@ -101,7 +101,8 @@ static struct str_list *shm_append_str_list(
 				      3 = IP address
 				      4 = user
 **/
-int secf_append_rule(int action, int type, str *value)
+static int secf_data_append_rule(
+		secf_data_p data, int action, int type, str *value)
 {
 	secf_info_p ini = NULL;
 	secf_info_p last = NULL;
@@ -117,11 +118,11 @@ int secf_append_rule(int action, int type, str *value)
 	}
 
 	if(action == 1) {
-		ini = &(*secf_data)->wl;
-		last = &(*secf_data)->wl_last;
+		ini = &data->wl;
+		last = &data->wl_last;
 	} else {
-		ini = &(*secf_data)->bl;
-		last = &(*secf_data)->bl_last;
+		ini = &data->bl;
+		last = &data->bl_last;
 	}
 
 	switch(type) {
@@ -182,6 +183,11 @@ int secf_append_rule(int action, int type, str *value)
 	return 0;
 }
 
+int secf_append_rule(int action, int type, str *value)
+{
+	return secf_data_append_rule(*secf_data, action, type, value);
+}
+
 /**
  * @brief Removes entries from a whitelist or blacklist based on action, type, and value.
  *
@@ -294,6 +300,7 @@ int secf_load_db(void)
 {
 	db_key_t db_cols[3];
 	db1_res_t *db_res = NULL;
+	secf_data_p data = NULL;
 	str str_data = STR_NULL;
 	int i, action, type;
 	int rows = 0;
@@ -306,13 +313,14 @@ int secf_load_db(void)
 		return -1;
 	}
 
-	/* Choose new hash table and free its old contents */
+	/* Choose new hash table and free its old contents, it is made active
+	 * once loaded and compiled */
 	if(*secf_data == secf_data_1) {
-		*secf_data = secf_data_2;
+		data = secf_data_2;
 	} else {
-		*secf_data = secf_data_1;
+		data = secf_data_1;
 	}
-	secf_free_data(*secf_data);
+	secf_free_data(data);
 
 	/* Prepare the data for the query */
 	db_cols[0] = &secf_action_col;
@@ -323,6 +331,7 @@ int secf_load_db(void)
 	if(db_funcs.use_table(db_handle, &secf_table_name) < 0) {
 		LM_ERR("Unable to use table '%.*s'\n", secf_table_name.len,
 				secf_table_name.s);
+		db_funcs.close(db_handle);
 		return -1;
 	}
 	if(db_funcs.query(db_handle, NULL, NULL, NULL, db_cols, 0, 3, NULL, &db_res)
@@ -335,11 +344,12 @@ int secf_load_db(void)
 	rows = RES_ROW_N(db_res);
 	if(rows == 0) {
 		LM_DBG("No data found in database\n");
+		*secf_data = data;
 		res = 0;
 		goto clean;
 	}
 
-	lock_get(&(*secf_data)->lock);
+	lock_get(&data->lock);
 	for(i = 0; i < rows; i++) {
 		action = (int)RES_ROWS(db_res)[i].values[0].val.int_val;
 		type = (int)RES_ROWS(db_res)[i].values[1].val.int_val;
@@ -348,14 +358,20 @@ int secf_load_db(void)
 		LM_DBG("[%d] append_rule for action:%d type:%d data:%.*s\n", i, action,
 				type, str_data.len, str_data.s);
 
-		if(secf_append_rule(action, type, &str_data) < 0) {
+		if(secf_data_append_rule(data, action, type, &str_data) < 0) {
 			LM_ERR("Can't append_rule with action:%d type:%d\n", action, type);
 			res = -1;
-			lock_release(&(*secf_data)->lock);
+			lock_release(&data->lock);
 			goto clean;
 		}
 	}
-	lock_release(&(*secf_data)->lock);
+	if(secf_match_build(data) < 0) {
+		res = -1;
+		lock_release(&data->lock);
+		goto clean;
+	}
+	lock_release(&data->lock);
+	*secf_data = data;
 
 clean:
 	if(db_funcs.free_result(db_handle, db_res) < 0) {
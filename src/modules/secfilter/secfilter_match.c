@@ -0,0 +1,456 @@
+/**
+ * Copyright (C) 2026 Kamailio.org
+ *
+ * This file is part of Kamailio, a free SIP server.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Kamailio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * Kamailio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * The values of the lists are matched case insensitive against the start
+ * of the header values. Each list is compiled in a prefix tree stored in a
+ * single shared memory block, so a check walks the header value once,
+ * whatever the number of values in the list.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+#include "../../core/dprint.h"
+#include "../../core/mem/mem.h"
+#include "../../core/mem/shm_mem.h"
+#include "secfilter.h"
+
+
+typedef struct _secf_pattern
+{
+	str s;
+	unsigned int id;
+} secf_pattern_t;
+
+typedef struct _secf_tbuild
+{
+	secf_pattern_t *pats;
+	secf_tnode_t *nodes;
+	unsigned int nnodes;
+} secf_tbuild_t;
+
+
+static int secf_pattern_cmp(const void *a, const void *b)
+{
+	const secf_pattern_t *pa = (const secf_pattern_t *)a;
+	const secf_pattern_t *pb = (const secf_pattern_t *)b;
+	int len;
+	int i;
+	int d;
+
+	len = (pa->s.len < pb->s.len) ? pa->s.len : pb->s.len;
+	for(i = 0; i < len; i++) {
+		d = tolower((unsigned char)pa->s.s[i])
+			- tolower((unsigned char)pb->s.s[i]);
+		if(d != 0)
+			return d;
+	}
+	if(pa->s.len != pb->s.len)
+		return pa->s.len - pb->s.len;
+	return (pa->id < pb->id) ? -1 : (pa->id > pb->id);
+}
+
+
+/**
+ * build the subtree of node from the sorted patterns [lo, hi), all of them
+ * sharing the first depth chars
+ */
+static void secf_trie_build_node(
+		secf_tbuild_t *tb, unsigned int node, int lo, int hi, int depth)
+{
+	unsigned int child;
+	int ng;
+	int i;
+	int j;
+	unsigned char c;
+
+	/* the values ending here sort first, the lowest id is the first one */
+	while(lo < hi && tb->pats[lo].s.len == depth) {
+		if(tb->nodes[node].id == 0 || tb->pats[lo].id < tb->nodes[node].id)
+			tb->nodes[node].id = tb->pats[lo].id;
+		lo++;
+	}
+	if(lo >= hi)
+		return;
+
+	/* children are allocated together, to be searched by key */
+	ng = 0;
+	for(i = lo; i < hi; i = j) {
+		c = tolower((unsigned char)tb->pats[i].s.s[depth]);
+		for(j = i + 1; j < hi
+					   && tolower((unsigned char)tb->pats[j].s.s[depth]) == c;
+				j++)
+			;
+		ng++;
+	}
+	child = tb->nnodes;
+	tb->nnodes += ng;
+	tb->nodes[node].child = child;
+	tb->nodes[node].nchild = (unsigned short)ng;
+
+	for(i = lo; i < hi; i = j) {
+		c = tolower((unsigned char)tb->pats[i].s.s[depth]);
+		for(j = i + 1; j < hi
+					   && tolower((unsigned char)tb->pats[j].s.s[depth]) == c;
+				j++)
+			;
+		memset(&tb->nodes[child], 0, sizeof(secf_tnode_t));
+		tb->nodes[child].key = c;
+		secf_trie_build_node(tb, child, i, j, depth + 1);
+		child++;
+	}
+}
+
+
+/**
+ * length of the common prefix of two patterns, ignoring the case
+ */
+static int secf_pattern_lcp(secf_pattern_t *pa, secf_pattern_t *pb)
+{
+	int len;
+	int i;
+
+	len = (pa->s.len < pb->s.len) ? pa->s.len : pb->s.len;
+	for(i = 0; i < len; i++) {
+		if(tolower((unsigned char)pa->s.s[i])
+				!= tolower((unsigned char)pb->s.s[i]))
+			break;
+	}
+	return i;
+}
+
+
+/**
+ * compile a list in a prefix tree
+ * @return 0 on success (trie is NULL for an empty list), -1 on error
+ */
+static int secf_trie_build(struct str_list *list, secf_trie_p *trie)
+{
+	secf_tbuild_t tb;
+	struct str_list *it;
+	secf_trie_p t;
+	unsigned long nnodes;
+	int n;
+	int i;
+
+	*trie = NULL;
+	n = 0;
+	for(it = list; it != NULL; it = it->next)
+		n++;
+	if(n == 0)
+		return 0;
+
+	memset(&tb, 0, sizeof(secf_tbuild_t));
+	tb.pats = (secf_pattern_t *)pkg_malloc(n * sizeof(secf_pattern_t));
+	if(tb.pats == NULL) {
+		PKG_MEM_ERROR;
+		return -1;
+	}
+	n = 0;
+	for(it = list; it != NULL; it = it->next) {
+		tb.pats[n].s = it->s;
+		tb.pats[n].id = n + 1;
+		n++;
+	}
+	qsort(tb.pats, n, sizeof(secf_pattern_t), secf_pattern_cmp);
+
+	/* each sorted pattern adds the nodes after the prefix it shares with
+	 * the previous one, so the nodes are built directly in shared memory */
+	nnodes = 1 + tb.pats[0].s.len;
+	for(i = 1; i < n; i++)
+		nnodes += tb.pats[i].s.len
+				  - secf_pattern_lcp(&tb.pats[i - 1], &tb.pats[i]);
+
+	t = (secf_trie_p)shm_malloc(
+			sizeof(secf_trie_t) + nnodes * sizeof(secf_tnode_t));
+	if(t == NULL) {
+		SHM_MEM_ERROR;
+		pkg_free(tb.pats);
+		return -1;
+	}
+	t->nodes = (secf_tnode_t *)(t + 1);
+
+	tb.nodes = t->nodes;
+	memset(&tb.nodes[0], 0, sizeof(secf_tnode_t));
+	tb.nnodes = 1;
+	secf_trie_build_node(&tb, 0, 0, n, 0);
+	t->nnodes = tb.nnodes;
+	LM_DBG("compiled %d values in %u nodes\n", n, t->nnodes);
+
+	pkg_free(tb.pats);
+	*trie = t;
+	return 0;
+}
+
+
+/* bits of the compiled lists in a set */
+#define SECF_M_WL_BIT(i) (1U << (i))
+#define SECF_M_BL_BIT(i) (1U << (SECF_M_SIZE + (i)))
+#define SECF_M_ALL ((1U << (2 * SECF_M_SIZE)) - 1)
+
+
+static void secf_match_free(secf_match_p m)
+{
+	int i;
+
+	for(i = 0; i < SECF_M_SIZE; i++) {
+		if(m->wl[i] != NULL && (m->own & SECF_M_WL_BIT(i)))
+			shm_free(m->wl[i]);
+		if(m->bl[i] != NULL && (m->own & SECF_M_BL_BIT(i)))
+			shm_free(m->bl[i]);
+	}
+	shm_free(m);
+}
+
+
+/**
+ * replace the current compiled lists with m, the previous set is kept
+ * until the next cleanup and frees only the replaced lists, the others
+ * being shared with m
+ */
+static void secf_match_set(secf_data_p data, secf_match_p m, unsigned int bits)
+{
+	if(data->match != NULL) {
+		data->match->own &= bits;
+		data->match->retired = time(NULL);
+		data->match->next = data->retired;
+		data->retired = data->match;
+	}
+	m->own = SECF_M_ALL;
+	m->retired = 0;
+	m->next = NULL;
+	data->match = m;
+}
+
+
+/**
+ * compile the lists of data and replace the previous compiled lists,
+ * which are kept until the next cleanup (to be done with the data lock)
+ * @return 0 on success, -1 on error (the previous compiled lists are kept)
+ */
+int secf_match_build(secf_data_p data)
+{
+	struct str_list *wl[SECF_M_SIZE];
+	struct str_list *bl[SECF_M_SIZE];
+	secf_match_p m;
+	int i;
+
+	m = (secf_match_p)shm_malloc(sizeof(secf_match_t));
+	if(m == NULL) {
+		SHM_MEM_ERROR;
+		return -1;
+	}
+	memset(m, 0, sizeof(secf_match_t));
+	m->own = SECF_M_ALL;
+
+	wl[SECF_M_UA] = data->wl.ua;
+	wl[SECF_M_COUNTRY] = data->wl.country;
+	wl[SECF_M_DOMAIN] = data->wl.domain;
+	wl[SECF_M_USER] = data->wl.user;
+	wl[SECF_M_IP] = data->wl.ip;
+	wl[SECF_M_DST] = data->wl.dst;
+	bl[SECF_M_UA] = data->bl.ua;
+	bl[SECF_M_COUNTRY] = data->bl.country;
+	bl[SECF_M_DOMAIN] = data->bl.domain;
+	bl[SECF_M_USER] = data->bl.user;
+	bl[SECF_M_IP] = data->bl.ip;
+	bl[SECF_M_DST] = data->bl.dst;
+	for(i = 0; i < SECF_M_SIZE; i++) {
+		if(secf_trie_build(wl[i], &m->wl[i]) < 0
+				|| secf_trie_build(bl[i], &m->bl[i]) < 0) {
+			LM_ERR("failed to compile the lists\n");
+			secf_match_free(m);
+			return -1;
+		}
+	}
+
+	secf_match_set(data, m, SECF_M_ALL);
+	return 0;
+}
+
+
+/**
+ * compile only the list of data changed by a rule with action and type
+ * (see secf_append_rule()), the other compiled lists are reused
+ * @return 0 on success, -1 on error (the previous compiled lists are kept)
+ */
+int secf_match_build_list(secf_data_p data, int action, int type)
+{
+	secf_info_p info;
+	struct str_list *list;
+	secf_match_p m;
+	secf_trie_p *trie;
+	unsigned int bit;
+	int i;
+
+	if(data->match == NULL)
+		return secf_match_build(data);
+
+	if(action < 0 || action > 2) {
+		LM_ERR("unknown action value %d\n", action);
+		return -1;
+	}
+	info = (action == 1) ? &data->wl : &data->bl;
+	switch(type) {
+		case 0:
+			if(action == 2) {
+				i = SECF_M_DST;
+				list = info->dst;
+			} else {
+				i = SECF_M_UA;
+				list = info->ua;
+			}
+			break;
+		case 1:
+			i = SECF_M_COUNTRY;
+			list = info->country;
+			break;
+		case 2:
+			i = SECF_M_DOMAIN;
+			list = info->domain;
+			break;
+		case 3:
+			i = SECF_M_IP;
+			list = info->ip;
+			break;
+		case 4:
+			i = SECF_M_USER;
+			list = info->user;
+			break;
+		default:
+			LM_ERR("unknown type value %d\n", type);
+			return -1;
+	}
+
+	m = (secf_match_p)shm_malloc(sizeof(secf_match_t));
+	if(m == NULL) {
+		SHM_MEM_ERROR;
+		return -1;
+	}
+	memcpy(m, data->match, sizeof(secf_match_t));
+	if(action == 1) {
+		trie = &m->wl[i];
+		bit = SECF_M_WL_BIT(i);
+	} else {
+		trie = &m->bl[i];
+		bit = SECF_M_BL_BIT(i);
+	}
+	if(secf_trie_build(list, trie) < 0) {
+		LM_ERR("failed to compile the list\n");
+		shm_free(m);
+		return -1;
+	}
+
+	secf_match_set(data, m, bit);
+	return 0;
+}
+
+
+/**
+ * free the compiled lists replaced before the given time
+ */
+void secf_match_free_retired(secf_data_p data, time_t before)
+{
+	secf_match_p *pm;
+	secf_match_p m;
+
+	lock_get(&data->lock);
+	pm = &data->retired;
+	while(*pm != NULL) {
+		m = *pm;
+		if(m->retired < before) {
+			*pm = m->next;
+			secf_match_free(m);
+		} else {
+			pm = &m->next;
+		}
+	}
+	lock_release(&data->lock);
+}
+
+
+/**
+ * free the current and replaced compiled lists (to be done with the
+ * data lock)
+ */
+void secf_match_free_all(secf_data_p data)
+{
+	secf_match_p m;
+
+	if(data->match != NULL) {
+		secf_match_free(data->match);
+		data->match = NULL;
+	}
+	while(data->retired != NULL) {
+		m = data->retired;
+		data->retired = m->next;
+		secf_match_free(m);
+	}
+}
+
+
+/**
+ * match a value against a compiled list
+ * @param exact if 0, the value has to start with a list value, otherwise
+ * it has to be equal with it
+ * @return list position + 1 of the first matching value, 0 if not found
+ */
+unsigned int secf_trie_match(secf_trie_p trie, str *val, int exact)
+{
+	secf_tnode_t *nodes;
+	secf_tnode_t *n;
+	unsigned int best;
+	unsigned char c;
+	int lo, hi, mid;
+	int i;
+
+	if(trie == NULL)
+		return 0;
+
+	nodes = trie->nodes;
+	n = &nodes[0];
+	best = n->id;
+	for(i = 0; i < val->len; i++) {
+		c = tolower((unsigned char)val->s[i]);
+		lo = 0;
+		hi = n->nchild - 1;
+		while(lo <= hi) {
+			mid = (lo + hi) >> 1;
+			if(nodes[n->child + mid].key < c) {
+				lo = mid + 1;
+			} else if(nodes[n->child + mid].key > c) {
+				hi = mid - 1;
+			} else {
+				break;
+			}
+		}
+		if(lo > hi)
+			return (exact) ? 0 : best;
+		n = &nodes[n->child + mid];
+		if(n->id != 0 && (best == 0 || n->id < best))
+			best = n->id;
+	}
+	return (exact) ? n->id : best;
+}
@@ -31,6 +31,9 @@
 
 /* RPC commands */
 
+static char *secf_rpc_build_err =
+		"List changed, but not compiled - reload to apply the change";
+
 
 static int get_type(str ctype)
 {
@@ -81,11 +84,13 @@ void secf_rpc_add_dst(rpc_t *rpc, void *ctx)
 	}
 	memcpy(data.s, text, data.len);
 	lock_get(&(*secf_data)->lock);
-	if(secf_append_rule(2, 0, &data) == 0) {
+	if(secf_append_rule(2, 0, &data) < 0) {
+		rpc->fault(ctx, 500, "Error insert values in the blacklist");
+	} else if(secf_match_build_list(*secf_data, 2, 0) < 0) {
+		rpc->fault(ctx, 500, secf_rpc_build_err);
+	} else {
 		rpc->rpl_printf(
 				ctx, "Values (%s) inserted into blacklist destinations", data);
-	} else {
-		rpc->fault(ctx, 500, "Error insert values in the blacklist");
 	}
 	lock_release(&(*secf_data)->lock);
 	if(data.s)
@@ -115,12 +120,14 @@ void secf_rpc_del_dst(rpc_t *rpc, void *ctx)
 	}
 	memcpy(data.s, text, data.len);
 	lock_get(&(*secf_data)->lock);
-	if(secf_remove_rule(2, 0, &data) == 0) {
-		rpc->rpl_printf(
-				ctx, "Values (%s) removed into blacklist destinations", data);
-	} else {
+	if(secf_remove_rule(2, 0, &data) < 0) {
 		rpc->fault(
 				ctx, 500, "Error removing value from blacklist destinations");
+	} else if(secf_match_build_list(*secf_data, 2, 0) < 0) {
+		rpc->fault(ctx, 500, secf_rpc_build_err);
+	} else {
+		rpc->rpl_printf(
+				ctx, "Values (%s) removed into blacklist destinations", data);
 	}
 	lock_release(&(*secf_data)->lock);
 	if(data.s)
@@ -146,11 +153,13 @@ void secf_rpc_add_bl(rpc_t *rpc, void *ctx)
 	type = get_type(ctype);
 
 	lock_get(&(*secf_data)->lock);
-	if(secf_append_rule(0, type, &data) == 0) {
+	if(secf_append_rule(0, type, &data) < 0) {
+		rpc->fault(ctx, 500, "Error inserting values in the blacklist");
+	} else if(secf_match_build_list(*secf_data, 0, type) < 0) {
+		rpc->fault(ctx, 500, secf_rpc_build_err);
+	} else {
 		rpc->rpl_printf(ctx, "Values (%.*s, %.*s) inserted into blacklist",
 				ctype.len, ctype.s, data.len, data.s);
-	} else {
-		rpc->fault(ctx, 500, "Error inserting values in the blacklist");
 	}
 	lock_release(&(*secf_data)->lock);
 }
@@ -177,11 +186,13 @@ void secf_rpc_del_bl(rpc_t *rpc, void *ctx)
 	}
 
 	lock_get(&(*secf_data)->lock);
-	if(secf_remove_rule(0, type, &data) == 0) {
+	if(secf_remove_rule(0, type, &data) < 0) {
+		rpc->fault(ctx, 500, "Error removing value from blacklist");
+	} else if(secf_match_build_list(*secf_data, 0, type) < 0) {
+		rpc->fault(ctx, 500, secf_rpc_build_err);
+	} else {
 		rpc->rpl_printf(ctx, "Value (%.*s, %.*s) removed from blacklist",
 				ctype.len, ctype.s, data.len, data.s);
-	} else {
-		rpc->fault(ctx, 500, "Error removing value from blacklist");
 	}
 	lock_release(&(*secf_data)->lock);
 }
@@ -205,11 +216,13 @@ void secf_rpc_add_wl(rpc_t *rpc, void *ctx)
 	type = get_type(ctype);
 
 	lock_get(&(*secf_data)->lock);
-	if(secf_append_rule(1, type, &data) == 0) {
+	if(secf_append_rule(1, type, &data) < 0) {
+		rpc->fault(ctx, 500, "Error insert values in the whitelist");
+	} else if(secf_match_build_list(*secf_data, 1, type) < 0) {
+		rpc->fault(ctx, 500, secf_rpc_build_err);
+	} else {
 		rpc->rpl_printf(ctx, "Values (%.*s, %.*s) inserted into whitelist",
 				ctype.len, ctype.s, data.len, data.s);
-	} else {
-		rpc->fault(ctx, 500, "Error insert values in the whitelist");
 	}
 	lock_release(&(*secf_data)->lock);
 }
@@ -236,11 +249,13 @@ void secf_rpc_del_wl(rpc_t *rpc, void *ctx)
 	}
 
 	lock_get(&(*secf_data)->lock);
-	if(secf_remove_rule(1, type, &data) == 0) {
+	if(secf_remove_rule(1, type, &data) < 0) {
+		rpc->fault(ctx, 500, "Error removing value from whitelist");
+	} else if(secf_match_build_list(*secf_data, 1, type) < 0) {
+		rpc->fault(ctx, 500, secf_rpc_build_err);
+	} else {
 		rpc->rpl_printf(ctx, "Value (%.*s, %.*s) removed from whitelist",
 				ctype.len, ctype.s, data.len, data.s);
-	} else {
-		rpc->fault(ctx, 500, "Error removing value from whitelist");
 	}
 	lock_release(&(*secf_data)->lock);
 }
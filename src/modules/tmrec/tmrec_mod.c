@@ -39,6 +39,8 @@
 #include "../../core/pvar.h"
 #include "../../core/mod_fix.h"
 #include "../../core/kemi.h"
+#include "../../core/hashes.h"
+#include "../../core/mem/mem.h"
 #include "../../core/utils/tmrec.h"
 #include "period.h"
 
@@ -59,6 +61,16 @@ static int w_time_period_match(struct sip_msg *msg, char *period, char *t);
 int tmrec_wday = 0;
 char tmrec_separator = '|';
 char *tmrec_separator_param = NULL;
+int tmrec_cache_size = 64;
+
+/* per process cache of match results, indexed by recurrence definition */
+typedef struct tmrec_centry
+{
+	str rdef;
+	tr_cache_t trc;
+} tmrec_centry_t;
+
+static tmrec_centry_t *_tmrec_cache = NULL;
 
 /* clang-format off */
 static cmd_export_t cmds[] = {
@@ -77,6 +89,7 @@ static cmd_export_t cmds[] = {
 static param_export_t params[] = {
 	{"wday", PARAM_INT, &tmrec_wday},
 	{"separator", PARAM_STRING, &tmrec_separator_param},
+	{"cache_size", PARAM_INT, &tmrec_cache_size},
 	{0, 0, 0}
 };
 
@@ -119,7 +132,16 @@ static int child_init(int rank)
  */
 static void mod_destroy(void)
 {
-	return;
+	int i;
+
+	if(_tmrec_cache == NULL)
+		return;
+	for(i = 0; i < tmrec_cache_size; i++) {
+		if(_tmrec_cache[i].rdef.s != NULL)
+			pkg_free(_tmrec_cache[i].rdef.s);
+	}
+	pkg_free(_tmrec_cache);
+	_tmrec_cache = NULL;
 }
 
 static int w_is_leap_year(struct sip_msg *msg, char *t, char *str2)
@@ -177,11 +199,52 @@ static int fixup_is_leap_year(void **param, int param_no)
 	return 0;
 }
 
+/**
+ * get the cache entry for the recurrence definition, reset if it was used
+ * by another definition
+ */
+static tmrec_centry_t *tmrec_cache_entry(str *rv)
+{
+	tmrec_centry_t *e;
+
+	if(tmrec_cache_size <= 0)
+		return NULL;
+	if(_tmrec_cache == NULL) {
+		_tmrec_cache = (tmrec_centry_t *)pkg_malloc(
+				tmrec_cache_size * sizeof(tmrec_centry_t));
+		if(_tmrec_cache == NULL) {
+			PKG_MEM_ERROR;
+			tmrec_cache_size = 0;
+			return NULL;
+		}
+		memset(_tmrec_cache, 0, tmrec_cache_size * sizeof(tmrec_centry_t));
+	}
+
+	e = &_tmrec_cache[get_hash1_raw(rv->s, rv->len) % tmrec_cache_size];
+	if(e->rdef.len == rv->len && memcmp(e->rdef.s, rv->s, rv->len) == 0)
+		return e;
+
+	if(e->rdef.s != NULL)
+		pkg_free(e->rdef.s);
+	memset(e, 0, sizeof(tmrec_centry_t));
+	e->rdef.s = (char *)pkg_malloc(rv->len + 1);
+	if(e->rdef.s == NULL) {
+		PKG_MEM_ERROR;
+		return NULL;
+	}
+	memcpy(e->rdef.s, rv->s, rv->len);
+	e->rdef.s[rv->len] = '\0';
+	e->rdef.len = rv->len;
+	return e;
+}
+
 static int ki_tmrec_match_timestamp(sip_msg_t *msg, str *rv, int ti)
 {
 	time_t tv;
 	ac_tm_t act;
 	tmrec_t tmr;
+	tmrec_centry_t *e;
+	int ret;
 
 	if(msg == NULL)
 		return -1;
@@ -191,6 +254,12 @@ static int ki_tmrec_match_timestamp(sip_msg_t *msg, str *rv, int ti)
 	} else {
 		tv = time(NULL);
 	}
+
+	/* the result is the same until the next interval bound */
+	e = tmrec_cache_entry(rv);
+	if(e != NULL && tr_cache_get(&e->trc, tv, &ret) == 0)
+		return (ret == 0) ? 1 : -1;
+
 	memset(&act, 0, sizeof(act));
 	memset(&tmr, 0, sizeof(tmr));
 
@@ -207,7 +276,13 @@ static int ki_tmrec_match_timestamp(sip_msg_t *msg, str *rv, int ti)
 		goto error;
 
 	/* match the specified recurrence */
-	if(tr_check_recurrence(&tmr, &act, 0) != 0)
+	ret = tr_check_recurrence(&tmr, &act, 0);
+	if(e != NULL && ret >= 0)
+		tr_cache_set(&e->trc, tv,
+				tr_next_change(tmr.dtstart, tmr.duration, tmr.until, &tmr.ts,
+						tv, &act.t),
+				ret);
+	if(ret != 0)
 		goto error;
 
 done:
@@ -42,6 +42,7 @@
  */
 
 extern int match_mode;
+extern int ubl_dtrie_mode;
 
 int db_build_userbl_tree(const str *username, const str *domain,
 		const str *dbtable, struct dtrie_node_t *root, int use_domain)
@@ -74,7 +75,7 @@ int db_build_userbl_tree(const str *username, const str *domain,
 		return -1;
 	}
 
-	dtrie_clear(root, NULL, match_mode);
+	dtrie_clear(root, NULL, ubl_dtrie_mode);
 
 	if(RES_COL_N(res) > 1) {
 		for(i = 0; i < RES_ROW_N(res); i++) {
@@ -97,7 +98,7 @@ int db_build_userbl_tree(const str *username, const str *domain,
 							   strlen(RES_ROWS(res)[i]
 											   .values[0]
 											   .val.string_val),
-							   nodeflags, match_mode)
+							   nodeflags, ubl_dtrie_mode)
 							< 0)
 						LM_ERR("could not insert values into trie.\n");
 
@@ -139,7 +140,7 @@ int db_reload_source(const str *dbtable, struct dtrie_node_t *root)
 		return -1;
 	}
 
-	dtrie_clear(root, NULL, match_mode);
+	dtrie_clear(root, NULL, ubl_dtrie_mode);
 
 	if(RES_COL_N(res) > 1) {
 		for(i = 0; i < RES_ROW_N(res); i++) {
@@ -162,7 +163,7 @@ int db_reload_source(const str *dbtable, struct dtrie_node_t *root)
 							   strlen(RES_ROWS(res)[i]
 											   .values[0]
 											   .val.string_val),
-							   nodeflags, match_mode)
+							   nodeflags, ubl_dtrie_mode)
 							< 0)
 						LM_ERR("could not insert values into trie.\n");
 
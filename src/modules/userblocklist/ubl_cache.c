@@ -0,0 +1,467 @@
+/*
+ * Copyright (C) 2026 Kamailio.org
+ *
+ * This file is part of Kamailio, a free SIP server.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Kamailio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * Kamailio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*!
+ * \file
+ * \brief USERBLOCKLIST :: shared memory cache of user lists
+ * \ingroup userblocklist
+ * - Module: \ref userblocklist
+ *
+ * The list of a user is loaded in the d-tree of the process, then copied
+ * in a compact form (prefixes sorted in the d-tree order) to a shared
+ * memory hash table, bounded in size with LRU eviction and expired after
+ * a time to live.
+ */
+
+#include <string.h>
+
+#include "../../core/mem/shm_mem.h"
+#include "../../core/locking.h"
+#include "../../core/hashes.h"
+#include "../../core/timer.h"
+#include "../../core/dprint.h"
+#include "../../core/ut.h"
+
+#include "ubl_cache.h"
+
+/* longer prefixes cannot match, the checked numbers are shorter */
+#define UBL_CACHE_MAXPREFIX 32
+
+typedef struct ubl_prefix
+{
+	unsigned int off; /* offset in the prefix buffer */
+	unsigned short len;
+	unsigned short mark;
+} ubl_prefix_t;
+
+typedef struct ubl_centry
+{
+	unsigned int hid;
+	ticks_t expires;
+	str table;
+	str user;
+	str domain;
+	int nprefix;
+	int maxlen;
+	ubl_prefix_t *prefix; /* sorted by prefix */
+	char *pbuf;
+
+	struct ubl_centry *prev; /* lru list, most recent first */
+	struct ubl_centry *next;
+	struct ubl_centry *hnext; /* next in hash slot */
+} ubl_centry_t;
+
+typedef struct ubl_cache
+{
+	unsigned int hsize;
+	int count;
+	unsigned long hits;
+	unsigned long misses;
+	ubl_centry_t **htable;
+	ubl_centry_t *head;
+	ubl_centry_t *tail;
+} ubl_cache_t;
+
+int ubl_cache_size = 0;
+int ubl_cache_ttl = 300;
+int ubl_cache_negative = 1;
+
+extern int match_mode;
+extern int ubl_dtrie_mode;
+
+static ubl_cache_t *_ubl_cache = NULL;
+static gen_lock_t *_ubl_cache_lock = NULL;
+
+
+int ubl_cache_init(void)
+{
+	unsigned int hsize;
+
+	if(ubl_cache_size <= 0)
+		return 0;
+
+	for(hsize = 1; hsize < (unsigned int)ubl_cache_size && hsize < (1 << 20);
+			hsize <<= 1)
+		;
+	_ubl_cache = (ubl_cache_t *)shm_malloc(
+			sizeof(ubl_cache_t) + hsize * sizeof(ubl_centry_t *));
+	if(_ubl_cache == NULL) {
+		SHM_MEM_ERROR;
+		return -1;
+	}
+	memset(_ubl_cache, 0, sizeof(ubl_cache_t) + hsize * sizeof(ubl_centry_t *));
+	_ubl_cache->hsize = hsize;
+	_ubl_cache->htable = (ubl_centry_t **)(_ubl_cache + 1);
+
+	_ubl_cache_lock = lock_alloc();
+	if(_ubl_cache_lock == NULL) {
+		LM_CRIT("cannot allocate memory for lock.\n");
+		shm_free(_ubl_cache);
+		_ubl_cache = NULL;
+		return -1;
+	}
+	if(lock_init(_ubl_cache_lock) == 0) {
+		LM_CRIT("cannot initialize lock.\n");
+		lock_dealloc((void *)_ubl_cache_lock);
+		_ubl_cache_lock = NULL;
+		shm_free(_ubl_cache);
+		_ubl_cache = NULL;
+		return -1;
+	}
+	LM_DBG("cache for %d user lists (%u slots)\n", ubl_cache_size, hsize);
+	return 0;
+}
+
+
+static void ubl_cache_unlink(ubl_centry_t *e)
+{
+	ubl_centry_t **h;
+
+	if(e->prev)
+		e->prev->next = e->next;
+	else
+		_ubl_cache->head = e->next;
+	if(e->next)
+		e->next->prev = e->prev;
+	else
+		_ubl_cache->tail = e->prev;
+
+	for(h = &_ubl_cache->htable[e->hid & (_ubl_cache->hsize - 1)]; *h != e;
+			h = &(*h)->hnext)
+		;
+	*h = e->hnext;
+	_ubl_cache->count--;
+}
+
+
+static void ubl_cache_link(ubl_centry_t *e)
+{
+	unsigned int idx;
+
+	e->prev = NULL;
+	e->next = _ubl_cache->head;
+	if(_ubl_cache->head)
+		_ubl_cache->head->prev = e;
+	_ubl_cache->head = e;
+	if(_ubl_cache->tail == NULL)
+		_ubl_cache->tail = e;
+
+	idx = e->hid & (_ubl_cache->hsize - 1);
+	e->hnext = _ubl_cache->htable[idx];
+	_ubl_cache->htable[idx] = e;
+	_ubl_cache->count++;
+}
+
+
+void ubl_cache_destroy(void)
+{
+	ubl_centry_t *e;
+
+	if(_ubl_cache == NULL)
+		return;
+	while(_ubl_cache->head) {
+		e = _ubl_cache->head;
+		ubl_cache_unlink(e);
+		shm_free(e);
+	}
+	shm_free(_ubl_cache);
+	_ubl_cache = NULL;
+	if(_ubl_cache_lock) {
+		lock_destroy(_ubl_cache_lock);
+		lock_dealloc((void *)_ubl_cache_lock);
+		_ubl_cache_lock = NULL;
+	}
+}
+
+
+static ubl_centry_t *ubl_cache_find(unsigned int hid, const str *table,
+		const str *user, const str *domain)
+{
+	ubl_centry_t *e;
+
+	for(e = _ubl_cache->htable[hid & (_ubl_cache->hsize - 1)]; e != NULL;
+			e = e->hnext) {
+		if(e->hid == hid && e->user.len == user->len
+				&& e->domain.len == domain->len && e->table.len == table->len
+				&& memcmp(e->user.s, user->s, user->len) == 0
+				&& memcmp(e->domain.s, domain->s, domain->len) == 0
+				&& memcmp(e->table.s, table->s, table->len) == 0)
+			return e;
+	}
+	return NULL;
+}
+
+
+static int ubl_prefix_cmp(ubl_centry_t *e, ubl_prefix_t *p, const char *s,
+		int len)
+{
+	int ret;
+
+	ret = memcmp(s, e->pbuf + p->off, (len < p->len) ? len : p->len);
+	if(ret == 0)
+		ret = len - p->len;
+	return ret;
+}
+
+
+int ubl_cache_match(const str *table, const str *user, const str *domain,
+		int use_domain, const char *number, int numberlen)
+{
+	static str nodomain = STR_NULL;
+	ubl_centry_t *e;
+	unsigned char digit;
+	unsigned int hid;
+	int l, lo, hi, mid, ret;
+	int mark;
+
+	if(_ubl_cache == NULL)
+		return UBL_CACHE_MISS;
+	if(!use_domain)
+		domain = &nodomain;
+
+	hid = get_hash1_raw(user->s, user->len);
+	lock_get(_ubl_cache_lock);
+	e = ubl_cache_find(hid, table, user, domain);
+	if(e != NULL && e->expires <= get_ticks()) {
+		ubl_cache_unlink(e);
+		shm_free(e);
+		e = NULL;
+	}
+	if(e == NULL) {
+		_ubl_cache->misses++;
+		lock_release(_ubl_cache_lock);
+		return UBL_CACHE_MISS;
+	}
+	_ubl_cache->hits++;
+	if(e != _ubl_cache->head) {
+		ubl_cache_unlink(e);
+		ubl_cache_link(e);
+	}
+
+	/* the d-tree walk stops at the first char out of the branches */
+	for(l = 0; l < numberlen && l < e->maxlen; l++) {
+		digit = (match_mode == 10) ? (unsigned char)(number[l] - '0')
+								   : (unsigned char)number[l];
+		if(digit >= (unsigned int)match_mode)
+			break;
+	}
+	mark = 0;
+	for(; l >= 0 && mark == 0; l--) {
+		lo = 0;
+		hi = e->nprefix - 1;
+		while(lo <= hi) {
+			mid = (lo + hi) / 2;
+			ret = ubl_prefix_cmp(e, &e->prefix[mid], number, l);
+			if(ret == 0) {
+				mark = e->prefix[mid].mark;
+				break;
+			}
+			if(ret < 0)
+				hi = mid - 1;
+			else
+				lo = mid + 1;
+		}
+	}
+	lock_release(_ubl_cache_lock);
+	return mark;
+}
+
+
+static void ubl_dtrie_count(
+		struct dtrie_node_t *node, int depth, int *n, int *size)
+{
+	struct dtrie_node_t *child;
+	int i;
+
+	if(node->data != NULL) {
+		(*n)++;
+		*size += depth;
+	}
+	if(depth >= UBL_CACHE_MAXPREFIX)
+		return;
+	for(i = 0; i < match_mode; i++) {
+		child = dtrie_get_child(node, i, ubl_dtrie_mode);
+		if(child)
+			ubl_dtrie_count(child, depth + 1, n, size);
+	}
+}
+
+
+static void ubl_dtrie_fill(struct dtrie_node_t *node, char *buf, int depth,
+		ubl_centry_t *e, int *off)
+{
+	struct dtrie_node_t *child;
+	ubl_prefix_t *p;
+	int i;
+
+	if(node->data != NULL) {
+		p = &e->prefix[e->nprefix++];
+		p->off = *off;
+		p->len = depth;
+		p->mark = (unsigned short)(unsigned long)node->data;
+		memcpy(e->pbuf + *off, buf, depth);
+		*off += depth;
+		if(depth > e->maxlen)
+			e->maxlen = depth;
+	}
+	if(depth >= UBL_CACHE_MAXPREFIX)
+		return;
+	for(i = 0; i < match_mode; i++) {
+		child = dtrie_get_child(node, i, ubl_dtrie_mode);
+		if(child) {
+			buf[depth] = (match_mode == 10) ? '0' + i : i;
+			ubl_dtrie_fill(child, buf, depth + 1, e, off);
+		}
+	}
+}
+
+
+int ubl_cache_add(const str *table, const str *user, const str *domain,
+		int use_domain, struct dtrie_node_t *root, int nrows)
+{
+	static str nodomain = STR_NULL;
+	char buf[UBL_CACHE_MAXPREFIX];
+	ubl_centry_t *e;
+	ubl_centry_t *old;
+	int n, size, off;
+	char *p;
+
+	if(_ubl_cache == NULL)
+		return 0;
+	if(nrows == 0 && !ubl_cache_negative)
+		return 0;
+	if(!use_domain)
+		domain = &nodomain;
+
+	n = size = 0;
+	ubl_dtrie_count(root, 0, &n, &size);
+	e = (ubl_centry_t *)shm_malloc(sizeof(ubl_centry_t)
+								   + n * sizeof(ubl_prefix_t) + table->len
+								   + user->len + domain->len + size);
+	if(e == NULL) {
+		SHM_MEM_ERROR;
+		return -1;
+	}
+	memset(e, 0, sizeof(ubl_centry_t));
+	e->prefix = (ubl_prefix_t *)(e + 1);
+	p = (char *)(e->prefix + n);
+	e->table.s = p;
+	e->table.len = table->len;
+	memcpy(p, table->s, table->len);
+	p += table->len;
+	e->user.s = p;
+	e->user.len = user->len;
+	memcpy(p, user->s, user->len);
+	p += user->len;
+	e->domain.s = p;
+	e->domain.len = domain->len;
+	if(domain->len > 0)
+		memcpy(p, domain->s, domain->len);
+	p += domain->len;
+	e->pbuf = p;
+	off = 0;
+	ubl_dtrie_fill(root, buf, 0, e, &off);
+	e->hid = get_hash1_raw(user->s, user->len);
+	e->expires = get_ticks() + ubl_cache_ttl;
+
+	lock_get(_ubl_cache_lock);
+	/* loaded meanwhile by another process */
+	old = ubl_cache_find(e->hid, table, user, domain);
+	if(old != NULL) {
+		ubl_cache_unlink(old);
+		shm_free(old);
+	}
+	while(_ubl_cache->count >= ubl_cache_size && _ubl_cache->tail) {
+		old = _ubl_cache->tail;
+		ubl_cache_unlink(old);
+		shm_free(old);
+	}
+	ubl_cache_link(e);
+	lock_release(_ubl_cache_lock);
+
+	LM_DBG("cached %d prefixes for user %.*s@%.*s in table %.*s\n", n,
+			user->len, user->s, domain->len, ZSW(domain->s), table->len,
+			table->s);
+	return 0;
+}
+
+
+int ubl_cache_flush(const str *user, const str *domain)
+{
+	ubl_centry_t *e;
+	ubl_centry_t *next;
+	unsigned int hid;
+	int n = 0;
+
+	if(_ubl_cache == NULL)
+		return 0;
+
+	lock_get(_ubl_cache_lock);
+	if(user == NULL || user->len <= 0) {
+		while(_ubl_cache->head) {
+			e = _ubl_cache->head;
+			ubl_cache_unlink(e);
+			shm_free(e);
+			n++;
+		}
+	} else {
+		hid = get_hash1_raw(user->s, user->len);
+		for(e = _ubl_cache->htable[hid & (_ubl_cache->hsize - 1)]; e != NULL;
+				e = next) {
+			next = e->hnext;
+			if(e->hid == hid && e->user.len == user->len
+					&& memcmp(e->user.s, user->s, user->len) == 0
+					&& (domain == NULL || domain->len <= 0
+							|| (e->domain.len == domain->len
+									&& memcmp(e->domain.s, domain->s,
+											   domain->len)
+											   == 0))) {
+				ubl_cache_unlink(e);
+				shm_free(e);
+				n++;
+			}
+		}
+	}
+	lock_release(_ubl_cache_lock);
+	return n;
+}
+
+
+void ubl_cache_rpc_stats(rpc_t *rpc, void *ctx)
+{
+	void *th;
+
+	if(_ubl_cache == NULL) {
+		rpc->fault(ctx, 500, "Cache not enabled");
+		return;
+	}
+	if(rpc->add(ctx, "{", &th) < 0) {
+		rpc->fault(ctx, 500, "Internal error creating rpc");
+		return;
+	}
+	lock_get(_ubl_cache_lock);
+	rpc->struct_add(th, "ddduu", "size", ubl_cache_size, "ttl", ubl_cache_ttl,
+			"entries", _ubl_cache->count, "hits",
+			(unsigned int)_ubl_cache->hits, "misses",
+			(unsigned int)_ubl_cache->misses);
+	lock_release(_ubl_cache_lock);
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2026 Kamailio.org
+ *
+ * This file is part of Kamailio, a free SIP server.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Kamailio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * Kamailio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*!
+ * \file
+ * \brief USERBLOCKLIST :: shared memory cache of user lists
+ * \ingroup userblocklist
+ * - Module: \ref userblocklist
+ */
+
+#ifndef _UBL_CACHE_H_
+#define _UBL_CACHE_H_
+
+#include "../../core/str.h"
+#include "../../core/rpc.h"
+#include "../../lib/trie/dtrie.h"
+
+#define UBL_CACHE_MISS -1
+
+extern int ubl_cache_size;
+extern int ubl_cache_ttl;
+extern int ubl_cache_negative;
+
+int ubl_cache_init(void);
+void ubl_cache_destroy(void);
+
+/*!
+ * \brief Match the number in the cached list of the user
+ * \return UBL_CACHE_MISS if the list is not cached, 0 if the number is
+ * not matched, otherwise the mark of the longest matching prefix
+ */
+int ubl_cache_match(const str *table, const str *user, const str *domain,
+		int use_domain, const char *number, int numberlen);
+
+/*!
+ * \brief Store a copy of the list of the user built in the d-tree
+ * \param nrows number of records loaded from database
+ * \return 0 on success (or if not cached), -1 on error
+ */
+int ubl_cache_add(const str *table, const str *user, const str *domain,
+		int use_domain, struct dtrie_node_t *root, int nrows);
+
+/*!
+ * \brief Remove the cached lists of a user (from all tables), or all the
+ * cached lists if user is NULL or empty
+ * \return number of removed lists
+ */
+int ubl_cache_flush(const str *user, const str *domain);
+
+void ubl_cache_rpc_stats(rpc_t *rpc, void *ctx);
+
+#endif
@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2026 Kamailio.org
+ *
+ * This file is part of Kamailio, a free SIP server.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Kamailio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * Kamailio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*!
+ * \file
+ * \brief USERBLOCKLIST :: DMQ replication of cache invalidations
+ * \ingroup userblocklist
+ * - Module: \ref userblocklist
+ */
+
+#include <string.h>
+
+#include "../../core/dprint.h"
+#include "../../core/utils/srjson.h"
+#include "../../core/parser/msg_parser.h"
+#include "../../core/parser/parse_content.h"
+#include "../dmq/bind_dmq.h"
+
+#include "ubl_cache.h"
+#include "ubl_dmq.h"
+
+int ubl_enable_dmq = 0;
+
+static str ubl_dmq_content_type = str_init("application/json");
+static str ubl_dmq_200_rpl = str_init("OK");
+static str ubl_dmq_400_rpl = str_init("Bad Request");
+
+static dmq_api_t ubl_dmqb;
+static dmq_peer_t *ubl_dmq_peer = NULL;
+
+static int ubl_dmq_handle_msg(
+		struct sip_msg *msg, peer_reponse_t *resp, dmq_node_t *node);
+
+/**
+ * register the userblocklist dmq peer
+ */
+int ubl_dmq_init(void)
+{
+	dmq_peer_t not_peer;
+
+	if(dmq_load_api(&ubl_dmqb) != 0) {
+		LM_ERR("cannot load dmq api\n");
+		return -1;
+	}
+
+	memset(&not_peer, 0, sizeof(dmq_peer_t));
+	not_peer.callback = ubl_dmq_handle_msg;
+	not_peer.init_callback = NULL;
+	not_peer.description.s = "userblocklist";
+	not_peer.description.len = 13;
+	not_peer.peer_id.s = "userblocklist";
+	not_peer.peer_id.len = 13;
+	ubl_dmq_peer = ubl_dmqb.register_dmq_peer(&not_peer);
+	if(ubl_dmq_peer == NULL) {
+		LM_ERR("error in register_dmq_peer\n");
+		return -1;
+	}
+	LM_DBG("dmq peer registered\n");
+	return 0;
+}
+
+/**
+ * flush the cached lists as requested by a peer
+ */
+static int ubl_dmq_handle_msg(
+		struct sip_msg *msg, peer_reponse_t *resp, dmq_node_t *node)
+{
+	srjson_doc_t jdoc;
+	srjson_t *it = NULL;
+	str body = STR_NULL;
+	str user = STR_NULL;
+	str domain = STR_NULL;
+	int n;
+
+	srjson_InitDoc(&jdoc, NULL);
+
+	if(!msg->content_length) {
+		LM_ERR("no content length header found\n");
+		goto invalid;
+	}
+	body.len = get_content_length(msg);
+	body.s = get_body(msg);
+	if(body.len <= 0 || body.s == NULL) {
+		LM_ERR("unable to get body\n");
+		goto invalid;
+	}
+
+	jdoc.buf = body;
+	jdoc.root = srjson_Parse(&jdoc, jdoc.buf.s);
+	if(jdoc.root == NULL) {
+		LM_ERR("invalid json doc [[%.*s]]\n", body.len, body.s);
+		goto invalid;
+	}
+	for(it = jdoc.root->child; it; it = it->next) {
+		if(it->type != srjson_String)
+			continue;
+		if(strcmp(it->string, "user") == 0) {
+			user.s = it->valuestring;
+			user.len = strlen(it->valuestring);
+		} else if(strcmp(it->string, "domain") == 0) {
+			domain.s = it->valuestring;
+			domain.len = strlen(it->valuestring);
+		}
+	}
+
+	n = ubl_cache_flush(&user, &domain);
+	LM_DBG("flushed %d cached lists for [%.*s@%.*s]\n", n, user.len,
+			ZSW(user.s), domain.len, ZSW(domain.s));
+
+	resp->reason = ubl_dmq_200_rpl;
+	resp->resp_code = 200;
+	srjson_DestroyDoc(&jdoc);
+	return 0;
+
+invalid:
+	resp->reason = ubl_dmq_400_rpl;
+	resp->resp_code = 400;
+	srjson_DestroyDoc(&jdoc);
+	return 0;
+}
+
+/**
+ * ask the peers to flush the cached lists of a user, or all if user is empty
+ */
+int ubl_dmq_replicate_flush(const str *user, const str *domain)
+{
+	srjson_doc_t jdoc;
+	int ret = -1;
+
+	if(ubl_dmq_peer == NULL) {
+		LM_ERR("dmq peer not registered\n");
+		return -1;
+	}
+
+	srjson_InitDoc(&jdoc, NULL);
+	jdoc.root = srjson_CreateObject(&jdoc);
+	if(jdoc.root == NULL) {
+		LM_ERR("cannot create json root\n");
+		goto done;
+	}
+	if(user != NULL && user->len > 0) {
+		srjson_AddStrToObject(&jdoc, jdoc.root, "user", user->s, user->len);
+		if(domain != NULL && domain->len > 0)
+			srjson_AddStrToObject(
+					&jdoc, jdoc.root, "domain", domain->s, domain->len);
+	}
+	jdoc.buf.s = srjson_PrintUnformatted(&jdoc, jdoc.root);
+	if(jdoc.buf.s == NULL) {
+		LM_ERR("unable to serialize data\n");
+		goto done;
+	}
+	jdoc.buf.len = strlen(jdoc.buf.s);
+	LM_DBG("sending serialized data %.*s\n", jdoc.buf.len, jdoc.buf.s);
+	if(ubl_dmqb.bcast_message(ubl_dmq_peer, &jdoc.buf, 0, NULL, 1,
+			   &ubl_dmq_content_type)
+			== 0)
+		ret = 0;
+	jdoc.free_fn(jdoc.buf.s);
+	jdoc.buf.s = NULL;
+
+done:
+	srjson_DestroyDoc(&jdoc);
+	return ret;
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2026 Kamailio.org
+ *
+ * This file is part of Kamailio, a free SIP server.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Kamailio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * Kamailio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*!
+ * \file
+ * \brief USERBLOCKLIST :: DMQ replication of cache invalidations
+ * \ingroup userblocklist
+ * - Module: \ref userblocklist
+ */
+
+#ifndef _UBL_DMQ_H_
+#define _UBL_DMQ_H_
+
+#include "../../core/str.h"
+
+extern int ubl_enable_dmq;
+
+int ubl_dmq_init(void);
+int ubl_dmq_replicate_flush(const str *user, const str *domain);
+
+#endif
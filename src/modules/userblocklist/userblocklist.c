@@ -55,6 +55,8 @@
 #include "../../lib/trie/dtrie.h"
 #include "db.h"
 #include "db_userblocklist.h"
+#include "ubl_cache.h"
+#include "ubl_dmq.h"
 
 MODULE_VERSION
 
@@ -85,6 +87,8 @@ struct check_blocklist_fs_t
 str userblocklist_db_url = str_init(DEFAULT_RODB_URL);
 int use_domain = 0;
 int match_mode = 10; /* numeric */
+int ubl_dtrie_compact = 0;
+int ubl_dtrie_mode = 10;
 static struct dtrie_node_t *gnode = NULL;
 
 /* ---- fixup functions: */
@@ -146,6 +150,11 @@ static param_export_t params[] = {
 	globalblocklist_DB_COLS
 	{"use_domain", PARAM_INT, &use_domain},
 	{"match_mode", PARAM_INT, &match_mode},
+	{"dtrie_compact", PARAM_INT, &ubl_dtrie_compact},
+	{"cache_size", PARAM_INT, &ubl_cache_size},
+	{"cache_ttl", PARAM_INT, &ubl_cache_ttl},
+	{"cache_negative", PARAM_INT, &ubl_cache_negative},
+	{"enable_dmq", PARAM_INT, &ubl_enable_dmq},
 	{0, 0, 0}
 };
 
@@ -222,6 +231,8 @@ static int ki_check_user_list(sip_msg_t *msg, str *suser, str *sdomain,
 	void **nodeflags;
 	char *ptr;
 	char req_number[MAXNUMBERLEN + 1];
+	int mark;
+	int nrows;
 
 	if(stable == NULL || stable->len <= 0) {
 		/* use default table name */
@@ -258,11 +269,6 @@ static int ki_check_user_list(sip_msg_t *msg, str *suser, str *sdomain,
 	LM_DBG("check entry %s for user %.*s on domain %.*s in table %.*s\n",
 			req_number, suser->len, suser->s, sdomain->len, sdomain->s,
 			table.len, table.s);
-	if(db_build_userbl_tree(suser, sdomain, &table, dtrie_root, use_domain)
-			< 0) {
-		LM_ERR("cannot build d-tree\n");
-		return -1;
-	}
 
 	ptr = req_number;
 	/* Skip over non-digits.  */
@@ -270,10 +276,23 @@ static int ki_check_user_list(sip_msg_t *msg, str *suser, str *sdomain,
 		ptr = ptr + 1;
 	}
 
-	nodeflags =
-			dtrie_longest_match(dtrie_root, ptr, strlen(ptr), NULL, match_mode);
-	if(nodeflags) {
-		if(*nodeflags == (void *)MARK_ALLOWLIST) {
+	mark = ubl_cache_match(
+			&table, suser, sdomain, use_domain, ptr, strlen(ptr));
+	if(mark == UBL_CACHE_MISS) {
+		nrows = db_build_userbl_tree(
+				suser, sdomain, &table, dtrie_root, use_domain);
+		if(nrows < 0) {
+			LM_ERR("cannot build d-tree\n");
+			return -1;
+		}
+		ubl_cache_add(&table, suser, sdomain, use_domain, dtrie_root, nrows);
+
+		nodeflags = dtrie_longest_match(
+				dtrie_root, ptr, strlen(ptr), NULL, ubl_dtrie_mode);
+		mark = (nodeflags) ? (int)(unsigned long)*nodeflags : 0;
+	}
+	if(mark != 0) {
+		if(mark == MARK_ALLOWLIST) {
 			/* LM_ERR("allowlisted"); */
 			return 1; /* found, but is allowlisted */
 		}
@@ -480,7 +499,7 @@ static int add_source(const char *table)
 	strcpy(src->table, table);
 	LM_DBG("add table %s", table);
 
-	src->dtrie_root = dtrie_init(match_mode);
+	src->dtrie_root = dtrie_init(ubl_dtrie_mode);
 
 	if(src->dtrie_root == NULL) {
 		LM_ERR("could not initialize data");
@@ -692,7 +711,7 @@ static int check_blocklist(sip_msg_t *msg, struct check_blocklist_fs_t *arg1)
 	/* avoids dirty reads when updating d-tree */
 	lock_get(lock);
 	nodeflags = dtrie_longest_match(
-			arg1->dtrie_root, ptr, strlen(ptr), NULL, match_mode);
+			arg1->dtrie_root, ptr, strlen(ptr), NULL, ubl_dtrie_mode);
 	if(nodeflags) {
 		if(*nodeflags == (void *)MARK_ALLOWLIST) {
 			/* LM_DBG("allowlisted"); */
@@ -778,7 +797,7 @@ static int check_allowlist(sip_msg_t *msg, struct check_blocklist_fs_t *arg1)
 	/* avoids dirty reads when updating d-tree */
 	lock_get(lock);
 	nodeflags = dtrie_longest_match(
-			arg1->dtrie_root, ptr, strlen(ptr), NULL, match_mode);
+			arg1->dtrie_root, ptr, strlen(ptr), NULL, ubl_dtrie_mode);
 	if(nodeflags) {
 		if(*nodeflags == (void *)MARK_ALLOWLIST) {
 			/* LM_DBG("allowlisted"); */
@@ -846,7 +865,7 @@ static void destroy_source_list(void)
 
 			if(src->table)
 				shm_free(src->table);
-			dtrie_destroy(&(src->dtrie_root), NULL, match_mode);
+			dtrie_destroy(&(src->dtrie_root), NULL, ubl_dtrie_mode);
 			shm_free(src);
 		}
 
@@ -886,6 +905,7 @@ static void dump_dtrie_mi(const struct dtrie_node_t *root,
 		const unsigned int branches, char *prefix, int *length,
 		struct mi_root *reply)
 {
+	struct dtrie_node_t *child;
 	struct mi_node *crt_node;
 	unsigned int i;
 	char digit, *val = NULL;
@@ -925,7 +945,8 @@ static void dump_dtrie_mi(const struct dtrie_node_t *root,
 	/* Perform a DFS search */
 	for(i = 0; i < branches; i++) {
 		/* If child branch found, traverse it */
-		if(root->child[i]) {
+		child = dtrie_get_child(root, i, ubl_dtrie_mode);
+		if(child) {
 			if(branches == 10) {
 				digit = i + '0';
 			} else {
@@ -940,7 +961,7 @@ static void dump_dtrie_mi(const struct dtrie_node_t *root,
 			prefix[(*length)++] = digit;
 
 			/* Recursive DFS call */
-			dump_dtrie_mi(root->child[i], branches, prefix, length, reply);
+			dump_dtrie_mi(child, branches, prefix, length, reply);
 
 			/* Pop digit from prefix stack */
 			(*length)--;
@@ -1000,7 +1021,8 @@ static struct mi_root *check_list_mi(struct mi_root *cmd, int list_type)
 
 	/* Avoids dirty reads when updating d-tree */
 	lock_get(lock);
-	nodeflags = dtrie_longest_match(gnode, ptr, strlen(ptr), NULL, match_mode);
+	nodeflags = dtrie_longest_match(
+			gnode, ptr, strlen(ptr), NULL, ubl_dtrie_mode);
 	if(nodeflags) {
 		if(*nodeflags == (void *)MARK_ALLOWLIST) {
 			LM_DBG("prefix %.*s is allowlisted in table %.*s\n", prefix.len,
@@ -1147,8 +1169,8 @@ static struct mi_root *check_userlist_mi(struct mi_root *cmd, int list_type)
 	}
 
 	/* Search for a match in dtrie */
-	nodeflags =
-			dtrie_longest_match(dtrie_root, ptr, strlen(ptr), NULL, match_mode);
+	nodeflags = dtrie_longest_match(
+			dtrie_root, ptr, strlen(ptr), NULL, ubl_dtrie_mode);
 	if(nodeflags) {
 		if(*nodeflags == (void *)MARK_ALLOWLIST) {
 			LM_DBG("user %.*s is allowlisted for prefix %.*s in table %.*s\n",
@@ -1278,6 +1300,7 @@ static void dump_dtrie_rpc(rpc_t *rpc, void *ctx,
 		const struct dtrie_node_t *root, const unsigned int branches,
 		char *prefix, int *length)
 {
+	struct dtrie_node_t *child;
 	unsigned int i;
 	char digit, *val = NULL;
 	int val_len = 0;
@@ -1310,7 +1333,8 @@ static void dump_dtrie_rpc(rpc_t *rpc, void *ctx,
 	/* Perform a DFS search */
 	for(i = 0; i < branches; i++) {
 		/* If child branch found, traverse it */
-		if(root->child[i]) {
+		child = dtrie_get_child(root, i, ubl_dtrie_mode);
+		if(child) {
 			if(branches == 10) {
 				digit = i + '0';
 			} else {
@@ -1325,7 +1349,7 @@ static void dump_dtrie_rpc(rpc_t *rpc, void *ctx,
 			prefix[(*length)++] = digit;
 
 			/* Recursive DFS call */
-			dump_dtrie_rpc(rpc, ctx, root->child[i], branches, prefix, length);
+			dump_dtrie_rpc(rpc, ctx, child, branches, prefix, length);
 
 			/* Pop digit from prefix stack */
 			(*length)--;
@@ -1391,7 +1415,8 @@ static void check_list_rpc(rpc_t *rpc, void *ctx, int list_type)
 
 	/* Avoids dirty reads when updating d-tree */
 	lock_get(lock);
-	nodeflags = dtrie_longest_match(gnode, ptr, strlen(ptr), NULL, match_mode);
+	nodeflags = dtrie_longest_match(
+			gnode, ptr, strlen(ptr), NULL, ubl_dtrie_mode);
 	if(nodeflags) {
 		if(*nodeflags == (void *)MARK_ALLOWLIST) {
 			LM_DBG("prefix %.*s is allowlisted in table %.*s\n", prefix.len,
@@ -1499,8 +1524,8 @@ static void check_userlist_rpc(rpc_t *rpc, void *ctx, int list_type)
 
 	/* Avoids dirty reads when updating d-tree */
 	/* Search for a match in dtrie */
-	nodeflags =
-			dtrie_longest_match(dtrie_root, ptr, strlen(ptr), NULL, match_mode);
+	nodeflags = dtrie_longest_match(
+			dtrie_root, ptr, strlen(ptr), NULL, ubl_dtrie_mode);
 	if(nodeflags) {
 		if(*nodeflags == (void *)MARK_ALLOWLIST) {
 			LM_DBG("user %.*s is allowlisted for prefix %.*s in table %.*s\n",
@@ -1598,6 +1623,30 @@ static void ubl_rpc_check_userallowlist(rpc_t *rpc, void *ctx)
 	return check_userlist_rpc(rpc, ctx, MARK_ALLOWLIST);
 }
 
+static void ubl_rpc_cache_flush(rpc_t *rpc, void *ctx)
+{
+	str user = STR_NULL;
+	str domain = STR_NULL;
+	int n;
+
+	if(rpc->scan(ctx, "*S", &user) == 1) {
+		if(rpc->scan(ctx, "*S", &domain) < 1) {
+			domain.s = NULL;
+			domain.len = 0;
+		}
+	}
+	n = ubl_cache_flush(&user, &domain);
+	if(ubl_enable_dmq > 0 && ubl_dmq_replicate_flush(&user, &domain) < 0) {
+		LM_WARN("failed to replicate the cache flush\n");
+	}
+	rpc->add(ctx, "d", n);
+}
+
+static void ubl_rpc_cache_stats(rpc_t *rpc, void *ctx)
+{
+	ubl_cache_rpc_stats(rpc, ctx);
+}
+
 static const char *ubl_rpc_reload_blocklist_doc[2] = {
 		"Reload user blocklist records.", 0};
 
@@ -1616,6 +1665,12 @@ static const char *ubl_rpc_check_userblocklist_doc[2] = {
 static const char *ubl_rpc_check_userallowlist_doc[2] = {
 		"Check user allowlist records.", 0};
 
+static const char *ubl_rpc_cache_flush_doc[2] = {
+		"Remove the cached user lists, optionally only for a user.", 0};
+
+static const char *ubl_rpc_cache_stats_doc[2] = {
+		"Statistics of the user lists cache.", 0};
+
 rpc_export_t ubl_rpc[] = {
 		{"userblocklist.reload_blocklist", ubl_rpc_reload_blocklist,
 				ubl_rpc_reload_blocklist_doc, 0},
@@ -1629,6 +1684,10 @@ rpc_export_t ubl_rpc[] = {
 				ubl_rpc_check_userblocklist_doc, 0},
 		{"userblocklist.check_userallowlist", ubl_rpc_check_userallowlist,
 				ubl_rpc_check_userallowlist_doc, 0},
+		{"userblocklist.cache_flush", ubl_rpc_cache_flush,
+				ubl_rpc_cache_flush_doc, 0},
+		{"userblocklist.cache_stats", ubl_rpc_cache_stats,
+				ubl_rpc_cache_stats_doc, 0},
 		{0, 0, 0, 0}};
 
 static int ubl_rpc_init(void)
@@ -1642,6 +1701,7 @@ static int ubl_rpc_init(void)
 
 static int mod_init(void)
 {
+	ubl_dtrie_mode = match_mode | (ubl_dtrie_compact ? DTRIE_COMPACT : 0);
 	if(ubl_rpc_init() < 0)
 		return -1;
 	if(userblocklist_db_init() != 0)
@@ -1650,6 +1710,10 @@ static int mod_init(void)
 		return -1;
 	if(init_source_list() != 0)
 		return -1;
+	if(ubl_cache_init() != 0)
+		return -1;
+	if(ubl_enable_dmq > 0 && ubl_dmq_init() != 0)
+		return -1;
 	return 0;
 }
 
@@ -1672,7 +1736,7 @@ static int rpc_child_init(void)
 		return 0;
 	if(userblocklist_db_open() != 0)
 		return -1;
-	dtrie_root = dtrie_init(match_mode);
+	dtrie_root = dtrie_init(ubl_dtrie_mode);
 	if(dtrie_root == NULL) {
 		LM_ERR("could not initialize data");
 		return -1;
@@ -1698,8 +1762,9 @@ static void mod_destroy(void)
 {
 	destroy_source_list();
 	destroy_shmlock();
+	ubl_cache_destroy();
 	userblocklist_db_close();
-	dtrie_destroy(&dtrie_root, NULL, match_mode);
+	dtrie_destroy(&dtrie_root, NULL, ubl_dtrie_mode);
 }
 
 /**
@@ -41,6 +41,7 @@
 #include "usrloc.h"
 #include "urecord.h"
 #include "ucontact.h"
+#include "ul_dbcache.h"
 
 extern int ul_db_insert_null;
 
@@ -1741,8 +1742,11 @@ int update_ucontact(struct urecord *_r, ucontact_t *_c, ucontact_info_t *_ci)
 		/* urecord is static generate a copy for later */
 		if(_r)
 			memcpy(&_ur, _r, sizeof(struct urecord));
-		if(update_contact_db(_c) < 0)
+		if(update_contact_db(_c) < 0) {
+			ul_dbcache_del(_c->domain, _c->aor);
 			return -1;
+		}
+		ul_dbcache_del(_c->domain, _c->aor);
 	}
 
 	/* run callbacks for UPDATE event */
@@ -44,6 +44,7 @@
 #include "ul_callback.h"
 #include "ul_keepalive.h"
 #include "urecord.h"
+#include "ul_dbcache.h"
 
 extern int ul_rm_expired_delay;
 extern int ul_db_clean_tcp;
@@ -1416,6 +1417,44 @@ int get_urecord(udomain_t *_d, str *_aor, struct urecord **_r)
 	return 1; /* Nothing found */
 }
 
+/*!
+ * \brief Obtain a urecord pointer for read only use, in db_mode=3 the
+ * record can be served from the cache of records loaded from DB
+ * \param _d domain to search the record
+ * \param _aor address of record
+ * \param _r new created record
+ * \return 0 if a record was found, 1 if nothing could be found
+ */
+int get_urecord_cached(udomain_t *_d, str *_aor, struct urecord **_r)
+{
+	unsigned int gen = 0;
+	int ret;
+	urecord_t *r;
+
+	if(ul_db_mode != DB_ONLY || ul_db_cache_ttl <= 0)
+		return get_urecord(_d, _aor, _r);
+
+	/* search in the cache of records loaded from DB */
+	get_static_urecord(_d, _aor, &r);
+	ret = ul_dbcache_get(_d, r, &gen);
+	if(ret == 0) {
+		*_r = r;
+		return 0;
+	}
+	if(ret < 0) {
+		free_urecord(r);
+	}
+	/* search in DB */
+	r = db_load_urecord(ul_dbh, _d, _aor);
+	if(r) {
+		ul_dbcache_put(_d, r, gen);
+		*_r = r;
+		return 0;
+	}
+
+	return 1; /* Nothing found */
+}
+
 /*!
  * \brief Obtain a urecord pointer if the urecord exists in domain (lock slot)
  * \param _d domain to search the record
@@ -1493,8 +1532,10 @@ int delete_urecord(udomain_t *_d, str *_aor, struct urecord *_r)
 			get_static_urecord(_d, _aor, &_r);
 		if(db_delete_urecord(_r) < 0) {
 			LM_ERR("DB delete failed\n");
+			ul_dbcache_del(_r->domain, &_r->aor);
 			return -1;
 		}
+		ul_dbcache_del(_r->domain, &_r->aor);
 		free_urecord(_r);
 		return 0;
 	}
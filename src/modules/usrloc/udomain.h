@@ -102,6 +102,16 @@ int preload_udomain(db1_con_t *_c, udomain_t *_d);
 int testdb_udomain(db1_con_t *con, udomain_t *d);
 
 
+/*!
+ * \brief Loads from DB all contacts for a RUID
+ * \param _c database connection
+ * \param _d domain
+ * \param _ruid record unique id
+ * \return pointer to the record on success, 0 on errors or if nothing is found
+ */
+urecord_t *db_load_urecord_by_ruid(db1_con_t *_c, udomain_t *_d, str *_ruid);
+
+
 /*!
  * \brief Timer function to cleanup expired contacts, DB_ONLY db_mode
  * \param _d cleaned domain
@@ -187,6 +197,16 @@ int insert_urecord(udomain_t *_d, str *_aor, struct urecord **_r);
  */
 int get_urecord(udomain_t *_d, str *_aor, struct urecord **_r);
 
+/*!
+ * \brief Obtain a urecord pointer for read only use, in db_mode=3 the
+ * record can be served from the cache of records loaded from DB
+ * \param _d domain to search the record
+ * \param _aor address of record
+ * \param _r new created record
+ * \return 0 if a record was found, 1 if nothing could be found
+ */
+int get_urecord_cached(udomain_t *_d, str *_aor, struct urecord **_r);
+
 /*!
  * \brief Obtain a urecord pointer if the urecord exists in domain (lock slot)
  * \param _d domain to search the record
@@ -0,0 +1,502 @@
+/*
+ * Usrloc module - read-through cache of records for db only mode
+ *
+ * This file is part of Kamailio, a free SIP server.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Kamailio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * Kamailio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*! \file
+ *  \brief USRLOC - read-through cache of records for db only mode
+ *  \ingroup usrloc
+ *
+ * The records loaded from database by lookups are kept for a limited time
+ * in a shared memory hash table, so that the next lookups for the same
+ * address of record do not have to query the database. An item is dropped
+ * when the record is changed by this instance and when its lifetime is
+ * over, the latter bounding the staleness with respect to changes done by
+ * other instances sharing the database.
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "../../core/dprint.h"
+#include "../../core/locking.h"
+#include "../../core/atomic_ops.h"
+#include "../../core/mem/shm_mem.h"
+#include "../../core/socket_info.h"
+#include "ul_dbcache.h"
+#include "ucontact.h"
+#include "usrloc_mod.h"
+
+int ul_db_cache_ttl = 0;	  /*!< lifetime of cached records, 0 - disabled */
+int ul_db_cache_size = 10;	  /*!< power of two for number of slots */
+int ul_db_cache_max = 100000; /*!< max number of cached records */
+
+/*! cached contact */
+typedef struct ul_dbcache_contact
+{
+	str c;
+	str ruid;
+	str received;
+	str path;
+	str callid;
+	str user_agent;
+	str instance;
+	time_t expires;
+	qvalue_t q;
+	int cseq;
+	unsigned int flags;
+	unsigned int cflags;
+	struct socket_info *sock;
+	unsigned int methods;
+	unsigned int reg_id;
+	int server_id;
+	int tcpconn_id;
+	int keepalive;
+	time_t last_modified;
+} ul_dbcache_contact_t;
+
+/*! cached record */
+typedef struct ul_dbcache_item
+{
+	str domain;
+	str aor;
+	unsigned int aorhash;
+	time_t expires;
+	int ncontacts;
+	ul_dbcache_contact_t *contacts;
+	struct ul_dbcache_item *next;
+} ul_dbcache_item_t;
+
+/*! cache slot */
+typedef struct ul_dbcache_slot
+{
+	ul_dbcache_item_t *first;
+	unsigned int gen; /*!< changed on every invalidation */
+} ul_dbcache_slot_t;
+
+/*! cache table */
+typedef struct ul_dbcache
+{
+	unsigned int size;
+	ul_dbcache_slot_t *slots;
+	gen_lock_set_t *locks;
+	atomic_t items;
+	atomic_t hits;
+	atomic_t misses;
+	atomic_t invalidations;
+} ul_dbcache_t;
+
+#define UL_DBCACHE_LOCKS_MAX 256
+
+static ul_dbcache_t *_ul_dbcache = NULL;
+
+#define ul_dbcache_lock_idx(_sl) ((_sl) & (_ul_dbcache_nlocks - 1))
+static unsigned int _ul_dbcache_nlocks = 0;
+
+/*!
+ * \brief Initialize the cache
+ * \return 0 on success, -1 on failure
+ */
+int ul_dbcache_init(void)
+{
+	if(ul_db_cache_ttl <= 0 || _ul_dbcache != NULL)
+		return 0;
+
+	if(ul_db_cache_size <= 0 || ul_db_cache_size > 20) {
+		LM_WARN("invalid db cache size power %d - using 10\n",
+				ul_db_cache_size);
+		ul_db_cache_size = 10;
+	}
+
+	_ul_dbcache = (ul_dbcache_t *)shm_malloc(sizeof(ul_dbcache_t));
+	if(_ul_dbcache == NULL) {
+		SHM_MEM_ERROR;
+		return -1;
+	}
+	memset(_ul_dbcache, 0, sizeof(ul_dbcache_t));
+	_ul_dbcache->size = 1 << ul_db_cache_size;
+
+	_ul_dbcache->slots = (ul_dbcache_slot_t *)shm_malloc(
+			_ul_dbcache->size * sizeof(ul_dbcache_slot_t));
+	if(_ul_dbcache->slots == NULL) {
+		SHM_MEM_ERROR;
+		goto error;
+	}
+	memset(_ul_dbcache->slots, 0,
+			_ul_dbcache->size * sizeof(ul_dbcache_slot_t));
+
+	_ul_dbcache_nlocks = (_ul_dbcache->size < UL_DBCACHE_LOCKS_MAX)
+								 ? _ul_dbcache->size
+								 : UL_DBCACHE_LOCKS_MAX;
+	_ul_dbcache->locks = lock_set_alloc(_ul_dbcache_nlocks);
+	if(_ul_dbcache->locks == NULL) {
+		LM_ERR("failed to alloc lock set\n");
+		goto error;
+	}
+	if(lock_set_init(_ul_dbcache->locks) == NULL) {
+		LM_ERR("failed to init lock set\n");
+		lock_set_dealloc(_ul_dbcache->locks);
+		_ul_dbcache->locks = NULL;
+		goto error;
+	}
+	atomic_set(&_ul_dbcache->items, 0);
+	atomic_set(&_ul_dbcache->hits, 0);
+	atomic_set(&_ul_dbcache->misses, 0);
+	atomic_set(&_ul_dbcache->invalidations, 0);
+
+	return 0;
+
+error:
+	if(_ul_dbcache->slots != NULL)
+		shm_free(_ul_dbcache->slots);
+	shm_free(_ul_dbcache);
+	_ul_dbcache = NULL;
+	return -1;
+}
+
+/*!
+ * \brief Remove all the items of a slot
+ * \param sl cache slot
+ * \note the slot lock must be held
+ */
+static void ul_dbcache_slot_clean(ul_dbcache_slot_t *sl)
+{
+	ul_dbcache_item_t *it;
+
+	while(sl->first) {
+		it = sl->first;
+		sl->first = it->next;
+		shm_free(it);
+		atomic_dec(&_ul_dbcache->items);
+	}
+}
+
+/*!
+ * \brief Destroy the cache
+ */
+void ul_dbcache_destroy(void)
+{
+	unsigned int i;
+
+	if(_ul_dbcache == NULL)
+		return;
+
+	for(i = 0; i < _ul_dbcache->size; i++) {
+		ul_dbcache_slot_clean(&_ul_dbcache->slots[i]);
+	}
+	lock_set_destroy(_ul_dbcache->locks);
+	lock_set_dealloc(_ul_dbcache->locks);
+	shm_free(_ul_dbcache->slots);
+	shm_free(_ul_dbcache);
+	_ul_dbcache = NULL;
+}
+
+/*!
+ * \brief Copy a string in the buffer of a cache item
+ */
+static inline char *ul_dbcache_str_copy(str *dst, str *src, char *p)
+{
+	if(src->s == NULL || src->len <= 0) {
+		dst->s = NULL;
+		dst->len = 0;
+		return p;
+	}
+	dst->s = p;
+	dst->len = src->len;
+	memcpy(p, src->s, src->len);
+	return p + src->len;
+}
+
+/*!
+ * \brief Look up a record in cache and fill the contacts if found
+ * \param _d domain
+ * \param _r record structure (with aor, aorhash and domain set) where the
+ *        contacts are added
+ * \param _gen filled with the generation of the slot on cache miss, to be
+ *        given to ul_dbcache_put()
+ * \return 0 if the record was found in cache, 1 if not found, -1 on error
+ */
+int ul_dbcache_get(udomain_t *_d, urecord_t *_r, unsigned int *_gen)
+{
+	ul_dbcache_slot_t *sl;
+	ul_dbcache_item_t *it;
+	ul_dbcache_item_t **pit;
+	ul_dbcache_contact_t *cc;
+	ucontact_info_t ci;
+	ucontact_t *c;
+	unsigned int idx;
+	time_t tnow;
+	int i;
+
+	if(_ul_dbcache == NULL)
+		return 1;
+
+	tnow = time(NULL);
+	idx = _r->aorhash & (_ul_dbcache->size - 1);
+	sl = &_ul_dbcache->slots[idx];
+	lock_set_get(_ul_dbcache->locks, ul_dbcache_lock_idx(idx));
+	*_gen = sl->gen;
+	pit = &sl->first;
+	for(it = sl->first; it != NULL; it = *pit) {
+		if(it->expires <= tnow) {
+			/* drop expired item */
+			*pit = it->next;
+			shm_free(it);
+			atomic_dec(&_ul_dbcache->items);
+			continue;
+		}
+		if(it->aorhash == _r->aorhash && it->aor.len == _r->aor.len
+				&& it->domain.len == _d->name->len
+				&& memcmp(it->aor.s, _r->aor.s, _r->aor.len) == 0
+				&& memcmp(it->domain.s, _d->name->s, _d->name->len) == 0) {
+			break;
+		}
+		pit = &it->next;
+	}
+	if(it == NULL) {
+		lock_set_release(_ul_dbcache->locks, ul_dbcache_lock_idx(idx));
+		atomic_inc(&_ul_dbcache->misses);
+		return 1;
+	}
+
+	for(i = 0; i < it->ncontacts; i++) {
+		cc = &it->contacts[i];
+		memset(&ci, 0, sizeof(ucontact_info_t));
+		ci.ruid = cc->ruid;
+		ci.received = cc->received;
+		ci.path = &cc->path;
+		ci.expires = cc->expires;
+		ci.q = cc->q;
+		ci.callid = &cc->callid;
+		ci.cseq = cc->cseq;
+		ci.flags = cc->flags;
+		ci.cflags = cc->cflags;
+		ci.user_agent = &cc->user_agent;
+		ci.sock = cc->sock;
+		ci.methods = cc->methods;
+		ci.instance = cc->instance;
+		ci.reg_id = cc->reg_id;
+		ci.server_id = cc->server_id;
+		ci.tcpconn_id = cc->tcpconn_id;
+		ci.keepalive = cc->keepalive;
+		ci.last_modified = cc->last_modified;
+		if((c = mem_insert_ucontact(_r, &cc->c, &ci)) == NULL) {
+			lock_set_release(_ul_dbcache->locks, ul_dbcache_lock_idx(idx));
+			LM_ERR("failed to add cached contact for [%.*s]\n", _r->aor.len,
+					_r->aor.s);
+			return -1;
+		}
+		/* the contact is in the database already */
+		c->state = CS_SYNC;
+	}
+	lock_set_release(_ul_dbcache->locks, ul_dbcache_lock_idx(idx));
+	atomic_inc(&_ul_dbcache->hits);
+	return 0;
+}
+
+/*!
+ * \brief Add to cache a record loaded from database
+ * \param _d domain
+ * \param _r record loaded from database
+ * \param _gen generation of the slot returned by ul_dbcache_get(), the item
+ *        is not added if the slot was invalidated meanwhile
+ */
+void ul_dbcache_put(udomain_t *_d, urecord_t *_r, unsigned int _gen)
+{
+	ul_dbcache_slot_t *sl;
+	ul_dbcache_item_t *it;
+	ul_dbcache_item_t *old;
+	ul_dbcache_item_t **pit;
+	ul_dbcache_contact_t *cc;
+	ucontact_t *c;
+	unsigned int idx;
+	time_t tnow;
+	int n;
+	int len;
+	char *p;
+
+	if(_ul_dbcache == NULL || _r == NULL)
+		return;
+
+	n = 0;
+	len = sizeof(ul_dbcache_item_t) + _d->name->len + _r->aor.len;
+	for(c = _r->contacts; c != NULL; c = c->next) {
+		if(c->xavp != NULL) {
+			/* contact attributes are not cached */
+			return;
+		}
+		n++;
+		len += sizeof(ul_dbcache_contact_t) + c->c.len + c->ruid.len
+			   + c->received.len + c->path.len + c->callid.len
+			   + c->user_agent.len + c->instance.len;
+	}
+	if(n == 0)
+		return;
+
+	it = (ul_dbcache_item_t *)shm_malloc(len);
+	if(it == NULL) {
+		SHM_MEM_ERROR;
+		return;
+	}
+	memset(it, 0, len);
+	tnow = time(NULL);
+	it->expires = tnow + ul_db_cache_ttl;
+	it->aorhash = _r->aorhash;
+	it->ncontacts = n;
+	it->contacts = (ul_dbcache_contact_t *)(it + 1);
+	p = (char *)(it->contacts + n);
+	p = ul_dbcache_str_copy(&it->domain, _d->name, p);
+	p = ul_dbcache_str_copy(&it->aor, &_r->aor, p);
+	for(c = _r->contacts, cc = it->contacts; c != NULL; c = c->next, cc++) {
+		p = ul_dbcache_str_copy(&cc->c, &c->c, p);
+		p = ul_dbcache_str_copy(&cc->ruid, &c->ruid, p);
+		p = ul_dbcache_str_copy(&cc->received, &c->received, p);
+		p = ul_dbcache_str_copy(&cc->path, &c->path, p);
+		p = ul_dbcache_str_copy(&cc->callid, &c->callid, p);
+		p = ul_dbcache_str_copy(&cc->user_agent, &c->user_agent, p);
+		p = ul_dbcache_str_copy(&cc->instance, &c->instance, p);
+		cc->expires = c->expires;
+		cc->q = c->q;
+		cc->cseq = c->cseq;
+		cc->flags = c->flags;
+		cc->cflags = c->cflags;
+		cc->sock = c->sock;
+		cc->methods = c->methods;
+		cc->reg_id = c->reg_id;
+		cc->server_id = c->server_id;
+		cc->tcpconn_id = c->tcpconn_id;
+		cc->keepalive = c->keepalive;
+		cc->last_modified = c->last_modified;
+	}
+
+	idx = _r->aorhash & (_ul_dbcache->size - 1);
+	sl = &_ul_dbcache->slots[idx];
+	lock_set_get(_ul_dbcache->locks, ul_dbcache_lock_idx(idx));
+	if(sl->gen != _gen) {
+		/* record changed since it was loaded from database */
+		lock_set_release(_ul_dbcache->locks, ul_dbcache_lock_idx(idx));
+		shm_free(it);
+		return;
+	}
+	/* drop expired items and a previous copy of the record */
+	pit = &sl->first;
+	while(*pit != NULL) {
+		if((*pit)->expires <= tnow
+				|| ((*pit)->aorhash == it->aorhash
+						&& (*pit)->aor.len == it->aor.len
+						&& memcmp((*pit)->aor.s, it->aor.s, it->aor.len) == 0
+						&& (*pit)->domain.len == it->domain.len
+						&& memcmp((*pit)->domain.s, it->domain.s,
+								   it->domain.len)
+								   == 0)) {
+			old = *pit;
+			*pit = old->next;
+			shm_free(old);
+			atomic_dec(&_ul_dbcache->items);
+			continue;
+		}
+		pit = &(*pit)->next;
+	}
+	if(atomic_get(&_ul_dbcache->items) >= ul_db_cache_max) {
+		lock_set_release(_ul_dbcache->locks, ul_dbcache_lock_idx(idx));
+		shm_free(it);
+		return;
+	}
+	it->next = sl->first;
+	sl->first = it;
+	atomic_inc(&_ul_dbcache->items);
+	lock_set_release(_ul_dbcache->locks, ul_dbcache_lock_idx(idx));
+}
+
+/*!
+ * \brief Drop a record from cache, done when it is changed in database
+ * \param _domain domain name (location table)
+ * \param _aor address of record
+ */
+void ul_dbcache_del(str *_domain, str *_aor)
+{
+	ul_dbcache_slot_t *sl;
+	ul_dbcache_item_t *it;
+	ul_dbcache_item_t **pit;
+	unsigned int aorhash;
+	unsigned int idx;
+
+	if(_ul_dbcache == NULL || _domain == NULL || _aor == NULL)
+		return;
+
+	aorhash = ul_get_aorhash(_aor);
+	idx = aorhash & (_ul_dbcache->size - 1);
+	sl = &_ul_dbcache->slots[idx];
+	lock_set_get(_ul_dbcache->locks, ul_dbcache_lock_idx(idx));
+	sl->gen++;
+	pit = &sl->first;
+	while(*pit != NULL) {
+		it = *pit;
+		if(it->aorhash == aorhash && it->aor.len == _aor->len
+				&& it->domain.len == _domain->len
+				&& memcmp(it->aor.s, _aor->s, _aor->len) == 0
+				&& memcmp(it->domain.s, _domain->s, _domain->len) == 0) {
+			*pit = it->next;
+			shm_free(it);
+			atomic_dec(&_ul_dbcache->items);
+			atomic_inc(&_ul_dbcache->invalidations);
+			continue;
+		}
+		pit = &it->next;
+	}
+	lock_set_release(_ul_dbcache->locks, ul_dbcache_lock_idx(idx));
+}
+
+/*!
+ * \brief Drop all records from cache
+ */
+void ul_dbcache_flush(void)
+{
+	unsigned int i;
+
+	if(_ul_dbcache == NULL)
+		return;
+
+	for(i = 0; i < _ul_dbcache->size; i++) {
+		lock_set_get(_ul_dbcache->locks, ul_dbcache_lock_idx(i));
+		_ul_dbcache->slots[i].gen++;
+		ul_dbcache_slot_clean(&_ul_dbcache->slots[i]);
+		lock_set_release(_ul_dbcache->locks, ul_dbcache_lock_idx(i));
+	}
+}
+
+/*!
+ * \brief Get the cache usage statistics
+ * \param _st structure filled with the statistics
+ * \return 0 on success, -1 if the cache is not enabled
+ */
+int ul_dbcache_get_stats(ul_dbcache_stats_t *_st)
+{
+	if(_ul_dbcache == NULL)
+		return -1;
+
+	_st->items = (unsigned int)atomic_get(&_ul_dbcache->items);
+	_st->hits = (unsigned long)atomic_get(&_ul_dbcache->hits);
+	_st->misses = (unsigned long)atomic_get(&_ul_dbcache->misses);
+	_st->invalidations =
+			(unsigned long)atomic_get(&_ul_dbcache->invalidations);
+	return 0;
+}
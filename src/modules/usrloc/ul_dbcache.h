@@ -0,0 +1,60 @@
+/*
+ * Usrloc module - read-through cache of records for db only mode
+ *
+ * This file is part of Kamailio, a free SIP server.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Kamailio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * Kamailio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*! \file
+ *  \brief USRLOC - read-through cache of records for db only mode
+ *  \ingroup usrloc
+ */
+
+#ifndef _UL_DBCACHE_H_
+#define _UL_DBCACHE_H_
+
+#include "../../core/str.h"
+#include "udomain.h"
+#include "urecord.h"
+
+extern int ul_db_cache_ttl;
+extern int ul_db_cache_size;
+extern int ul_db_cache_max;
+
+int ul_dbcache_init(void);
+void ul_dbcache_destroy(void);
+
+int ul_dbcache_get(udomain_t *_d, urecord_t *_r, unsigned int *_gen);
+void ul_dbcache_put(udomain_t *_d, urecord_t *_r, unsigned int _gen);
+
+void ul_dbcache_del(str *_domain, str *_aor);
+void ul_dbcache_flush(void);
+
+/*! cache usage statistics */
+typedef struct ul_dbcache_stats
+{
+	unsigned int items;	  /*!< number of cached records */
+	unsigned long hits;	  /*!< lookups served from cache */
+	unsigned long misses; /*!< lookups that loaded the record from db */
+	unsigned long invalidations; /*!< records dropped due to local changes */
+} ul_dbcache_stats_t;
+
+int ul_dbcache_get_stats(ul_dbcache_stats_t *_st);
+
+#endif
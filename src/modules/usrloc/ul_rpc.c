@@ -27,6 +27,7 @@
 #include "udomain.h"
 #include "usrloc_mod.h"
 #include "utime.h"
+#include "ul_dbcache.h"
 
 /*! CSEQ nr used */
 #define RPC_UL_CSEQ 1
@@ -850,6 +851,46 @@ static const char *ul_rpc_db_expired_contacts_doc[2] = {
 		"Tell number of expired contacts in database table (db_mode=3 only)",
 		0};
 
+static void ul_rpc_db_cache_stats(rpc_t *rpc, void *ctx)
+{
+	ul_dbcache_stats_t st;
+	void *th;
+
+	if(ul_dbcache_get_stats(&st) < 0) {
+		rpc->fault(ctx, 500, "DB cache not enabled");
+		return;
+	}
+	if(rpc->add(ctx, "{", &th) < 0) {
+		rpc->fault(ctx, 500, "Internal error creating rpc");
+		return;
+	}
+	if(rpc->struct_add(th, "ujjjd", "items", st.items, "hits", st.hits,
+			   "misses", st.misses, "invalidations", st.invalidations, "ttl",
+			   ul_db_cache_ttl)
+			< 0) {
+		rpc->fault(ctx, 500, "Internal error adding fields");
+		return;
+	}
+}
+
+static const char *ul_rpc_db_cache_stats_doc[2] = {
+		"Statistics of the cache of records loaded from DB (db_mode=3 only)",
+		0};
+
+static void ul_rpc_db_cache_flush(rpc_t *rpc, void *ctx)
+{
+	ul_dbcache_stats_t st;
+
+	if(ul_dbcache_get_stats(&st) < 0) {
+		rpc->fault(ctx, 500, "DB cache not enabled");
+		return;
+	}
+	ul_dbcache_flush();
+}
+
+static const char *ul_rpc_db_cache_flush_doc[2] = {
+		"Drop all records from the cache of records loaded from DB", 0};
+
 /* clang-format off */
 rpc_export_t ul_rpc[] = {
 	{"ul.dump", ul_rpc_dump, ul_rpc_dump_doc, 0},
@@ -862,6 +903,10 @@ rpc_export_t ul_rpc[] = {
 	{"ul.db_contacts", ul_rpc_db_contacts, ul_rpc_db_contacts_doc, 0},
 	{"ul.db_expired_contacts", ul_rpc_db_expired_contacts,
 			ul_rpc_db_expired_contacts_doc, 0},
+	{"ul.db_cache_stats", ul_rpc_db_cache_stats,
+			ul_rpc_db_cache_stats_doc, 0},
+	{"ul.db_cache_flush", ul_rpc_db_cache_flush,
+			ul_rpc_db_cache_flush_doc, 0},
 	{0, 0, 0, 0}
 };
 /* clang-format on */
@@ -41,6 +41,8 @@
 #include "usrloc.h"
 #include "utime.h"
 #include "ul_callback.h"
+#include "udomain.h"
+#include "ul_dbcache.h"
 
 /*! contact matching mode */
 int ul_matching_mode = CONTACT_ONLY;
@@ -598,10 +600,12 @@ int insert_ucontact(
 
 		if(db_insert_ucontact(*_c) < 0) {
 			LM_ERR("failed to insert in database\n");
+			ul_dbcache_del(_r->domain, &_r->aor);
 			return -1;
 		} else {
 			(*_c)->state = CS_SYNC;
 		}
+		ul_dbcache_del(_r->domain, &_r->aor);
 	}
 
 	if(exists_ulcb_type(UL_CONTACT_INSERT)) {
@@ -658,6 +662,9 @@ int delete_ucontact(urecord_t *_r, struct ucontact *_c)
 				LM_ERR("failed to remove contact from database\n");
 				ret = -1;
 			}
+			if(ul_db_mode == DB_ONLY) {
+				ul_dbcache_del(_r->domain, &_r->aor);
+			}
 		}
 
 		mem_delete_ucontact(_r, _c);
@@ -669,13 +676,25 @@ int delete_ucontact(urecord_t *_r, struct ucontact *_c)
 
 int delete_urecord_by_ruid(udomain_t *_d, str *_ruid)
 {
+	urecord_t *r = NULL;
+	int ret;
+
 	if(ul_db_mode != DB_ONLY) {
 		LM_ERR("delete_urecord_by_ruid currently available only in "
 			   "db_mode=3\n");
 		return -1;
 	}
 
-	return db_delete_urecord_by_ruid(_d->name, _ruid);
+	if(ul_db_cache_ttl > 0) {
+		/* get the address of record to drop it from the cache */
+		r = db_load_urecord_by_ruid(ul_dbh, _d, _ruid);
+	}
+	ret = db_delete_urecord_by_ruid(_d->name, _ruid);
+	if(r != NULL) {
+		ul_dbcache_del(_d->name, &r->aor);
+		free_urecord(r);
+	}
+	return ret;
 }
 
 
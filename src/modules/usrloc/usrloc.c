@@ -78,6 +78,8 @@ int bind_usrloc(usrloc_api_t *api)
 	api->refresh_keepalive = ul_refresh_keepalive;
 	api->set_max_partition = ul_set_max_partition;
 
+	api->get_urecord_cached = get_urecord_cached;
+
 	api->use_domain = ul_use_domain;
 	api->db_mode = ul_db_mode;
 	api->nat_flag = ul_nat_bflag;
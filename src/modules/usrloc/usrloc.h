@@ -243,6 +243,8 @@ typedef struct usrloc_api
 	ul_set_keepalive_timeout_t set_keepalive_timeout;
 	ul_refresh_keepalive_t refresh_keepalive;
 	ul_set_max_partition_t set_max_partition;
+
+	get_urecord_t get_urecord_cached;
 } usrloc_api_t;
 
 
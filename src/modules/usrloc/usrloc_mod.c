@@ -58,6 +58,7 @@
 #include "ul_rpc.h"
 #include "ul_callback.h"
 #include "ul_keepalive.h"
+#include "ul_dbcache.h"
 #include "usrloc.h"
 
 MODULE_VERSION
@@ -312,6 +313,9 @@ static param_export_t params[] = {
 	{"ka_reply_codes", PARAM_STRING, &ul_ka_reply_codes_str},
 	{"load_rank", PARAM_INT, &ul_load_rank},
 	{"db_clean_tcp", PARAM_INT, &ul_db_clean_tcp},
+	{"db_cache_ttl", PARAM_INT, &ul_db_cache_ttl},
+	{"db_cache_size", PARAM_INT, &ul_db_cache_size},
+	{"db_cache_max", PARAM_INT, &ul_db_cache_max},
 	{0, 0, 0}
 };
 
@@ -466,6 +470,16 @@ static int mod_init(void)
 		ul_set_xavp_contact_clone(1);
 	}
 
+	if(ul_db_cache_ttl > 0) {
+		if(ul_db_mode != DB_ONLY) {
+			LM_WARN("db cache is used only in db only mode\n");
+			ul_db_cache_ttl = 0;
+		} else if(ul_dbcache_init() < 0) {
+			LM_ERR("failed to initialize the db cache\n");
+			return -1;
+		}
+	}
+
 	if(ul_ka_mode != ULKA_NONE) {
 		/* set max partition number for timers processing of db records */
 		if(ul_timer_procs > 1) {
@@ -564,6 +578,7 @@ static void destroy(void)
 			LM_ERR("flushing cache failed\n");
 		}
 	}
+	ul_dbcache_destroy();
 }
 
 /*! \brief
@@ -0,0 +1,501 @@
+/*
+ * ptfc - compiler for prebuilt prefix tree files
+ *
+ * Copyright (C) 2026 Kamailio.org
+ *
+ * This file is part of Kamailio, a free SIP server.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Kamailio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * Kamailio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Reads prefix records from a text file and writes the tree file that
+ * can be mapped by mtree, prefix_route and pdt modules. Each input line
+ * has the fields:
+ *
+ *   tree <delim> prefix <delim> value
+ *
+ * or, when the tree name is given with -t:
+ *
+ *   prefix <delim> value
+ *
+ * The output is written to a temporary file that is renamed at the end,
+ * so processes still using the old file are not affected.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "../../src/lib/trie/ptfile.h"
+
+typedef struct rec
+{
+	char *tree;
+	int tlen;
+	char *prefix;
+	int plen;
+	char *value;
+	int vlen;
+	unsigned long line;
+} rec_t;
+
+typedef struct buf
+{
+	char *s;
+	size_t len;
+	size_t size;
+} buf_t;
+
+static rec_t *recs = NULL;
+static long nrecs = 0;
+
+static ptf_node_t *nodes = NULL;
+static uint32_t nnodes = 0;
+static uint32_t snodes = 0;
+static uint32_t nitems = 0;
+
+static buf_t labels;
+static buf_t values;
+static buf_t names;
+static buf_t treenodes;
+
+static int verbose = 0;
+
+
+static void usage(void)
+{
+	fprintf(stderr,
+			"usage: ptfc [-t tree] [-d delim] [-i input] -o output [-v]\n"
+			"  -t tree    tree name for all records, the input has only the\n"
+			"             prefix and value fields\n"
+			"  -d delim   field delimiter (default: tab)\n"
+			"  -i input   input file (default: stdin)\n"
+			"  -o output  tree file to write\n"
+			"  -v         print statistics\n");
+}
+
+
+static int buf_add(buf_t *b, const void *p, size_t len)
+{
+	char *n;
+	size_t size;
+
+	if(b->len + len > b->size) {
+		size = (b->size > 0) ? b->size : 4096;
+		while(b->len + len > size)
+			size *= 2;
+		n = realloc(b->s, size);
+		if(n == NULL) {
+			fprintf(stderr, "ERROR: out of memory\n");
+			return -1;
+		}
+		b->s = n;
+		b->size = size;
+	}
+	if(p != NULL)
+		memcpy(b->s + b->len, p, len);
+	else
+		memset(b->s + b->len, 0, len);
+	b->len += len;
+	return 0;
+}
+
+
+static int buf_pad(buf_t *b)
+{
+	return buf_add(b, NULL, PTF_ALIGN(b->len) - b->len);
+}
+
+
+static int rec_cmp(const void *a, const void *b)
+{
+	const rec_t *ra = (const rec_t *)a;
+	const rec_t *rb = (const rec_t *)b;
+	int n;
+	int r;
+
+	n = (ra->tlen < rb->tlen) ? ra->tlen : rb->tlen;
+	r = memcmp(ra->tree, rb->tree, n);
+	if(r != 0)
+		return r;
+	if(ra->tlen != rb->tlen)
+		return ra->tlen - rb->tlen;
+	n = (ra->plen < rb->plen) ? ra->plen : rb->plen;
+	r = memcmp(ra->prefix, rb->prefix, n);
+	if(r != 0)
+		return r;
+	if(ra->plen != rb->plen)
+		return ra->plen - rb->plen;
+	return (ra->line < rb->line) ? -1 : (ra->line > rb->line);
+}
+
+
+static int read_records(FILE *f, char *tree, char delim)
+{
+	char *line = NULL;
+	size_t lsize = 0;
+	ssize_t len;
+	unsigned long lno = 0;
+	long srecs = 0;
+	rec_t *nr;
+	rec_t r;
+	char *p;
+	char *q;
+
+	while((len = getline(&line, &lsize, f)) >= 0) {
+		lno++;
+		while(len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+			line[--len] = '\0';
+		if(len == 0 || line[0] == '#')
+			continue;
+		p = strdup(line);
+		if(p == NULL) {
+			fprintf(stderr, "ERROR: out of memory\n");
+			return -1;
+		}
+		memset(&r, 0, sizeof(rec_t));
+		r.line = lno;
+		if(tree != NULL) {
+			r.tree = tree;
+			r.tlen = strlen(tree);
+		} else {
+			r.tree = p;
+			q = strchr(p, delim);
+			if(q == NULL)
+				goto bad;
+			r.tlen = q - p;
+			p = q + 1;
+		}
+		r.prefix = p;
+		q = strchr(p, delim);
+		if(q == NULL)
+			goto bad;
+		r.plen = q - p;
+		r.value = q + 1;
+		r.vlen = strlen(r.value);
+		if(r.tlen <= 0 || r.plen <= 0 || r.vlen <= 0)
+			goto bad;
+		if(r.plen >= PTF_MAX_DEPTH) {
+			fprintf(stderr, "ERROR: prefix too long at line %lu\n", lno);
+			return -1;
+		}
+		if(nrecs == srecs) {
+			srecs = (srecs > 0) ? 2 * srecs : 65536;
+			nr = realloc(recs, srecs * sizeof(rec_t));
+			if(nr == NULL) {
+				fprintf(stderr, "ERROR: out of memory\n");
+				return -1;
+			}
+			recs = nr;
+		}
+		recs[nrecs++] = r;
+		continue;
+bad:
+		fprintf(stderr, "WARNING: skipping bad record at line %lu\n", lno);
+	}
+	free(line);
+	return 0;
+}
+
+
+static int node_new(uint32_t n)
+{
+	ptf_node_t *nn;
+	uint32_t size;
+
+	if(nnodes + n > snodes) {
+		size = (snodes > 0) ? snodes : 4096;
+		while(nnodes + n > size)
+			size *= 2;
+		nn = realloc(nodes, size * sizeof(ptf_node_t));
+		if(nn == NULL) {
+			fprintf(stderr, "ERROR: out of memory\n");
+			return -1;
+		}
+		nodes = nn;
+		snodes = size;
+	}
+	memset(nodes + nnodes, 0, n * sizeof(ptf_node_t));
+	nnodes += n;
+	return 0;
+}
+
+
+/* append a value record, linked after the one at offset prev (if any) */
+static int value_add(rec_t *r, uint32_t prev, uint32_t *off)
+{
+	ptf_value_t v;
+
+	*off = values.len;
+	v.next = 0;
+	v.len = r->vlen;
+	if(buf_add(&values, &v, sizeof(v)) < 0
+			|| buf_add(&values, r->value, r->vlen + 1) < 0
+			|| buf_pad(&values) < 0)
+		return -1;
+	if(prev != 0)
+		((ptf_value_t *)(values.s + prev))->next = *off;
+	nitems++;
+	return 0;
+}
+
+
+/*
+ * records [lo, hi) are sorted and share the first d chars of the prefix,
+ * node idx is at depth d
+ */
+static int build_node(uint32_t idx, long lo, long hi, int d)
+{
+	uint32_t prev;
+	uint32_t off;
+	uint32_t first;
+	uint32_t nch;
+	long i, j, k;
+	int lcp;
+	unsigned char ch;
+
+	/* values of the prefix ending at this node come first */
+	prev = 0;
+	for(i = lo; i < hi && recs[i].plen == d; i++) {
+		if(value_add(&recs[i], prev, &off) < 0)
+			return -1;
+		if(prev == 0)
+			nodes[idx].value = off;
+		prev = off;
+	}
+
+	nch = 0;
+	for(j = i; j < hi; j = k) {
+		ch = recs[j].prefix[d];
+		for(k = j; k < hi && (unsigned char)recs[k].prefix[d] == ch; k++)
+			;
+		nch++;
+	}
+	nodes[idx].nchild = nch;
+	if(nch == 0)
+		return 0;
+	first = nnodes;
+	nodes[idx].child = first;
+	if(node_new(nch) < 0)
+		return -1;
+
+	nch = 0;
+	for(j = i; j < hi; j = k) {
+		ch = recs[j].prefix[d];
+		for(k = j; k < hi && (unsigned char)recs[k].prefix[d] == ch; k++)
+			;
+		/* the common prefix of a sorted group is given by its ends */
+		lcp = d + 1;
+		while(lcp < recs[j].plen && lcp < recs[k - 1].plen
+				&& recs[j].prefix[lcp] == recs[k - 1].prefix[lcp])
+			lcp++;
+		nodes[first + nch].key = ch;
+		nodes[first + nch].llen = lcp - d;
+		nodes[first + nch].label = labels.len;
+		if(buf_add(&labels, recs[j].prefix + d, lcp - d) < 0)
+			return -1;
+		if(build_node(first + nch, j, k, lcp) < 0)
+			return -1;
+		nch++;
+	}
+	return 0;
+}
+
+
+int main(int argc, char **argv)
+{
+	char *tree = NULL;
+	char *input = NULL;
+	char *output = NULL;
+	char *tmpfile = NULL;
+	char delim = '\t';
+	FILE *f;
+	ptf_header_t hdr;
+	ptf_tree_t *dir = NULL;
+	uint32_t ntrees;
+	uint64_t off;
+	uint32_t nbase, lbase, vbase;
+	uint32_t i, t, tn;
+	ptf_value_t *v;
+	long lo, hi;
+	int c;
+
+	while((c = getopt(argc, argv, "t:d:i:o:vh")) != -1) {
+		switch(c) {
+			case 't':
+				tree = optarg;
+				break;
+			case 'd':
+				delim = optarg[0];
+				break;
+			case 'i':
+				input = optarg;
+				break;
+			case 'o':
+				output = optarg;
+				break;
+			case 'v':
+				verbose = 1;
+				break;
+			default:
+				usage();
+				return 1;
+		}
+	}
+	if(output == NULL) {
+		usage();
+		return 1;
+	}
+
+	f = (input != NULL) ? fopen(input, "r") : stdin;
+	if(f == NULL) {
+		fprintf(stderr, "ERROR: cannot open %s: %s\n", input, strerror(errno));
+		return 1;
+	}
+	if(read_records(f, tree, delim) < 0)
+		return 1;
+	if(f != stdin)
+		fclose(f);
+
+	qsort(recs, nrecs, sizeof(rec_t), rec_cmp);
+
+	ntrees = 0;
+	for(lo = 0; lo < nrecs; lo = hi) {
+		for(hi = lo; hi < nrecs && recs[hi].tlen == recs[lo].tlen
+					 && memcmp(recs[hi].tree, recs[lo].tree, recs[lo].tlen) == 0;
+				hi++)
+			;
+		ntrees++;
+	}
+	dir = calloc(ntrees > 0 ? ntrees : 1, sizeof(ptf_tree_t));
+	if(dir == NULL) {
+		fprintf(stderr, "ERROR: out of memory\n");
+		return 1;
+	}
+
+	/* offset 0 of the value buffer is reserved for 'no value' */
+	if(buf_add(&values, NULL, 4) < 0)
+		return 1;
+
+	t = 0;
+	for(lo = 0; lo < nrecs; lo = hi) {
+		for(hi = lo; hi < nrecs && recs[hi].tlen == recs[lo].tlen
+					 && memcmp(recs[hi].tree, recs[lo].tree, recs[lo].tlen) == 0;
+				hi++)
+			;
+		nnodes = 0;
+		nitems = 0;
+		if(node_new(1) < 0 || build_node(0, lo, hi, 0) < 0)
+			return 1;
+		dir[t].name = names.len;
+		dir[t].namelen = recs[lo].tlen;
+		if(buf_add(&names, recs[lo].tree, recs[lo].tlen) < 0
+				|| buf_add(&names, NULL, 1) < 0)
+			return 1;
+		dir[t].nodes = treenodes.len;
+		dir[t].nrnodes = nnodes;
+		dir[t].nritems = nitems;
+		if(buf_add(&treenodes, nodes, nnodes * sizeof(ptf_node_t)) < 0)
+			return 1;
+		if(verbose)
+			printf("tree [%.*s]: %u nodes, %u values\n", (int)dir[t].namelen,
+					recs[lo].tree, dir[t].nrnodes, dir[t].nritems);
+		t++;
+	}
+	if(buf_pad(&names) < 0 || buf_pad(&labels) < 0)
+		return 1;
+
+	/* layout: header, directory, names, nodes, labels, values */
+	off = sizeof(ptf_header_t) + ntrees * sizeof(ptf_tree_t);
+	nbase = off;
+	off += names.len + treenodes.len;
+	lbase = off;
+	off += labels.len;
+	vbase = off;
+	off += values.len;
+	if(off > UINT32_MAX) {
+		fprintf(stderr, "ERROR: tree file too large (%llu bytes)\n",
+				(unsigned long long)off);
+		return 1;
+	}
+
+	/* relocate the offsets */
+	i = 4;
+	while(i < values.len) {
+		v = (ptf_value_t *)(values.s + i);
+		if(v->next != 0)
+			v->next += vbase;
+		i += PTF_ALIGN(sizeof(ptf_value_t) + v->len + 1);
+	}
+	for(t = 0; t < ntrees; t++) {
+		ptf_node_t *tnodes = (ptf_node_t *)(treenodes.s + dir[t].nodes);
+		for(tn = 0; tn < dir[t].nrnodes; tn++) {
+			tnodes[tn].label += lbase;
+			if(tnodes[tn].value != 0)
+				tnodes[tn].value += vbase;
+		}
+		dir[t].name += nbase;
+		dir[t].nodes += nbase + names.len;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = PTF_MAGIC;
+	hdr.version = PTF_VERSION;
+	hdr.ntrees = ntrees;
+	hdr.size = off;
+
+	tmpfile = malloc(strlen(output) + 5);
+	if(tmpfile == NULL) {
+		fprintf(stderr, "ERROR: out of memory\n");
+		return 1;
+	}
+	sprintf(tmpfile, "%s.tmp", output);
+	f = fopen(tmpfile, "w");
+	if(f == NULL) {
+		fprintf(stderr, "ERROR: cannot open %s: %s\n", tmpfile,
+				strerror(errno));
+		return 1;
+	}
+	if(fwrite(&hdr, sizeof(hdr), 1, f) != 1
+			|| (ntrees > 0
+					&& fwrite(dir, sizeof(ptf_tree_t), ntrees, f) != ntrees)
+			|| fwrite(names.s, 1, names.len, f) != names.len
+			|| fwrite(treenodes.s, 1, treenodes.len, f) != treenodes.len
+			|| fwrite(labels.s, 1, labels.len, f) != labels.len
+			|| fwrite(values.s, 1, values.len, f) != values.len
+			|| fflush(f) != 0 || fsync(fileno(f)) != 0) {
+		fprintf(stderr, "ERROR: cannot write %s: %s\n", tmpfile,
+				strerror(errno));
+		fclose(f);
+		unlink(tmpfile);
+		return 1;
+	}
+	fclose(f);
+	if(rename(tmpfile, output) < 0) {
+		fprintf(stderr, "ERROR: cannot rename %s to %s: %s\n", tmpfile, output,
+				strerror(errno));
+		unlink(tmpfile);
+		return 1;
+	}
+	if(verbose)
+		printf("written %s: %u trees, %ld records, %llu bytes\n", output,
+				ntrees, nrecs, (unsigned long long)off);
+	return 0;
+}